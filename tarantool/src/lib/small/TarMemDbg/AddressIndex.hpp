@@ -0,0 +1,72 @@
+/**
+ ** @file AddressIndex.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий индекс диапазонов адресов эпох очереди
+ ** \~russian @details По любому указателю (например, адресу из SIGSEGV) за O(log n) находит эпоху, 
+ **                    slab и диапазон id аллокаций, не обходя списки slab'ов и не трогая защищённую память
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    ADDRESS_INDEX_PROTECT_SIGNATURE_E6TM2WQ9HZ4KXA
+#define    ADDRESS_INDEX_PROTECT_SIGNATURE_E6TM2WQ9HZ4KXA
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Диапазон адресов одной эпохи. Все нужные для ответа данные копируются сюда, 
+ **        потому что сама эпоха к моменту запроса может быть уже удалена
+ **/
+struct AddressIndexEntry {
+  Byte * start = nullptr;
+  Size byte_size = 0;
+  Size position = 0;      ///< позиция эпохи в очереди
+  Size slab_size = 0;     ///< 0 - диапазон не нарезан на slab'ы
+  int64_t min_id = 0;     ///< id аллокаций эпохи лежат в ( min_id, max_id ]
+  int64_t max_id = INT64_MAX;
+
+  Byte * GetEnd() const noexcept { return start + byte_size; }
+};
+
+/**
+ ** @brief Отсортированный массив диапазонов фиксированного размера под seqlock'ом
+ ** @details Пишет только поток, владеющий очередью (под блокировкой очереди), при сдвиге эпох 
+ **          (BeginUpdate/Add/EndUpdate) и при slab_map/slab_unmap вне окна эпохи (Insert/Remove). Find не берёт блокировок и не выделяет память, 
+ **          поэтому его можно звать из обработчика сигнала. Если обработчик прервал запись в тот же индекс, 
+ **          Find после нескольких попыток вернёт false
+ **/
+class AddressIndex {
+ public:
+  static constexpr const Size kCapacity = 128;
+  static constexpr const Size kMaxReadAttempts = 16;
+
+  void BeginUpdate() noexcept;
+  /// @return false, если места нет и диапазон отброшен
+  bool Add( const AddressIndexEntry & entry ) noexcept;
+  void EndUpdate( Size position ) noexcept;
+  /// вставка одного диапазона с сохранением порядка, без пересборки. @return false, если места нет
+  bool Insert( const AddressIndexEntry & entry ) noexcept;
+  /// @return false, если диапазона, начинающегося с @a start, нет
+  bool Remove( const void * start ) noexcept;
+
+  bool Find( const void * ptr, AddressIndexEntry & found, Size & position ) const noexcept;
+  Size GetCount() const noexcept { return count_; }
+  Size GetDropped() const noexcept { return dropped_.load( std::memory_order_relaxed ); }
+
+ private:
+  std::atomic<Size> sequence_ { 0 }; ///< нечётное - идёт запись
+  std::array< AddressIndexEntry, kCapacity > entries_;
+  Size count_ = 0;
+  Size position_ = 0; ///< позиция текущей эпохи на момент записи
+  std::atomic<Size> dropped_ { 0 };
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // ADDRESS_INDEX_PROTECT_SIGNATURE_E6TM2WQ9HZ4KXA
@@ -0,0 +1,100 @@
+/**
+ ** @file AddressIndex.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "индекса адресов" AddressIndex.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    ADDRESS_INDEX_IMPL_PROTECT_SIGNATURE_9BQ3XN7DVL0FRC
+
+namespace      TARMEMDBG_NAMESPACE {
+
+void AddressIndex::BeginUpdate() noexcept {
+  sequence_.fetch_add( 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  count_ = 0;
+}
+
+bool AddressIndex::Add( const AddressIndexEntry & entry ) noexcept {
+  assert( sequence_.load( std::memory_order_relaxed ) & 1 );
+  if ( !entry.byte_size ) return true;
+  if ( count_ == kCapacity ) {
+    dropped_.fetch_add( 1, std::memory_order_relaxed );
+    return false;
+  }
+  entries_[count_++] = entry;
+  return true;
+}
+
+void AddressIndex::EndUpdate( Size position ) noexcept {
+  // std::sort не выделяет память; диапазонов мало, поэтому сортировка дешевле поддержки порядка при вставке
+  std::sort( entries_.begin(), entries_.begin() + count_, 
+      []( const AddressIndexEntry & left, const AddressIndexEntry & right ) { return left.start < right.start; } );
+  position_ = position;
+  sequence_.fetch_add( 1, std::memory_order_release );
+}
+
+bool AddressIndex::Insert( const AddressIndexEntry & entry ) noexcept {
+  if ( !entry.byte_size ) return true;
+  if ( count_ == kCapacity ) {
+    dropped_.fetch_add( 1, std::memory_order_relaxed );
+    return false;
+  }
+  sequence_.fetch_add( 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  Size at = count_;
+  for ( ; at && entries_[at - 1].start > entry.start; --at ) entries_[at] = entries_[at - 1];
+  entries_[at] = entry;
+  ++count_;
+  sequence_.fetch_add( 1, std::memory_order_release );
+  return true;
+}
+
+bool AddressIndex::Remove( const void * start ) noexcept {
+  Size at = 0;
+  while ( at < count_ && entries_[at].start != start ) ++at;
+  if ( at == count_ ) return false;
+  sequence_.fetch_add( 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  for ( --count_; at < count_; ++at ) entries_[at] = entries_[at + 1];
+  sequence_.fetch_add( 1, std::memory_order_release );
+  return true;
+}
+
+bool AddressIndex::Find( const void * ptr, AddressIndexEntry & found, Size & position ) const noexcept {
+  const Byte * address = (const Byte *)ptr;
+  for ( Size attempt = 0; attempt < kMaxReadAttempts; ++attempt ) {
+    Size before = sequence_.load( std::memory_order_acquire );
+    if ( before & 1 ) continue;
+    // upper_bound по началу диапазона: кандидат - предыдущий элемент
+    Size left = 0, right = count_;
+    if ( right > kCapacity ) continue;
+    while ( left < right ) {
+      Size middle = left + ( right - left ) / 2;
+      if ( entries_[middle].start <= address ) left = middle + 1;
+      else right = middle;
+    }
+    bool ret = false;
+    if ( left ) {
+      found = entries_[left - 1];
+      position = position_;
+      ret = address < found.GetEnd();
+    }
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( sequence_.load( std::memory_order_relaxed ) == before ) return ret;
+  }
+  return false;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    ADDRESS_INDEX_IMPL_PROTECT_SIGNATURE_9BQ3XN7DVL0FRC
+#endif  // ADDRESS_INDEX_IMPL_PROTECT_SIGNATURE_9BQ3XN7DVL0FRC
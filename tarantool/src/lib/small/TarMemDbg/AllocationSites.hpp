@@ -0,0 +1,265 @@
+/**
+ ** @file AllocationSites.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий выборочный сбор мест аллокаций lsregion'а и mempool'ов
+ ** \~russian @details Когда отладчик ловит обращение к устаревшей памяти, он знает эпоху или mempool,
+ **                    но не код, который эту память выделил. Место аллокации - стек вызовов, снятый
+ **                    по цепочке указателей кадров. Одинаковые стеки хранятся один раз, а у выбранного
+ **                    чанка остаётся только небольшой id места: у эпохи - в её таблице чанков,
+ **                    у mempool'а - в массиве id slab'а
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    ALLOCATION_SITES_PROTECT_SIGNATURE_W8DK3PZ6TN1QXF
+#define    ALLOCATION_SITES_PROTECT_SIGNATURE_W8DK3PZ6TN1QXF
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct AllocationSiteStats {
+  Size sample_bytes = 0;  ///< сколько байт аллокаций в среднем приходится на один сэмпл, 0 - выключено
+  Size sites = 0;         ///< разных стеков в таблице
+  Size capacity = 0;      ///< и сколько их помещается
+  Size samples = 0;       ///< сэмплы за всё время
+  Size sampled_bytes = 0; ///< и их размер
+  Size dropped = 0;       ///< сэмплы, стек которых не поместился в таблицу
+  Size table_bytes = 0;   ///< память таблицы стеков, таблиц эпох и массивов id slab'ов
+};
+
+/// стек места аллокации и его счётчики
+struct AllocationSiteInfo {
+  static constexpr const Size kMaxDepth = 16;
+
+  uint32_t id = 0;
+  Size depth = 0;
+  uintptr_t frames[kMaxDepth] = {}; ///< адреса возврата, начиная с вызвавшего аллокатор
+  Size samples = 0;
+  Size sampled_bytes = 0;
+  Size estimated_bytes = 0; ///< оценка всех байт, выделенных в этом месте
+};
+
+/// выбранные чанки одного места в эпохе или mempool'е
+struct AllocationSiteUsage {
+  uint32_t site = 0;
+  Size chunks = 0;
+  Size bytes = 0;
+};
+
+/**
+ ** @brief Таблица мест аллокаций и выборка по байтам
+ ** @details У каждого потока свой счётчик байт до следующего сэмпла, расстояния между сэмплами
+ **          распределены экспоненциально со средним GetSampleBytes(), так что вероятность попасть в выборку
+ **          пропорциональна размеру чанка, а не числу вызовов. Быстрый путь - вычитание из счётчика потока.
+ **          На сэмпле снимается не больше kMaxDepth кадров и делается один поиск в открытой хэш-таблице
+ **          фиксированного размера. Места добавляются под блокировкой и больше не меняются, id места
+ **          не превышает kCapacity и помещается в 15 бит. Стек берётся по указателям кадров: с ними
+ **          собираются TarMemDbg и исходники small (mempool_alloc, smalloc), функции вызывающего кода
+ **          без -fno-omit-frame-pointer из стека выпадают или обрывают его
+ **/
+class AllocationSites {
+ public:
+  static constexpr const Size kMaxDepth = AllocationSiteInfo::kMaxDepth;
+  static constexpr const Size kCapacity = 8192;
+  static constexpr const Size kSlots = kCapacity * 2;        ///< хэш-таблица заполнена не больше, чем наполовину
+  static constexpr const uint16_t kFreedBit = 0x8000;        ///< в массиве id slab'а mempool'а: объект освобождён
+  static constexpr const Size kMaxFrameBytes = 1 << 20;      ///< кадр больше считается концом цепочки
+  static_assert( kCapacity < kFreedBit, "site id must fit into 15 bits" );
+
+  /// при первом обращении читается из TARARAM_ALLOCATION_SAMPLE_BYTES
+  static Size GetSampleBytes() noexcept { return sample_bytes_.Get(); }
+  /// @return предыдущее значение
+  static Size SetSampleBytes( Size byte_size ) noexcept { return sample_bytes_.Set( byte_size ); }
+  static AllocationSiteStats GetStats() noexcept;
+  /// @return false, если места с таким id нет
+  static bool GetSite( uint32_t id, AllocationSiteInfo & info ) noexcept;
+  /// печатает стек места в stderr, для сообщений об испорченной памяти
+  static void Print( uint32_t id ) noexcept;
+
+  /**
+   ** @brief учитывает аллокацию в выборке потока и, если она выбрана, запоминает её стек
+   ** @param frame кадр обёртки аллокатора (__builtin_frame_address( 0 )), стек начинается с её вызывающего
+   ** @return id места или 0, если аллокация не выбрана
+   **/
+  static uint32_t Sample( Size byte_size, const void * frame ) noexcept {
+    Size sample_bytes = GetSampleBytes();
+    if ( !sample_bytes ) return 0;
+    countdown_ -= (int64_t)byte_size;
+    if ( countdown_ > 0 && sample_bytes == thread_sample_bytes_ ) return 0;
+    return Capture( byte_size, frame );
+  }
+
+  // id мест объектов mempool'а, см. mempool_site_alloc
+  static void OnMempoolAlloc( struct mempool * pool, struct mslab * slab, void * ptr, const void * frame ) noexcept;
+  static void OnMempoolFree( const struct mempool * pool, struct mslab * slab, const void * ptr ) noexcept {
+    if ( slab->sites ) slab->sites[GetObjectIndex( pool, slab, ptr )] |= kFreedBit;
+  }
+  static void ReleaseMempoolSlab( const struct mempool * pool, struct mslab * slab ) noexcept;
+  /// место объекта @a pool, содержащего @a ptr, освобождённого или нет, 0 - неизвестно
+  static uint32_t FindInMempool( const struct mempool * pool, const void * ptr ) noexcept;
+  /// живые выбранные объекты @a pool по местам, см. ExportUsage
+  static Size GetMempoolUsage( struct mempool * pool, AllocationSiteUsage * usage, Size max_sites );
+  /// вызывает @a callback( site ) для каждого живого выбранного объекта @a pool
+  template< class Callback >
+  static void ForEachMempoolSample( struct mempool * pool, Callback callback ) {
+    struct slab * slab = nullptr;
+    rlist_foreach_entry( slab, &pool->slabs.slabs, next_in_list ) {
+      const uint16_t * sites = ( (const struct mslab *)slab )->sites;
+      if ( !sites ) continue;
+      for ( Size i = 0; i < pool->objcount; ++i ) {
+        if ( sites[i] && !( sites[i] & kFreedBit ) ) callback( (uint32_t)sites[i] );
+      }
+    }
+  }
+  /// во сколько раз выбранный чанк @a byte_size байт представляет больше байт и чанков, см. Capture
+  static double GetSampleWeight( Size byte_size, Size sample_bytes ) noexcept {
+    return 1.0 / -std::expm1( -(double)std::max( byte_size, (Size)1 ) / (double)sample_bytes );
+  }
+
+  /**
+   ** @brief складывает @a chunks выбранных чанков по местам и отдаёт самые большие
+   ** @param per_site байты и чанки по id места, размером GetCount() + 1
+   ** @return число мест, заполняется не больше @a max_sites
+   **/
+  static Size ExportUsage( std::vector< AllocationSiteUsage > & per_site, AllocationSiteUsage * usage, Size max_sites );
+  static Size GetCount() noexcept { return count_.load( std::memory_order_acquire ); }
+  static void AccountTable( PtrDiff byte_size ) noexcept { table_bytes_.fetch_add( (Size)byte_size, std::memory_order_relaxed ); }
+
+ protected:
+  struct Site {
+    uint64_t hash = 0;
+    Size depth = 0;
+    uintptr_t frames[kMaxDepth] = {};
+    std::atomic<Size> samples { 0 };
+    std::atomic<Size> sampled_bytes { 0 };
+    std::atomic<Size> estimated_bytes { 0 };
+  };
+
+  [[gnu::noinline]] static uint32_t Capture( Size byte_size, const void * frame ) noexcept;
+  /// кадры читаются только внутри стека потока, см. GetStackBounds
+  static Size Unwind( const void * frame, uintptr_t * frames ) noexcept;
+  /// [ low, high ) стека потока, читается один раз на поток. Если узнать не удалось - пустой диапазон
+  static void GetStackBounds( uintptr_t & low, uintptr_t & high ) noexcept;
+  static uint64_t Hash( const uintptr_t * frames, Size depth ) noexcept;
+  /// @return id места, добавленного при необходимости, или 0, если таблица заполнена
+  static uint32_t Intern( const uintptr_t * frames, Size depth ) noexcept;
+  static uint32_t Lookup( Site * sites, uint64_t hash, const uintptr_t * frames, Size depth, Size & slot ) noexcept;
+  /// следующее расстояние между сэмплами потока
+  static int64_t NextDistance( Size sample_bytes ) noexcept;
+  static Size GetObjectIndex( const struct mempool * pool, const struct mslab * slab, const void * ptr ) noexcept {
+    return (Size)( (const Byte *)ptr - (const Byte *)slab - pool->offset ) / pool->objsize;
+  }
+  static Size GetSlabSitesBytes( const struct mempool * pool ) noexcept {
+    Size page_size = PageSize()();
+    return ( pool->objcount * sizeof( uint16_t ) + page_size - 1 ) & ~( page_size - 1 );
+  }
+
+ private:
+  static thread_local int64_t countdown_;  ///< байты до следующего сэмпла потока
+  static thread_local Size thread_sample_bytes_; ///< с каким средним разыгран countdown_, 0 - выборка потока не начата
+  static thread_local uint64_t random_;
+  static thread_local uintptr_t stack_low_;
+  static thread_local uintptr_t stack_high_; ///< 0 - границы стека потока ещё не читались
+  static EnvSetting<Size> sample_bytes_;
+  static std::atomic<Site *> sites_;       ///< kCapacity мест в страницах MetadataPagePool, создаются с первым сэмплом
+  static std::atomic<uint16_t> slots_[kSlots]; ///< id места или 0
+  static std::atomic<Size> count_;
+  static std::atomic<Size> samples_;
+  static std::atomic<Size> sampled_bytes_;
+  static std::atomic<Size> dropped_;
+  static std::atomic<Size> table_bytes_;
+  static Mutex lock_;                      ///< добавление мест
+};
+
+/**
+ ** @brief Выбранные чанки lsregion'а одной эпохи
+ ** @details Пишет только поток, аллоцирующий из эпохи. Чанки идут в порядке id, поэтому lsregion_gc_orig
+ **          освобождает их префикс. Пока эпоха в карантине, чанки помнятся: именно к ним и приходят
+ **          устаревшие обращения
+ **/
+class EpochSiteTable {
+ public:
+  EpochSiteTable() {}
+  ~EpochSiteTable() noexcept;
+  /// без памяти под запись сэмпл отбрасывается
+  void Add( Byte * chunk, Size byte_size, Size redzone_size, uint32_t site, int64_t id ) noexcept;
+  /// забывает чанки с id <= @a forget_id
+  void Forget( int64_t forget_id ) noexcept;
+  /// место чанка, содержащего @a ptr вместе с его redzone'ом, 0 - не выбран
+  uint32_t Find( const void * ptr ) const noexcept;
+  /// выбранные чанки по местам, см. AllocationSites::ExportUsage
+  Size GetUsage( AllocationSiteUsage * usage, Size max_sites ) const;
+  bool IsEmpty() const noexcept { return !count_; }
+  /// вызывает @a callback( site, byte_size, id ) для каждого выбранного чанка
+  template< class Callback >
+  void ForEach( Callback callback ) const {
+    for ( Size i = 0; i < count_; ++i ) callback( (uint32_t)chunks_[i].site, (Size)chunks_[i].byte_size, chunks_[i].id );
+  }
+
+ protected:
+  struct Chunk {
+    Byte * start;
+    uint32_t byte_size;
+    uint16_t redzone_size;
+    uint16_t site;
+    int64_t id;
+  };
+
+  DISALLOW_COPY_MOVE_AND_ASSIGN( EpochSiteTable )
+  bool Grow() noexcept;
+
+ private:
+  Chunk * chunks_ = nullptr; ///< по возрастанию id, в страницах MetadataPagePool
+  Size capacity_ = 0;
+  Size count_ = 0;
+};
+
+/**
+ ** @brief Выбранные чанки region'а
+ ** @details Живёт в region->sites и создаётся с первым сэмплом. Чанк помнится по своему смещению
+ **          region_used() в момент аллокации: region_truncate, region_reset и region_free только уменьшают
+ **          region_used(), так что освобождены ровно чанки со смещением не ниже нового значения, и их
+ **          всегда можно снять с конца. Записи лежат в страницах MetadataPagePool. Как и сам region,
+ **          таблица принадлежит одному потоку
+ **/
+class RegionSiteTable {
+ public:
+  static void OnAlloc( struct region * region, Size byte_size, const void * frame ) noexcept;
+  /// забывает чанки выше нынешнего region_used()
+  static void Truncate( struct region * region ) noexcept;
+  static void Release( struct region * region ) noexcept;
+  static const RegionSiteTable * Get( const struct region * region ) noexcept { return (const RegionSiteTable *)region->sites; }
+
+  /// вызывает @a callback( site, byte_size ) для каждого выбранного чанка
+  template< class Callback >
+  void ForEach( Callback callback ) const {
+    for ( Size i = 0; i < count_; ++i ) callback( (uint32_t)entries_[i].site, (Size)entries_[i].byte_size );
+  }
+
+  RegionSiteTable() {}
+  ~RegionSiteTable() noexcept;
+
+ protected:
+  struct Entry {
+    Size position; ///< region_used() перед аллокацией
+    uint32_t byte_size;
+    uint32_t site;
+  };
+
+  DISALLOW_COPY_MOVE_AND_ASSIGN( RegionSiteTable )
+  bool Grow() noexcept;
+
+ private:
+  Entry * entries_ = nullptr;
+  Size capacity_ = 0; ///< в записях, entries_ занимает целые страницы
+  Size count_ = 0;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // ALLOCATION_SITES_PROTECT_SIGNATURE_W8DK3PZ6TN1QXF
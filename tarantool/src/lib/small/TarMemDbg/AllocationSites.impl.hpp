@@ -0,0 +1,361 @@
+/**
+ ** @file AllocationSites.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "мест аллокаций" AllocationSites.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    ALLOCATION_SITES_IMPL_PROTECT_SIGNATURE_C4HV7NL2RM9ZKE
+
+namespace      TARMEMDBG_NAMESPACE {
+
+thread_local int64_t AllocationSites::countdown_ = 0;
+thread_local Size AllocationSites::thread_sample_bytes_ = 0;
+thread_local uint64_t AllocationSites::random_ = 0;
+thread_local uintptr_t AllocationSites::stack_low_ = 0;
+thread_local uintptr_t AllocationSites::stack_high_ = 0;
+EnvSetting<Size> AllocationSites::sample_bytes_ { "TARARAM_ALLOCATION_SAMPLE_BYTES", TARMEMDBG_ALLOCATION_SAMPLE_BYTES, ParseEnvSize };
+std::atomic<AllocationSites::Site *> AllocationSites::sites_ { nullptr };
+std::atomic<uint16_t> AllocationSites::slots_[AllocationSites::kSlots] = {};
+std::atomic<Size> AllocationSites::count_ { 0 };
+std::atomic<Size> AllocationSites::samples_ { 0 };
+std::atomic<Size> AllocationSites::sampled_bytes_ { 0 };
+std::atomic<Size> AllocationSites::dropped_ { 0 };
+std::atomic<Size> AllocationSites::table_bytes_ { 0 };
+Mutex AllocationSites::lock_;
+
+AllocationSiteStats AllocationSites::GetStats() noexcept {
+  AllocationSiteStats ret;
+  ret.sample_bytes = GetSampleBytes();
+  ret.sites = GetCount();
+  ret.capacity = kCapacity;
+  ret.samples = samples_.load( std::memory_order_relaxed );
+  ret.sampled_bytes = sampled_bytes_.load( std::memory_order_relaxed );
+  ret.dropped = dropped_.load( std::memory_order_relaxed );
+  ret.table_bytes = table_bytes_.load( std::memory_order_relaxed );
+  return ret;
+}
+
+bool AllocationSites::GetSite( uint32_t id, AllocationSiteInfo & info ) noexcept {
+  if ( !id || id > GetCount() ) return false;
+  const Site & site = sites_.load( std::memory_order_acquire )[id - 1];
+  info.id = id;
+  info.depth = site.depth;
+  std::copy( site.frames, site.frames + site.depth, info.frames );
+  info.samples = site.samples.load( std::memory_order_relaxed );
+  info.sampled_bytes = site.sampled_bytes.load( std::memory_order_relaxed );
+  info.estimated_bytes = site.estimated_bytes.load( std::memory_order_relaxed );
+  return true;
+}
+
+void AllocationSites::Print( uint32_t id ) noexcept {
+  AllocationSiteInfo info;
+  if ( !GetSite( id, info ) ) return;
+  fprintf( stderr, "TaraRam:   allocated at site %u:", (unsigned)id );
+  for ( Size i = 0; i < info.depth; ++i ) fprintf( stderr, " %p", (void *)info.frames[i] );
+  fprintf( stderr, "\n" );
+}
+
+uint32_t AllocationSites::Capture( Size byte_size, const void * frame ) noexcept {
+  Size sample_bytes = GetSampleBytes();
+  if ( thread_sample_bytes_ != sample_bytes ) {
+    // выборка потока только начинается или среднее поменяли: старое расстояние уже не годится
+    if ( !random_ ) random_ = ( (uint64_t)(uintptr_t)&countdown_ ^ (uint64_t)Clock::now().time_since_epoch().count() ) | 1;
+    thread_sample_bytes_ = sample_bytes;
+    countdown_ = NextDistance( sample_bytes ) - (int64_t)byte_size;
+    if ( countdown_ > 0 ) return 0;
+  }
+  countdown_ = NextDistance( sample_bytes );
+  uintptr_t frames[kMaxDepth];
+  Size depth = Unwind( frame, frames );
+  samples_.fetch_add( 1, std::memory_order_relaxed );
+  sampled_bytes_.fetch_add( byte_size, std::memory_order_relaxed );
+  uint32_t id = Intern( frames, depth );
+  if ( !id ) {
+    dropped_.fetch_add( 1, std::memory_order_relaxed );
+    return 0;
+  }
+  Site & site = sites_.load( std::memory_order_relaxed )[id - 1];
+  // чанк размера s попадает в выборку с вероятностью 1 - exp( -s / sample_bytes )
+  site.samples.fetch_add( 1, std::memory_order_relaxed );
+  site.sampled_bytes.fetch_add( byte_size, std::memory_order_relaxed );
+  site.estimated_bytes.fetch_add( (Size)( (double)byte_size * GetSampleWeight( byte_size, sample_bytes ) ), std::memory_order_relaxed );
+  return id;
+}
+
+int64_t AllocationSites::NextDistance( Size sample_bytes ) noexcept {
+  // xorshift64*, равномерное в ( 0, 1 ] -> экспоненциальное
+  random_ ^= random_ >> 12;
+  random_ ^= random_ << 25;
+  random_ ^= random_ >> 27;
+  double uniform = (double)( ( random_ * 0x2545F4914F6CDD1Dull ) >> 11 ) * 0x1.0p-53;
+  double distance = -std::log1p( -uniform ) * (double)sample_bytes;
+  return std::max( (int64_t)1, (int64_t)std::min( distance, (double)INT64_MAX / 2 ) );
+}
+
+void AllocationSites::GetStackBounds( uintptr_t & low, uintptr_t & high ) noexcept {
+  if ( !stack_high_ ) {
+    pthread_attr_t attr;
+    void * stack = nullptr;
+    size_t stack_size = 0;
+    // пустой диапазон, если не получится: повторять pthread_getattr_np на каждом сэмпле незачем
+    stack_low_ = stack_high_ = 1;
+    if ( !pthread_getattr_np( pthread_self(), &attr ) ) {
+      if ( !pthread_attr_getstack( &attr, &stack, &stack_size ) ) {
+        stack_low_ = (uintptr_t)stack;
+        stack_high_ = stack_low_ + stack_size;
+      }
+      pthread_attr_destroy( &attr );
+    }
+  }
+  low = stack_low_;
+  high = stack_high_;
+}
+
+Size AllocationSites::Unwind( const void * frame, uintptr_t * frames ) noexcept {
+  uintptr_t low = 0, high = 0;
+  GetStackBounds( low, high );
+  const uintptr_t * fp = (const uintptr_t *)frame;
+  Size depth = 0;
+  // кадр ( fp[0], fp[1] ) должен целиком лежать в стеке потока, иначе читать его нельзя
+  while ( (uintptr_t)fp >= low && (uintptr_t)( fp + 2 ) <= high && depth < kMaxDepth ) {
+    uintptr_t return_address = fp[1];
+    if ( !return_address ) break;
+    frames[depth++] = return_address;
+    const uintptr_t * next = (const uintptr_t *)fp[0];
+    // стек растёт вниз: кадр вызывающего выше, недалеко и выровнен, иначе цепочка кончилась
+    if ( next <= fp || (uintptr_t)next - (uintptr_t)fp > kMaxFrameBytes || (uintptr_t)next % sizeof( uintptr_t ) ) break;
+    fp = next;
+  }
+  return depth;
+}
+
+uint64_t AllocationSites::Hash( const uintptr_t * frames, Size depth ) noexcept {
+  uint64_t ret = 0x9E3779B97F4A7C15ull ^ depth;
+  for ( Size i = 0; i < depth; ++i ) {
+    ret = ( ret ^ frames[i] ) * 0xBF58476D1CE4E5B9ull;
+    ret ^= ret >> 31;
+  }
+  return ret;
+}
+
+uint32_t AllocationSites::Lookup( Site * sites, uint64_t hash, const uintptr_t * frames, Size depth, Size & slot ) noexcept {
+  slot = hash & ( kSlots - 1 );
+  for ( Size probe = 0; probe < kSlots; ++probe, slot = ( slot + 1 ) & ( kSlots - 1 ) ) {
+    uint16_t id = slots_[slot].load( std::memory_order_acquire );
+    if ( !id ) return 0;
+    const Site & site = sites[id - 1];
+    if ( site.hash == hash && site.depth == depth && std::equal( frames, frames + depth, site.frames ) ) return id;
+  }
+  return 0;
+}
+
+uint32_t AllocationSites::Intern( const uintptr_t * frames, Size depth ) noexcept {
+  uint64_t hash = Hash( frames, depth );
+  Size slot = 0;
+  Site * sites = sites_.load( std::memory_order_acquire );
+  if ( sites ) {
+    uint32_t found = Lookup( sites, hash, frames, depth, slot );
+    if ( found ) return found;
+  }
+  LockGuard lock( lock_ );
+  sites = sites_.load( std::memory_order_relaxed );
+  if ( !sites ) {
+    Size page_size = PageSize()();
+    Size table_bytes = ( kCapacity * sizeof( Site ) + page_size - 1 ) & ~( page_size - 1 );
+    sites = (Site *)AllocateMetadataPages( table_bytes );
+    if ( !sites ) return 0;
+    AccountTable( (PtrDiff)table_bytes );
+    sites_.store( sites, std::memory_order_release );
+  }
+  // пока ждали блокировку, этот стек мог добавить другой поток
+  uint32_t found = Lookup( sites, hash, frames, depth, slot );
+  if ( found ) return found;
+  Size count = count_.load( std::memory_order_relaxed );
+  if ( count == kCapacity ) return 0;
+  Site * site = new ( &sites[count] ) Site();
+  site->hash = hash;
+  site->depth = depth;
+  std::copy( frames, frames + depth, site->frames );
+  uint32_t id = (uint32_t)( count + 1 );
+  slots_[slot].store( (uint16_t)id, std::memory_order_release );
+  count_.store( count + 1, std::memory_order_release );
+  return id;
+}
+
+void AllocationSites::OnMempoolAlloc( struct mempool * pool, struct mslab * slab, void * ptr, const void * frame ) noexcept {
+  uint32_t site = Sample( pool->objsize, frame );
+  if ( !slab->sites ) {
+    if ( !site ) return;
+    Size byte_size = GetSlabSitesBytes( pool );
+    slab->sites = (uint16_t *)AllocateMetadataPages( byte_size );
+    if ( !slab->sites ) return;
+    // страницы пула могут быть переиспользованными
+    memset( slab->sites, 0, pool->objcount * sizeof( uint16_t ) );
+    AccountTable( (PtrDiff)byte_size );
+  }
+  slab->sites[GetObjectIndex( pool, slab, ptr )] = (uint16_t)site;
+}
+
+void AllocationSites::ReleaseMempoolSlab( const struct mempool * pool, struct mslab * slab ) noexcept {
+  if ( !slab->sites ) return;
+  Size byte_size = GetSlabSitesBytes( pool );
+  DeallocateMetadataPages( slab->sites, byte_size );
+  AccountTable( -(PtrDiff)byte_size );
+  slab->sites = nullptr;
+}
+
+uint32_t AllocationSites::FindInMempool( const struct mempool * pool, const void * ptr ) noexcept {
+  // slab'ы mempool'а выровнены по своему размеру, как в slab_from_ptr
+  const struct mslab * slab = (const struct mslab *)( (intptr_t)ptr & pool->slab_ptr_mask );
+  if ( !slab->sites || (const Byte *)ptr < (const Byte *)slab + pool->offset ) return 0;
+  Size index = GetObjectIndex( pool, slab, ptr );
+  if ( index >= pool->objcount ) return 0;
+  return slab->sites[index] & ~kFreedBit;
+}
+
+Size AllocationSites::GetMempoolUsage( struct mempool * pool, AllocationSiteUsage * usage, Size max_sites ) {
+  std::vector< AllocationSiteUsage > per_site( GetCount() + 1 );
+  ForEachMempoolSample( pool, [&]( uint32_t site ) {
+    AllocationSiteUsage & entry = per_site[site];
+    ++entry.chunks;
+    entry.bytes += pool->objsize;
+  } );
+  return ExportUsage( per_site, usage, max_sites );
+}
+
+Size AllocationSites::ExportUsage( std::vector< AllocationSiteUsage > & per_site, AllocationSiteUsage * usage, Size max_sites ) {
+  Size nsites = 0;
+  for ( Size id = 1; id < per_site.size(); ++id ) {
+    if ( !per_site[id].chunks ) continue;
+    per_site[id].site = (uint32_t)id;
+    per_site[nsites++] = per_site[id];
+  }
+  per_site.resize( nsites );
+  std::sort( per_site.begin(), per_site.end(), []( const AllocationSiteUsage & left, const AllocationSiteUsage & right ) {
+    return left.bytes > right.bytes;
+  } );
+  std::copy( per_site.begin(), per_site.begin() + std::min( nsites, max_sites ), usage );
+  return nsites;
+}
+
+void EpochSiteTable::Add( Byte * chunk, Size byte_size, Size redzone_size, uint32_t site, int64_t id ) noexcept {
+  if ( count_ == capacity_ && !Grow() ) return;
+  Chunk & entry = chunks_[count_++];
+  entry.start = chunk;
+  entry.byte_size = (uint32_t)std::min( byte_size, (Size)UINT32_MAX );
+  entry.redzone_size = (uint16_t)redzone_size;
+  entry.site = (uint16_t)site;
+  entry.id = id;
+}
+
+void EpochSiteTable::Forget( int64_t forget_id ) noexcept {
+  Chunk * first_kept = std::find_if( chunks_, chunks_ + count_, [forget_id]( const Chunk & chunk ) { return chunk.id > forget_id; } );
+  Size kept = count_ - (Size)( first_kept - chunks_ );
+  std::copy( first_kept, chunks_ + count_, chunks_ );
+  count_ = kept;
+}
+
+uint32_t EpochSiteTable::Find( const void * ptr ) const noexcept {
+  for ( Size i = 0; i < count_; ++i ) {
+    const Chunk & chunk = chunks_[i];
+    if ( (const Byte *)ptr >= chunk.start && (const Byte *)ptr < chunk.start + chunk.byte_size + chunk.redzone_size ) return chunk.site;
+  }
+  return 0;
+}
+
+EpochSiteTable::~EpochSiteTable() noexcept {
+  if ( !chunks_ ) return;
+  DeallocateMetadataPages( chunks_, capacity_ * sizeof( Chunk ) );
+  AllocationSites::AccountTable( -(PtrDiff)( capacity_ * sizeof( Chunk ) ) );
+}
+
+bool EpochSiteTable::Grow() noexcept {
+  Size per_page = PageSize()() / sizeof( Chunk );
+  Size capacity = std::max( capacity_ * 2, per_page );
+  Chunk * chunks = (Chunk *)AllocateMetadataPages( capacity * sizeof( Chunk ) );
+  if ( !chunks ) return false;
+  std::copy( chunks_, chunks_ + count_, chunks );
+  if ( chunks_ ) DeallocateMetadataPages( chunks_, capacity_ * sizeof( Chunk ) );
+  AllocationSites::AccountTable( (PtrDiff)( ( capacity - capacity_ ) * sizeof( Chunk ) ) );
+  chunks_ = chunks;
+  capacity_ = capacity;
+  return true;
+}
+
+Size EpochSiteTable::GetUsage( AllocationSiteUsage * usage, Size max_sites ) const {
+  std::vector< AllocationSiteUsage > per_site( AllocationSites::GetCount() + 1 );
+  for ( Size i = 0; i < count_; ++i ) {
+    const Chunk & chunk = chunks_[i];
+    AllocationSiteUsage & entry = per_site[chunk.site];
+    ++entry.chunks;
+    entry.bytes += chunk.byte_size;
+  }
+  return AllocationSites::ExportUsage( per_site, usage, max_sites );
+}
+
+void RegionSiteTable::OnAlloc( struct region * region, Size byte_size, const void * frame ) noexcept {
+  uint32_t site = AllocationSites::Sample( byte_size, frame );
+  if ( !site ) return;
+  RegionSiteTable * table = (RegionSiteTable *)region->sites;
+  if ( !table ) {
+    table = NewAligned<RegionSiteTable>();
+    if ( !table ) return;
+    region->sites = (struct region_sites *)table;
+  }
+  // смещения растут, пока region_used() не уменьшили, а уменьшить его в обход region_site_truncate
+  // может только код, трогающий region->slabs напрямую
+  Size position = region->slabs.stats.used - byte_size;
+  while ( table->count_ && table->entries_[table->count_ - 1].position >= position ) --table->count_;
+  if ( table->count_ == table->capacity_ && !table->Grow() ) return;
+  Entry & entry = table->entries_[table->count_++];
+  entry.position = position;
+  entry.byte_size = (uint32_t)std::min( byte_size, (Size)UINT32_MAX );
+  entry.site = site;
+}
+
+void RegionSiteTable::Truncate( struct region * region ) noexcept {
+  RegionSiteTable * table = (RegionSiteTable *)region->sites;
+  if ( !table ) return;
+  Size used = region->slabs.stats.used;
+  while ( table->count_ && table->entries_[table->count_ - 1].position >= used ) --table->count_;
+}
+
+void RegionSiteTable::Release( struct region * region ) noexcept {
+  RegionSiteTable * table = (RegionSiteTable *)region->sites;
+  if ( !table ) return;
+  region->sites = nullptr;
+  DeleteAligned( table );
+}
+
+RegionSiteTable::~RegionSiteTable() noexcept {
+  if ( !entries_ ) return;
+  DeallocateMetadataPages( entries_, capacity_ * sizeof( Entry ) );
+  AllocationSites::AccountTable( -(PtrDiff)( capacity_ * sizeof( Entry ) ) );
+}
+
+bool RegionSiteTable::Grow() noexcept {
+  Size per_page = PageSize()() / sizeof( Entry );
+  Size capacity = std::max( capacity_ * 2, per_page );
+  Entry * entries = (Entry *)AllocateMetadataPages( capacity * sizeof( Entry ) );
+  if ( !entries ) return false;
+  std::copy( entries_, entries_ + count_, entries );
+  if ( entries_ ) DeallocateMetadataPages( entries_, capacity_ * sizeof( Entry ) );
+  AllocationSites::AccountTable( (PtrDiff)( ( capacity - capacity_ ) * sizeof( Entry ) ) );
+  entries_ = entries;
+  capacity_ = capacity;
+  return true;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    ALLOCATION_SITES_IMPL_PROTECT_SIGNATURE_C4HV7NL2RM9ZKE
+#endif  // ALLOCATION_SITES_IMPL_PROTECT_SIGNATURE_C4HV7NL2RM9ZKE
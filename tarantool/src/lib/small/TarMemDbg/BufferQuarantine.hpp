@@ -0,0 +1,85 @@
+/**
+ ** @file BufferQuarantine.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий карантин slab'ов ibuf и obuf
+ ** \~russian @details ibuf_reserve_slow сдвигает данные memmove'ом или переносит их в новый slab, а старый
+ **                    сразу отдаёт в slab_cache, obuf_reset переиспользует slab'ы iovec'ов на месте. Указатель,
+ **                    оставшийся в сетевом буфере после этого, молча читает чужие данные. В отладочном режиме
+ **                    буферы отдают такие slab'ы сюда, и они возвращаются в slab_cache не сразу
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    BUFFER_QUARANTINE_PROTECT_SIGNATURE_Q5RL9VC2HJ7MWX
+#define    BUFFER_QUARANTINE_PROTECT_SIGNATURE_Q5RL9VC2HJ7MWX
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Карантин slab'ов сетевых буферов одного потока
+ ** @details slab_cache не потокобезопасен, поэтому slab возвращается в свой кэш тем же потоком, что его
+ **          отдал, и у каждого потока свой FIFO - кольцевой буфер в страницах MetadataPagePool. Бюджет
+ **          действует на поток, а не на соединение, так что число соединений на память не влияет.
+ **          Данные slab'а заливаются канарейкой, его целые страницы после заголовка запрещаются (заголовок
+ **          читает и пишет slab_cache). Канарейка проверяется при возврате. slab_cache_destroy сначала
+ **          забирает свои slab'ы из карантина вызывающего потока. Карантин потока опустошается и удаляется
+ **          при завершении потока
+ **/
+class BufferQuarantine {
+ public:
+  /// бюджет потока в байтах, при первом обращении читается из TARARAM_BUFFER_QUARANTINE
+  static Size GetBudget() noexcept { return budget_.Get(); }
+  /// @return предыдущий бюджет. Лишние slab'ы потока вытесняются при его следующем Put
+  static Size SetBudget( Size byte_size ) noexcept { return budget_.Set( byte_size ); }
+  /// limit - бюджет, items - slab'ы, released - возвращённые в slab_cache
+  static QuarantineStats GetStats() noexcept { return counters_.GetStats( GetBudget() ); }
+
+  /// @return false, если карантин выключен или slab больше бюджета и его надо вернуть как обычно
+  static bool Put( struct slab_cache * cache, struct slab * slab ) noexcept;
+  static bool IsEnabled() noexcept { return GetBudget() != 0; }
+  /// возвращает в @a cache все его slab'ы из карантина вызывающего потока
+  static void Drain( struct slab_cache * cache ) noexcept;
+
+  BufferQuarantine() {}
+  ~BufferQuarantine() noexcept;
+
+ protected:
+  struct Entry {
+    struct slab_cache * cache;
+    struct slab * slab;
+  };
+
+  DISALLOW_COPY_MOVE_AND_ASSIGN( BufferQuarantine )
+  static void Release( const Entry & entry ) noexcept;
+  void ReleaseOldest() noexcept;
+  bool Grow() noexcept;
+  Entry & At( Size i ) noexcept { return ring_[( head_ + i ) % capacity_]; }
+
+ private:
+  /// возвращает slab'ы карантина в их кэши и удаляет его при завершении потока
+  struct ThreadOwner {
+    ThreadOwner() {}
+    ~ThreadOwner();
+  };
+
+  Entry * ring_ = nullptr;
+  Size capacity_ = 0; ///< в записях, ring_ занимает целые страницы
+  Size head_ = 0;     ///< самый старый slab
+  Size count_ = 0;
+  Size bytes_held_ = 0;
+  static thread_local BufferQuarantine * instance_;
+  static thread_local bool thread_exited_; ///< slab'ы из деструкторов после ThreadOwner возвращаются сразу
+  static thread_local ThreadOwner thread_owner_;
+  static EnvSetting<Size> budget_;
+  static QuarantineCounters counters_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // BUFFER_QUARANTINE_PROTECT_SIGNATURE_Q5RL9VC2HJ7MWX
@@ -0,0 +1,120 @@
+/**
+ ** @file BufferQuarantine.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "карантина сетевых буферов" BufferQuarantine.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    BUFFER_QUARANTINE_IMPL_PROTECT_SIGNATURE_T4ZC8NF0WD3KSA
+
+namespace      TARMEMDBG_NAMESPACE {
+
+thread_local BufferQuarantine * BufferQuarantine::instance_ = nullptr;
+thread_local bool BufferQuarantine::thread_exited_ = false;
+thread_local BufferQuarantine::ThreadOwner BufferQuarantine::thread_owner_;
+EnvSetting<Size> BufferQuarantine::budget_ { "TARARAM_BUFFER_QUARANTINE", TARMEMDBG_BUFFER_QUARANTINE, ParseEnvSize };
+QuarantineCounters BufferQuarantine::counters_ { "buffer slab", "it was retired" };
+
+bool BufferQuarantine::Put( struct slab_cache * cache, struct slab * slab ) noexcept {
+  Size budget = GetBudget();
+  BufferQuarantine * quarantine = instance_;
+  if ( !quarantine ) {
+    if ( slab->size > budget || thread_exited_ ) return false;
+    // регистрирует деструктор владельца до того, как появится карантин
+    (void)&thread_owner_;
+    quarantine = NewAligned<BufferQuarantine>();
+    if ( !quarantine ) return false;
+    instance_ = quarantine;
+  }
+  // бюджет могли уменьшить, лишнее уходит сразу
+  while ( quarantine->count_ && quarantine->bytes_held_ + slab->size > budget ) quarantine->ReleaseOldest();
+  if ( slab->size > budget ) return false;
+  if ( quarantine->count_ == quarantine->capacity_ && !quarantine->Grow() ) {
+    if ( !quarantine->count_ ) return false;
+    quarantine->ReleaseOldest();
+  }
+  Size protected_bytes = RedzoneTable::PoisonAndProtect( (Byte *)slab + slab_sizeof(), slab->size - slab_sizeof() );
+  Entry & entry = quarantine->At( quarantine->count_++ );
+  entry.cache = cache;
+  entry.slab = slab;
+  quarantine->bytes_held_ += slab->size;
+  counters_.Put( slab->size, protected_bytes );
+  return true;
+}
+
+void BufferQuarantine::Drain( struct slab_cache * cache ) noexcept {
+  BufferQuarantine * quarantine = instance_;
+  if ( !quarantine ) return;
+  // остальные slab'ы сдвигаются к началу, сохраняя порядок
+  Size kept = 0;
+  for ( Size i = 0; i < quarantine->count_; ++i ) {
+    Entry entry = quarantine->At( i );
+    if ( entry.cache == cache ) {
+      quarantine->bytes_held_ -= entry.slab->size;
+      Release( entry );
+    } else {
+      quarantine->At( kept++ ) = entry;
+    }
+  }
+  quarantine->count_ = kept;
+}
+
+bool BufferQuarantine::Grow() noexcept {
+  Size per_page = PageSize()() / sizeof( Entry );
+  Size capacity = std::max( capacity_ * 2, per_page );
+  Entry * ring = (Entry *)AllocateMetadataPages( capacity * sizeof( Entry ) );
+  if ( !ring ) return false;
+  for ( Size i = 0; i < count_; ++i ) ring[i] = At( i );
+  if ( ring_ ) DeallocateMetadataPages( ring_, capacity_ * sizeof( Entry ) );
+  ring_ = ring;
+  capacity_ = capacity;
+  head_ = 0;
+  return true;
+}
+
+void BufferQuarantine::ReleaseOldest() noexcept {
+  assert( count_ );
+  Entry entry = ring_[head_];
+  head_ = ( head_ + 1 ) % capacity_;
+  --count_;
+  bytes_held_ -= entry.slab->size;
+  Release( entry );
+}
+
+BufferQuarantine::~BufferQuarantine() noexcept {
+  while ( count_ ) ReleaseOldest();
+  if ( ring_ ) DeallocateMetadataPages( ring_, capacity_ * sizeof( Entry ) );
+}
+
+BufferQuarantine::ThreadOwner::~ThreadOwner() {
+  thread_exited_ = true;
+  BufferQuarantine * quarantine = instance_;
+  if ( !quarantine ) return;
+  instance_ = nullptr;
+  DeleteAligned( quarantine );
+}
+
+void BufferQuarantine::Release( const Entry & entry ) noexcept {
+  struct slab * slab = entry.slab;
+  Size protected_bytes = 0;
+  const Byte * bad = RedzoneTable::UnprotectAndVerify( (Byte *)slab + slab_sizeof(), slab->size - slab_sizeof(), protected_bytes );
+  if ( bad ) {
+    counters_.ReportCorruption( slab, slab->size, bad );
+    if ( TARMEMDBG_BUFFER_QUARANTINE_ABORT ) abort();
+  }
+  counters_.Release( slab->size, protected_bytes );
+  slab_put( entry.cache, slab );
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    BUFFER_QUARANTINE_IMPL_PROTECT_SIGNATURE_T4ZC8NF0WD3KSA
+#endif  // BUFFER_QUARANTINE_IMPL_PROTECT_SIGNATURE_T4ZC8NF0WD3KSA
@@ -0,0 +1,130 @@
+/**
+ ** @file CallTrace.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий запись вызовов аллокаторов для их последующего воспроизведения
+ ** \~russian @details Создание и удаление аллокаторов, аллокации и освобождения mempool'ов, small_alloc'ов,
+ **                    region'ов и lsregion'ов пишутся в файл без потерь. Формат (small_call_header,
+ **                    small_call_chunk, кодирование записей) описан в slab_arena_internal.h,
+ **                    воспроизводит его TarMemDbg_replay
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    CALL_TRACE_PROTECT_SIGNATURE_Q2VD8KT5MX1RZN
+#define    CALL_TRACE_PROTECT_SIGNATURE_Q2VD8KT5MX1RZN
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct CallTraceStats {
+  bool enabled = false;
+  Size threads = 0;
+  Size records = 0;
+  Size bytes = 0;
+  Size chunks = 0;
+  Size write_errors = 0;
+};
+
+class CallTrace;
+
+/**
+ ** @brief Буфер записей одного потока, пишется в файл куском, когда заполнится или поток завершится
+ **/
+struct CallTraceBuffer {
+  static constexpr const Size kByteSize = TARMEMDBG_CALL_TRACE_BUFFER_BYTES;
+  static_assert( kByteSize >= 4096 && kByteSize <= UINT32_MAX, "TARMEMDBG_CALL_TRACE_BUFFER_BYTES is out of range" );
+
+  CallTrace * trace = nullptr;
+  uint32_t thread = 0;
+  uint32_t records = 0;
+  Size used = 0;
+  // состояние дельта-кодирования, с нуля в каждом куске
+  uint64_t object = 0;
+  uint64_t ptr = 0;
+  int64_t arg = 0;
+  Byte data[kByteSize];
+};
+
+/**
+ ** @brief Запись вызовов аллокаторов: по буферу на поток, куски пишутся в файл под блокировкой
+ ** @details Выключенная запись стоит двух relaxed-чтений. Включённая - кодирования записи в буфер потока
+ **          и write раз в CallTraceBuffer::kByteSize байт. Буфер потока пишется, когда заполнится, при Close
+ **          для вызвавшего потока и при завершении потока для остальных: записи других потоков, сделанные
+ **          до Close, попадают в файл, когда эти потоки завершатся. Поэтому закрытая запись, как и EventTrace,
+ **          не удаляется, и её файл не закрывается
+ **/
+class CallTrace {
+ public:
+  /**
+   ** @brief создаёт файл @a path и начинает в него писать, предыдущая запись закрывается
+   ** @return false и errno при ошибке
+   **/
+  static bool Open( const char * path ) noexcept;
+  static void Close() noexcept;
+  static bool IsOpen() noexcept { return current_.load( std::memory_order_acquire ) != nullptr; }
+  /// читает TARARAM_CALL_TRACE, если этого ещё не было
+  static void Init() noexcept { if ( !env_read_.load( std::memory_order_relaxed ) ) OpenFromEnv(); }
+  static CallTraceStats GetStats() noexcept;
+
+  static void Record( small_call_type type, const void * object, const void * ptr, uint64_t size, int64_t arg, uint32_t aux ) noexcept {
+    CallTrace * trace = current_.load( std::memory_order_acquire );
+    if ( !trace ) {
+      if ( env_read_.load( std::memory_order_relaxed ) ) return;
+      trace = OpenFromEnv();
+      if ( !trace ) return;
+    }
+    trace->Append( type, object, ptr, size, arg, aux );
+  }
+
+  CallTrace() {}
+
+ protected:
+  DISALLOW_COPY_MOVE_AND_ASSIGN( CallTrace )
+  static CallTrace * OpenFromEnv() noexcept;
+  /// Open под lock_
+  static bool OpenLocked( const char * path ) noexcept;
+  [[gnu::noinline]] void Append( small_call_type type, const void * object, const void * ptr, uint64_t size, int64_t arg, uint32_t aux ) noexcept;
+  /// привязывает буфер потока к этой записи, прежний кусок пишется в свою запись. nullptr - поток уже завершается
+  CallTraceBuffer * AttachThread() noexcept;
+  /// пишет накопленный кусок потока в файл его записи
+  static void Flush( CallTraceBuffer * buffer ) noexcept;
+  static Byte * PutVarint( Byte * out, uint64_t value ) noexcept {
+    while ( value >= 0x80 ) {
+      *out++ = (Byte)( value | 0x80 );
+      value >>= 7;
+    }
+    *out++ = (Byte)value;
+    return out;
+  }
+  static uint64_t ZigZag( int64_t value ) noexcept { return ( (uint64_t)value << 1 ) ^ (uint64_t)( value >> 63 ); }
+
+ private:
+  /// пишет и удаляет буфер потока при завершении потока
+  struct ThreadBufferOwner {
+    ThreadBufferOwner() {}
+    ~ThreadBufferOwner();
+  };
+
+  int fd_ = -1;                        ///< не закрывается, см. описание класса
+  Mutex write_lock_;                   ///< куски пишутся целиком
+  std::atomic<uint32_t> threads_ { 0 };
+  std::atomic<Size> records_ { 0 };
+  std::atomic<Size> bytes_ { 0 };
+  std::atomic<Size> chunks_ { 0 };
+  std::atomic<Size> write_errors_ { 0 };
+  static std::atomic<CallTrace *> current_;
+  static std::atomic<bool> env_read_;
+  static thread_local CallTraceBuffer * thread_buffer_;
+  static thread_local bool thread_exited_;          ///< записи из деструкторов после ThreadBufferOwner теряются
+  static thread_local ThreadBufferOwner thread_owner_;
+  static Mutex lock_;                  ///< Open и Close
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // CALL_TRACE_PROTECT_SIGNATURE_Q2VD8KT5MX1RZN
@@ -0,0 +1,206 @@
+/**
+ ** @file CallTrace.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "записи вызовов аллокаторов" CallTrace.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    CALL_TRACE_IMPL_PROTECT_SIGNATURE_J4XR7BW2PL9NCE
+
+namespace      TARMEMDBG_NAMESPACE {
+
+std::atomic<CallTrace *> CallTrace::current_ { nullptr };
+std::atomic<bool> CallTrace::env_read_ { false };
+thread_local CallTraceBuffer * CallTrace::thread_buffer_ = nullptr;
+thread_local bool CallTrace::thread_exited_ = false;
+thread_local CallTrace::ThreadBufferOwner CallTrace::thread_owner_;
+Mutex CallTrace::lock_;
+
+CallTrace * CallTrace::OpenFromEnv() noexcept {
+  {
+    LockGuard lock( lock_ );
+    if ( !env_read_.load( std::memory_order_relaxed ) ) {
+      const char * path = getenv( "TARARAM_CALL_TRACE" );
+      env_read_.store( true, std::memory_order_relaxed );
+      if ( path && *path && !OpenLocked( path ) ) {
+        fprintf( stderr, "TaraRam: cannot open call trace %s: %s\n", path, strerror( errno ) );
+      }
+    }
+  }
+  return current_.load( std::memory_order_acquire );
+}
+
+bool CallTrace::Open( const char * path ) noexcept {
+  LockGuard lock( lock_ );
+  env_read_.store( true, std::memory_order_relaxed );
+  return OpenLocked( path );
+}
+
+bool CallTrace::OpenLocked( const char * path ) noexcept {
+  if ( !path ) {
+    errno = EINVAL;
+    return false;
+  }
+  // новый файл, а не обрезанный старый: потоки прежней записи того же пути дописывают в свой.
+  // Удаляется только обычный файл, /dev/null и прочие открываются как есть
+  struct stat old_file;
+  if ( lstat( path, &old_file ) == 0 && S_ISREG( old_file.st_mode ) ) unlink( path );
+  int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644 );
+  if ( fd < 0 ) return false;
+  small_call_header header;
+  memset( &header, 0, sizeof( header ) );
+  memcpy( header.magic, "SMCALLS", 8 );
+  header.version = SMALL_CALL_VERSION;
+  header.header_size = sizeof( header );
+  header.start_realtime_ns = (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
+  header.pid = (uint32_t)getpid();
+  CallTrace * trace = nullptr;
+  if ( write( fd, &header, sizeof( header ) ) != (ssize_t)sizeof( header ) ) {
+    if ( !errno ) errno = EIO;
+  } else {
+    trace = NewAligned<CallTrace>();
+    if ( !trace ) errno = ENOMEM;
+  }
+  if ( !trace ) {
+    int saved_errno = errno;
+    close( fd );
+    errno = saved_errno;
+    return false;
+  }
+  trace->fd_ = fd;
+  // кусок вызвавшего потока уходит в прежнюю запись, остальные - при следующей записи или завершении потоков
+  if ( thread_buffer_ ) Flush( thread_buffer_ );
+  current_.store( trace, std::memory_order_release );
+  return true;
+}
+
+void CallTrace::Close() noexcept {
+  LockGuard lock( lock_ );
+  env_read_.store( true, std::memory_order_relaxed );
+  current_.store( nullptr, std::memory_order_release );
+  if ( thread_buffer_ ) Flush( thread_buffer_ );
+}
+
+CallTraceStats CallTrace::GetStats() noexcept {
+  CallTraceStats ret;
+  CallTrace * trace = current_.load( std::memory_order_acquire );
+  if ( !trace ) return ret;
+  ret.enabled = true;
+  ret.threads = trace->threads_.load( std::memory_order_relaxed );
+  ret.records = trace->records_.load( std::memory_order_relaxed );
+  ret.bytes = trace->bytes_.load( std::memory_order_relaxed );
+  ret.chunks = trace->chunks_.load( std::memory_order_relaxed );
+  ret.write_errors = trace->write_errors_.load( std::memory_order_relaxed );
+  return ret;
+}
+
+void CallTrace::Append( small_call_type type, const void * object, const void * ptr, uint64_t size, int64_t arg, uint32_t aux ) noexcept {
+  CallTraceBuffer * buffer = thread_buffer_;
+  if ( !buffer || buffer->trace != this ) {
+    buffer = AttachThread();
+    if ( !buffer ) return;
+  }
+  if ( buffer->used + SMALL_CALL_RECORD_MAX > CallTraceBuffer::kByteSize ) Flush( buffer );
+  Byte * start = buffer->data + buffer->used;
+  Byte * out = start + 2;
+  Byte flags = 0;
+  uint64_t object_value = (uint64_t)(uintptr_t)object;
+  if ( object_value != buffer->object ) {
+    flags |= SMALL_CALL_FIELD_OBJECT;
+    out = PutVarint( out, object_value );
+    buffer->object = object_value;
+  }
+  if ( ptr ) {
+    uint64_t ptr_value = (uint64_t)(uintptr_t)ptr;
+    flags |= SMALL_CALL_FIELD_PTR;
+    out = PutVarint( out, ZigZag( (int64_t)( ptr_value - buffer->ptr ) ) );
+    buffer->ptr = ptr_value;
+  }
+  if ( size ) {
+    flags |= SMALL_CALL_FIELD_SIZE;
+    out = PutVarint( out, size );
+  }
+  if ( arg ) {
+    flags |= SMALL_CALL_FIELD_ARG;
+    out = PutVarint( out, ZigZag( (int64_t)( (uint64_t)arg - (uint64_t)buffer->arg ) ) );
+    buffer->arg = arg;
+  }
+  if ( aux ) {
+    flags |= SMALL_CALL_FIELD_AUX;
+    out = PutVarint( out, aux );
+  }
+  start[0] = (Byte)type;
+  start[1] = flags;
+  buffer->used = (Size)( out - buffer->data );
+  ++buffer->records;
+}
+
+CallTraceBuffer * CallTrace::AttachThread() noexcept {
+  if ( thread_exited_ ) return nullptr;
+  CallTraceBuffer * buffer = thread_buffer_;
+  if ( !buffer ) {
+    // регистрирует деструктор владельца до того, как появится буфер
+    (void)&thread_owner_;
+    buffer = NewAligned<CallTraceBuffer>();
+    if ( !buffer ) return nullptr;
+    thread_buffer_ = buffer;
+  } else {
+    Flush( buffer );
+  }
+  buffer->trace = this;
+  buffer->thread = threads_.fetch_add( 1, std::memory_order_relaxed );
+  return buffer;
+}
+
+void CallTrace::Flush( CallTraceBuffer * buffer ) noexcept {
+  CallTrace * trace = buffer->trace;
+  if ( trace && buffer->used ) {
+    small_call_chunk chunk;
+    chunk.thread = buffer->thread;
+    chunk.byte_size = (uint32_t)buffer->used;
+    chunk.records = buffer->records;
+    chunk.reserved = 0;
+    iovec parts[2] = { { &chunk, sizeof( chunk ) }, { buffer->data, buffer->used } };
+    ssize_t expected = (ssize_t)( sizeof( chunk ) + buffer->used );
+    ssize_t written;
+    {
+      // O_APPEND и блокировка не дают кускам разных потоков перемешаться
+      LockGuard lock( trace->write_lock_ );
+      written = writev( trace->fd_, parts, 2 );
+    }
+    if ( written == expected ) {
+      trace->chunks_.fetch_add( 1, std::memory_order_relaxed );
+      trace->records_.fetch_add( buffer->records, std::memory_order_relaxed );
+      trace->bytes_.fetch_add( (Size)written, std::memory_order_relaxed );
+    } else {
+      trace->write_errors_.fetch_add( 1, std::memory_order_relaxed );
+    }
+  }
+  buffer->used = 0;
+  buffer->records = 0;
+  buffer->object = 0;
+  buffer->ptr = 0;
+  buffer->arg = 0;
+}
+
+CallTrace::ThreadBufferOwner::~ThreadBufferOwner() {
+  thread_exited_ = true;
+  CallTraceBuffer * buffer = thread_buffer_;
+  if ( !buffer ) return;
+  thread_buffer_ = nullptr;
+  Flush( buffer );
+  DeleteAligned( buffer );
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    CALL_TRACE_IMPL_PROTECT_SIGNATURE_J4XR7BW2PL9NCE
+#endif  // CALL_TRACE_IMPL_PROTECT_SIGNATURE_J4XR7BW2PL9NCE
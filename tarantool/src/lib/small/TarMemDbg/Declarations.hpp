@@ -32,6 +32,32 @@
 
 #   define TARMEMDBG_REUSE_EPOCHS 1 ///< Если 0, то старые эпохи удаляются, если 1 - то переиспользуются
 #   define TARMEMDBG_REUSE_LAZY_CLEAN 1 ///< Если 0, то зачистка lsregion_gc проводится сразу после дампа, если 1 - то только перед удалением/переиспользованием эпохи
+#   define TARMEMDBG_EPOCH_QUEUE_DEPTH 4 ///< Сколько эпох хранит очередь по умолчанию (текущая + на чтение + недоступные). Переопределяется переменной окружения TARARAM_EPOCH_QUEUE_DEPTH или slab_arena_set_epoch_queue_depth
+#   define TARMEMDBG_SAMPLE_ROTATIONS 1 ///< Защищается в среднем один из N сдвигов эпох, 1 - все, 0 - ни один. Переопределяется переменной окружения TARARAM_SAMPLE_ROTATIONS
+#   define TARMEMDBG_SAMPLE_ARENAS 1 ///< Эпохи сдвигает одна из N арен, остальные работают как обычный lsregion. Переопределяется переменной окружения TARARAM_SAMPLE_ARENAS
+#   define TARMEMDBG_ASYNC_PROTECTION 0 ///< Если 1, то смена защиты и удаление старых эпох при сдвиге выполняются фоновым потоком (можно переключить в рантайме)
+#   define TARMEMDBG_EPOCH_POOL_SIZE 4 ///< Сколько готовых эпох держит EpochPool, 0 - эпохи создаются прямо при сдвиге. Переопределяется переменной окружения TARARAM_EPOCH_POOL_SIZE
+#   define TARMEMDBG_QUARANTINE_RELEASE 0 ///< Как отдавать ядру физическую память недоступных эпох: 0 - никак, 1 - MADV_DONTNEED, 2 - MADV_FREE. Переопределяется переменной окружения TARARAM_QUARANTINE_RELEASE
+#   define TARMEMDBG_EPOCH_WINDOW_SIZE ( Size(1) << 30 ) ///< Если не 0, то каждая эпоха заранее резервирует непрерывное окно адресов такого размера и берёт slab'ы из него. Тогда защита эпохи - один mprotect на занятую часть окна
+#   define TARMEMDBG_SLAB_GUARDS 0 ///< Если 1, то последняя страница каждого slab'а из окна эпохи запрещена, и lsregion получает slab на страницу меньше. Переопределяется переменной окружения TARARAM_SLAB_GUARDS
+#   define TARMEMDBG_SLAB_GUARD_BATCH 16 ///< Для скольких следующих slab'ов окна запрещённые страницы расставляются за раз
+#   define TARMEMDBG_LARGE_BLOCK_GUARD_PAGES 1 ///< Сколько запрещённых страниц стоит за каждым большим slab'ом lsregion'а эпохи
+#   define TARMEMDBG_LARGE_BLOCK_POOL_SIZE ( Size(64) << 20 ) ///< Сколько байт освобождённых больших блоков держится для переиспользования вместо munmap
+#   define TARMEMDBG_METADATA_POOL 1 ///< Если 1, то страницы под очереди, эпохи, их slab_arena и lsregion берутся из MetadataPagePool, если 0 - memalign'ом из кучи
+#   define TARMEMDBG_METADATA_CHUNK_SIZE ( Size(1) << 20 ) ///< Какими кусками MetadataPagePool отображает память
+#   define TARMEMDBG_REDZONE_SIZE 0 ///< Сколько байт канарейки добавляется за каждой аллокацией lsregion_alloc/lsregion_aligned_alloc, 0 - нисколько. Переопределяется переменной окружения TARARAM_REDZONE
+#   define TARMEMDBG_REDZONE_ABORT 1 ///< Если 1, то испорченная канарейка после сообщения в stderr вызывает abort()
+#   define TARMEMDBG_MEMPOOL_QUARANTINE 0 ///< Сколько байт освобождённых объектов держит карантин каждого mempool'а (т.е. каждого класса размеров small_alloc), 0 - карантина нет. Переопределяется переменной окружения TARARAM_MEMPOOL_QUARANTINE
+#   define TARMEMDBG_MEMPOOL_QUARANTINE_ABORT 1 ///< Если 1, то объект, испорченный в карантине, после сообщения в stderr вызывает abort()
+#   define TARMEMDBG_REGION_GENERATIONS 0 ///< Slab'ы скольких последних region_truncate/region_free держит каждый region, прежде чем вернуть их в slab_cache, 0 - сразу. Переопределяется переменной окружения TARARAM_REGION_GENERATIONS
+#   define TARMEMDBG_REGION_QUARANTINE_ABORT 1 ///< Если 1, то slab region'а, испорченный в карантине, после сообщения в stderr вызывает abort()
+#   define TARMEMDBG_BUFFER_QUARANTINE 0 ///< Сколько байт slab'ов ibuf/obuf держит карантин каждого потока, 0 - карантина нет. Переопределяется переменной окружения TARARAM_BUFFER_QUARANTINE
+#   define TARMEMDBG_BUFFER_QUARANTINE_ABORT 1 ///< Если 1, то slab буфера, испорченный в карантине, после сообщения в stderr вызывает abort()
+#   define TARMEMDBG_ALLOCATION_SAMPLE_BYTES 0 ///< Сколько байт lsregion_alloc/mempool_alloc в среднем приходится на одно запомненное место аллокации, 0 - места не запоминаются. Переопределяется переменной окружения TARARAM_ALLOCATION_SAMPLE_BYTES
+#   define TARMEMDBG_MEMORY_DEBUG 1 ///< Если 0, то обёртки slab_arena и lsregion сразу зовут *_orig текущей эпохи, пока отладку не включат slab_arena_set_memory_debug. Переопределяется переменной окружения TARARAM_MEMORY_DEBUG
+#   define TARMEMDBG_EVENT_TRACE_RINGS 64 ///< Сколько потоков могут писать в трейс событий аллокаторов, по кольцу на поток. Путь к файлу трейса берётся из переменной окружения TARARAM_EVENT_TRACE
+#   define TARMEMDBG_EVENT_TRACE_RING_EVENTS 8192 ///< Событий в кольце одного потока, степень двойки
+#   define TARMEMDBG_CALL_TRACE_BUFFER_BYTES 65536 ///< Размер буфера записи вызовов одного потока, он же наибольший кусок файла. Путь к файлу записи берётся из переменной окружения TARARAM_CALL_TRACE
 
 namespace      TARMEMDBG_NAMESPACE {
 
@@ -49,6 +75,12 @@ enum ProtectMemoryConstant : Size {
 # endif
 };
 
+enum QuarantineRelease : int {
+  kReleaseNone = 0,      ///< недоступные эпохи держат всю свою физическую память
+  kReleaseDontNeed = 1,  ///< MADV_DONTNEED: память отдаётся сразу
+  kReleaseFree = 2,      ///< MADV_FREE: ядро заберёт память, когда она ему понадобится
+};
+
 static inline bool IsAlignedToMemoryPage( void * ptr, Size page_size ) noexcept;
 static inline bool IsAlignedToMemoryPage( Size checked_size, Size page_size ) noexcept;
 
@@ -56,11 +88,19 @@ void ProtectMemoryOrDie(
     void * aligned_start, 
     Size aligned_byte_size, 
     ProtectMemoryConstant protection );
+static inline Size ProtectWholePagesInside( void * start, Size byte_size, ProtectMemoryConstant protection ) noexcept;
+static inline void * ReserveAlignedWindow( Size byte_size, Size alignment, bool shared ) noexcept;
+static inline void * MapGuardedBlock( Size body_byte_size, Size guard_byte_size ) noexcept;
+static inline void UnmapMemory( void * aligned_start, Size aligned_byte_size ) noexcept;
+static inline bool ReleasePhysicalMemory( void * aligned_start, Size aligned_byte_size, QuarantineRelease mode ) noexcept;
+static inline Size CountResidentBytes( void * aligned_start, Size aligned_byte_size ) noexcept;
 template <typename Tn, typename ... Args> void Construct( Tn & to_construct, Args &&... args );
 template <typename Tn> void Destruct( Tn & to_destruct );
 static inline void * AllocateAligned( Size byte_size, Size alignment ) noexcept;
 static inline void DeallocateAlignedUnsafe( void * to_free ) noexcept;
 static inline void DeallocateAligned( void * to_free ) noexcept;
+static inline void * AllocateMetadataPages( Size byte_size ) noexcept;
+static inline void DeallocateMetadataPages( void * pages, Size byte_size ) noexcept;
 template <typename Tn, typename... Args> Tn * NewAligned( Args && ... args );
 template <typename Tn> Tn * NewAlignedInPages();
 template <typename Tn> void DeleteAligned( Tn * to_free );
@@ -69,10 +109,41 @@ template <typename Tn> void Delete( Tn * to_free );
 
 // основной код
 
-template <typename TypeTn, Size BufferSizeTn> class SlidingWindow;
+template <typename TypeTn> class SlidingWindowDefaultOnDelete;
+template <typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn = SlidingWindowDefaultOnDelete<TypeTn> > class SlidingWindow;
+class MetadataPagePool;
+struct MemoryRange;
+class ProtectionPlan;
 struct LargeMemoryBlock;
-class MemoryEpochInterface;
+struct LargeBlockHeader;
+struct SlabGuardStats;
+struct RedzoneStats;
+class RedzoneTable;
+struct QuarantineStats;
+class QuarantineCounters;
+class MempoolQuarantine;
+class RegionQuarantine;
+class BufferQuarantine;
+struct AllocationSiteStats;
+struct AllocationSiteUsage;
+class AllocationSites;
+class EpochSiteTable;
+class LargeBlockOwnerScope;
+class LargeBlockPool;
+class MemoryEpochCommon;
+template <typename DerivedTn> class MemoryEpochInterface;
 class MemoryEpochLsRegion;
+typedef MemoryEpochLsRegion MemoryEpoch; ///< вид эпох, с которыми работают очереди, выбирается при компиляции
+struct PerfCost;
+struct PerfCounters;
+struct AddressIndexEntry;
+class AddressIndex;
+class SamplingConfig;
+class RotationSampler;
+class RotationJob;
+class EpochProtector;
+class EpochPool;
+struct EpochPoolStats;
 template <typename Tn> inline Size CalculateSizeInPages( Size page_size ) noexcept;
 template <typename Tn> Tn * AllocateWithForbiddenPageAtStart( 
     Size & out_allocated_size,
@@ -80,6 +151,8 @@ template <typename Tn> Tn * AllocateWithForbiddenPageAtStart(
 void DeallocateWithForbiddenPageAtStart( void * to_free, Size allocated_size ) noexcept;
 
 template <typename TypeTn> class SlidingWindowEpochOnDelete;
+class MemoryEpochQueue;
+class QueueRegistry;
 class Type;
 
 } // namespace TARMEMDBG_NAMESPACE
@@ -0,0 +1,86 @@
+/**
+ ** @file EntryPoints.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий переключение обёрток slab_arena и lsregion между отладчиком и *_orig на лету
+ ** \~russian @details Обёртки берут таблицу отладочных точек входа одним атомарным чтением. Пока отладка выключена,
+ **                    таблицы нет, и обёртка сразу уходит в *_orig текущей эпохи, так что одна сборка с TARARAM
+ **                    годится и для работы, и для отладки
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    ENTRY_POINTS_PROTECT_SIGNATURE_W5KB1QX8NF3JTD
+#define    ENTRY_POINTS_PROTECT_SIGNATURE_W5KB1QX8NF3JTD
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Отладочные реализации обёрток. Аргументы те же, что у обёрток, то есть хэндлы очередей эпох.
+ **        Аллокации получают ещё и кадр обёртки, с которого начинается стек места аллокации
+ **/
+struct DebugEntryPoints {
+  void * ( *slab_map )( slab_arena * arena );
+  void   ( *slab_unmap )( slab_arena * arena, void * ptr );
+  void * ( *lsregion_aligned_reserve_slow )( lsregion * handle, size_t size, size_t alignment, void ** unaligned );
+  void * ( *lsregion_aligned_reserve )( lsregion * handle, size_t size, size_t alignment, void ** unaligned );
+  void * ( *lsregion_reserve )( lsregion * handle, size_t size );
+  void * ( *lsregion_alloc )( lsregion * handle, size_t size, int64_t id, const void * frame );
+  void * ( *lsregion_aligned_alloc )( lsregion * handle, size_t size, size_t alignment, int64_t id, const void * frame );
+  void   ( *lsregion_gc )( lsregion * handle, int64_t min_id );
+};
+
+struct EntryPointStats {
+  bool enabled = false;
+  Size switches = 0; ///< сколько раз отладку включали или выключали
+};
+
+/**
+ ** @brief Текущая таблица точек входа: записывающая вызовы, отладочная или никакой
+ ** @details Переключение - одна атомарная запись. Пока открыта запись вызовов (CallTrace), обёртки идут
+ **          в записывающую таблицу, а она - в отладочную, если отладка включена, или в *_orig.
+ **          Так выключенная запись не стоит обёрткам ничего сверх чтения таблицы. Поток, уже вошедший в отладочную обёртку, её дорабатывает,
+ **          поэтому обе реализации должны уживаться на одной очереди. Для этого выключенная отладка
+ **          продолжает работать в текущей эпохе очереди: новых эпох не появляется, а lsregion_gc
+ **          освобождает текущую эпоху на месте, как несэмплированный сдвиг эпох
+ **/
+class EntryPoints {
+ public:
+  /// nullptr - отладка выключена и вызовы не записываются
+  static const DebugEntryPoints * Get() noexcept { return table_.load( std::memory_order_acquire ); }
+  /// отладочная таблица, nullptr - отладка выключена. Для записывающей таблицы
+  static const DebugEntryPoints * GetDebug() noexcept { return debug_enabled_.load( std::memory_order_acquire ); }
+  /**
+   ** @brief запоминает таблицы и при первом вызове включает отладочную, если не запрещает TARARAM_MEMORY_DEBUG,
+   **        и записывающую, если TARARAM_CALL_TRACE открыл запись вызовов
+   **/
+  static void Init( const DebugEntryPoints * debug, const DebugEntryPoints * record ) noexcept;
+  /// @return прежнее состояние
+  static bool Set( bool enabled ) noexcept;
+  /// включает или выключает записывающую таблицу после открытия или закрытия CallTrace
+  static void UpdateRecording() noexcept;
+  static EntryPointStats GetStats() noexcept;
+
+ protected:
+  static bool ReadFromEnvironment() noexcept;
+  /// публикует таблицу по текущему состоянию. Только под lock_
+  static void Publish() noexcept;
+
+ private:
+  static std::atomic<const DebugEntryPoints *> table_;
+  static const DebugEntryPoints * debug_;  ///< меняется только под lock_
+  static const DebugEntryPoints * record_; ///< меняется только под lock_
+  static std::atomic<const DebugEntryPoints *> debug_enabled_;
+  static std::atomic<Size> switches_;
+  static Mutex lock_;
+  static std::atomic<bool> initialized_; ///< Init уже опубликовал таблицы
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // ENTRY_POINTS_PROTECT_SIGNATURE_W5KB1QX8NF3JTD
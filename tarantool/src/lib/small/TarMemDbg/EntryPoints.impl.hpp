@@ -0,0 +1,82 @@
+/**
+ ** @file EntryPoints.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "переключения точек входа" EntryPoints.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    ENTRY_POINTS_IMPL_PROTECT_SIGNATURE_G7TC4MZ2HV9QXS
+
+namespace      TARMEMDBG_NAMESPACE {
+
+std::atomic<const DebugEntryPoints *> EntryPoints::table_ { nullptr };
+const DebugEntryPoints * EntryPoints::debug_ = nullptr;
+const DebugEntryPoints * EntryPoints::record_ = nullptr;
+std::atomic<const DebugEntryPoints *> EntryPoints::debug_enabled_ { nullptr };
+std::atomic<Size> EntryPoints::switches_ { 0 };
+Mutex EntryPoints::lock_;
+std::atomic<bool> EntryPoints::initialized_ { false };
+
+void EntryPoints::Init( const DebugEntryPoints * debug, const DebugEntryPoints * record ) noexcept {
+  assert( (bool)debug && (bool)record );
+  // зовётся из каждого slab_arena_create. Таблицы читаются через table_ и debug_enabled_, так что хватает relaxed
+  if ( initialized_.load( std::memory_order_relaxed ) ) return;
+  // открывает запись из TARARAM_CALL_TRACE, чтобы Publish её увидел
+  CallTrace::Init();
+  LockGuard lock( lock_ );
+  if ( debug_ ) return;
+  debug_ = debug;
+  record_ = record;
+  if ( ReadFromEnvironment() ) debug_enabled_.store( debug, std::memory_order_release );
+  Publish();
+  initialized_.store( true, std::memory_order_relaxed );
+}
+
+bool EntryPoints::Set( bool enabled ) noexcept {
+  LockGuard lock( lock_ );
+  assert( (bool)debug_ );
+  bool previous = debug_enabled_.load( std::memory_order_relaxed ) != nullptr;
+  if ( previous == enabled ) return previous;
+  debug_enabled_.store( enabled ? debug_ : nullptr, std::memory_order_release );
+  Publish();
+  switches_.fetch_add( 1, std::memory_order_relaxed );
+  return previous;
+}
+
+void EntryPoints::UpdateRecording() noexcept {
+  LockGuard lock( lock_ );
+  // до первого slab_arena_create таблиц ещё нет, Init опубликует
+  if ( debug_ ) Publish();
+}
+
+void EntryPoints::Publish() noexcept {
+  const DebugEntryPoints * table = CallTrace::IsOpen() ? record_ : debug_enabled_.load( std::memory_order_relaxed );
+  table_.store( table, std::memory_order_release );
+}
+
+EntryPointStats EntryPoints::GetStats() noexcept {
+  EntryPointStats ret;
+  ret.enabled = GetDebug() != nullptr;
+  ret.switches = switches_.load( std::memory_order_relaxed );
+  return ret;
+}
+
+bool EntryPoints::ReadFromEnvironment() noexcept {
+  int ret = TARMEMDBG_MEMORY_DEBUG != 0;
+  const char * from_env = getenv( "TARARAM_MEMORY_DEBUG" );
+  if ( from_env ) ParseEnvDigit<1>( from_env, ret );
+  return ret;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    ENTRY_POINTS_IMPL_PROTECT_SIGNATURE_G7TC4MZ2HV9QXS
+#endif  // ENTRY_POINTS_IMPL_PROTECT_SIGNATURE_G7TC4MZ2HV9QXS
@@ -0,0 +1,74 @@
+/**
+ ** @file EpochPool.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий пул заранее созданных эпох
+ ** \~russian @details MemoryEpochLsRegion::Create выделяет метаданные, резервирует окно адресов и создаёт
+ **                    арену и lsregion. Чтобы сдвиг эпох этим не занимался, эпохи создаются заранее
+ **                    потоком EpochProtector (когда у него нет работ) или явно, в простое
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    EPOCH_POOL_PROTECT_SIGNATURE_N5GA0TK8WQ3XJD
+#define    EPOCH_POOL_PROTECT_SIGNATURE_N5GA0TK8WQ3XJD
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct EpochPoolStats {
+  Size size = 0;   ///< сколько готовых эпох пул старается держать
+  Size ready = 0;  ///< готовые эпохи сейчас
+  Size taken = 0;  ///< эпохи, взятые из пула
+  Size missed = 0; ///< эпохи, которые пришлось создавать на месте, потому что пул был пуст
+  Size built = 0;  ///< эпохи, созданные заранее
+};
+
+/**
+ ** @brief Пул готовых эпох
+ ** @details Take отдаёт готовую эпоху, а если её нет - создаёт новую на месте. Когда готовых эпох становится
+ **          меньше GetSize(), EpochProtector получает просьбу пополнить пул и выполняет её, когда у него
+ **          нет работ по сдвигу эпох. Эпохи в пуле создаются с режимами (например, TARMEMDBG_SLAB_GUARDS),
+ **          действовавшими при их создании. Пул, как и MetadataPagePool, не разрушается
+ **/
+class EpochPool {
+ public:
+  static constexpr const Size kMaxSize = 16;
+
+  /// размер пула, при первом обращении читается из TARARAM_EPOCH_POOL_SIZE
+  static Size GetSize() noexcept { return size_.Get(); }
+  /// @return предыдущий размер. Лишние готовые эпохи удаляются
+  static Size SetSize( Size size ) noexcept;
+  static MemoryEpochLsRegion * Take() noexcept;
+  /**
+   ** @brief создаёт одну недостающую эпоху
+   ** @return true, если пул ещё не полон
+   **/
+  static bool RefillOne() noexcept;
+  /// создаёт все недостающие эпохи. @return число готовых эпох
+  static Size Refill() noexcept;
+  static EpochPoolStats GetStats() noexcept;
+
+ protected:
+  EpochPool() {}
+  DISALLOW_COPY_MOVE_AND_ASSIGN( EpochPool )
+  static EpochPool & GetInstance() noexcept;
+
+ private:
+  Mutex mutex_;
+  std::array< MemoryEpochLsRegion *, kMaxSize > ready_ {};
+  Size count_ = 0;
+  Size building_ = 0; ///< эпохи, которые сейчас создаются вне мьютекса
+  static EnvSetting<Size> size_;
+  static std::atomic<Size> taken_;
+  static std::atomic<Size> missed_;
+  static std::atomic<Size> built_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // EPOCH_POOL_PROTECT_SIGNATURE_N5GA0TK8WQ3XJD
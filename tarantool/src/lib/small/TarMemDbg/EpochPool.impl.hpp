@@ -0,0 +1,110 @@
+/**
+ ** @file EpochPool.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "пула готовых эпох" EpochPool.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    EPOCH_POOL_IMPL_PROTECT_SIGNATURE_C4YH9PZ2MB7RVE
+
+namespace      TARMEMDBG_NAMESPACE {
+
+EnvSetting<Size> EpochPool::size_ { "TARARAM_EPOCH_POOL_SIZE", TARMEMDBG_EPOCH_POOL_SIZE, ParseEnvSize, LimitSize<EpochPool::kMaxSize> };
+std::atomic<Size> EpochPool::taken_ { 0 };
+std::atomic<Size> EpochPool::missed_ { 0 };
+std::atomic<Size> EpochPool::built_ { 0 };
+
+EpochPool & EpochPool::GetInstance() noexcept {
+  // готовые эпохи берёт и создаёт EpochProtector, который может пережить любой глобальный объект
+  alignas( EpochPool ) static Byte storage[ sizeof( EpochPool ) ];
+  static EpochPool * instance = ::new ( storage ) EpochPool;
+  return *instance;
+}
+
+Size EpochPool::SetSize( Size size ) noexcept {
+  Size previous = size_.Set( size );
+  size = GetSize();
+  std::array< MemoryEpochLsRegion *, kMaxSize > extra {};
+  Size nextra = 0;
+  {
+    EpochPool & pool = GetInstance();
+    LockGuard lock( pool.mutex_ );
+    while ( pool.count_ > size ) extra[nextra++] = pool.ready_[--pool.count_];
+  }
+  for ( Size i = 0; i < nextra; ++i ) delete extra[i];
+  return previous;
+}
+
+MemoryEpochLsRegion * EpochPool::Take() noexcept {
+  MemoryEpochLsRegion * ret = nullptr;
+  bool refill = false;
+  {
+    EpochPool & pool = GetInstance();
+    LockGuard lock( pool.mutex_ );
+    if ( pool.count_ ) ret = pool.ready_[--pool.count_];
+    refill = pool.count_ + pool.building_ < GetSize();
+  }
+  if ( refill ) EpochProtector::GetInstance().RequestRefill();
+  if ( ret ) {
+    taken_.fetch_add( 1, std::memory_order_relaxed );
+    return ret;
+  }
+  missed_.fetch_add( 1, std::memory_order_relaxed );
+  return MemoryEpochLsRegion::Create();
+}
+
+bool EpochPool::RefillOne() noexcept {
+  EpochPool & pool = GetInstance();
+  {
+    LockGuard lock( pool.mutex_ );
+    if ( pool.count_ + pool.building_ >= GetSize() ) return false;
+    ++pool.building_;
+  }
+  // создание эпохи - несколько mmap'ов, его нельзя делать под мьютексом пула
+  MemoryEpochLsRegion * built = MemoryEpochLsRegion::Create();
+  built_.fetch_add( 1, std::memory_order_relaxed );
+  {
+    LockGuard lock( pool.mutex_ );
+    --pool.building_;
+    if ( pool.count_ < GetSize() ) {
+      pool.ready_[pool.count_++] = built;
+      built = nullptr;
+    }
+    if ( !built ) return pool.count_ + pool.building_ < GetSize();
+  }
+  // размер пула успели уменьшить
+  delete built;
+  return false;
+}
+
+Size EpochPool::Refill() noexcept {
+  while ( RefillOne() ) {}
+  EpochPool & pool = GetInstance();
+  LockGuard lock( pool.mutex_ );
+  return pool.count_;
+}
+
+EpochPoolStats EpochPool::GetStats() noexcept {
+  EpochPoolStats ret;
+  ret.size = GetSize();
+  ret.taken = taken_.load( std::memory_order_relaxed );
+  ret.missed = missed_.load( std::memory_order_relaxed );
+  ret.built = built_.load( std::memory_order_relaxed );
+  EpochPool & pool = GetInstance();
+  LockGuard lock( pool.mutex_ );
+  ret.ready = pool.count_;
+  return ret;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    EPOCH_POOL_IMPL_PROTECT_SIGNATURE_C4YH9PZ2MB7RVE
+#endif  // EPOCH_POOL_IMPL_PROTECT_SIGNATURE_C4YH9PZ2MB7RVE
@@ -0,0 +1,106 @@
+/**
+ ** @file EpochProtector.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий работу по сдвигу эпох и фоновый поток, который её выполняет
+ ** \~russian @details Сдвиг эпох записывает смены защиты, lsregion_gc и удаление эпох в RotationJob.
+ **                    В синхронном режиме работа выполняется сразу, в асинхронном - отдаётся
+ **                    потоку EpochProtector, а поток, вызвавший lsregion_gc, только переключает текущую эпоху
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    EPOCH_PROTECTOR_PROTECT_SIGNATURE_Q8VN2XK5T0LJ3M
+#define    EPOCH_PROTECTOR_PROTECT_SIGNATURE_Q8VN2XK5T0LJ3M
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Работа, накопленная за один сдвиг эпох. Шаги выполняются строго по порядку
+ **/
+class RotationJob {
+ public:
+  enum StepType { kStepProtect, kStepGc, kStepVerifyRedzones, kStepDestroy };
+  struct Step {
+    StepType type = kStepProtect;
+    MemoryEpoch * epoch = nullptr;
+    ProtectMemoryConstant protection = kProtectReadWrite; ///< для kStepProtect
+    int64_t gc_id = 0;                                     ///< для kStepGc
+  };
+  static constexpr const Size kMaxSteps = 8;
+
+  void Reset( MemoryEpochQueue * owner ) noexcept { owner_ = owner; nsteps_ = 0; }
+  void Protect( MemoryEpoch * epoch, ProtectMemoryConstant protection ) noexcept;
+  void Gc( MemoryEpoch * epoch, int64_t gc_id ) noexcept;
+  /// проверка канареек эпохи, переставшей быть текущей. Её redzone'ы после этого забываются
+  void VerifyRedzones( MemoryEpoch * epoch ) noexcept;
+  void Destroy( MemoryEpoch * epoch ) noexcept;
+  bool IsEmpty() const noexcept { return !nsteps_; }
+  /**
+   ** @brief выполняет все шаги и учитывает их стоимость (PerfCost) в очереди-владельце
+   **/
+  void Execute() noexcept;
+
+ private:
+  void Add( const Step & step ) noexcept;
+
+  MemoryEpochQueue * owner_ = nullptr;
+  std::array< Step, kMaxSteps > steps_;
+  Size nsteps_ = 0;
+};
+
+/**
+ ** @brief Фоновый поток, выполняющий RotationJob'ы всех очередей эпох по порядку их поступления
+ ** @details Очередь работ ограничена kCapacity, при переполнении Submit ждёт освобождения места.
+ **          Поток запускается при первой работе. Flush - барьер: ждёт выполнения всего,
+ **          что было отправлено до него (нужен тестам и синхронному режиму после асинхронного).
+ **          Когда работ нет, поток пополняет EpochPool, если его об этом попросили (в том числе в синхронном режиме)
+ **/
+class EpochProtector {
+ public:
+  static constexpr const Size kCapacity = 64;
+
+  static EpochProtector & GetInstance();
+  /// Flush, если поток уже создан и ещё не разрушен (безопасно вызывать из деструкторов глобальных объектов)
+  static void FlushIfAlive();
+  ~EpochProtector();
+
+  bool IsEnabled() const noexcept { return enabled_.load( std::memory_order_relaxed ); }
+  void SetEnabled( bool enabled ) noexcept;
+  void Submit( const RotationJob & job );
+  void Flush();
+  /// просит пополнить EpochPool, когда не будет работ. Запускает поток, если его ещё нет
+  void RequestRefill();
+  Size GetPending() const noexcept { return submitted_.load( std::memory_order_acquire ) - done_.load( std::memory_order_acquire ); }
+
+ protected:
+  EpochProtector() { alive_.store( true, std::memory_order_release ); }
+  DISALLOW_COPY_MOVE_AND_ASSIGN( EpochProtector )
+  void StartIfNeeded();
+  void Run();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::condition_variable drained_;
+  std::array< RotationJob, kCapacity > jobs_;
+  Size head_ = 0;  ///< следующая работа к выполнению
+  Size count_ = 0; ///< работ в очереди
+  std::atomic<Size> submitted_ { 0 };
+  std::atomic<Size> done_ { 0 };
+  std::atomic<bool> enabled_ { TARMEMDBG_ASYNC_PROTECTION != 0 };
+  bool stop_ = false;
+  bool refill_ = false; ///< EpochPool просил пополнения
+  static std::atomic<bool> alive_;
+  std::thread thread_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // EPOCH_PROTECTOR_PROTECT_SIGNATURE_Q8VN2XK5T0LJ3M
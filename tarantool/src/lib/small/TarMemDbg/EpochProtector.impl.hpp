@@ -0,0 +1,180 @@
+/**
+ ** @file EpochProtector.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "фонового потока защиты эпох" EpochProtector.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    EPOCH_PROTECTOR_IMPL_PROTECT_SIGNATURE_7RC1WZ4HMD0YEP
+
+namespace      TARMEMDBG_NAMESPACE {
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// RotationJob                                                               //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void RotationJob::Add( const Step & step ) noexcept {
+  assert( nsteps_ < kMaxSteps );
+  steps_[nsteps_++] = step;
+}
+
+void RotationJob::Protect( MemoryEpoch * epoch, ProtectMemoryConstant protection ) noexcept {
+  Step step;
+  step.type = kStepProtect;
+  step.epoch = epoch;
+  step.protection = protection;
+  Add( step );
+}
+
+void RotationJob::Gc( MemoryEpoch * epoch, int64_t gc_id ) noexcept {
+  Step step;
+  step.type = kStepGc;
+  step.epoch = epoch;
+  step.gc_id = gc_id;
+  Add( step );
+}
+
+void RotationJob::VerifyRedzones( MemoryEpoch * epoch ) noexcept {
+  Step step;
+  step.type = kStepVerifyRedzones;
+  step.epoch = epoch;
+  Add( step );
+}
+
+void RotationJob::Destroy( MemoryEpoch * epoch ) noexcept {
+  Step step;
+  step.type = kStepDestroy;
+  step.epoch = epoch;
+  Add( step );
+}
+
+void RotationJob::Execute() noexcept {
+  PerfCost cost;
+  for ( Size i = 0; i < nsteps_; ++i ) {
+    Step & step = steps_[i];
+    assert( (bool)step.epoch );
+    switch ( step.type ) {
+      case kStepProtect:
+        step.epoch->ProtectEpoch( step.protection, cost );
+        break;
+      case kStepGc:
+        step.epoch->GarbageCollect( step.gc_id, cost );
+        break;
+      case kStepVerifyRedzones:
+        step.epoch->VerifyRedzones( INT64_MAX, cost );
+        break;
+      case kStepDestroy:
+        // удалять можно только доступную на запись эпоху
+        if ( step.epoch->GetProtection() != kProtectReadWrite ) {
+          step.epoch->ProtectEpoch( kProtectReadWrite, cost );
+        }
+        delete step.epoch;
+        break;
+    }
+  }
+  nsteps_ = 0;
+  if ( owner_ ) owner_->AccountRotation( cost );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// EpochProtector                                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> EpochProtector::alive_ { false };
+
+EpochProtector & EpochProtector::GetInstance() {
+  static EpochProtector protector;
+  return protector;
+}
+
+void EpochProtector::FlushIfAlive() {
+  if ( alive_.load( std::memory_order_acquire ) ) GetInstance().Flush();
+}
+
+EpochProtector::~EpochProtector() {
+  alive_.store( false, std::memory_order_release );
+  {
+    std::unique_lock<std::mutex> lock( mutex_ );
+    stop_ = true;
+  }
+  not_empty_.notify_all();
+  if ( thread_.joinable() ) thread_.join();
+}
+
+void EpochProtector::SetEnabled( bool enabled ) noexcept {
+  enabled_.store( enabled, std::memory_order_relaxed );
+  // работы, отправленные до выключения, должны завершиться раньше синхронных
+  if ( !enabled ) Flush();
+}
+
+void EpochProtector::StartIfNeeded() {
+  if ( !thread_.joinable() ) thread_ = std::thread( [this] { Run(); } );
+}
+
+void EpochProtector::Submit( const RotationJob & job ) {
+  std::unique_lock<std::mutex> lock( mutex_ );
+  StartIfNeeded();
+  not_full_.wait( lock, [this] { return count_ < kCapacity; } );
+  jobs_[( head_ + count_ ) % kCapacity] = job;
+  ++count_;
+  submitted_.fetch_add( 1, std::memory_order_release );
+  not_empty_.notify_one();
+}
+
+void EpochProtector::Flush() {
+  std::unique_lock<std::mutex> lock( mutex_ );
+  Size target = submitted_.load( std::memory_order_acquire );
+  drained_.wait( lock, [this, target] { return done_.load( std::memory_order_acquire ) >= target; } );
+}
+
+void EpochProtector::RequestRefill() {
+  std::unique_lock<std::mutex> lock( mutex_ );
+  if ( stop_ ) return;
+  StartIfNeeded();
+  refill_ = true;
+  not_empty_.notify_one();
+}
+
+void EpochProtector::Run() {
+  std::unique_lock<std::mutex> lock( mutex_ );
+  while ( true ) {
+    not_empty_.wait( lock, [this] { return count_ || stop_ || refill_; } );
+    if ( !count_ && refill_ && !stop_ ) {
+      // по одной эпохе, чтобы сдвиги эпох не ждали всего пополнения
+      refill_ = false;
+      lock.unlock();
+      bool more = EpochPool::RefillOne();
+      lock.lock();
+      refill_ = refill_ || more;
+      continue;
+    }
+    // перед остановкой доделываем всё, что успели отправить
+    if ( !count_ ) return;
+    RotationJob job = jobs_[head_];
+    head_ = ( head_ + 1 ) % kCapacity;
+    --count_;
+    not_full_.notify_one();
+    lock.unlock();
+    job.Execute();
+    lock.lock();
+    done_.fetch_add( 1, std::memory_order_release );
+    drained_.notify_all();
+  }
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    EPOCH_PROTECTOR_IMPL_PROTECT_SIGNATURE_7RC1WZ4HMD0YEP
+#endif  // EPOCH_PROTECTOR_IMPL_PROTECT_SIGNATURE_7RC1WZ4HMD0YEP
@@ -0,0 +1,118 @@
+/**
+ ** @file EventTrace.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий трейс событий аллокаторов в разделяемом файле
+ ** \~russian @details slab_map/slab_unmap, разбиение и слияние slab'ов slab_cache, slab'ы mempool'ов, lsregion_gc
+ **                    и сдвиги эпох пишутся бинарными событиями фиксированного размера с меткой rdtsc.
+ **                    Формат файла (small_trace_header, small_trace_ring, small_trace_event) описан
+ **                    в slab_arena_internal.h, так что внешний читатель может отобразить файл и читать его
+ **                    на ходу, не останавливая процесс
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    EVENT_TRACE_PROTECT_SIGNATURE_H3QW6ZP1KM8TBV
+#define    EVENT_TRACE_PROTECT_SIGNATURE_H3QW6ZP1KM8TBV
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct EventTraceStats {
+  bool enabled = false;
+  Size ring_count = 0;
+  Size ring_capacity = 0;
+  Size rings_used = 0;
+  Size events = 0;  ///< записано во все кольца
+  Size dropped = 0; ///< потеряно потоками, которым не досталось кольца
+};
+
+/**
+ ** @brief Трейс событий аллокаторов: по кольцу на поток в файле, отображённом MAP_SHARED
+ ** @details Поток берёт кольцо при первом событии и пишет в него один, поэтому запись - это rdtsc,
+ **          32 байта в слот и release-запись head'а, без атомарных RMW и блокировок. Выключенный трейс
+ **          стоит двух relaxed-чтений. Кольца ушедших потоков не освобождаются. Закрытый трейс
+ **          остаётся отображённым до выхода процесса: поток мог уже взять его указатель и дописывать событие
+ **/
+class EventTrace {
+ public:
+  /**
+   ** @brief создаёт файл @a path и начинает в него писать, предыдущий трейс закрывается
+   ** @param ring_events событий в кольце, округляется вверх до степени двойки
+   ** @return false и errno при ошибке
+   **/
+  static bool Open( const char * path, Size ring_events, Size rings ) noexcept;
+  static void Close() noexcept;
+  static EventTraceStats GetStats() noexcept;
+
+  static void Record( small_trace_type type, const void * ptr, uint64_t arg, uint32_t aux ) noexcept {
+    EventTrace * trace = current_.load( std::memory_order_acquire );
+    if ( !trace ) {
+      if ( env_read_.load( std::memory_order_relaxed ) ) return;
+      trace = OpenFromEnv();
+      if ( !trace ) return;
+    }
+    small_trace_ring * ring = thread_trace_ == trace ? thread_ring_ : trace->ClaimRing();
+    if ( !ring ) {
+      dropped_.fetch_add( 1, std::memory_order_relaxed );
+      return;
+    }
+    uint64_t head = ring->head;
+    small_trace_event & event = trace->GetEvents( ring )[head & trace->mask_];
+    event.tsc = ReadTsc();
+    event.ptr = (uint64_t)(uintptr_t)ptr;
+    event.arg = arg;
+    event.aux = aux;
+    event.type = (uint16_t)type;
+    event.reserved = 0;
+    __atomic_store_n( &ring->head, head + 1, __ATOMIC_RELEASE );
+  }
+
+  static uint64_t ReadTsc() noexcept {
+#   if        defined(__x86_64__)
+    return __rdtsc();
+#   else   // defined(__x86_64__)
+    return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now().time_since_epoch() ).count();
+#   endif  // defined(__x86_64__)
+  }
+
+  EventTrace() {}
+
+ protected:
+  static constexpr const Size kRingHeaderBytes = SMALL_TRACE_ALIGN;
+  static_assert( sizeof( small_trace_header ) <= SMALL_TRACE_ALIGN, "trace header must fit into one block" );
+  static_assert( sizeof( small_trace_event ) == 32, "trace event layout changed" );
+
+  DISALLOW_COPY_MOVE_AND_ASSIGN( EventTrace )
+  static EventTrace * OpenFromEnv() noexcept;
+  /// Open под lock_
+  static bool OpenLocked( const char * path, Size ring_events, Size rings ) noexcept;
+  static uint64_t CalibrateTsc() noexcept;
+  [[gnu::noinline]] small_trace_ring * ClaimRing() noexcept;
+  small_trace_ring * GetRing( Size index ) const noexcept {
+    return (small_trace_ring *)( base_ + SMALL_TRACE_ALIGN + index * header_->ring_size );
+  }
+  small_trace_event * GetEvents( small_trace_ring * ring ) const noexcept {
+    return (small_trace_event *)( (Byte *)ring + kRingHeaderBytes );
+  }
+
+ private:
+  Byte * base_ = nullptr;
+  Size byte_size_ = 0;
+  small_trace_header * header_ = nullptr;
+  uint64_t mask_ = 0;
+  static std::atomic<EventTrace *> current_;
+  static std::atomic<bool> env_read_;
+  static std::atomic<Size> dropped_;
+  static thread_local EventTrace * thread_trace_;     ///< трейс, из которого взято кольцо потока
+  static thread_local small_trace_ring * thread_ring_; ///< nullptr - колец не хватило
+  static Mutex lock_;                                 ///< Open и Close
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // EVENT_TRACE_PROTECT_SIGNATURE_H3QW6ZP1KM8TBV
@@ -0,0 +1,140 @@
+/**
+ ** @file EventTrace.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "трейса событий аллокаторов" EventTrace.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    EVENT_TRACE_IMPL_PROTECT_SIGNATURE_B8NV2JX5RD4GLC
+
+namespace      TARMEMDBG_NAMESPACE {
+
+std::atomic<EventTrace *> EventTrace::current_ { nullptr };
+std::atomic<bool> EventTrace::env_read_ { false };
+std::atomic<Size> EventTrace::dropped_ { 0 };
+thread_local EventTrace * EventTrace::thread_trace_ = nullptr;
+thread_local small_trace_ring * EventTrace::thread_ring_ = nullptr;
+Mutex EventTrace::lock_;
+
+EventTrace * EventTrace::OpenFromEnv() noexcept {
+  {
+    LockGuard lock( lock_ );
+    if ( !env_read_.load( std::memory_order_relaxed ) ) {
+      const char * path = getenv( "TARARAM_EVENT_TRACE" );
+      env_read_.store( true, std::memory_order_relaxed );
+      if ( path && *path && !OpenLocked( path, TARMEMDBG_EVENT_TRACE_RING_EVENTS, TARMEMDBG_EVENT_TRACE_RINGS ) ) {
+        fprintf( stderr, "TaraRam: cannot open event trace %s: %s\n", path, strerror( errno ) );
+      }
+    }
+  }
+  return current_.load( std::memory_order_acquire );
+}
+
+bool EventTrace::Open( const char * path, Size ring_events, Size rings ) noexcept {
+  LockGuard lock( lock_ );
+  env_read_.store( true, std::memory_order_relaxed );
+  return OpenLocked( path, ring_events, rings );
+}
+
+bool EventTrace::OpenLocked( const char * path, Size ring_events, Size rings ) noexcept {
+  if ( !path || !ring_events || !rings || rings > UINT32_MAX || ring_events > ( Size(1) << 31 ) ) {
+    errno = EINVAL;
+    return false;
+  }
+  Size capacity = 1;
+  while ( capacity < ring_events ) capacity <<= 1;
+  Size ring_size = kRingHeaderBytes + capacity * sizeof( small_trace_event );
+  Size byte_size = SMALL_TRACE_ALIGN + rings * ring_size;
+  // новый файл, а не обрезанный старый: прежний трейс того же пути остаётся отображённым,
+  // и обрезка его inode дала бы SIGBUS или смесь двух трейсов
+  struct stat old_file;
+  if ( lstat( path, &old_file ) == 0 && S_ISREG( old_file.st_mode ) ) unlink( path );
+  int fd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+  if ( fd < 0 ) return false;
+  void * base = MAP_FAILED;
+  if ( !ftruncate( fd, (off_t)byte_size ) ) base = mmap( nullptr, byte_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  int saved_errno = errno;
+  close( fd );
+  EventTrace * trace = base != MAP_FAILED ? NewAligned<EventTrace>() : nullptr;
+  if ( !trace ) {
+    if ( base != MAP_FAILED ) munmap( base, byte_size );
+    errno = base != MAP_FAILED ? ENOMEM : saved_errno;
+    return false;
+  }
+  trace->base_ = (Byte *)base;
+  trace->byte_size_ = byte_size;
+  trace->mask_ = capacity - 1;
+  small_trace_header * header = trace->header_ = (small_trace_header *)base;
+  // файл только что создан и заполнен нулями, заполняется один заголовок
+  memcpy( header->magic, "SMTRACE", 8 );
+  header->version = SMALL_TRACE_VERSION;
+  header->event_size = sizeof( small_trace_event );
+  header->ring_count = (uint32_t)rings;
+  header->ring_capacity = (uint32_t)capacity;
+  header->ring_size = ring_size;
+  header->tsc_hz = CalibrateTsc();
+  header->start_tsc = ReadTsc();
+  header->start_realtime_ns = (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
+  header->pid = (uint32_t)getpid();
+  // прежний трейс не отображается обратно, см. описание класса
+  current_.store( trace, std::memory_order_release );
+  return true;
+}
+
+void EventTrace::Close() noexcept {
+  LockGuard lock( lock_ );
+  env_read_.store( true, std::memory_order_relaxed );
+  current_.store( nullptr, std::memory_order_release );
+}
+
+EventTraceStats EventTrace::GetStats() noexcept {
+  EventTraceStats ret;
+  ret.dropped = dropped_.load( std::memory_order_relaxed );
+  EventTrace * trace = current_.load( std::memory_order_acquire );
+  if ( !trace ) return ret;
+  const small_trace_header * header = trace->header_;
+  ret.enabled = true;
+  ret.ring_count = header->ring_count;
+  ret.ring_capacity = header->ring_capacity;
+  ret.rings_used = std::min( (Size)__atomic_load_n( &header->rings_used, __ATOMIC_RELAXED ), ret.ring_count );
+  for ( Size i = 0; i < ret.rings_used; ++i ) ret.events += __atomic_load_n( &trace->GetRing( i )->head, __ATOMIC_ACQUIRE );
+  return ret;
+}
+
+small_trace_ring * EventTrace::ClaimRing() noexcept {
+  thread_trace_ = this;
+  thread_ring_ = nullptr;
+  uint32_t index = __atomic_fetch_add( &header_->rings_used, 1, __ATOMIC_RELAXED );
+  if ( index >= header_->ring_count ) return nullptr;
+  small_trace_ring * ring = GetRing( index );
+  __atomic_store_n( &ring->tid, (uint32_t)syscall( SYS_gettid ), __ATOMIC_RELEASE );
+  thread_ring_ = ring;
+  return ring;
+}
+
+uint64_t EventTrace::CalibrateTsc() noexcept {
+#   if        defined(__x86_64__)
+  // частота TSC по стационарным часам, 10 мс дают точность лучше 0.1%
+  auto started = Clock::now();
+  uint64_t started_tsc = ReadTsc();
+  std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+  uint64_t elapsed_ns = ElapsedNs( started );
+  uint64_t elapsed_tsc = ReadTsc() - started_tsc;
+  return elapsed_ns ? (uint64_t)( (double)elapsed_tsc * 1e9 / (double)elapsed_ns ) : 0;
+#   else   // defined(__x86_64__)
+  return 1000000000;
+#   endif  // defined(__x86_64__)
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    EVENT_TRACE_IMPL_PROTECT_SIGNATURE_B8NV2JX5RD4GLC
+#endif  // EVENT_TRACE_IMPL_PROTECT_SIGNATURE_B8NV2JX5RD4GLC
@@ -0,0 +1,121 @@
+/**
+ ** @file HeapProfile.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий профиль живой памяти аллокаторов small в формате pprof
+ ** \~russian @details Профиль складывается из выбранных чанков AllocationSites, пересчитанных на всю выборку,
+ **                    и обхода самих аллокаторов: то, что выборка не покрыла, уходит в отдельный сэмпл
+ **                    "[unsampled ...]" аллокатора, так что сумма профиля совпадает с занятой памятью.
+ **                    Результат - profile.proto, сжатый gzip'ом, его понимают pprof и построители flame graph'ов
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    HEAP_PROFILE_PROTECT_SIGNATURE_N6TB1WK8QZ3FJD
+#define    HEAP_PROFILE_PROTECT_SIGNATURE_N6TB1WK8QZ3FJD
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Минимальная запись protobuf: varint'ы и поля с длиной, вложенные сообщения пишутся отдельным ProtoWriter'ом
+ **/
+class ProtoWriter {
+ public:
+  enum WireType : uint32_t { kVarint = 0, kLengthDelimited = 2 };
+
+  void Varint( uint64_t value );
+  void Uint( uint32_t field, uint64_t value ) { Tag( field, kVarint ); Varint( value ); }
+  void Int( uint32_t field, int64_t value ) { Uint( field, (uint64_t)value ); }
+  void Bytes( uint32_t field, const void * data, Size byte_size );
+  void String( uint32_t field, const std::string & value ) { Bytes( field, value.data(), value.size() ); }
+  void Message( uint32_t field, const ProtoWriter & message ) { Bytes( field, message.data_.data(), message.data_.size() ); }
+  void Packed( uint32_t field, const std::vector< uint64_t > & values );
+  const std::vector< Byte > & GetData() const noexcept { return data_; }
+
+ protected:
+  void Tag( uint32_t field, WireType type ) { Varint( ( (uint64_t)field << 3 ) | type ); }
+
+ private:
+  std::vector< Byte > data_;
+};
+
+/**
+ ** @brief Снимок живой памяти аллокаторов по местам аллокаций
+ ** @details Add* только складывают счётчики в таблицу сэмплов и вызываются потоком-владельцем аллокатора
+ **          (для эпох - под блокировкой очереди): обход занимает время, пропорциональное числу slab'ов
+ **          и выбранных чанков. Стеки, отображения /proc/self/maps, кодирование и сжатие делает Write,
+ **          и его можно звать из любого потока. Выбранный чанк размера s пересчитывается с весом
+ **          AllocationSites::GetSampleWeight при среднем расстоянии выборки на момент снимка
+ **/
+class HeapProfile {
+ public:
+  enum Allocator : uint8_t { kMempool, kRegion, kLsRegion, kAllocatorCount };
+
+  HeapProfile();
+  /// живые объекты @a pool
+  void AddMempool( struct mempool * pool );
+  /// живые чанки @a region, от начала до region_used()
+  void AddRegion( struct region * region );
+  /**
+   ** @brief живые чанки эпох очереди: текущей целиком и сданных эпох выше их min_id
+   ** @details Только под que->GetLock() после EpochProtector::FlushIfAlive(). Метаданные lsregion'а сданных эпох
+   **          закрыты, поэтому обход занятой памяти есть только у текущей эпохи
+   **/
+  void AddEpochs( MemoryEpochQueue * que );
+  /// @return false и errno при ошибке записи в @a fd
+  bool Write( int fd ) const;
+
+ protected:
+  /// site 0 - то, что выборка не покрыла
+  struct Key {
+    uint32_t site;
+    Allocator allocator;
+    Size objsize;   ///< размер объекта mempool'а, иначе 0
+    Size epoch_age; ///< возраст эпохи lsregion'а, иначе kNoEpoch
+
+    bool operator < ( const Key & other ) const noexcept {
+      return std::tie( site, allocator, objsize, epoch_age ) < std::tie( other.site, other.allocator, other.objsize, other.epoch_age );
+    }
+  };
+  struct Value {
+    double objects = 0;
+    double bytes = 0;
+  };
+
+  DISALLOW_COPY_MOVE_AND_ASSIGN( HeapProfile )
+  /// добавляет выбранный чанк и возвращает, сколько байт он представляет
+  double AddSample( const Key & key, Size byte_size );
+  /// остаток обхода аллокатора, не покрытый выборкой
+  void AddUnsampled( Key key, double objects, double bytes, const Value & estimated );
+  std::vector< Byte > Encode() const;
+  static const char * GetAllocatorName( Allocator allocator ) noexcept;
+
+ private:
+  static constexpr const Size kNoEpoch = SIZE_MAX;
+  Size sample_bytes_;  ///< среднее расстояние выборки на момент создания профиля, 0 - выборка выключена
+  int64_t time_nanos_;
+  std::map< Key, Value > samples_;
+};
+
+/**
+ ** @brief gzip без внешних зависимостей: deflate из несжатых блоков и CRC32
+ ** @details pprof ждёт gzip, но несжатые блоки deflate читает так же, как сжатые. Профиль в несколько
+ **          мегабайт не стоит того, чтобы тянуть zlib в отладчик
+ **/
+class Gzip {
+ public:
+  static std::vector< Byte > Store( const std::vector< Byte > & data );
+  static uint32_t Crc32( const Byte * data, Size byte_size ) noexcept;
+
+ protected:
+  static constexpr const Size kMaxStoredBlock = 65535;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // HEAP_PROFILE_PROTECT_SIGNATURE_N6TB1WK8QZ3FJD
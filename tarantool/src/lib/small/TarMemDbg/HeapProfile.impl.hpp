@@ -0,0 +1,315 @@
+/**
+ ** @file HeapProfile.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "профиля живой памяти" HeapProfile.hpp
+ ** \~russian @details Номера полей - из profile.proto pprof'а
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    HEAP_PROFILE_IMPL_PROTECT_SIGNATURE_R2XM7DC5LV9HSQ
+
+namespace      TARMEMDBG_NAMESPACE {
+
+void ProtoWriter::Varint( uint64_t value ) {
+  while ( value >= 0x80 ) {
+    data_.push_back( (Byte)( value | 0x80 ) );
+    value >>= 7;
+  }
+  data_.push_back( (Byte)value );
+}
+
+void ProtoWriter::Bytes( uint32_t field, const void * data, Size byte_size ) {
+  Tag( field, kLengthDelimited );
+  Varint( byte_size );
+  data_.insert( data_.end(), (const Byte *)data, (const Byte *)data + byte_size );
+}
+
+void ProtoWriter::Packed( uint32_t field, const std::vector< uint64_t > & values ) {
+  ProtoWriter packed;
+  for ( uint64_t value : values ) packed.Varint( value );
+  Message( field, packed );
+}
+
+HeapProfile::HeapProfile()
+    :  sample_bytes_( AllocationSites::GetSampleBytes() ),
+       time_nanos_( (int64_t)std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::system_clock::now().time_since_epoch() ).count() ) {
+}
+
+double HeapProfile::AddSample( const Key & key, Size byte_size ) {
+  double weight = AllocationSites::GetSampleWeight( byte_size, sample_bytes_ );
+  Value & value = samples_[key];
+  value.objects += weight;
+  value.bytes += weight * (double)byte_size;
+  return weight;
+}
+
+void HeapProfile::AddUnsampled( Key key, double objects, double bytes, const Value & estimated ) {
+  // оценка по выборке может оказаться и больше обхода, тогда остатка нет
+  key.site = 0;
+  Value rest;
+  rest.objects = std::max( objects - estimated.objects, 0.0 );
+  rest.bytes = std::max( bytes - estimated.bytes, 0.0 );
+  if ( rest.bytes < 0.5 ) return;
+  Value & value = samples_[key];
+  value.objects += rest.objects;
+  value.bytes += rest.bytes;
+}
+
+void HeapProfile::AddMempool( struct mempool * pool ) {
+  Key key { 0, kMempool, pool->objsize, kNoEpoch };
+  Value estimated;
+  if ( sample_bytes_ ) {
+    AllocationSites::ForEachMempoolSample( pool, [&]( uint32_t site ) {
+      key.site = site;
+      double weight = AddSample( key, pool->objsize );
+      estimated.objects += weight;
+      estimated.bytes += weight * pool->objsize;
+    } );
+  }
+  Size used = pool->slabs.stats.used;
+  AddUnsampled( key, (double)( used / pool->objsize ), (double)used, estimated );
+}
+
+void HeapProfile::AddRegion( struct region * region ) {
+  Key key { 0, kRegion, 0, kNoEpoch };
+  Value estimated;
+  const RegionSiteTable * table = RegionSiteTable::Get( region );
+  if ( sample_bytes_ && table ) {
+    table->ForEach( [&]( uint32_t site, Size byte_size ) {
+      key.site = site;
+      double weight = AddSample( key, byte_size );
+      estimated.objects += weight;
+      estimated.bytes += weight * byte_size;
+    } );
+  }
+  // чанки region'а не считаются, только байты
+  AddUnsampled( key, estimated.objects, (double)region->slabs.stats.used, estimated );
+}
+
+void HeapProfile::AddEpochs( MemoryEpochQueue * que ) {
+  que->ForEachEpoch( [&]( MemoryEpoch * epoch, Size age, Size ) {
+    Key key { 0, kLsRegion, 0, age };
+    Value estimated;
+    // сданная эпоха помнит и освобождённые lsregion_gc_orig чанки, их id не выше её min_id
+    int64_t retired_id = epoch->GetRetiredId();
+    if ( sample_bytes_ ) {
+      epoch->GetSites().ForEach( [&]( uint32_t site, Size byte_size, int64_t id ) {
+        if ( age && id <= retired_id ) return;
+        key.site = site;
+        double weight = AddSample( key, byte_size );
+        estimated.objects += weight;
+        estimated.bytes += weight * byte_size;
+      } );
+    }
+    if ( !age ) AddUnsampled( key, estimated.objects, (double)lsregion_used_orig( que->GetLsRegionFast() ), estimated );
+  } );
+}
+
+const char * HeapProfile::GetAllocatorName( Allocator allocator ) noexcept {
+  switch ( allocator ) {
+    case kMempool: return "mempool";
+    case kRegion: return "region";
+    case kLsRegion: return "lsregion";
+    default: return "unknown";
+  }
+}
+
+std::vector< Byte > HeapProfile::Encode() const {
+  ProtoWriter profile;
+  std::vector< std::string > strings { "" };
+  std::map< std::string, int64_t > string_ids { { "", 0 } };
+  auto intern = [&]( const std::string & value ) {
+    auto found = string_ids.find( value );
+    if ( found != string_ids.end() ) return found->second;
+    strings.push_back( value );
+    return string_ids[value] = (int64_t)strings.size() - 1;
+  };
+  auto value_type = [&]( uint32_t field, const char * type, const char * unit ) {
+    ProtoWriter message;
+    message.Int( 1, intern( type ) );
+    message.Int( 2, intern( unit ) );
+    profile.Message( field, message );
+  };
+  value_type( 1, "inuse_objects", "count" );
+  value_type( 1, "inuse_space", "bytes" );
+
+  // исполняемые отображения: по ним pprof находит бинарник и символизирует адреса
+  struct Mapping {
+    uintptr_t start;
+    uintptr_t limit;
+    uintptr_t offset;
+    std::string filename;
+  };
+  std::vector< Mapping > mappings;
+  if ( FILE * maps = fopen( "/proc/self/maps", "r" ) ) {
+    char line[4096];
+    while ( fgets( line, sizeof( line ), maps ) ) {
+      unsigned long start = 0, limit = 0, offset = 0;
+      char perms[5] = {};
+      int path_at = 0;
+      if ( sscanf( line, "%lx-%lx %4s %lx %*s %*s %n", &start, &limit, perms, &offset, &path_at ) < 4 || !path_at ) continue;
+      std::string filename( line + path_at );
+      while ( !filename.empty() && ( filename.back() == '\n' || filename.back() == ' ' ) ) filename.pop_back();
+      if ( perms[2] != 'x' || filename.empty() || filename[0] != '/' ) continue;
+      mappings.push_back( Mapping { start, limit, offset, filename } );
+    }
+    fclose( maps );
+  }
+  for ( Size i = 0; i < mappings.size(); ++i ) {
+    ProtoWriter message;
+    message.Uint( 1, i + 1 );
+    message.Uint( 2, mappings[i].start );
+    message.Uint( 3, mappings[i].limit );
+    message.Uint( 4, mappings[i].offset );
+    message.Int( 5, intern( mappings[i].filename ) );
+    profile.Message( 3, message );
+  }
+
+  // адрес возврата указывает за инструкцию вызова, а место аллокации - сам вызов
+  std::map< uintptr_t, uint64_t > address_locations;
+  std::map< std::string, uint64_t > named_locations;
+  uint64_t next_location = 1;
+  auto address_location = [&]( uintptr_t address ) {
+    auto found = address_locations.find( address );
+    if ( found != address_locations.end() ) return found->second;
+    ProtoWriter message;
+    message.Uint( 1, next_location );
+    for ( Size i = 0; i < mappings.size(); ++i ) {
+      if ( address >= mappings[i].start && address < mappings[i].limit ) message.Uint( 2, i + 1 );
+    }
+    message.Uint( 3, address );
+    profile.Message( 4, message );
+    return address_locations[address] = next_location++;
+  };
+  // место без стека показывается одним кадром с функцией-названием
+  auto named_location = [&]( const std::string & name ) {
+    auto found = named_locations.find( name );
+    if ( found != named_locations.end() ) return found->second;
+    uint64_t id = next_location++;
+    ProtoWriter function;
+    function.Uint( 1, id );
+    function.Int( 2, intern( name ) );
+    function.Int( 3, intern( name ) );
+    profile.Message( 5, function );
+    ProtoWriter line;
+    line.Uint( 1, id );
+    ProtoWriter message;
+    message.Uint( 1, id );
+    message.Message( 4, line );
+    profile.Message( 4, message );
+    return named_locations[name] = id;
+  };
+
+  for ( const auto & entry : samples_ ) {
+    const Key & key = entry.first;
+    int64_t objects = (int64_t)std::llround( entry.second.objects );
+    int64_t bytes = (int64_t)std::llround( entry.second.bytes );
+    if ( !objects && !bytes ) continue;
+    std::vector< uint64_t > location_ids;
+    AllocationSiteInfo info;
+    if ( key.site && AllocationSites::GetSite( key.site, info ) ) {
+      for ( Size i = 0; i < info.depth; ++i ) location_ids.push_back( address_location( info.frames[i] - 1 ) );
+    }
+    if ( location_ids.empty() ) {
+      std::string name = key.site ? "[" + std::string( GetAllocatorName( key.allocator ) ) + " site " + std::to_string( key.site ) + "]"
+                                  : "[unsampled " + std::string( GetAllocatorName( key.allocator ) ) + "]";
+      location_ids.push_back( named_location( name ) );
+    }
+    ProtoWriter sample;
+    sample.Packed( 1, location_ids );
+    sample.Packed( 2, { (uint64_t)objects, (uint64_t)bytes } );
+    ProtoWriter allocator;
+    allocator.Int( 1, intern( "allocator" ) );
+    allocator.Int( 2, intern( GetAllocatorName( key.allocator ) ) );
+    sample.Message( 3, allocator );
+    if ( key.objsize ) {
+      ProtoWriter objsize;
+      objsize.Int( 1, intern( "bytes" ) );
+      objsize.Int( 3, (int64_t)key.objsize );
+      sample.Message( 3, objsize );
+    }
+    if ( key.epoch_age != kNoEpoch ) {
+      ProtoWriter epoch_age;
+      epoch_age.Int( 1, intern( "epoch_age" ) );
+      epoch_age.Int( 3, (int64_t)key.epoch_age );
+      sample.Message( 3, epoch_age );
+    }
+    profile.Message( 2, sample );
+  }
+
+  profile.Int( 9, time_nanos_ );
+  value_type( 11, "space", "bytes" );
+  profile.Int( 12, (int64_t)sample_bytes_ );
+  profile.Int( 13, intern( "TaraRam heap profile, sample_bytes=" + std::to_string( sample_bytes_ ) ) );
+  profile.Int( 14, intern( "inuse_space" ) );
+  // таблица строк пишется последней: в неё попадают строки всех полей выше
+  for ( const std::string & value : strings ) profile.String( 6, value );
+  return profile.GetData();
+}
+
+bool HeapProfile::Write( int fd ) const {
+  std::vector< Byte > data = Gzip::Store( Encode() );
+  const Byte * at = data.data();
+  Size left = data.size();
+  while ( left ) {
+    ssize_t written = write( fd, at, left );
+    if ( written < 0 ) {
+      if ( errno == EINTR ) continue;
+      return false;
+    }
+    at += written;
+    left -= (Size)written;
+  }
+  return true;
+}
+
+std::vector< Byte > Gzip::Store( const std::vector< Byte > & data ) {
+  // заголовок: сигнатура, deflate, без флагов и времени, ОС - unix
+  std::vector< Byte > ret { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+  ret.reserve( ret.size() + data.size() + ( data.size() / kMaxStoredBlock + 1 ) * 5 + 8 );
+  Size offset = 0;
+  do {
+    Size length = std::min( data.size() - offset, kMaxStoredBlock );
+    bool last = offset + length == data.size();
+    // BFINAL и BTYPE 00 (без сжатия), затем LEN и NLEN
+    ret.push_back( last ? 1 : 0 );
+    ret.push_back( (Byte)length );
+    ret.push_back( (Byte)( length >> 8 ) );
+    ret.push_back( (Byte)~length );
+    ret.push_back( (Byte)( ~length >> 8 ) );
+    ret.insert( ret.end(), data.begin() + offset, data.begin() + offset + length );
+    offset += length;
+  } while ( offset < data.size() );
+  uint32_t trailer[2] = { Crc32( data.data(), data.size() ), (uint32_t)data.size() };
+  for ( uint32_t value : trailer ) {
+    for ( int shift = 0; shift < 32; shift += 8 ) ret.push_back( (Byte)( value >> shift ) );
+  }
+  return ret;
+}
+
+uint32_t Gzip::Crc32( const Byte * data, Size byte_size ) noexcept {
+  static const std::array< uint32_t, 256 > table = [] {
+    std::array< uint32_t, 256 > ret {};
+    for ( uint32_t i = 0; i < 256; ++i ) {
+      uint32_t crc = i;
+      for ( int bit = 0; bit < 8; ++bit ) crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xEDB88320u : crc >> 1;
+      ret[i] = crc;
+    }
+    return ret;
+  }();
+  uint32_t crc = 0xFFFFFFFFu;
+  for ( Size i = 0; i < byte_size; ++i ) crc = table[( crc ^ data[i] ) & 0xFF] ^ ( crc >> 8 );
+  return ~crc;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    HEAP_PROFILE_IMPL_PROTECT_SIGNATURE_R2XM7DC5LV9HSQ
+#endif  // HEAP_PROFILE_IMPL_PROTECT_SIGNATURE_R2XM7DC5LV9HSQ
@@ -0,0 +1,74 @@
+/**
+ ** @file LargeBlockPool.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий пул отображений под большие slab'ы lsregion'ов эпох
+ ** \~russian @details Большой slab эпохи - отдельное отображение с запрещёнными страницами в конце.
+ **                    Освобождённые отображения не отдаются munmap'у сразу, а ждут следующего
+ **                    большого slab'а подходящего размера, чтобы не платить за mmap/mprotect/munmap
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    LARGE_BLOCK_POOL_PROTECT_SIGNATURE_W3ZK8D0QH5NVRA
+#define    LARGE_BLOCK_POOL_PROTECT_SIGNATURE_W3ZK8D0QH5NVRA
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct LargeBlockPoolStats {
+  Size live_blocks = 0;   ///< блоки, выданные эпохам и ещё не возвращённые
+  Size live_bytes = 0;    ///< их тела (без запрещённых страниц)
+  Size cached_blocks = 0; ///< блоки в пуле
+  Size cached_bytes = 0;
+  Size mapped = 0;        ///< сколько раз понадобился новый mmap
+  Size reused = 0;        ///< сколько раз блок взят из пула
+  Size unmapped = 0;      ///< сколько раз блок не поместился в пул и отдан munmap'у
+};
+
+/**
+ ** @brief Пул отображений с запрещёнными страницами в конце
+ ** @details Блок берётся из пула, если его тело не меньше запрошенного и не больше чем вдвое.
+ **          Тела блоков в пуле открыты на чтение и запись, запрещённые страницы остаются запрещёнными.
+ **          Эпохи возвращают блоки из lsregion_gc_orig, в том числе из потока EpochProtector, 
+ **          поэтому пул под мьютексом
+ **/
+class LargeBlockPool {
+ public:
+  static constexpr const Size kCapacity = 32;
+
+  /// @return блок с address == nullptr, если памяти нет
+  static LargeMemoryBlock Acquire( Size body_byte_size, Size guard_byte_size ) noexcept;
+  /// тело блока должно быть открыто на чтение и запись
+  static void Release( const LargeMemoryBlock & block ) noexcept;
+  static LargeBlockPoolStats GetStats() noexcept;
+  ~LargeBlockPool();
+
+ protected:
+  LargeBlockPool() { alive_.store( true, std::memory_order_release ); }
+  DISALLOW_COPY_MOVE_AND_ASSIGN( LargeBlockPool )
+  static LargeBlockPool & GetInstance();
+  bool Take( Size body_byte_size, Size guard_byte_size, LargeMemoryBlock & out ) noexcept;
+  bool Put( const LargeMemoryBlock & block ) noexcept;
+  static void Unmap( const LargeMemoryBlock & block ) noexcept;
+
+ private:
+  Mutex mutex_;
+  std::array< LargeMemoryBlock, kCapacity > cached_;
+  Size count_ = 0;
+  Size cached_bytes_ = 0;
+  static std::atomic<bool> alive_; ///< после разрушения пула блоки сразу отдаются munmap'у
+  static std::atomic<Size> live_blocks_;
+  static std::atomic<Size> live_bytes_;
+  static std::atomic<Size> mapped_;
+  static std::atomic<Size> reused_;
+  static std::atomic<Size> unmapped_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // LARGE_BLOCK_POOL_PROTECT_SIGNATURE_W3ZK8D0QH5NVRA
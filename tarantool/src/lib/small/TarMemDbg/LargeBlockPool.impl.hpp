@@ -0,0 +1,113 @@
+/**
+ ** @file LargeBlockPool.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "пула больших блоков" LargeBlockPool.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    LARGE_BLOCK_POOL_IMPL_PROTECT_SIGNATURE_5RJX1CM8YV2FQT
+
+namespace      TARMEMDBG_NAMESPACE {
+
+std::atomic<bool> LargeBlockPool::alive_ { false };
+std::atomic<Size> LargeBlockPool::live_blocks_ { 0 };
+std::atomic<Size> LargeBlockPool::live_bytes_ { 0 };
+std::atomic<Size> LargeBlockPool::mapped_ { 0 };
+std::atomic<Size> LargeBlockPool::reused_ { 0 };
+std::atomic<Size> LargeBlockPool::unmapped_ { 0 };
+
+LargeBlockPool & LargeBlockPool::GetInstance() {
+  static LargeBlockPool instance;
+  return instance;
+}
+
+LargeBlockPool::~LargeBlockPool() {
+  alive_.store( false, std::memory_order_release );
+  LockGuard lock( mutex_ );
+  for ( Size i = 0; i < count_; ++i ) Unmap( cached_[i] );
+  count_ = 0;
+  cached_bytes_ = 0;
+}
+
+LargeMemoryBlock LargeBlockPool::Acquire( Size body_byte_size, Size guard_byte_size ) noexcept {
+  LargeMemoryBlock ret;
+  if ( GetInstance().Take( body_byte_size, guard_byte_size, ret ) ) {
+    reused_.fetch_add( 1, std::memory_order_relaxed );
+  } else {
+    void * address = MapGuardedBlock( body_byte_size, guard_byte_size );
+    if ( !address ) return LargeMemoryBlock();
+    ret = LargeMemoryBlock( address, body_byte_size );
+    ret.guard_bytesize = guard_byte_size;
+    mapped_.fetch_add( 1, std::memory_order_relaxed );
+  }
+  live_blocks_.fetch_add( 1, std::memory_order_relaxed );
+  live_bytes_.fetch_add( ret.allocated_bytesize, std::memory_order_relaxed );
+  return ret;
+}
+
+void LargeBlockPool::Release( const LargeMemoryBlock & block ) noexcept {
+  assert( (bool)block.address );
+  live_blocks_.fetch_sub( 1, std::memory_order_relaxed );
+  live_bytes_.fetch_sub( block.allocated_bytesize, std::memory_order_relaxed );
+  if ( alive_.load( std::memory_order_acquire ) && GetInstance().Put( block ) ) return;
+  unmapped_.fetch_add( 1, std::memory_order_relaxed );
+  Unmap( block );
+}
+
+bool LargeBlockPool::Take( Size body_byte_size, Size guard_byte_size, LargeMemoryBlock & out ) noexcept {
+  LockGuard lock( mutex_ );
+  Size best = count_;
+  for ( Size i = 0; i < count_; ++i ) {
+    const LargeMemoryBlock & cached = cached_[i];
+    if ( cached.guard_bytesize != guard_byte_size ) continue;
+    if ( cached.allocated_bytesize < body_byte_size || cached.allocated_bytesize / 2 > body_byte_size ) continue;
+    if ( best == count_ || cached.allocated_bytesize < cached_[best].allocated_bytesize ) best = i;
+  }
+  if ( best == count_ ) return false;
+  out = cached_[best];
+  cached_bytes_ -= out.allocated_bytesize;
+  cached_[best] = cached_[--count_];
+  return true;
+}
+
+bool LargeBlockPool::Put( const LargeMemoryBlock & block ) noexcept {
+  LockGuard lock( mutex_ );
+  if ( count_ == kCapacity ) return false;
+  if ( cached_bytes_ + block.allocated_bytesize > TARMEMDBG_LARGE_BLOCK_POOL_SIZE ) return false;
+  cached_[count_++] = block;
+  cached_bytes_ += block.allocated_bytesize;
+  return true;
+}
+
+void LargeBlockPool::Unmap( const LargeMemoryBlock & block ) noexcept {
+  UnmapMemory( block.address, block.allocated_bytesize + block.guard_bytesize );
+}
+
+LargeBlockPoolStats LargeBlockPool::GetStats() noexcept {
+  LargeBlockPoolStats ret;
+  ret.live_blocks = live_blocks_.load( std::memory_order_relaxed );
+  ret.live_bytes = live_bytes_.load( std::memory_order_relaxed );
+  ret.mapped = mapped_.load( std::memory_order_relaxed );
+  ret.reused = reused_.load( std::memory_order_relaxed );
+  ret.unmapped = unmapped_.load( std::memory_order_relaxed );
+  if ( alive_.load( std::memory_order_acquire ) ) {
+    LargeBlockPool & pool = GetInstance();
+    LockGuard lock( pool.mutex_ );
+    ret.cached_blocks = pool.count_;
+    ret.cached_bytes = pool.cached_bytes_;
+  }
+  return ret;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    LARGE_BLOCK_POOL_IMPL_PROTECT_SIGNATURE_5RJX1CM8YV2FQT
+#endif  // LARGE_BLOCK_POOL_IMPL_PROTECT_SIGNATURE_5RJX1CM8YV2FQT
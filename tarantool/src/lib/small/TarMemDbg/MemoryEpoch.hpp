@@ -23,9 +23,12 @@ namespace      TARMEMDBG_NAMESPACE {
  ** @brief Структура, созданная для контроля больших блоков (хранения информации о них). 
  ** @details Small в некоторых случаях выделяет память malloc'ом, минуя lsregion и другие аллокаторы
  **        если этого не учитывать, то такая память "выпадет" из схемы изоляции эпох и изолирована
- **        не будет
+ **        не будет. Для lsregion'а эпохи большой slab - отдельное отображение 
+ **        [ тело | TARMEMDBG_LARGE_BLOCK_GUARD_PAGES запрещённых страниц ], slab прижат к концу тела,
+ **        так что выход за его конец сразу вызывает segfault
  **/
 struct LargeMemoryBlock {
+  LargeMemoryBlock() {}
   LargeMemoryBlock( void * address_val, Size alloc_size_val )
       :  address( address_val ),
          allocated_bytesize( alloc_size_val ) {             
@@ -36,69 +39,230 @@ struct LargeMemoryBlock {
   inline void Check( Size page_size ) noexcept;
 
   void * address = nullptr;
-  Size allocated_bytesize = 0;
+  Size allocated_bytesize = 0; ///< тело блока, его защита меняется вместе с эпохой
+  Size guard_bytesize = 0;     ///< запрещённые страницы за телом, всегда PROT_NONE
+  void * slab = nullptr;       ///< lslab внутри тела, перед ним LargeBlockHeader
+};
+
+/**
+ ** @brief Лежит непосредственно перед большим slab'ом. По нему lsregion_large_slab_free 
+ **        за O(1) находит блок в LMBStorage эпохи
+ **/
+struct LargeBlockHeader {
+  static constexpr const uint64_t kSignature = 0xDEADBEEFc0ffee1b; // мёртвое мясо кофе 1b
+  static constexpr const Size kSlabAlignment = 16;
+
+  static LargeBlockHeader * FromSlab( void * slab ) noexcept { return (LargeBlockHeader *)slab - 1; }
+
+  uint64_t signature;
+  MemoryEpoch * owner;
+  Size index; ///< позиция блока в LMBStorage владельца
 };
     
-class MemoryEpochInterface {
+/**
+ ** @brief Цена режима запрещённых страниц за slab'ами (см. TARMEMDBG_SLAB_GUARDS)
+ **/
+struct SlabGuardStats {
+  bool enabled = false;
+  Size guard_pages = 0;      ///< расставленные сейчас запрещённые страницы
+  Size guard_bytes = 0;      ///< адресное пространство под ними, недоступное lsregion'у
+  Size mprotect_calls = 0;   ///< вызовы mprotect на расстановку и восстановление после открытия эпохи на запись
+  Size split_huge_pages = 0; ///< 2 МБ области с запрещённой страницей: их нельзя отобразить одной большой страницей (одной записью TLB)
+};
+
+/**
+ ** @brief Общая часть эпох, не зависящая от их вида: счётчики, redzone'ы, окно арены, режимы и сбор плана защиты
+ ** @details Удалять эпоху можно только через её настоящий тип, поэтому деструктор защищён
+ **/
+class MemoryEpochCommon {
  public:
   typedef std::vector< LargeMemoryBlock > LMBStorage;
 
-  virtual ~MemoryEpochInterface() { signature_ = 0; }
-  
-  void operator delete( void * ptr ) noexcept;
+  void operator delete( void * ptr, std::size_t byte_size ) noexcept;
+
+  /// запоминает redzone аллокации из текущей эпохи (см. RedzoneTable::Add)
+  void AddRedzone( Byte * redzone, Size byte_size, int64_t id ) noexcept { redzones_.Add( redzone, byte_size, id ); }
+  /**
+   ** @brief проверяет канарейки всех redzone'ов эпохи и забывает redzone'ы аллокаций с id <= @a forget_id
+   ** @return число испорченных
+   **/
+  Size VerifyRedzones( int64_t forget_id, PerfCost & cost ) noexcept;
+  bool HasRedzones() const noexcept { return !redzones_.IsEmpty(); }
+  /// запоминает место выбранной аллокации из текущей эпохи (см. AllocationSites::Sample)
+  void AddSite( Byte * chunk, Size byte_size, Size redzone_size, uint32_t site, int64_t id ) noexcept { 
+    sites_.Add( chunk, byte_size, redzone_size, site, id ); 
+  }
+  /// забывает места чанков с id <= @a forget_id, когда их память может быть выдана снова
+  void ForgetSites( int64_t forget_id ) noexcept { if ( !sites_.IsEmpty() ) sites_.Forget( forget_id ); }
+  const EpochSiteTable & GetSites() const noexcept { return sites_; }
+  const PerfCounters & GetCounters() const noexcept { return counters_; }
 
-  slab_arena * GetArena() noexcept { return GetArena_(); }
-  lsregion * GetLsRegion() noexcept { return GetLsRegion_(); }
-  void * AllocateLargeMemoryBlock( Size byte_size ) noexcept { return AllocateLargeMemoryBlock_( byte_size ); }
-  void ProtectEpoch( ProtectMemoryConstant protect_type ) noexcept { ProtectEpoch_( protect_type ); }
+  /// режим освобождения физической памяти недоступных эпох, при первом обращении читается из TARARAM_QUARANTINE_RELEASE
+  static QuarantineRelease GetQuarantineRelease() noexcept { return (QuarantineRelease)quarantine_release_.Get(); }
+  /// @return предыдущий режим
+  static QuarantineRelease SetQuarantineRelease( QuarantineRelease mode ) noexcept {
+    return (QuarantineRelease)quarantine_release_.Set( mode );
+  }
+  /// сколько байт всего отдано ядру за всё время
+  static Size GetReleasedBytesTotal() noexcept { return released_bytes_total_.load( std::memory_order_relaxed ); }
+  /// режим запрещённых страниц за slab'ами, при первом обращении читается из TARARAM_SLAB_GUARDS
+  static bool GetSlabGuards() noexcept { return slab_guards_mode_.Get(); }
+  /// действует на арены эпох, созданные после вызова. @return предыдущий режим
+  static bool SetSlabGuards( bool enabled ) noexcept { return slab_guards_mode_.Set( enabled ); }
+  static SlabGuardStats GetSlabGuardStats() noexcept;
 
-  template <typename DerivedTn>  static MemoryEpochInterface * AllocateDerived() noexcept;
-  //static slab_arena * GetArenaByHandle( void * handle ) noexcept;
-  //static lsregion * GetLsRegionByHandle( void * handle ) noexcept;
+  template <typename DerivedTn>  static DerivedTn * AllocateDerived() noexcept;
   bool CheckIfThisIsReallyMemoryEpoch() { return signature_ == kSignature; }
+  /// id из lsregion_gc, на котором эпоха перестала быть текущей. С ним вызывается lsregion_gc_orig перед её переиспользованием
+  int64_t GetRetiredId() const noexcept { return retired_id_; }
+  void SetRetiredId( int64_t id ) noexcept { retired_id_ = id; }
+  /// окно адресов арены (зарезервированное или prealloc), пустое, если окна нет. 
+  /// Копия, чтобы не читать метаданные арены, когда они защищены
+  const MemoryRange & GetWindow() const noexcept { return window_; }
+  Size GetSlabSize() const noexcept { return slab_size_; }
+  /// очередь, в которой эпоха стала текущей. Её блокировка и учёт slab'ов вне окна нужны хуку lsregion_slab_mapped
+  MemoryEpochQueue * GetQueue() const noexcept { return queue_; }
+  void SetQueue( MemoryEpochQueue * queue ) noexcept { queue_ = queue; }
+  static bool IsSlabInsideWindow( const slab_arena * arena, const void * slab ) noexcept;
 
 
  protected:
-  virtual slab_arena * GetArena_() = 0;
-  virtual lsregion * GetLsRegion_() = 0;
-  virtual void * AllocateLargeMemoryBlock_( Size byte_size ) = 0;
-  virtual void ProtectEpoch_( ProtectMemoryConstant protect_type ) = 0;
-
-  //static MemoryEpochInterface * GetSelfByHandle( void * handle ) noexcept;
-  //static void * GetHandle( MemoryEpochInterface * self ) noexcept;
-  static void ProtectArena( 
+  ~MemoryEpochCommon() { signature_ = 0; }
+
+  static void AccountSlabGuards( Size pages, Size split_huge_pages, Size calls, bool placed ) noexcept;
+  static void AccountReleased( Size byte_size ) noexcept { released_bytes_total_.fetch_add( byte_size, std::memory_order_relaxed ); }
+
+  // Сбор диапазонов памяти в план защиты. Память должна быть доступна на чтение.
+  // В @a bodies попадают slab'ы без первой страницы: заголовки slab'ов (звенья списков lsregion'а 
+  // и кэша арены) нужны lsregion_gc_orig при переиспользовании, а остальную память можно отдать ядру
+  static bool IsArenaInsideWindow( const slab_arena * arena ) noexcept;
+  static void AddSlabBody( ProtectionPlan * bodies, void * slab, Size slab_size );
+  static void CollectArena( 
       slab_arena * arena, 
-      ProtectMemoryConstant protect_type );
-  static void ProtectLsRegion(
+      ProtectionPlan & plan,
+      ProtectionPlan * bodies = nullptr );
+  static void CollectLsRegion(
       lsregion * lsallocator, 
-      ProtectMemoryConstant protect_type );
+      ProtectionPlan & plan,
+      ProtectionPlan * bodies = nullptr );
       
-  static void ProtectLsRegionCache(
+  static void CollectLsRegionCache(
       lsregion * lsallocator, 
-      ProtectMemoryConstant protect_type );
-  static void ProtectLsRegionSlabs(
+      ProtectionPlan & plan,
+      ProtectionPlan * bodies = nullptr );
+  static void CollectLsRegionSlabs(
       lsregion * lsallocator, 
-      ProtectMemoryConstant protect_type );
-  static void ProtectRlistOfLslabs(
-      rlist * head, 
-      Size page_size,
-      Size lslab_size,
-      ProtectMemoryConstant protect_type );
-  static void ProtectLargeMemoryBlocks( 
+      ProtectionPlan & plan,
+      ProtectionPlan * bodies = nullptr );
+  static void CollectLargeMemoryBlocks( 
       LMBStorage & large_blocks, 
-      ProtectMemoryConstant protect_type );
+      ProtectionPlan & plan,
+      ProtectionPlan * bodies = nullptr );
   static void DeallocateLargeMemoryBlocks( LMBStorage & large_blocks ) noexcept;
+  /// запоминает окно и размер slab'а арены, вызывается после её (пере)инициализации
+  void RememberArenaLayout( const slab_arena * arena ) noexcept;
+
+  PerfCounters counters_;
 
  private:
+  static EnvSetting<int> quarantine_release_;
+  static EnvSetting<int> slab_guards_mode_;
+  static std::atomic<Size> slab_guard_pages_;
+  static std::atomic<Size> slab_guard_split_huge_pages_;
+  static std::atomic<Size> slab_guard_calls_;
+  static std::atomic<Size> released_bytes_total_;
   static constexpr const uint64_t kSignature = 0xDEADBEEFc0ffee72; // мёртвое мясо кофе 72
   volatile uint64_t signature_ = kSignature;
-  //Size page_size_ = PageSize::kInitialPageSize;
+  int64_t retired_id_ = 0;
+  MemoryEpochQueue * queue_ = nullptr;
+  MemoryRange window_;
+  Size slab_size_ = 0;
+  RedzoneTable redzones_; ///< заполняется, только пока эпоха текущая
+  EpochSiteTable sites_;  ///< заполняется, пока эпоха текущая, и помнится, пока её память не выдана снова
+};
+
+/**
+ ** @brief Интерфейс эпохи, разрешаемый при компиляции (CRTP)
+ ** @tparam DerivedTn вид эпохи. Реализует методы с подчёркиванием в конце (GetArena_ и т. д.) 
+ **         и объявляет MemoryEpochInterface<DerivedTn> другом
+ ** @details Вид эпох выбирается при компиляции (см. MemoryEpoch), поэтому вызовы методов эпохи 
+ **          на пути аллокации встраиваются, а у эпохи нет таблицы виртуальных функций
+ **/
+template <typename DerivedTn>
+class MemoryEpochInterface : public MemoryEpochCommon {
+ public:
+  typedef DerivedTn Derived;
+
+  slab_arena * GetArena() noexcept { return Self().GetArena_(); }
+  lsregion * GetLsRegion() noexcept { return Self().GetLsRegion_(); }
+  /**
+   ** @brief большой slab lsregion'а эпохи размером @a byte_size (см. LargeMemoryBlock)
+   ** @return nullptr, если памяти нет
+   **/
+  void * AllocateLargeMemoryBlock( Size byte_size ) noexcept { return Self().AllocateLargeMemoryBlock_( byte_size ); }
+  /// возвращает большой slab в пул. Эпоха должна быть открыта на запись
+  void DeallocateLargeMemoryBlock( void * slab ) noexcept { Self().DeallocateLargeMemoryBlock_( slab ); }
+  /**
+   ** @brief меняет защиту всей памяти эпохи
+   ** @return число сделанных системных вызовов mprotect
+   **/
+  Size ProtectEpoch( ProtectMemoryConstant protect_type ) noexcept;
+  /// то же с учётом времени в @a cost
+  Size ProtectEpoch( ProtectMemoryConstant protect_type, PerfCost & cost ) noexcept;
+  /// lsregion_gc_orig с учётом времени в счётчиках эпохи и в @a cost
+  void GarbageCollect( int64_t min_id, PerfCost & cost ) noexcept;
+  /// сколько slab'ов выдала арена эпохи. Для недоступной эпохи - на момент, когда она стала только для чтения
+  Size GetMappedSlabs() noexcept { return Self().GetMappedSlabs_(); }
+  ProtectMemoryConstant GetProtection() noexcept { return Self().GetProtection_(); }
+  /**
+   ** @brief память недоступной эпохи: адресное пространство и то, что из него в физической памяти
+   ** @return 0, если эпоха доступна
+   **/
+  Size GetQuarantinedBytes( Size & resident ) noexcept { return Self().GetQuarantinedBytes_( resident ); }
+  /**
+   ** @brief размер нового slab'а для lsregion'а эпохи. В режиме запрещённых страниц - на страницу меньше 
+   **        slab'а арены, а страницы за следующими slab'ами окна при необходимости расставляются
+   **/
+  Size GetUsableSlabSize() noexcept { return Self().GetUsableSlabSize_(); }
+
+ protected:
+  MemoryEpochInterface() {}
+  ~MemoryEpochInterface() {}
+  Derived & Self() noexcept { return *static_cast< Derived * >( this ); }
+};
+
+/**
+ ** @brief Пока жив объект, большие slab'ы lsregion'а эпохи @a owner выделяет и освобождает сама эпоха
+ ** @details small вызывает lsregion_large_slab_alloc/free, зная только lsregion. Все вызовы *_orig 
+ **          функций на lsregion'е эпохи, которые могут выделить или освободить большой slab, 
+ **          должны идти под этим объектом. Для чужих lsregion'ов остаются malloc и free
+ **/
+class LargeBlockOwnerScope {
+ public:
+  explicit LargeBlockOwnerScope( MemoryEpoch * owner ) noexcept 
+      :  previous_( owner_ ) {
+    owner_ = owner;
+  }
+  ~LargeBlockOwnerScope() { owner_ = previous_; }
+  /// эпоха, которой принадлежит @a region, или nullptr
+  static MemoryEpoch * GetOwner( const lsregion * region ) noexcept;
+
+ private:
+  DISALLOW_COPY_MOVE_AND_ASSIGN( LargeBlockOwnerScope )
+  MemoryEpoch * previous_;
+  static thread_local MemoryEpoch * owner_;
 };
 
-class MemoryEpochLsRegion : public MemoryEpochInterface {
+class MemoryEpochLsRegion : public MemoryEpochInterface< MemoryEpochLsRegion > {
  public:
   static MemoryEpochLsRegion * Create();
   ~MemoryEpochLsRegion() noexcept;
+  /**
+   ** @brief (пере)инициализирует арену эпохи. Вызывается до первой аллокации из эпохи
+   ** @details При ненулевом TARMEMDBG_EPOCH_WINDOW_SIZE и нулевом @a prealloc арена получает 
+   **          заранее зарезервированное окно адресов, и все её slab'ы лежат подряд
+   **/
+  int InitArena( quota * quota_value, Size prealloc, uint32_t slab_size, int flags ) noexcept;
 
 
  protected:
@@ -108,16 +272,37 @@ class MemoryEpochLsRegion : public MemoryEpochInterface {
          lsregion_( nullptr ) {              
   }
 
-  virtual slab_arena * GetArena_() override { return arena_; }
-  virtual lsregion * GetLsRegion_() override { return lsregion_; }
-  virtual void * AllocateLargeMemoryBlock_( [[maybe_unused]] Size byte_size ) override { assert(false); return nullptr; }
-  void operator delete( void * ptr ) noexcept;
-  virtual void ProtectEpoch_( ProtectMemoryConstant protect_type ) override;
+  friend class MemoryEpochInterface< MemoryEpochLsRegion >;
+  slab_arena * GetArena_() noexcept { return arena_; }
+  lsregion * GetLsRegion_() noexcept { return lsregion_; }
+  void * AllocateLargeMemoryBlock_( Size byte_size ) noexcept;
+  void DeallocateLargeMemoryBlock_( void * slab ) noexcept;
+  Size ProtectEpoch_( ProtectMemoryConstant protect_type ) noexcept;
+  ProtectMemoryConstant GetProtection_() noexcept { return protection_; }
+  Size GetQuarantinedBytes_( Size & resident ) noexcept;
+  Size GetMappedSlabs_() noexcept;
+  Size GetUsableSlabSize_() noexcept;
+  /**
+   ** @brief запрещает последние страницы slab'ов окна в [ @a from, @a to ) (смещения от начала окна)
+   ** @param[in] restore восстановление после открытия окна на запись (в статистике страниц не учитывается)
+   ** @return число вызовов mprotect
+   **/
+  Size PlaceSlabGuards( Size from, Size to, bool restore ) noexcept;
+  /// убирает из статистики страницы окна, которое сейчас будет освобождено
+  void DropSlabGuards() noexcept;
+  Size CountGuardHugePages( Size from, Size to ) const noexcept;
 
   private:
+   static constexpr const Size kHugePageSize = Size(2) << 20;
    slab_arena * arena_;
    lsregion * lsregion_;
-   LMBStorage large_blocks_;
+   LMBStorage large_blocks_; ///< большие slab'ы lsregion'а, удаление за O(1) по LargeBlockHeader::index
+   ProtectionPlan plan_; ///< собирается при первой защите после записи, сбрасывается при открытии на запись
+   ProtectionPlan bodies_; ///< тела slab'ов из plan_, их память отдаётся ядру, когда эпоха становится недоступной
+   ProtectMemoryConstant protection_ = kProtectReadWrite;
+   Size mapped_slabs_ = 0; ///< запоминается при сборке plan_, пока метаданные арены доступны
+   bool slab_guards_ = false; ///< режим выбирается при (пере)инициализации арены и не меняется до её разрушения
+   Size guarded_byte_size_ = 0; ///< начало окна, в котором страницы за slab'ами уже запрещены
 };
 
 } // namespace TARMEMDBG_NAMESPACE
@@ -25,7 +25,7 @@ namespace      TARMEMDBG_NAMESPACE {
 
 template <typename Tn> inline Size 
 CalculateSizeInPages( Size page_size )  noexcept {
-  return ( sizeof(Tn) - 1 + page_size ) & ( page_size - 1 );
+  return ( sizeof(Tn) - 1 + page_size ) & ~( page_size - 1 );
 }
 
 /**
@@ -39,7 +39,7 @@ template <typename Tn> Tn * AllocateWithForbiddenPageAtStart(
   out_page_size = PageSize()();
   // выделяем память размером в байтах, кратно страницам. добавляем одну страница перед объектом
   out_allocated_size = (   CalculateSizeInPages<Tn>( out_page_size )   ) + out_page_size;
-  Byte * start_block_address = (Byte *)AllocateAligned( out_allocated_size, out_page_size );
+  Byte * start_block_address = (Byte *)AllocateMetadataPages( out_allocated_size );
   if ( start_block_address == nullptr ) return nullptr;
   assert( (bool)out_page_size );
   assert( (bool)out_allocated_size );
@@ -56,7 +56,8 @@ void DeallocateWithForbiddenPageAtStart( void * to_free, Size allocated_size ) n
   // если не заданы специальные макро-ключи, ничего не удаляем. Блок висит в памяти запрещённым
   // и отлавливает повторное обращение к нему
 # if ( defined(TARMEMDBG_DELETE_EPOCHS_OBJECTS) || defined(TARMEMDBG_DELETE_ALL) )
-  DeallocateAligned( address_of_block );  
+  ProtectMemoryOrDie( address_of_block, allocated_size, kProtectReadWrite );
+  DeallocateMetadataPages( address_of_block, allocated_size );  
 # endif  
 }
 
@@ -74,7 +75,7 @@ void LargeMemoryBlock::Protect( ProtectMemoryConstant protect_type ) {
 void LargeMemoryBlock::Deallocate() noexcept {
   Size page_size = PageSize()();
   Check( page_size );
-  DeallocateAligned( address );
+  LargeBlockPool::Release( *this );
 }
 void LargeMemoryBlock::Check( [[maybe_unused]] Size page_size ) noexcept {
   assert(   ( (intptr_t)address % page_size ) == 0 );
@@ -83,116 +84,199 @@ void LargeMemoryBlock::Check( [[maybe_unused]] Size page_size ) noexcept {
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
-// MemoryEpochInterface                                                      //
+// LargeBlockOwnerScope                                                      //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-//slab_arena * MemoryEpochInterface::GetArenaByHandle( void * handle ) noexcept {
+thread_local MemoryEpoch * LargeBlockOwnerScope::owner_ = nullptr;
+
+MemoryEpoch * LargeBlockOwnerScope::GetOwner( const lsregion * region ) noexcept {
+  MemoryEpoch * owner = owner_;
+  if ( !owner || owner->GetLsRegion() != region ) return nullptr;
+  return owner;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// MemoryEpochCommon                                                         //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+//slab_arena * MemoryEpochCommon::GetArenaByHandle( void * handle ) noexcept {
 //  return GetSelfByHandle( handle )->GetArena_();
 //}
-//lsregion * MemoryEpochInterface::GetLsRegionByHandle( void * handle ) noexcept {    
+//lsregion * MemoryEpochCommon::GetLsRegionByHandle( void * handle ) noexcept {    
 //  return GetSelfByHandle( handle )->GetLsRegion_();
 //}
 
-template <typename DerivedTn> MemoryEpochInterface * 
-MemoryEpochInterface::AllocateDerived() noexcept {
-  static_assert( std::is_base_of< MemoryEpochInterface, DerivedTn>::value, "Template argument must be inherited from MemoryEpochInterface" );
-  Size allocated_bytes = 0, page_size = PageSize::kInitialPageSize;
-  auto ret = (DerivedTn *)AllocateAligned( allocated_bytes, page_size );
+template <typename DerivedTn> DerivedTn * 
+MemoryEpochCommon::AllocateDerived() noexcept {
+  static_assert( std::is_base_of< MemoryEpochCommon, DerivedTn>::value, "Template argument must be inherited from MemoryEpochCommon" );
+  Size page_size = PageSize()();
+  Size allocated_bytes = CalculateSizeInPages<DerivedTn>( page_size );
+  auto ret = (DerivedTn *)AllocateMetadataPages( allocated_bytes );
   assert( (bool)ret );
   return ret;
 }
 
-//MemoryEpochInterface * MemoryEpochInterface::GetSelfByHandle( void * handle ) noexcept {
-//  return (MemoryEpochInterface *)( reinterpret_cast<Byte *>(handle) + PageSize()() );
+//MemoryEpochCommon * MemoryEpochCommon::GetSelfByHandle( void * handle ) noexcept {
+//  return (MemoryEpochCommon *)( reinterpret_cast<Byte *>(handle) + PageSize()() );
 //}
-//void * MemoryEpochInterface::GetHandle( MemoryEpochInterface * self ) noexcept {
+//void * MemoryEpochCommon::GetHandle( MemoryEpochCommon * self ) noexcept {
 //  return (void *)( reinterpret_cast<Byte *>(self) - PageSize()() );
 //}
 
-void MemoryEpochInterface::operator delete( void * to_free ) noexcept {  
+void MemoryEpochCommon::operator delete( void * to_free, std::size_t byte_size ) noexcept {  
   if ( !to_free ) return;
-  //MemoryEpochInterface * object = (MemoryEpochInterface*)to_free;
-  DeallocateAligned( to_free );
+  // размер настоящего типа эпохи: AllocateDerived выделил его, округлив до страниц
+  Size page_size = PageSize()();
+  DeallocateMetadataPages( to_free, ( byte_size + page_size - 1 ) & ~( page_size - 1 ) );
   //DeallocateWithForbiddenPageAtStart( GetHandle( object ), object->allocated_byte_size_ );
 }
 
-void MemoryEpochInterface::ProtectArena( 
+/**
+ ** @brief все slab'ы арены взяты из её непрерывного окна (prealloc), обходить списки не нужно
+ **/
+bool MemoryEpochCommon::IsArenaInsideWindow( const slab_arena * arena ) noexcept {
+  return arena->arena && arena->used <= arena->prealloc;
+}
+
+EnvSetting<int> MemoryEpochCommon::quarantine_release_ { "TARARAM_QUARANTINE_RELEASE", TARMEMDBG_QUARANTINE_RELEASE, ParseEnvDigit<2> };
+std::atomic<Size> MemoryEpochCommon::released_bytes_total_ { 0 };
+EnvSetting<int> MemoryEpochCommon::slab_guards_mode_ { "TARARAM_SLAB_GUARDS", TARMEMDBG_SLAB_GUARDS != 0, ParseEnvDigit<1> };
+std::atomic<Size> MemoryEpochCommon::slab_guard_pages_ { 0 };
+std::atomic<Size> MemoryEpochCommon::slab_guard_split_huge_pages_ { 0 };
+std::atomic<Size> MemoryEpochCommon::slab_guard_calls_ { 0 };
+
+SlabGuardStats MemoryEpochCommon::GetSlabGuardStats() noexcept {
+  SlabGuardStats ret;
+  ret.enabled = GetSlabGuards();
+  ret.guard_pages = slab_guard_pages_.load( std::memory_order_relaxed );
+  ret.guard_bytes = ret.guard_pages * PageSize()();
+  ret.mprotect_calls = slab_guard_calls_.load( std::memory_order_relaxed );
+  ret.split_huge_pages = slab_guard_split_huge_pages_.load( std::memory_order_relaxed );
+  return ret;
+}
+
+void MemoryEpochCommon::AccountSlabGuards( Size pages, Size split_huge_pages, Size calls, bool placed ) noexcept {
+  slab_guard_calls_.fetch_add( calls, std::memory_order_relaxed );
+  if ( placed ) {
+    slab_guard_pages_.fetch_add( pages, std::memory_order_relaxed );
+    slab_guard_split_huge_pages_.fetch_add( split_huge_pages, std::memory_order_relaxed );
+  } else {
+    slab_guard_pages_.fetch_sub( pages, std::memory_order_relaxed );
+    slab_guard_split_huge_pages_.fetch_sub( split_huge_pages, std::memory_order_relaxed );
+  }
+}
+
+Size MemoryEpochCommon::VerifyRedzones( int64_t forget_id, PerfCost & cost ) noexcept {
+  PerfCost verified;
+  Size ret = redzones_.Verify( forget_id, verified, &sites_ );
+  PerfCounters::Add( counters_.redzone_checks, verified.redzone_checks );
+  PerfCounters::Add( counters_.redzone_ns, verified.redzone_ns );
+  cost.redzone_checks += verified.redzone_checks;
+  cost.redzone_ns += verified.redzone_ns;
+  return ret;
+}
+
+void MemoryEpochCommon::RememberArenaLayout( const slab_arena * arena ) noexcept {
+  window_ = MemoryRange();
+  slab_size_ = arena->slab_size;
+  if ( !arena->arena ) return;
+  window_.start = (Byte *)arena->arena;
+  window_.byte_size = arena->prealloc;
+}
+
+bool MemoryEpochCommon::IsSlabInsideWindow( const slab_arena * arena, const void * slab ) noexcept {
+  const Byte * window = (const Byte *)arena->arena;
+  return window && (const Byte *)slab >= window && (const Byte *)slab < window + arena->prealloc;
+}
+
+void MemoryEpochCommon::AddSlabBody( ProtectionPlan * bodies, void * slab, Size slab_size ) {
+  Size page_size = PageSize()();
+  if ( !bodies || slab_size <= page_size ) return;
+  bodies->AddRange( (Byte *)slab + page_size, slab_size - page_size );
+}
+
+void MemoryEpochCommon::CollectArena( 
     slab_arena * arena, 
-    ProtectMemoryConstant protect_type ) {
+    ProtectionPlan & plan,
+    ProtectionPlan * bodies ) {
   Size page_size = PageSize()();
   assert( (bool)arena );
   assert(   IsAlignedToMemoryPage( arena, page_size )   );
-  Size arena_size = CalculateSizeInPages<slab_arena>( page_size );
-  // Страхуемся от конкурентного доступа + обеспечиваем права чтения, если их нет.
-  // Для этого память под арену мы выделили целыми страницами
-  ProtectMemoryOrDie( arena, arena_size, kProtectRead ); 
-  //assert( (bool)arena->cache );
+  // Память под арену мы выделили целыми страницами, поэтому её можно защитить вместе со slab'ами
+  plan.AddRange( arena, CalculateSizeInPages<slab_arena>( page_size ) );
   assert( (bool)arena->slab_size );
   assert(   IsAlignedToMemoryPage( arena->slab_size, page_size )   );
   Size slab_size = arena->slab_size;
+  // занятая часть окна одним диапазоном, сколько бы slab'ов в ней ни было
+  if ( arena->arena ) {
+    Size used = std::min( arena->used, arena->prealloc );
+    plan.AddRange( arena->arena, used );
+    for ( Size offset = 0; bodies && offset < used; offset += slab_size ) {
+      AddSlabBody( bodies, (Byte *)arena->arena + offset, slab_size );
+    }
+  }
+  if ( IsArenaInsideWindow( arena ) ) return;
 
-  lf_lifo * ptr = &arena->cache, *next;
-  while ( !ptr ) {
+  // в lf_lifo младшие 16 бит указателя - счётчик ABA, сами slab'ы выровнены по slab_size
+  lf_lifo * ptr = (lf_lifo *)( (intptr_t)arena->cache.next & ~(intptr_t)0xffff );
+  while ( ptr ) {
     assert(   IsAlignedToMemoryPage( ptr, page_size )   );
-    ProtectMemoryOrDie( ptr, slab_size, kProtectRead ); // даём себе права на чтение, если вдруг их нет
-    next = (lf_lifo *) ptr->next;
-    ProtectMemoryOrDie( ptr, slab_size, protect_type );
-    ptr = next;
+    if ( !IsSlabInsideWindow( arena, ptr ) ) {
+      plan.AddRange( ptr, slab_size );
+      AddSlabBody( bodies, ptr, slab_size );
+    }
+    ptr = (lf_lifo *)( (intptr_t)ptr->next & ~(intptr_t)0xffff );
   }
-  ProtectMemoryOrDie( arena, arena_size, protect_type );
 }
 
-void MemoryEpochInterface::ProtectLsRegion(
+void MemoryEpochCommon::CollectLsRegion(
     lsregion * lsallocator, 
-    ProtectMemoryConstant protect_type ) {
+    ProtectionPlan & plan,
+    ProtectionPlan * bodies ) {
   assert( (bool)lsallocator );
   Size page_size = PageSize()();
-  Size lspage_size = CalculateSizeInPages<lsregion>( page_size );
   assert(   IsAlignedToMemoryPage( lsallocator, page_size )   );
-  // Страхуемся от конкурентного доступа + обеспечиваем права чтения, если их нет.
-  // Для этого память под арену мы выделили целыми страницами
-  ProtectMemoryOrDie( lsallocator, lspage_size, kProtectRead );
-  ProtectLsRegionCache( lsallocator, protect_type );
-  ProtectLsRegionSlabs( lsallocator, protect_type );
-  ProtectMemoryOrDie( lsallocator, lspage_size, protect_type );
+  // Память под lsregion мы выделили целыми страницами, поэтому её можно защитить вместе со slab'ами
+  plan.AddRange( lsallocator, CalculateSizeInPages<lsregion>( page_size ) );
+  // slab'ы из окна арены уже в плане (CollectArena)
+  if ( IsArenaInsideWindow( lsallocator->arena ) ) return;
+  CollectLsRegionCache( lsallocator, plan, bodies );
+  CollectLsRegionSlabs( lsallocator, plan, bodies );
 }
 
-void MemoryEpochInterface::ProtectLsRegionCache(
+void MemoryEpochCommon::CollectLsRegionCache(
     lsregion * lsallocator, 
-    ProtectMemoryConstant protect_type ) {
-  Size page_size = PageSize()();
-  rlist * head = &lsallocator->cached->next_in_list;
-  Size lslab_size = CalculateSizeInPages<lslab>( page_size );
-  ProtectRlistOfLslabs( head, page_size, lslab_size, protect_type );
+    ProtectionPlan & plan,
+    ProtectionPlan * bodies ) {
+  // в кэше lsregion'а лежит не список, а единственный slab (или nullptr)
+  lslab * cached = lsallocator->cached;
+  if ( !cached || IsSlabInsideWindow( lsallocator->arena, cached ) ) return;
+  assert(   IsAlignedToMemoryPage( cached, PageSize()() )   );
+  plan.AddRange( cached, cached->slab_size );
+  AddSlabBody( bodies, cached, cached->slab_size );
 }
 
-void MemoryEpochInterface::ProtectLsRegionSlabs(
+void MemoryEpochCommon::CollectLsRegionSlabs(
     lsregion * lsallocator, 
-    ProtectMemoryConstant protect_type ) {
-  Size page_size = PageSize()();
+    ProtectionPlan & plan,
+    ProtectionPlan * bodies ) {
+  [[maybe_unused]] Size page_size = PageSize()();
   rlist * head = &lsallocator->slabs.slabs;
-  Size lslab_size = CalculateSizeInPages<lslab>( page_size );
-  ProtectRlistOfLslabs( head, page_size, lslab_size, protect_type );
-}
-
-void MemoryEpochInterface::ProtectRlistOfLslabs(
-    rlist * head, 
-    [[maybe_unused]] Size page_size,
-    Size lslab_size,
-    ProtectMemoryConstant protect_type ) {
-  rlist * ptr = rlist_first( head );
-  Size current_slab_size = 0;
-  while ( ptr != head ) {
-    assert( (bool)ptr );
-    assert(   IsAlignedToMemoryPage( ptr, page_size )   );
-    lslab * slab = rlist_entry( ptr, lslab, next_in_list );
-    ProtectMemoryOrDie( slab, lslab_size, kProtectRead );    
-    ptr = rlist_next( &slab->next_in_list ); // получаем следующее значение пока возможность чтения slab'а гарантирована
-    current_slab_size = slab->slab_size;
-    ProtectMemoryOrDie( slab, current_slab_size, protect_type );
+  slab_arena * arena = lsallocator->arena;
+  lslab * slab;
+  rlist_foreach_entry( slab, head, next_in_list ) {
+    if ( IsSlabInsideWindow( arena, slab ) ) continue;
+    // большие slab'ы выделяет эпоха, они собираются из LMBStorage (CollectLargeMemoryBlocks)
+    if ( slab->slab_size > arena->slab_size ) continue;
+    assert(   IsAlignedToMemoryPage( slab, page_size )   );
+    plan.AddRange( slab, slab->slab_size );
+    AddSlabBody( bodies, slab, slab->slab_size );
   }
 }
+
 /*struct lslab *slab, *next;
 rlist_foreach_entry_safe(slab, &lsregion->slabs.slabs, next_in_list, next);
 rlist_foreach_entry_safe(item, head, member, tmp) {
@@ -217,15 +301,24 @@ rlist_next_entry(item, member)	{
 //inline static struct rlist * rlist_last(struct rlist *head);
 //inline static struct rlist * rlist_next(struct rlist *item);
 
-void MemoryEpochInterface::ProtectLargeMemoryBlocks( 
+void MemoryEpochCommon::CollectLargeMemoryBlocks( 
     LMBStorage & large_blocks_pool, 
-    ProtectMemoryConstant protect_type ) {
+    ProtectionPlan & plan,
+    ProtectionPlan * bodies ) {
+  Size page_size = PageSize()();
   for ( auto & large_block : large_blocks_pool ) {
-    large_block.Protect( protect_type );
+    large_block.Check( page_size );
+    plan.AddRange( large_block.address, large_block.allocated_bytesize );
+    if ( !bodies ) continue;
+    // заголовок блока и lslab нужны lsregion_gc_orig, данные за ними можно отдать ядру
+    Byte * end = (Byte *)large_block.address + large_block.allocated_bytesize;
+    Byte * data = (Byte *)large_block.slab + lslab_sizeof();
+    data = (Byte *)(   ( (uintptr_t)data + page_size - 1 ) & ~(uintptr_t)( page_size - 1 )   );
+    if ( data < end ) bodies->AddRange( data, end - data );
   }
 }
 
-void MemoryEpochInterface::DeallocateLargeMemoryBlocks( LMBStorage & large_blocks_pool ) noexcept {
+void MemoryEpochCommon::DeallocateLargeMemoryBlocks( LMBStorage & large_blocks_pool ) noexcept {
   for ( auto & large_block : large_blocks_pool ) {
     large_block.Deallocate();
   }
@@ -234,18 +327,50 @@ void MemoryEpochInterface::DeallocateLargeMemoryBlocks( LMBStorage & large_block
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
-// MemoryEpochLsRegion                                                       //
+// MemoryEpochInterface                                                      //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
+template <typename DerivedTn>
+Size MemoryEpochInterface<DerivedTn>::ProtectEpoch( ProtectMemoryConstant protect_type ) noexcept {
+  PerfCost cost;
+  return ProtectEpoch( protect_type, cost );
+}
+
+template <typename DerivedTn>
+Size MemoryEpochInterface<DerivedTn>::ProtectEpoch( ProtectMemoryConstant protect_type, PerfCost & cost ) noexcept {
+  const auto started = Clock::now();
+  Size ret = Self().ProtectEpoch_( protect_type );
+  uint64_t elapsed = ElapsedNs( started );
+  PerfCounters::Add( counters_.protect_calls, ret );
+  PerfCounters::Add( counters_.protect_ns, elapsed );
+  cost.protect_calls += ret;
+  cost.protect_ns += elapsed;
+  return ret;
+}
 
-void MemoryEpochLsRegion::operator delete( void * to_free ) noexcept {
-  MemoryEpochInterface::operator delete( to_free );
+template <typename DerivedTn>
+void MemoryEpochInterface<DerivedTn>::GarbageCollect( int64_t min_id, PerfCost & cost ) noexcept {
+  const auto started = Clock::now();
+  {
+    LargeBlockOwnerScope large_blocks( &Self() );
+    lsregion_gc_orig( GetLsRegion(), min_id );
+  }
+  uint64_t elapsed = ElapsedNs( started );
+  PerfCounters::Add( counters_.gc_calls, Size(1) );
+  PerfCounters::Add( counters_.gc_ns, elapsed );
+  ++cost.gc_calls;
+  cost.gc_ns += elapsed;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// MemoryEpochLsRegion                                                       //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 MemoryEpochLsRegion * MemoryEpochLsRegion::Create() {
-  MemoryEpochLsRegion * ret = (MemoryEpochLsRegion *)
-                                  MemoryEpochInterface::AllocateDerived<MemoryEpochLsRegion>();
+  MemoryEpochLsRegion * ret = AllocateDerived<MemoryEpochLsRegion>();
   Construct( *ret );
   // Размер структур не только выравнен по странице, но и аллоцируем размер кратный странице.
   // Это нужно для того, чтобы перед манипуляциями с этими структурами запретить их модификацию
@@ -255,25 +380,186 @@ MemoryEpochLsRegion * MemoryEpochLsRegion::Create() {
   
   static struct quota runtime_quota;
   static const constexpr size_t SLAB_SIZE = 4 * 1024 * 1024;
-  quota_init(&runtime_quota, QUOTA_MAX);
-  slab_arena_create_orig( ret->arena_, &runtime_quota, 0, SLAB_SIZE, MAP_PRIVATE );
+  // квота общая для всех эпох: повторный quota_init обнулил бы учёт ещё живых больших slab'ов
+  static const bool runtime_quota_ready = ( quota_init(&runtime_quota, QUOTA_MAX), true );
+  (void)runtime_quota_ready;
+  ret->InitArena( &runtime_quota, 0, SLAB_SIZE, MAP_PRIVATE );
 
   lsregion_create_orig( ret->lsregion_, ret->arena_ );
 
   return ret;
 }
 
+int MemoryEpochLsRegion::InitArena( quota * quota_value, Size prealloc, uint32_t slab_size, int flags ) noexcept {
+  if ( arena_->arena ) {
+    // арена ещё ни разу не отдавала slab'ы, поэтому её можно просто разрушить
+    assert( !arena_->used );
+    DropSlabGuards();
+    slab_arena_destroy_orig( arena_ );
+  }
+  int ret = slab_arena_create_orig( arena_, quota_value, prealloc, slab_size, flags );
+  RememberArenaLayout( arena_ );
+  // запрещённые страницы ставятся только в окне, и slab должен остаться хотя бы из двух страниц
+  slab_guards_ = !ret && GetSlabGuards() && arena_->slab_size > 2 * PageSize()();
+  guarded_byte_size_ = 0;
+  if ( ret || arena_->prealloc || !TARMEMDBG_EPOCH_WINDOW_SIZE ) return ret;
+  // окно подставляется вместо prealloc: slab_map_orig нарезает slab'ы из него по порядку,
+  // а slab_arena_destroy_orig его освободит
+  Size window_size = small_align( TARMEMDBG_EPOCH_WINDOW_SIZE, arena_->slab_size );
+  bool shared = IS_SLAB_ARENA_FLAG( arena_->flags, SLAB_ARENA_SHARED );
+  void * window = ReserveAlignedWindow( window_size, arena_->slab_size, shared );
+  if ( window ) {
+    arena_->arena = window;
+    arena_->prealloc = window_size;
+    RememberArenaLayout( arena_ );
+  }
+  return ret;
+}
+
 MemoryEpochLsRegion::~MemoryEpochLsRegion() noexcept {
-  lsregion_destroy_orig( lsregion_ );
+  {
+    LargeBlockOwnerScope large_blocks( this );
+    lsregion_destroy_orig( lsregion_ );
+  }
+  assert( large_blocks_.empty() );
+  DeallocateLargeMemoryBlocks( large_blocks_ );
+  DropSlabGuards();
   slab_arena_destroy_orig( arena_ );
   DeleteAligned( arena_ );
   DeleteAligned( lsregion_ );
 }
 
-void MemoryEpochLsRegion::ProtectEpoch_( ProtectMemoryConstant protect_type ) {
-  ProtectArena( arena_, protect_type );
-  ProtectLsRegion( lsregion_, protect_type );
-  ProtectLargeMemoryBlocks( large_blocks_, protect_type );
+Size MemoryEpochLsRegion::ProtectEpoch_( ProtectMemoryConstant protect_type ) noexcept {
+  if ( !plan_.IsBuilt() ) {
+    // обходить списки slab'ов можно, только пока память эпохи доступна на чтение
+    assert( protection_ != kProtectNone );
+    plan_.Clear();
+    bodies_.Clear();
+    CollectArena( arena_, plan_, &bodies_ );
+    CollectLsRegion( lsregion_, plan_, &bodies_ );
+    CollectLargeMemoryBlocks( large_blocks_, plan_, &bodies_ );
+    plan_.Build();
+    bodies_.Build();
+    mapped_slabs_ = arena_->slab_size ? arena_->used / arena_->slab_size : 0;
+  }
+  Size ret = plan_.Apply( protect_type );
+  // план защищает занятую часть окна одним диапазоном вместе с запрещёнными страницами
+  if ( protect_type == kProtectReadWrite && slab_guards_ ) {
+    ret += PlaceSlabGuards( 0, std::min( guarded_byte_size_, (Size)arena_->used ), true );
+  }
+  // недоступную эпоху никто не читает до переиспользования, а заголовки slab'ов остаются на месте
+  if ( protect_type == kProtectNone && protection_ != kProtectNone ) {
+    AccountReleased(   bodies_.Release( GetQuarantineRelease() )   );
+  }
+  protection_ = protect_type;
+  // открытая на запись эпоха будет меняться (gc, новые slab'ы), поэтому план придётся собрать заново
+  if ( protect_type == kProtectReadWrite ) plan_.Invalidate();
+  return ret;
+}
+
+void * MemoryEpochLsRegion::AllocateLargeMemoryBlock_( Size byte_size ) noexcept {
+  // в открытую на запись эпоху пишут, её план защиты всё равно будет собран заново
+  assert( protection_ == kProtectReadWrite );
+  Size page_size = PageSize()();
+  Size guard_size = TARMEMDBG_LARGE_BLOCK_GUARD_PAGES * page_size;
+  Size body_size = byte_size + sizeof( LargeBlockHeader ) + LargeBlockHeader::kSlabAlignment - 1;
+  body_size = ( body_size + page_size - 1 ) & ~( page_size - 1 );
+  LargeMemoryBlock block = LargeBlockPool::Acquire( body_size, guard_size );
+  if ( !block.address ) return nullptr;
+  // slab прижимается к запрещённым страницам, насколько позволяет выравнивание
+  Byte * body_end = (Byte *)block.address + block.allocated_bytesize;
+  block.slab = (void *)(   (uintptr_t)( body_end - byte_size ) & ~(uintptr_t)( LargeBlockHeader::kSlabAlignment - 1 )   );
+  LargeBlockHeader * header = LargeBlockHeader::FromSlab( block.slab );
+  assert( (Byte *)header >= (Byte *)block.address );
+  header->signature = LargeBlockHeader::kSignature;
+  header->owner = this;
+  header->index = large_blocks_.size();
+  large_blocks_.push_back( block );
+  return block.slab;
+}
+
+void MemoryEpochLsRegion::DeallocateLargeMemoryBlock_( void * slab ) noexcept {
+  assert( protection_ == kProtectReadWrite );
+  LargeBlockHeader * header = LargeBlockHeader::FromSlab( slab );
+  assert( header->signature == LargeBlockHeader::kSignature );
+  assert( header->owner == this );
+  Size index = header->index;
+  assert( index < large_blocks_.size() );
+  assert( large_blocks_[index].slab == slab );
+  LargeMemoryBlock block = large_blocks_[index];
+  header->signature = 0;
+  // на место удаляемого встаёт последний блок
+  if ( index + 1 != large_blocks_.size() ) {
+    large_blocks_[index] = large_blocks_.back();
+    LargeBlockHeader::FromSlab( large_blocks_[index].slab )->index = index;
+  }
+  large_blocks_.pop_back();
+  block.Deallocate();
+}
+
+Size MemoryEpochLsRegion::GetUsableSlabSize_() noexcept {
+  Size slab_size = arena_->slab_size;
+  const MemoryRange & window = GetWindow();
+  if ( !slab_guards_ || !window.byte_size ) return slab_size;
+  // следующий новый slab slab_map_orig нарежет из окна сразу за занятой частью
+  Size next_end = arena_->used + slab_size;
+  if ( next_end > guarded_byte_size_ && guarded_byte_size_ < window.byte_size ) {
+    Size batch_end = guarded_byte_size_ + TARMEMDBG_SLAB_GUARD_BATCH * slab_size;
+    Size to = std::min( window.byte_size, std::max( next_end, batch_end ) );
+    PlaceSlabGuards( guarded_byte_size_, to, false );
+    guarded_byte_size_ = to;
+  }
+  return slab_size - PageSize()();
+}
+
+Size MemoryEpochLsRegion::PlaceSlabGuards( Size from, Size to, bool restore ) noexcept {
+  Size page_size = PageSize()();
+  Size slab_size = GetSlabSize();
+  Byte * window = GetWindow().start;
+  assert( from % slab_size == 0 );
+  Size calls = 0;
+  for ( Size offset = from; offset + slab_size <= to; offset += slab_size ) {
+    ProtectMemoryOrDie( window + offset + slab_size - page_size, page_size, kProtectNone );
+    ++calls;
+  }
+  if ( restore ) AccountSlabGuards( 0, 0, calls, true );
+  else AccountSlabGuards( calls, CountGuardHugePages( from, to ), calls, true );
+  return calls;
+}
+
+void MemoryEpochLsRegion::DropSlabGuards() noexcept {
+  if ( !guarded_byte_size_ ) return;
+  Size pages = guarded_byte_size_ / GetSlabSize();
+  AccountSlabGuards( pages, CountGuardHugePages( 0, guarded_byte_size_ ), 0, false );
+  guarded_byte_size_ = 0;
+}
+
+Size MemoryEpochLsRegion::CountGuardHugePages( Size from, Size to ) const noexcept {
+  Size page_size = PageSize()();
+  Size slab_size = GetSlabSize();
+  uintptr_t window = (uintptr_t)GetWindow().start;
+  Size ret = 0;
+  // страница перед from уже учтена предыдущей порцией
+  uintptr_t last_huge_page = from ? ( window + from - page_size ) / kHugePageSize : UINTPTR_MAX;
+  for ( Size offset = from; offset + slab_size <= to; offset += slab_size ) {
+    uintptr_t huge_page = ( window + offset + slab_size - page_size ) / kHugePageSize;
+    if ( huge_page != last_huge_page ) ++ret;
+    last_huge_page = huge_page;
+  }
+  return ret;
+}
+
+Size MemoryEpochLsRegion::GetMappedSlabs_() noexcept {
+  // пока эпоха открыта на запись, её арена доступна и меняется
+  if ( protection_ == kProtectReadWrite ) return arena_->slab_size ? arena_->used / arena_->slab_size : 0;
+  return mapped_slabs_;
+}
+
+Size MemoryEpochLsRegion::GetQuarantinedBytes_( Size & resident ) noexcept {
+  resident = 0;
+  if ( protection_ != kProtectNone ) return 0;
+  resident = plan_.GetResidentByteSize();
+  return plan_.GetByteSize();
 }
 
 } // namespace TARMEMDBG_NAMESPACE
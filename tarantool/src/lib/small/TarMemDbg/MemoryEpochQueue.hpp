@@ -17,12 +17,20 @@
 
 namespace      TARMEMDBG_NAMESPACE {
 
+/**
+ ** @brief Вытесненная из окна эпоха не удаляется сразу, а добавляется в работу текущего сдвига эпох,
+ **        чтобы её удаление шло после смены защиты и, в асинхронном режиме, в фоновом потоке
+ **/
 template <typename TypeTn>
-class SlidingWindowEpochOnDelete : public SlidingWindowOnDeleteInterface<TypeTn> {
+class SlidingWindowEpochOnDelete {
  public:
   typedef TypeTn Type;
 
-  virtual void OnDelete( Type & before_delete_value ) { delete before_delete_value; }
+  explicit SlidingWindowEpochOnDelete( MemoryEpochQueue * owner = nullptr ) : owner_( owner ) {}
+  inline void OnDelete( Type & before_delete_value ) noexcept;
+
+ private:
+  MemoryEpochQueue * owner_;
 };
 
 //template <typename TypeTn, Size BufferSizeTn> class 
@@ -39,28 +47,123 @@ class SlidingWindowEpochOnDelete : public SlidingWindowOnDeleteInterface<TypeTn>
  **/
 class MemoryEpochQueue {
  public:
-  static const constexpr Size kWinSize = 4;
-  typedef SlidingWindowEpochOnDelete<MemoryEpochInterface *> OnDeleteFunctor;  
-  typedef SlidingWindow< MemoryEpochInterface *, kWinSize > Storage;
+  static const constexpr Size kMinWinSize = 2;
+  static const constexpr Size kMaxWinSize = 16;
+  static const constexpr Size kDefaultWinSize = TARMEMDBG_EPOCH_QUEUE_DEPTH;
+  static_assert( kDefaultWinSize >= kMinWinSize && kDefaultWinSize <= kMaxWinSize, "TARMEMDBG_EPOCH_QUEUE_DEPTH is out of range" );
+  typedef SlidingWindowEpochOnDelete<MemoryEpoch *> OnDeleteFunctor;  
+  typedef SlidingWindow< MemoryEpoch *, kMaxWinSize, OnDeleteFunctor > Storage;
   typedef MemoryEpochQueue This;
 
-  static MemoryEpochQueue * Create( Size starting_index );
+  /**
+   ** @param depth число эпох в очереди, 0 - взять GetDefaultDepth(). Приводится к [kMinWinSize, kMaxWinSize]
+   **/
+  static MemoryEpochQueue * Create( Size starting_index, Size depth = 0 );
+  /**
+   ** @brief глубина очереди для создаваемых очередей
+   ** @details При первом обращении читается из переменной окружения TARARAM_EPOCH_QUEUE_DEPTH, 
+   **          если её нет - TARMEMDBG_EPOCH_QUEUE_DEPTH. На уже созданные очереди не влияет
+   **/
+  static Size GetDefaultDepth() noexcept { return default_depth_.Get(); }
+  /// @return предыдущее значение
+  static Size SetDefaultDepth( Size depth ) noexcept { return default_depth_.Set( depth ); }
+  static Size ClampDepth( Size depth ) noexcept;
+  Size GetDepth() const noexcept { return epochs_->GetBufferSize(); }
+  /**
+   ** @brief ищет эпоху очереди, которой принадлежит @a ptr. Без блокировок и выделения памяти, 
+   **        можно звать из обработчика сигнала
+   ** @param[out] age 0 - текущая эпоха, 1 - только на чтение, дальше - недоступные
+   **/
+  bool FindAddress( const void * ptr, AddressIndexEntry & found, Size & age ) const noexcept;
+  /// пересобирает индекс адресов. Только под GetLock()
+  void RebuildAddressIndex() noexcept;
+  /**
+   ** @brief учитывает slab вне окна текущей эпохи @a epoch: из slab_map_orig lsregion'а эпохи или из обёртки slab_map.
+   **        Индекс адресов дополняется, а не пересобирается. Только под GetLock()
+   **/
+  void TrackSlabOutsideWindow( MemoryEpoch * epoch, void * slab ) noexcept;
+  /// забывает slab, возвращённый обёрткой slab_unmap, какой бы эпохе он ни принадлежал. Только под GetLock()
+  void UntrackSlabOutsideWindow( void * slab ) noexcept;
+  /// забывает slab'ы вне окна удаляемой или переиспользуемой эпохи. Индекс пересобирается в NextEpoch
+  void ForgetSlabsOutsideWindow( MemoryEpoch * epoch ) noexcept;
+  bool IsInsideCurrentWindow( const void * slab ) const noexcept { 
+    return MemoryEpochCommon::IsSlabInsideWindow( GetArenaFast(), slab ); 
+  }
+  const AddressIndex & GetAddressIndex() const noexcept { return index_; }
+  /**
+   ** @brief сумма MemoryEpochInterface::GetQuarantinedBytes по эпохам очереди
+   ** @param[out] nepochs сколько эпох сейчас недоступны
+   **/
+  Size GetQuarantinedBytes( Size & resident, Size & nepochs ) noexcept;
+  RotationSampler & GetSampler() noexcept { return sampler_; }
+  const RotationSampler & GetSampler() const noexcept { return sampler_; }
   ~MemoryEpochQueue() { 
+    // в фоновом потоке могут остаться работы, ссылающиеся на эту очередь
+    EpochProtector::FlushIfAlive();
     signature_ = 0; 
     DeleteAligned<Storage>( epochs_ ); 
   }
   void operator delete( void * to_free ) noexcept;
   
-  void NextEpoch() noexcept;
+  /**
+   ** @brief сдвигает эпохи: текущая становится доступной только на чтение, предыдущая - недоступной, 
+   **        самая старая переиспользуется или удаляется
+   ** @details Смены защиты записываются в RotationJob. Если EpochProtector включён, работа отдаётся фоновому потоку, 
+   **          и вызывающий поток только публикует новую текущую эпоху. Тогда старые эпохи не переиспользуются, 
+   **          а удаляются фоновым потоком, и запись в только что закрытую эпоху ловится не сразу, а после выполнения работы.
+   **          Если сдвиг не попал в выборку (см. RotationSampler), то эпохи не сдвигаются, а у текущей эпохи просто вызывается lsregion_gc_orig
+   ** @param min_id аргумент lsregion_gc
+   **/
+  void NextEpoch( int64_t min_id ) noexcept;
+  /// lsregion_gc_orig текущей эпохи без сдвига: несэмплированный сдвиг и lsregion_gc при выключенной отладке
+  void CollectCurrentEpoch( int64_t min_id ) noexcept;
+  /// добавляет удаление вытесненной из окна эпохи в работу текущего сдвига
+  void RetireEpoch( MemoryEpoch * epoch ) noexcept {
+    ForgetSlabsOutsideWindow( epoch );
+    job_.Destroy( epoch );
+  }
+  /// учитывает вызовы mprotect выполненной работы. Вызывается из RotationJob::Execute, возможно из фонового потока
+  void AccountRotation( const PerfCost & cost ) noexcept;
+  /// учитывает аллокацию из lsregion'а очереди
+  void AccountAllocation( Size byte_size ) noexcept { allocation_counters_.Add( byte_size ); }
+  const AllocationCounters & GetAllocationCounters() const noexcept { return allocation_counters_; }
+  const PerfCounters & GetCounters() const noexcept { return counters_; }
+  /**
+   ** @brief вызывает @a functor( epoch, age, position ) для каждой эпохи очереди, начиная с текущей. 
+   **        Только под GetLock()
+   **/
+  template <typename FunctorTn> void ForEachEpoch( FunctorTn && functor );
+  int InitCurrentArena( quota * quota_value, Size prealloc, uint32_t slab_size, int flags ) noexcept;
   inline Size GetPositionOrMaxId() noexcept;
-  MemoryEpochInterface * GetCurrentEpoch();
+  MemoryEpoch * GetCurrentEpoch();
   static MemoryEpochQueue * GetSelfByHandle( void * handle ) noexcept;
   static MemoryEpochQueue * GetSelfByHandleNoChecks( void * handle ) noexcept;
+  static void * GetHandle( MemoryEpochQueue * self ) noexcept;
   
   slab_arena * GetArena() noexcept { return GetCurrentEpoch()->GetArena(); }
   lsregion * GetLsRegion() noexcept { return GetCurrentEpoch()->GetLsRegion(); }
+  /**
+   ** @brief Быстрый путь без блокировок: текущие арена и lsregion, опубликованные при последнем сдвиге эпох
+   ** @details Значения меняются только в NextEpoch. Вызывающий не должен аллоцировать из этой очереди
+   **          одновременно со сдвигом эпох (то же ограничение, что и у обычного lsregion)
+   **/
+  slab_arena * GetArenaFast() const noexcept { return current_arena_.load( std::memory_order_acquire ); }
+  lsregion * GetLsRegionFast() const noexcept { return current_lsregion_.load( std::memory_order_acquire ); }
+  MemoryEpoch * GetCurrentEpochFast() const noexcept { return current_epoch_.load( std::memory_order_acquire ); }
+  
+  /// число вызовов mprotect за последний сдвиг эпох
+  Size GetLastRotationProtectCalls() const noexcept { return last_rotation_protect_calls_.load( std::memory_order_relaxed ); }
+  /// число вызовов mprotect за все сдвиги эпох
+  Size GetTotalProtectCalls() const noexcept { return PerfCounters::Get( counters_.protect_calls ); }
   
   bool CheckIfThisIsReallyMemoryEpochQueue() { return signature_ == kSignature; }
+  /**
+   ** @brief блокировка сдвига эпох, учёта slab'ов вне окна и обхода эпох этой очереди
+   ** @details У каждой очереди своя блокировка, поэтому сдвиги эпох разных очередей (обычно - разных потоков) 
+   **          друг друга не ждут. Аллокации её не берут. Глобальная блокировка нужна только для создания очередей, 
+   **          и если нужны обе, она берётся первой
+   **/
+  Mutex & GetLock() noexcept { return lock_; }
 
  protected:
   DISALLOW_COPY_MOVE_AND_ASSIGN( MemoryEpochQueue )
@@ -68,9 +171,14 @@ class MemoryEpochQueue {
   //friend void * ::operator new( size_t size, const std::nothrow_t & ) noexcept;
   MemoryEpochQueue() {}
 
-  static void * GetHandle( MemoryEpochQueue * self ) noexcept;
-  static MemoryEpochLsRegion * GetLsEpoch( MemoryEpochInterface * value );
   static MemoryEpochQueue * AllocateQueue() noexcept;
+  /// 0 в TARARAM_EPOCH_QUEUE_DEPTH - глубина по умолчанию
+  static bool ParseDepth( const char * from_env, Size & depth ) noexcept;
+  void PublishCurrentEpoch() noexcept;
+  /// диапазон эпохи возраста @a age для индекса адресов, без slab'ов вне окна
+  AddressIndexEntry MakeIndexEntry( Size age, Size position ) noexcept;
+  /// @return false, если slab уже учтён или места нет
+  bool RememberSlabOutsideWindow( MemoryEpoch * epoch, void * slab ) noexcept;
 
  private:
   friend int ::slab_arena_create( memory_epoch_queue **arena, quota *quota, 
@@ -78,16 +186,31 @@ class MemoryEpochQueue {
 
   static constexpr const uint64_t kSignature = 0xDEADBEEFc0ffee27;  // мёртвое мясо кофе 27
   volatile uint64_t signature_ = kSignature;
+  Mutex lock_;
   Storage * epochs_;
+  std::atomic<slab_arena *> current_arena_ { nullptr };   ///< копия GetCurrentEpoch()->GetArena() для быстрого пути
+  std::atomic<lsregion *> current_lsregion_ { nullptr };  ///< копия GetCurrentEpoch()->GetLsRegion() для быстрого пути
+  std::atomic<MemoryEpoch *> current_epoch_ { nullptr }; ///< копия GetCurrentEpoch() для быстрого пути
+  std::atomic<Size> last_rotation_protect_calls_ { 0 };
+  PerfCounters counters_; ///< в том числе за уже удалённые эпохи
+  AllocationCounters allocation_counters_;
+  static EnvSetting<Size> default_depth_;
+  RotationSampler sampler_;
+  RotationJob job_; ///< работа текущего сдвига эпох, заполняется в NextEpoch
+  AddressIndex index_; ///< окна эпох и их slab'ы вне окон, пишется под lock_
+  /**
+   ** @brief slab'ы эпох очереди вне их окон (prealloc арены кончился или окна нет). Арена не отдаёт их ядру до своего
+   **        разрушения, но после lsregion_gc_orig они лежат в её кэше, поэтому при переиспользовании эпохи забываются
+   **/
+  struct SlabOutsideWindow {
+    MemoryEpoch * epoch;
+    Byte * start;
+  };
+  std::array< SlabOutsideWindow, AddressIndex::kCapacity > slabs_outside_window_; ///< больше индекс всё равно не вместит
+  Size nslabs_outside_window_ = 0;
   PtrDiff offset_of_allocated_ = 0;
   Size allocated_byte_size_ = 0;
 };
-/*
-  SlidingWindow( 
-      Size starting_index, 
-      const Type & initial_value, 
-      OnDeleteFunPtr on_delete_value = std::make_shared< SlidingWindowDefaultOnDelete<Type> >() )
-*/
 
 } // namespace TARMEMDBG_NAMESPACE
 
@@ -32,19 +32,38 @@ This && MemoryEpochQueue::operator=( This && value ) {
 }
 */
 
-MemoryEpochQueue * MemoryEpochQueue::Create( Size starting_index ) {
-  typename Storage::OnDeleteFunPtr on_delete_value = std::make_shared< OnDeleteFunctor >();
-  assert( (bool)on_delete_value );
-  std::unique_ptr< MemoryEpochInterface > starting_epoch( MemoryEpochLsRegion::Create() );
+template <typename TypeTn>
+void SlidingWindowEpochOnDelete<TypeTn>::OnDelete( Type & before_delete_value ) noexcept { 
+  owner_->RetireEpoch( before_delete_value ); 
+}
+
+EnvSetting<Size> MemoryEpochQueue::default_depth_ { "TARARAM_EPOCH_QUEUE_DEPTH", kDefaultWinSize, ParseDepth, ClampDepth };
+
+Size MemoryEpochQueue::ClampDepth( Size depth ) noexcept {
+  return std::min( std::max( depth, kMinWinSize ), kMaxWinSize );
+}
+
+bool MemoryEpochQueue::ParseDepth( const char * from_env, Size & depth ) noexcept {
+  Size parsed = 0;
+  if ( !ParseEnvSize( from_env, parsed ) || !parsed ) return false;
+  depth = parsed;
+  return true;
+}
+
+MemoryEpochQueue * MemoryEpochQueue::Create( Size starting_index, Size depth ) {
+  std::unique_ptr< MemoryEpochQueue > internal ( AllocateQueue() );
+  assert( (bool)internal );
+  std::unique_ptr< MemoryEpoch > starting_epoch( EpochPool::Take() );
   assert( (bool) starting_epoch );
   std::unique_ptr<Storage> sliding_window(   NewAligned< Storage >( 
       starting_index, 
       starting_epoch.release(),
-      on_delete_value )   );
+      OnDeleteFunctor( internal.get() ),
+      depth ? ClampDepth( depth ) : GetDefaultDepth() )   );
   assert( (bool)sliding_window );
-  std::unique_ptr< MemoryEpochQueue > internal ( AllocateQueue() );
-  assert( (bool)internal );
   internal->epochs_ = sliding_window.release();
+  internal->sampler_.Init( SamplingConfig::SampleArena(), (uint64_t)internal.get() );
+  internal->PublishCurrentEpoch();
   return internal.release();
 }
 
@@ -70,67 +89,240 @@ ProtectMemoryConstant CalcProtectTypeFor2ndEpoch(
 //# endif // TARMEMDBG_REUSE_EPOCHS
 }
 
-void MemoryEpochQueue::NextEpoch() noexcept {      
+void MemoryEpochQueue::NextEpoch( int64_t min_id ) noexcept {      
+  const auto started = Clock::now();
+  if ( !sampler_.ShouldSample() ) {
+    CollectCurrentEpoch( min_id );
+    sampler_.Account( false, ElapsedNs( started ) );
+    return;
+  }
+  EpochProtector & protector = EpochProtector::GetInstance();
+  const bool async = protector.IsEnabled();
+  job_.Reset( this );
   if ( !epochs_->IsEmpty() ) {
     Size nepochs = epochs_->GetNumberEpochs();
-    Size buffer_size = epochs_->buffer_size;
-    assert( nepochs >= 2 );
-    MemoryEpochInterface * last_epoch = GetCurrentEpoch(); 
+    Size buffer_size = epochs_->GetBufferSize();
+    assert( nepochs >= 1 );
+    MemoryEpoch * last_epoch = GetCurrentEpoch(); 
     assert( last_epoch );
-    last_epoch->ProtectEpoch( kProtectRead );
+    last_epoch->SetRetiredId( min_id );
+    job_.Protect( last_epoch, kProtectRead );
+    // закрытая на запись эпоха свои канарейки уже не меняет
+    if ( last_epoch->HasRedzones() ) job_.VerifyRedzones( last_epoch );
     if ( nepochs >= 2 ) {
-      MemoryEpochInterface * previous_epoch = epochs_->GetPrevious( 2 );
+      MemoryEpoch * previous_epoch = epochs_->GetPrevious( 1 );
       assert( previous_epoch );
       // если у нас НЕ ленивый вызов lsregion_gc, то вызываем его здесь (сдвиг на третью позицию), иначе - сразу перед удалением/переиспользованием самой дальней эпохи
-#     if       ~TARMEMDBG_REUSE_LAZY_CLEAN
-      lsregion_gc_orig( 
-          previous_epoch->GetLsRegion(), 
-          epochs_->GetPositionOrMaxId() - nepochs + 1 );
-#     endif // ~TARMEMDBG_REUSE_LAZY_CLEAN
-      previous_epoch->ProtectEpoch( CalcProtectTypeFor2ndEpoch(   nepochs, buffer_size )   );
-      if ( epochs_->IsFull() && nepochs >= 3 ) {        
-        MemoryEpochInterface * predelete_epoch = epochs_->GetPrevious( 2 );
-        assert( predelete_epoch );
-        predelete_epoch->ProtectEpoch( kProtectReadWrite );
-        // если у нас ленивый вызов lsregion_gc, то вызываем его здесь, иначе - сразу после сдвига на третью позицию
-#       if       TARMEMDBG_REUSE_LAZY_CLEAN
-        lsregion_gc_orig( 
-            predelete_epoch->GetLsRegion(), 
-            epochs_->GetPositionOrMaxId() - nepochs + 1 );
-#       endif // TARMEMDBG_REUSE_LAZY_CLEAN
-      }
+#     if       !TARMEMDBG_REUSE_LAZY_CLEAN
+      job_.Gc( previous_epoch, previous_epoch->GetRetiredId() );
+#     endif // !TARMEMDBG_REUSE_LAZY_CLEAN
+      job_.Protect( previous_epoch, CalcProtectTypeFor2ndEpoch(   nepochs, buffer_size )   );
+    }
+    if ( epochs_->IsFull() && !async ) {
+      // самая дальняя эпоха сейчас будет удалена или переиспользована
+      // (в асинхронном режиме она только удаляется, и RotationJob сам откроет её перед удалением)
+      MemoryEpoch * predelete_epoch = epochs_->GetPrevious( nepochs - 1 );
+      assert( predelete_epoch );
+      job_.Protect( predelete_epoch, kProtectReadWrite );
+      // если у нас ленивый вызов lsregion_gc, то вызываем его здесь, иначе - сразу после сдвига на третью позицию
+#     if       TARMEMDBG_REUSE_LAZY_CLEAN
+      job_.Gc( predelete_epoch, predelete_epoch->GetRetiredId() );
+#     endif // TARMEMDBG_REUSE_LAZY_CLEAN
     }
   }
   // Если нужно поведение, когда старая эпоха полностью удаляется и заменяется новой, 
   // то нужно всегда делать Push
-  // Если нужна политика переиспользования старых эпох, то при IsFull нужно делать SlideEpochs  
-  if ( epochs_->IsFull() ) {
+  // Если нужна политика переиспользования старых эпох, то при IsFull нужно делать SlideEpochs.
+  // Переиспользовать эпоху можно только после выполнения работы, поэтому в асинхронном режиме - всегда Push
+  MemoryEpoch * reused_epoch = nullptr;
+  if ( epochs_->IsFull() && !async ) {
 #   if       TARMEMDBG_REUSE_EPOCHS     
     epochs_->SlideEpochs();
+    reused_epoch = GetCurrentEpoch();
 #   else  // TARMEMDBG_REUSE_EPOCHS
-    epochs_->Push( MemoryEpochLsRegion::Create() );
+    epochs_->Push( EpochPool::Take() );
 #   endif // TARMEMDBG_REUSE_EPOCHS
   } else {
-    epochs_->Push( MemoryEpochLsRegion::Create() );
+    epochs_->Push( EpochPool::Take() );
+  }
+  // переиспользованная эпоха помнит места чанков, которые сейчас освободит lsregion_gc_orig
+  GetCurrentEpoch()->ForgetSites( INT64_MAX );
+  if ( async ) {
+    protector.Submit( job_ );
+  } else {
+    // работы, отправленные до выключения асинхронного режима, должны закончиться раньше этой
+    if ( protector.GetPending() ) protector.Flush();
+    job_.Execute();
+  }
+  if ( reused_epoch ) {
+    // lsregion_gc_orig вернул slab'ы эпохи в кэш арены, и slab_map_orig учтёт их заново. 
+    // Только slab, оставленный в самом lsregion'е, снова выдаётся без slab_map_orig
+    ForgetSlabsOutsideWindow( reused_epoch );
+    lslab * cached = reused_epoch->GetLsRegion()->cached;
+    if ( cached && !MemoryEpochCommon::IsSlabInsideWindow( reused_epoch->GetArena(), cached ) ) {
+      RememberSlabOutsideWindow( reused_epoch, cached );
+    }
+  }
+  RebuildAddressIndex();
+  PublishCurrentEpoch();
+  uint64_t elapsed_ns = ElapsedNs( started );
+  sampler_.Account( true, elapsed_ns );
+  EventTrace::Record( SMALL_TRACE_EPOCH_ROTATION, this, (uint64_t)min_id, (uint32_t)std::min< uint64_t >( elapsed_ns / 1000, UINT32_MAX ) );
+}
+
+void MemoryEpochQueue::CollectCurrentEpoch( int64_t min_id ) noexcept {
+  PerfCost cost;
+  // lsregion_gc_orig может отдать slab'ы под новые аллокации, поэтому их канарейки проверяются заранее
+  MemoryEpoch * current = GetCurrentEpoch();
+  if ( current->HasRedzones() ) current->VerifyRedzones( min_id, cost );
+  current->ForgetSites( min_id );
+  current->GarbageCollect( min_id, cost );
+  counters_.Add( cost );
+}
+
+AddressIndexEntry MemoryEpochQueue::MakeIndexEntry( Size age, Size position ) noexcept {
+  Size nepochs = epochs_->GetNumberEpochs();
+  MemoryEpoch * epoch = epochs_->GetPrevious( age );
+  assert( (bool)epoch );
+  AddressIndexEntry entry;
+  entry.position = position - age;
+  entry.slab_size = epoch->GetSlabSize();
+  // текущая эпоха ещё принимает любые id, самая старая - все id до своего
+  entry.max_id = age ? epoch->GetRetiredId() : INT64_MAX;
+  entry.min_id = 0;
+  if ( age + 1 < nepochs ) {
+    MemoryEpoch * older = epochs_->GetPrevious( age + 1 );
+    assert( (bool)older );
+    entry.min_id = older->GetRetiredId();
   }
+  const MemoryRange & window = epoch->GetWindow();
+  entry.start = window.start;
+  entry.byte_size = window.byte_size;
+  return entry;
+}
+
+void MemoryEpochQueue::RebuildAddressIndex() noexcept {
+  Size nepochs = epochs_->GetNumberEpochs();
+  Size position = epochs_->GetPositionOrMaxId();
+  index_.BeginUpdate();
+  for ( Size age = 0; age < nepochs; ++age ) {
+    AddressIndexEntry entry = MakeIndexEntry( age, position );
+    index_.Add( entry );
+    MemoryEpoch * epoch = epochs_->GetPrevious( age );
+    for ( Size i = 0; i < nslabs_outside_window_; ++i ) {
+      if ( slabs_outside_window_[i].epoch != epoch ) continue;
+      entry.start = slabs_outside_window_[i].start;
+      entry.byte_size = epoch->GetSlabSize();
+      index_.Add( entry );
+    }
+  }
+  index_.EndUpdate( position );
+}
+
+bool MemoryEpochQueue::FindAddress( const void * ptr, AddressIndexEntry & found, Size & age ) const noexcept {
+  Size position = 0;
+  if ( !index_.Find( ptr, found, position ) ) return false;
+  age = position - found.position;
+  return true;
 }
 
-MemoryEpochInterface * MemoryEpochQueue::GetCurrentEpoch() {
+template <typename FunctorTn> 
+void MemoryEpochQueue::ForEachEpoch( FunctorTn && functor ) {
+  Size position = epochs_->GetPositionOrMaxId();
+  for ( Size age = 0; age < epochs_->GetNumberEpochs(); ++age ) {
+    functor( epochs_->GetPrevious( age ), age, position - age );
+  }
+}
+
+Size MemoryEpochQueue::GetQuarantinedBytes( Size & resident, Size & nepochs ) noexcept {
+  Size ret = 0;
+  resident = 0;
+  nepochs = 0;
+  for ( Size age = 0; age < epochs_->GetNumberEpochs(); ++age ) {
+    Size epoch_resident = 0;
+    Size epoch_bytes = epochs_->GetPrevious( age )->GetQuarantinedBytes( epoch_resident );
+    if ( !epoch_bytes ) continue;
+    ret += epoch_bytes;
+    resident += epoch_resident;
+    ++nepochs;
+  }
+  return ret;
+}
+
+bool MemoryEpochQueue::RememberSlabOutsideWindow( MemoryEpoch * epoch, void * slab ) noexcept {
+  for ( Size i = 0; i < nslabs_outside_window_; ++i ) {
+    if ( slabs_outside_window_[i].start != slab ) continue;
+    // slab из кэша арены вернулся в lsregion той же эпохи
+    if ( slabs_outside_window_[i].epoch == epoch ) return false;
+    slabs_outside_window_[i].epoch = epoch;
+    index_.Remove( slab );
+    return true;
+  }
+  // индекс всё равно не вместит больше, такой slab FindAddress просто не найдёт
+  if ( nslabs_outside_window_ == slabs_outside_window_.size() ) return false;
+  slabs_outside_window_[nslabs_outside_window_++] = SlabOutsideWindow{ epoch, (Byte *)slab };
+  return true;
+}
+
+void MemoryEpochQueue::TrackSlabOutsideWindow( MemoryEpoch * epoch, void * slab ) noexcept {
+  assert( epoch == GetCurrentEpoch() );
+  if ( !RememberSlabOutsideWindow( epoch, slab ) ) return;
+  AddressIndexEntry entry = MakeIndexEntry( 0, epochs_->GetPositionOrMaxId() );
+  entry.start = (Byte *)slab;
+  entry.byte_size = epoch->GetSlabSize();
+  index_.Insert( entry );
+}
+
+void MemoryEpochQueue::UntrackSlabOutsideWindow( void * slab ) noexcept {
+  for ( Size i = 0; i < nslabs_outside_window_; ++i ) {
+    if ( slabs_outside_window_[i].start != slab ) continue;
+    slabs_outside_window_[i] = slabs_outside_window_[--nslabs_outside_window_];
+    index_.Remove( slab );
+    return;
+  }
+}
+
+void MemoryEpochQueue::ForgetSlabsOutsideWindow( MemoryEpoch * epoch ) noexcept {
+  Size kept = 0;
+  for ( Size i = 0; i < nslabs_outside_window_; ++i ) {
+    if ( slabs_outside_window_[i].epoch != epoch ) slabs_outside_window_[kept++] = slabs_outside_window_[i];
+  }
+  nslabs_outside_window_ = kept;
+}
+
+void MemoryEpochQueue::AccountRotation( const PerfCost & cost ) noexcept {
+  last_rotation_protect_calls_.store( cost.protect_calls, std::memory_order_relaxed );
+  counters_.Add( cost );
+}
+
+void MemoryEpochQueue::PublishCurrentEpoch() noexcept {
+  MemoryEpoch * current = GetCurrentEpoch();
+  current->SetQueue( this );
+  current_arena_.store( current->GetArena(), std::memory_order_release );
+  current_lsregion_.store( current->GetLsRegion(), std::memory_order_release );
+  current_epoch_.store( current, std::memory_order_release );
+}
+
+int MemoryEpochQueue::InitCurrentArena( 
+    quota * quota_value, 
+    Size prealloc, 
+    uint32_t slab_size, 
+    int flags ) noexcept {
+  int ret = GetCurrentEpoch()->InitArena( quota_value, prealloc, slab_size, flags );
+  RebuildAddressIndex();
+  PublishCurrentEpoch();
+  return ret;
+}
+
+MemoryEpoch * MemoryEpochQueue::GetCurrentEpoch() {
   assert( CheckIfThisIsReallyMemoryEpochQueue() );
   assert( (bool)epochs_ );
-  MemoryEpochInterface * ret = epochs_->GetCurrent();
+  MemoryEpoch * ret = epochs_->GetCurrent();
   assert( (bool)ret );
   assert( ret->CheckIfThisIsReallyMemoryEpoch() );
   return ret;
 }
 
-MemoryEpochLsRegion * MemoryEpochQueue::GetLsEpoch( MemoryEpochInterface * val_interface ) {
-    assert( (bool)val_interface );
-    assert(   dynamic_cast<MemoryEpochLsRegion *>( val_interface )   );
-    MemoryEpochLsRegion * epoch = (MemoryEpochLsRegion *)val_interface;
-    return epoch;
-}
-
 MemoryEpochQueue * 
 MemoryEpochQueue::AllocateQueue() noexcept {
   //static_assert( std::is_base_of< MemoryEpochInterface, DerivedTn>::value, "Template argument must be inherited from MemoryEpochInterface" );
@@ -138,6 +330,7 @@ MemoryEpochQueue::AllocateQueue() noexcept {
   Size page_size = PageSize::kInitialPageSize; // AllocateWithForbiddenPageAtStart изменит это значение и установит его на PageSize()()
   auto ret = AllocateWithForbiddenPageAtStart<MemoryEpochQueue>( allocated_bytes, page_size );
   assert( (bool)ret );
+  Construct( *ret );
   ret->offset_of_allocated_= -page_size;
   ret->allocated_byte_size_ = allocated_bytes;
   return ret;
@@ -146,8 +339,8 @@ MemoryEpochQueue::AllocateQueue() noexcept {
 void MemoryEpochQueue::operator delete( void * to_free ) noexcept {  
   if ( !to_free ) return;
   MemoryEpochQueue * object = (MemoryEpochQueue*)to_free;
-  assert( object->CheckIfThisIsReallyMemoryEpochQueue() );
-  DeallocateWithForbiddenPageAtStart( GetHandle( object ), object->allocated_byte_size_ );
+  // деструктор уже обнулил сигнатуру, поэтому без проверок. Страницу перед объектом функция вычтет сама
+  DeallocateWithForbiddenPageAtStart( object, object->allocated_byte_size_ );
 }
 
 MemoryEpochQueue * MemoryEpochQueue::GetSelfByHandleNoChecks( void * handle ) noexcept {
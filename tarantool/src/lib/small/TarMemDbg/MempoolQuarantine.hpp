@@ -0,0 +1,73 @@
+/**
+ ** @file MempoolQuarantine.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий карантин освобождённых объектов mempool'ов
+ ** \~russian @details Эпохи защищают только память lsregion'ов. mempool (и small_alloc поверх него) сразу
+ **                    кладёт освобождённый объект в free list slab'а, и следующий mempool_alloc отдаёт
+ **                    его снова, так что обращение по висячему указателю ничего не ломает заметно.
+ **                    Карантин задерживает переиспользование: освобождённый объект заливается канарейкой
+ **                    и встаёт в конец FIFO своего mempool'а, а в free list slab'а попадает, только когда
+ **                    его вытеснят более новые
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    MEMPOOL_QUARANTINE_PROTECT_SIGNATURE_W8FJ3QN5TC1LDA
+#define    MEMPOOL_QUARANTINE_PROTECT_SIGNATURE_W8FJ3QN5TC1LDA
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Карантин освобождённых объектов одного mempool'а
+ ** @details Кольцевой буфер указателей в страницах MetadataPagePool, растёт вдвое до предела
+ **          GetBudget() / objsize. Put и вытеснение - O(1): заливка объекта канарейкой при Put и её проверка
+ **          при возврате в slab. Когда в карантине оказываются все объекты slab'а (тогда его нет ни в
+ **          hot_slabs, ни в cold_slabs), тело slab'а от первой границы страницы после заголовка mslab
+ **          запрещается целиком. Страница заголовка остаётся доступной: в неё пишут соседи по спискам
+ **          и дереву mempool'а. Как и сам mempool, карантин используется одним потоком
+ **/
+class MempoolQuarantine {
+ public:
+  /// сколько байт держит карантин каждого mempool'а, при первом обращении читается из TARARAM_MEMPOOL_QUARANTINE
+  static Size GetBudget() noexcept { return budget_.Get(); }
+  /// @return предыдущий размер. Уже освобождённые объекты сверх нового размера вытесняются при следующих Put
+  static Size SetBudget( Size byte_size ) noexcept { return budget_.Set( byte_size ); }
+  /// limit - бюджет, items - объекты, protected_size - slab'ы, все объекты которых в карантине и тело недоступно
+  static QuarantineStats GetStats() noexcept { return counters_.GetStats( GetBudget() ); }
+
+  /// @return false, если карантин выключен и объект надо освободить как обычно
+  static bool Put( struct mempool * pool, struct mslab * slab, void * ptr ) noexcept;
+  /// возвращает все объекты карантина в их slab'ы и удаляет карантин mempool'а
+  static void Drain( struct mempool * pool ) noexcept;
+
+  MempoolQuarantine() {}
+  ~MempoolQuarantine();
+
+ protected:
+  DISALLOW_COPY_MOVE_AND_ASSIGN( MempoolQuarantine )
+  static MempoolQuarantine * Get( struct mempool * pool ) noexcept { return (MempoolQuarantine *)pool->quarantine; }
+  /// возвращает самый старый объект в его slab, проверив канарейку
+  void RecycleOldest( struct mempool * pool ) noexcept;
+  bool Grow( Size limit ) noexcept;
+  /// запрещает или разрешает тело slab'а, @sa MempoolQuarantine
+  static void ProtectSlabBody( struct mslab * slab, ProtectMemoryConstant protection ) noexcept;
+  static void ReportCorruption( const struct mempool * pool, const Byte * object ) noexcept;
+
+ private:
+  void ** ring_ = nullptr;
+  Size capacity_ = 0; ///< в указателях, ring_ занимает целые страницы
+  Size head_ = 0;     ///< самый старый объект
+  Size count_ = 0;
+  static EnvSetting<Size> budget_;
+  static QuarantineCounters counters_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // MEMPOOL_QUARANTINE_PROTECT_SIGNATURE_W8FJ3QN5TC1LDA
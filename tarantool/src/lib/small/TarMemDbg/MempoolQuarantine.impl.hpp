@@ -0,0 +1,113 @@
+/**
+ ** @file MempoolQuarantine.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "карантина mempool'ов" MempoolQuarantine.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    MEMPOOL_QUARANTINE_IMPL_PROTECT_SIGNATURE_E2VK6RB9HX4NQM
+
+namespace      TARMEMDBG_NAMESPACE {
+
+EnvSetting<Size> MempoolQuarantine::budget_ { "TARARAM_MEMPOOL_QUARANTINE", TARMEMDBG_MEMPOOL_QUARANTINE, ParseEnvSize };
+QuarantineCounters MempoolQuarantine::counters_ { "mempool object", "free" };
+
+MempoolQuarantine::~MempoolQuarantine() {
+  assert( !count_ );
+  if ( ring_ ) DeallocateMetadataPages( ring_, capacity_ * sizeof( void * ) );
+}
+
+bool MempoolQuarantine::Put( struct mempool * pool, struct mslab * slab, void * ptr ) noexcept {
+  Size limit = GetBudget() / pool->objsize;
+  MempoolQuarantine * quarantine = Get( pool );
+  if ( !quarantine ) {
+    if ( !limit ) return false;
+    quarantine = NewAligned<MempoolQuarantine>();
+    if ( !quarantine ) return false;
+    pool->quarantine = (struct mempool_quarantine *)quarantine;
+  }
+  // размер карантина могли уменьшить, лишнее уходит сразу, а не по одному объекту за Put
+  while ( quarantine->count_ && quarantine->count_ >= limit ) quarantine->RecycleOldest( pool );
+  if ( !limit ) return false;
+  if ( quarantine->count_ == quarantine->capacity_ && !quarantine->Grow( limit ) ) {
+    if ( !quarantine->count_ ) return false;
+    quarantine->RecycleOldest( pool );
+  }
+  memset( ptr, RedzoneTable::kCanary, pool->objsize );
+  quarantine->ring_[( quarantine->head_ + quarantine->count_ ) % quarantine->capacity_] = ptr;
+  ++quarantine->count_;
+  counters_.Put( pool->objsize, 0 );
+  if ( ++slab->nquarantined == pool->objcount ) {
+    assert( !slab->nfree && !slab->in_hot_slabs );
+    ProtectSlabBody( slab, kProtectNone );
+    counters_.Protect( 1 );
+  }
+  return true;
+}
+
+void MempoolQuarantine::Drain( struct mempool * pool ) noexcept {
+  MempoolQuarantine * quarantine = Get( pool );
+  if ( !quarantine ) return;
+  while ( quarantine->count_ ) quarantine->RecycleOldest( pool );
+  pool->quarantine = nullptr;
+  DeleteAligned( quarantine );
+}
+
+bool MempoolQuarantine::Grow( Size limit ) noexcept {
+  Size page_size = PageSize()();
+  Size per_page = page_size / sizeof( void * );
+  Size capacity = std::max( capacity_ * 2, per_page );
+  capacity = std::min( capacity, ( limit + per_page - 1 ) / per_page * per_page );
+  if ( capacity <= capacity_ ) return false;
+  void ** ring = (void **)AllocateMetadataPages( capacity * sizeof( void * ) );
+  if ( !ring ) return false;
+  for ( Size i = 0; i < count_; ++i ) ring[i] = ring_[( head_ + i ) % capacity_];
+  if ( ring_ ) DeallocateMetadataPages( ring_, capacity_ * sizeof( void * ) );
+  ring_ = ring;
+  capacity_ = capacity;
+  head_ = 0;
+  return true;
+}
+
+void MempoolQuarantine::RecycleOldest( struct mempool * pool ) noexcept {
+  assert( count_ );
+  Byte * object = (Byte *)ring_[head_];
+  head_ = ( head_ + 1 ) % capacity_;
+  --count_;
+  // slab'ы mempool'а выровнены по своему размеру, как в slab_from_ptr
+  struct mslab * slab = (struct mslab *)( (intptr_t)object & pool->slab_ptr_mask );
+  if ( slab->nquarantined-- == pool->objcount ) {
+    ProtectSlabBody( slab, kProtectReadWrite );
+    counters_.Unprotect( 1 );
+  }
+  if ( !RedzoneTable::IsIntact( object, pool->objsize ) ) ReportCorruption( pool, object );
+  counters_.Release( pool->objsize, 0 );
+  mslab_free( pool, slab, object );
+}
+
+void MempoolQuarantine::ProtectSlabBody( struct mslab * slab, ProtectMemoryConstant protection ) noexcept {
+  // slab в одну страницу целиком занят заголовком - защищать нечего
+  ProtectWholePagesInside( (Byte *)slab + mslab_sizeof(), slab->slab.size - mslab_sizeof(), protection );
+}
+
+void MempoolQuarantine::ReportCorruption( const struct mempool * pool, const Byte * object ) noexcept {
+  Size bad = 0;
+  while ( bad < pool->objsize && object[bad] == RedzoneTable::kCanary ) ++bad;
+  assert( bad < pool->objsize );
+  counters_.ReportCorruption( object, pool->objsize, object + bad );
+  AllocationSites::Print( AllocationSites::FindInMempool( pool, object ) );
+  if ( TARMEMDBG_MEMPOOL_QUARANTINE_ABORT ) abort();
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    MEMPOOL_QUARANTINE_IMPL_PROTECT_SIGNATURE_E2VK6RB9HX4NQM
+#endif  // MEMPOOL_QUARANTINE_IMPL_PROTECT_SIGNATURE_E2VK6RB9HX4NQM
@@ -0,0 +1,73 @@
+/**
+ ** @file MetadataPagePool.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий пул страниц под собственные объекты отладчика
+ ** \~russian @details Очереди эпох, эпохи, их slab_arena и lsregion занимают целые страницы (их защищают mprotect'ом).
+ **                    Раньше каждая такая страница бралась memalign'ом, то есть из кучи приложения и с вызовом
+ **                    malloc на каждом сдвиге эпох. Пул нарезает страницы из своих отображений и держит
+ **                    освобождённые серии страниц в списках по числу страниц, не трогая libc malloc
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    METADATA_PAGE_POOL_PROTECT_SIGNATURE_B7NW4QE1JZ9TUC
+#define    METADATA_PAGE_POOL_PROTECT_SIGNATURE_B7NW4QE1JZ9TUC
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct MetadataPoolStats {
+  Size mapped_bytes = 0; ///< всё, что пул отобразил (куски и отдельные отображения)
+  Size used_bytes = 0;   ///< выдано и не возвращено
+  Size cached_bytes = 0; ///< возвращено и ждёт повторной выдачи
+  Size chunks = 0;       ///< отображённые куски по TARMEMDBG_METADATA_CHUNK_SIZE
+  Size direct_maps = 0;  ///< серии длиннее kMaxCachedPages, отображённые отдельно
+  Size allocations = 0;
+  Size reused = 0;       ///< из них взято из списков освобождённых
+};
+
+/**
+ ** @brief Пул страниц для метаданных отладчика
+ ** @details Серии до kMaxCachedPages страниц нарезаются из кусков, отображённых mmap'ом, и после
+ **          освобождения попадают в список своей длины (ссылка хранится в первом слове серии).
+ **          Длинные серии отображаются и освобождаются напрямую. Куски никогда не отдаются munmap'у.
+ **          Пул не разрушается: метаданные освобождаются и из деструкторов глобальных объектов,
+ **          и из потока EpochProtector, поэтому он под мьютексом
+ **/
+class MetadataPagePool {
+ public:
+  static constexpr const Size kMaxCachedPages = 16;
+
+  /// @param byte_size кратен странице. @return nullptr, если памяти нет
+  static void * Allocate( Size byte_size ) noexcept { return GetInstance().Allocate_( byte_size ); }
+  /// серия должна быть открыта на чтение и запись. @a byte_size - тот же, что и при выделении
+  static void Deallocate( void * pages, Size byte_size ) noexcept { GetInstance().Deallocate_( pages, byte_size ); }
+  static MetadataPoolStats GetStats() noexcept;
+
+ protected:
+  struct FreeRun { FreeRun * next; };
+
+  MetadataPagePool() {}
+  DISALLOW_COPY_MOVE_AND_ASSIGN( MetadataPagePool )
+  static MetadataPagePool & GetInstance() noexcept;
+  void * Allocate_( Size byte_size ) noexcept;
+  void Deallocate_( void * pages, Size byte_size ) noexcept;
+  /// остаток текущего куска раскладывается по спискам, чтобы не пропал
+  void CacheChunkTail( Size page_size ) noexcept;
+
+ private:
+  Mutex mutex_;
+  std::array< FreeRun *, kMaxCachedPages + 1 > free_runs_ {}; ///< индекс - число страниц
+  Byte * chunk_position_ = nullptr;
+  Byte * chunk_end_ = nullptr;
+  MetadataPoolStats stats_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // METADATA_PAGE_POOL_PROTECT_SIGNATURE_B7NW4QE1JZ9TUC
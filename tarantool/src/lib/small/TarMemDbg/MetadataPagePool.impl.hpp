@@ -0,0 +1,119 @@
+/**
+ ** @file MetadataPagePool.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "пула страниц метаданных" MetadataPagePool.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    METADATA_PAGE_POOL_IMPL_PROTECT_SIGNATURE_L2XF8RM0VD6KQS
+
+namespace      TARMEMDBG_NAMESPACE {
+
+MetadataPagePool & MetadataPagePool::GetInstance() noexcept {
+  // пул никогда не разрушается, поэтому создаётся в статическом буфере
+  alignas( MetadataPagePool ) static Byte storage[ sizeof( MetadataPagePool ) ];
+  static MetadataPagePool * instance = ::new ( storage ) MetadataPagePool;
+  return *instance;
+}
+
+void * MetadataPagePool::Allocate_( Size byte_size ) noexcept {
+  Size page_size = PageSize()();
+  assert( byte_size && byte_size % page_size == 0 );
+  Size npages = byte_size / page_size;
+  LockGuard lock( mutex_ );
+  ++stats_.allocations;
+  if ( npages > kMaxCachedPages ) {
+    void * ret = MapGuardedBlock( byte_size, 0 );
+    if ( !ret ) return nullptr;
+    ++stats_.direct_maps;
+    stats_.mapped_bytes += byte_size;
+    stats_.used_bytes += byte_size;
+    return ret;
+  }
+  if ( FreeRun * run = free_runs_[npages] ) {
+    free_runs_[npages] = run->next;
+    ++stats_.reused;
+    stats_.cached_bytes -= byte_size;
+    stats_.used_bytes += byte_size;
+    return run;
+  }
+  if ( (Size)( chunk_end_ - chunk_position_ ) < byte_size ) {
+    Size chunk_size = std::max( (Size)TARMEMDBG_METADATA_CHUNK_SIZE, kMaxCachedPages * page_size );
+    Byte * chunk = (Byte *)MapGuardedBlock( chunk_size, 0 );
+    if ( !chunk ) return nullptr;
+    CacheChunkTail( page_size );
+    chunk_position_ = chunk;
+    chunk_end_ = chunk + chunk_size;
+    ++stats_.chunks;
+    stats_.mapped_bytes += chunk_size;
+  }
+  void * ret = chunk_position_;
+  chunk_position_ += byte_size;
+  stats_.used_bytes += byte_size;
+  return ret;
+}
+
+void MetadataPagePool::Deallocate_( void * pages, Size byte_size ) noexcept {
+  if ( !pages ) return;
+  Size page_size = PageSize()();
+  assert( byte_size && byte_size % page_size == 0 );
+  assert( (uintptr_t)pages % page_size == 0 );
+  Size npages = byte_size / page_size;
+  LockGuard lock( mutex_ );
+  stats_.used_bytes -= byte_size;
+  if ( npages > kMaxCachedPages ) {
+    UnmapMemory( pages, byte_size );
+    stats_.mapped_bytes -= byte_size;
+    return;
+  }
+  FreeRun * run = (FreeRun *)pages;
+  run->next = free_runs_[npages];
+  free_runs_[npages] = run;
+  stats_.cached_bytes += byte_size;
+}
+
+void MetadataPagePool::CacheChunkTail( Size page_size ) noexcept {
+  while ( chunk_position_ < chunk_end_ ) {
+    Size npages = std::min( (Size)( chunk_end_ - chunk_position_ ) / page_size, kMaxCachedPages );
+    FreeRun * run = (FreeRun *)chunk_position_;
+    run->next = free_runs_[npages];
+    free_runs_[npages] = run;
+    chunk_position_ += npages * page_size;
+    stats_.cached_bytes += npages * page_size;
+  }
+}
+
+MetadataPoolStats MetadataPagePool::GetStats() noexcept {
+  MetadataPagePool & pool = GetInstance();
+  LockGuard lock( pool.mutex_ );
+  return pool.stats_;
+}
+
+static inline void * AllocateMetadataPages( Size byte_size ) noexcept {
+# if       TARMEMDBG_METADATA_POOL
+  return MetadataPagePool::Allocate( byte_size );
+# else  // TARMEMDBG_METADATA_POOL
+  return AllocateAligned( byte_size, PageSize()() );
+# endif // TARMEMDBG_METADATA_POOL
+}
+
+static inline void DeallocateMetadataPages( void * pages, [[maybe_unused]] Size byte_size ) noexcept {
+# if       TARMEMDBG_METADATA_POOL
+  MetadataPagePool::Deallocate( pages, byte_size );
+# else  // TARMEMDBG_METADATA_POOL
+  DeallocateAligned( pages );
+# endif // TARMEMDBG_METADATA_POOL
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    METADATA_PAGE_POOL_IMPL_PROTECT_SIGNATURE_L2XF8RM0VD6KQS
+#endif  // METADATA_PAGE_POOL_IMPL_PROTECT_SIGNATURE_L2XF8RM0VD6KQS
@@ -0,0 +1,80 @@
+/**
+ ** @file PerfCounters.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий счётчики стоимости работы отладчика
+ ** \~russian @details Счётчики атомарные и меняются с memory_order_relaxed: их читают только для статистики
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    PERF_COUNTERS_PROTECT_SIGNATURE_R1MW8ZQ5KD2HNV
+#define    PERF_COUNTERS_PROTECT_SIGNATURE_R1MW8ZQ5KD2HNV
+
+namespace      TARMEMDBG_NAMESPACE {
+
+typedef std::chrono::steady_clock Clock;
+
+static inline uint64_t ElapsedNs( Clock::time_point started ) noexcept {
+  return (uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - started ).count();
+}
+
+/**
+ ** @brief Стоимость одной порции работы (например, одного RotationJob), потом добавляется в PerfCounters
+ **/
+struct PerfCost {
+  Size protect_calls = 0;  ///< вызовы mprotect
+  uint64_t protect_ns = 0; ///< время в ProtectEpoch_
+  Size gc_calls = 0;       ///< вызовы lsregion_gc_orig
+  uint64_t gc_ns = 0;      ///< время в lsregion_gc_orig
+  Size redzone_checks = 0; ///< проверенные канарейки redzone'ов
+  uint64_t redzone_ns = 0; ///< время их проверки
+};
+
+struct PerfCounters {
+  std::atomic<Size> protect_calls { 0 };
+  std::atomic<uint64_t> protect_ns { 0 };
+  std::atomic<Size> gc_calls { 0 };
+  std::atomic<uint64_t> gc_ns { 0 };
+  std::atomic<Size> redzone_checks { 0 };
+  std::atomic<uint64_t> redzone_ns { 0 };
+
+  template <typename Tn> static void Add( std::atomic<Tn> & counter, Tn value ) noexcept { 
+    counter.fetch_add( value, std::memory_order_relaxed ); 
+  }
+  template <typename Tn> static Tn Get( const std::atomic<Tn> & counter ) noexcept { 
+    return counter.load( std::memory_order_relaxed ); 
+  }
+  void Add( const PerfCost & cost ) noexcept {
+    Add( protect_calls, cost.protect_calls );
+    Add( protect_ns, cost.protect_ns );
+    Add( gc_calls, cost.gc_calls );
+    Add( gc_ns, cost.gc_ns );
+    Add( redzone_checks, cost.redzone_checks );
+    Add( redzone_ns, cost.redzone_ns );
+  }
+};
+
+/**
+ ** @brief Аллокации из lsregion'а очереди
+ ** @details lsregion однопоточный, счётчики пишет только его поток, поэтому вместо атомарного RMW 
+ **          на каждую аллокацию - relaxed load и store. Статистика читает их без блокировок
+ **/
+struct AllocationCounters {
+  std::atomic<Size> allocations { 0 };
+  std::atomic<Size> allocated_bytes { 0 };
+
+  void Add( Size byte_size ) noexcept {
+    allocations.store( allocations.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    allocated_bytes.store( allocated_bytes.load( std::memory_order_relaxed ) + byte_size, std::memory_order_relaxed );
+  }
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // PERF_COUNTERS_PROTECT_SIGNATURE_R1MW8ZQ5KD2HNV
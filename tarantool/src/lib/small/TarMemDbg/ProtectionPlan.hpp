@@ -0,0 +1,68 @@
+/**
+ ** @file ProtectionPlan.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий план защиты памяти эпохи - набор объединённых диапазонов адресов
+ ** \~russian @details Вместо двух mprotect на каждый slab диапазоны собираются один раз,
+ **                    сортируются, соседние склеиваются, и защита ставится минимальным числом вызовов
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    PROTECTION_PLAN_PROTECT_SIGNATURE_H3QZ7M1VX0C8RT
+#define    PROTECTION_PLAN_PROTECT_SIGNATURE_H3QZ7M1VX0C8RT
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Выровненный по странице диапазон адресов [start, start + byte_size)
+ **/
+struct MemoryRange {
+  Byte * start = nullptr;
+  Size byte_size = 0;
+
+  Byte * GetEnd() const noexcept { return start + byte_size; }
+};
+
+/**
+ ** @brief План защиты: диапазоны памяти эпохи, отсортированные и склеенные
+ ** @details Диапазоны собираются, пока память эпохи доступна на чтение (ходить по спискам slab'ов 
+ **          под PROT_NONE нельзя). Пока эпоха не открыта на запись, её slab'ы не меняются, поэтому 
+ **          готовый план переиспользуется для всех следующих смен защиты без обхода списков
+ **/
+class ProtectionPlan {
+ public:
+  typedef std::vector< MemoryRange > Ranges;
+
+  void Clear() noexcept { ranges_.clear(); built_ = false; }
+  void Invalidate() noexcept { built_ = false; }
+  bool IsBuilt() const noexcept { return built_; }
+  void AddRange( void * aligned_start, Size aligned_byte_size );
+  void Build();
+  /**
+   ** @brief устанавливает защиту на все диапазоны плана
+   ** @return число сделанных системных вызовов mprotect
+   **/
+  Size Apply( ProtectMemoryConstant protection ) const noexcept;
+  /**
+   ** @brief отдаёт ядру физическую память всех диапазонов плана
+   ** @return сколько байт отдано
+   **/
+  Size Release( QuarantineRelease mode ) const noexcept;
+  Size GetRangeCount() const noexcept { return ranges_.size(); }
+  Size GetByteSize() const noexcept;
+  Size GetResidentByteSize() const noexcept;
+
+ private:
+  Ranges ranges_;
+  bool built_ = false;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // PROTECTION_PLAN_PROTECT_SIGNATURE_H3QZ7M1VX0C8RT
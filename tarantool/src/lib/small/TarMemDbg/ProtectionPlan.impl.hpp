@@ -0,0 +1,78 @@
+/**
+ ** @file ProtectionPlan.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "плана защиты памяти" ProtectionPlan.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    PROTECTION_PLAN_IMPL_PROTECT_SIGNATURE_5UQW0E2N8KXD4F
+
+namespace      TARMEMDBG_NAMESPACE {
+
+void ProtectionPlan::AddRange( void * aligned_start, Size aligned_byte_size ) {
+  if ( !aligned_byte_size ) return;
+  [[maybe_unused]] Size page_size = PageSize()();
+  assert(   IsAlignedToMemoryPage( aligned_start, page_size )   );
+  assert(   IsAlignedToMemoryPage( aligned_byte_size, page_size )   );
+  ranges_.push_back( MemoryRange{ (Byte *)aligned_start, aligned_byte_size } );
+  built_ = false;
+}
+
+void ProtectionPlan::Build() {
+  std::sort( ranges_.begin(), ranges_.end(), 
+      []( const MemoryRange & left, const MemoryRange & right ) { return left.start < right.start; } );
+  // склеиваем соседние и перекрывающиеся диапазоны на месте
+  Size merged = 0;
+  for ( Size i = 0; i < ranges_.size(); ++i ) {
+    if ( merged && ranges_[merged - 1].GetEnd() >= ranges_[i].start ) {
+      Byte * end = std::max( ranges_[merged - 1].GetEnd(), ranges_[i].GetEnd() );
+      ranges_[merged - 1].byte_size = end - ranges_[merged - 1].start;
+    } else {
+      ranges_[merged++] = ranges_[i];
+    }
+  }
+  ranges_.resize( merged );
+  built_ = true;
+}
+
+Size ProtectionPlan::Apply( ProtectMemoryConstant protection ) const noexcept {
+  assert( built_ );
+  for ( const MemoryRange & range : ranges_ ) {
+    ProtectMemoryOrDie( range.start, range.byte_size, protection );
+  }
+  return ranges_.size();
+}
+
+Size ProtectionPlan::Release( QuarantineRelease mode ) const noexcept {
+  assert( built_ );
+  Size ret = 0;
+  for ( const MemoryRange & range : ranges_ ) {
+    if ( ReleasePhysicalMemory( range.start, range.byte_size, mode ) ) ret += range.byte_size;
+  }
+  return ret;
+}
+
+Size ProtectionPlan::GetResidentByteSize() const noexcept {
+  Size ret = 0;
+  for ( const MemoryRange & range : ranges_ ) ret += CountResidentBytes( range.start, range.byte_size );
+  return ret;
+}
+
+Size ProtectionPlan::GetByteSize() const noexcept {
+  Size ret = 0;
+  for ( const MemoryRange & range : ranges_ ) ret += range.byte_size;
+  return ret;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    PROTECTION_PLAN_IMPL_PROTECT_SIGNATURE_5UQW0E2N8KXD4F
+#endif  // PROTECTION_PLAN_IMPL_PROTECT_SIGNATURE_5UQW0E2N8KXD4F
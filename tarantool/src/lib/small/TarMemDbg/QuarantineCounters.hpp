@@ -0,0 +1,63 @@
+/**
+ ** @file QuarantineCounters.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий счётчики карантинов mempool'ов, region'ов и буферов
+ ** \~russian @details Счётчики атомарные и меняются с memory_order_relaxed: их читают только для статистики
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    QUARANTINE_COUNTERS_PROTECT_SIGNATURE_M4XQ7TB2RW9JNC
+#define    QUARANTINE_COUNTERS_PROTECT_SIGNATURE_M4XQ7TB2RW9JNC
+
+namespace      TARMEMDBG_NAMESPACE {
+
+struct QuarantineStats {
+  Size limit = 0;          ///< бюджет в байтах или глубина в поколениях, 0 - выключено
+  Size items = 0;          ///< slab'ы или объекты в карантинах сейчас
+  Size bytes = 0;          ///< и их размер
+  Size protected_size = 0; ///< из него недоступно: байты, у mempool'а - slab'ы, запрещённые целиком
+  Size released = 0;       ///< вернувшиеся из карантина
+  Size corrupted = 0;      ///< из них с испорченной канарейкой
+  const void * last_corrupted = nullptr; ///< первый испорченный байт последнего испорченного
+};
+
+/**
+ ** @brief Счётчики всех экземпляров карантина одного вида и сообщение о порче канарейки
+ **/
+class QuarantineCounters {
+ public:
+  /// @a what и @a retired_by для сообщения о порче: "<what> ... written after <retired_by>"
+  constexpr QuarantineCounters( const char * what, const char * retired_by ) noexcept
+      :  what_( what ), retired_by_( retired_by ) {}
+
+  void Put( Size byte_size, Size protected_size ) noexcept;
+  void Release( Size byte_size, Size protected_size ) noexcept;
+  /// недоступная часть меняется и без Put и Release: slab mempool'а запрещается, когда в карантине все его объекты
+  void Protect( Size protected_size ) noexcept { protected_size_.fetch_add( protected_size, std::memory_order_relaxed ); }
+  void Unprotect( Size protected_size ) noexcept { protected_size_.fetch_sub( protected_size, std::memory_order_relaxed ); }
+  /// считает и печатает порчу @a bad в @a item размером @a byte_size
+  void ReportCorruption( const void * item, Size byte_size, const Byte * bad ) noexcept;
+  QuarantineStats GetStats( Size limit ) const noexcept;
+
+ private:
+  DISALLOW_COPY_MOVE_AND_ASSIGN( QuarantineCounters )
+  const char * const what_;
+  const char * const retired_by_;
+  std::atomic<Size> items_ { 0 };
+  std::atomic<Size> bytes_ { 0 };
+  std::atomic<Size> protected_size_ { 0 };
+  std::atomic<Size> released_ { 0 };
+  std::atomic<Size> corrupted_ { 0 };
+  std::atomic<const void *> last_corrupted_ { nullptr };
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // QUARANTINE_COUNTERS_PROTECT_SIGNATURE_M4XQ7TB2RW9JNC
@@ -0,0 +1,55 @@
+/**
+ ** @file QuarantineCounters.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "счётчиков карантинов" QuarantineCounters.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    QUARANTINE_COUNTERS_IMPL_PROTECT_SIGNATURE_V6HN1SK8PD3ZFQ
+
+namespace      TARMEMDBG_NAMESPACE {
+
+void QuarantineCounters::Put( Size byte_size, Size protected_size ) noexcept {
+  items_.fetch_add( 1, std::memory_order_relaxed );
+  bytes_.fetch_add( byte_size, std::memory_order_relaxed );
+  protected_size_.fetch_add( protected_size, std::memory_order_relaxed );
+}
+
+void QuarantineCounters::Release( Size byte_size, Size protected_size ) noexcept {
+  items_.fetch_sub( 1, std::memory_order_relaxed );
+  bytes_.fetch_sub( byte_size, std::memory_order_relaxed );
+  protected_size_.fetch_sub( protected_size, std::memory_order_relaxed );
+  released_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void QuarantineCounters::ReportCorruption( const void * item, Size byte_size, const Byte * bad ) noexcept {
+  corrupted_.fetch_add( 1, std::memory_order_relaxed );
+  last_corrupted_.store( bad, std::memory_order_relaxed );
+  fprintf( stderr, "TaraRam: %s %p (size %zu) written after %s: byte +%zu is 0x%02x instead of 0x%02x\n",
+           what_, item, (size_t)byte_size, retired_by_, (size_t)( bad - (const Byte *)item ), (unsigned)*bad, (unsigned)RedzoneTable::kCanary );
+}
+
+QuarantineStats QuarantineCounters::GetStats( Size limit ) const noexcept {
+  QuarantineStats ret;
+  ret.limit = limit;
+  ret.items = items_.load( std::memory_order_relaxed );
+  ret.bytes = bytes_.load( std::memory_order_relaxed );
+  ret.protected_size = protected_size_.load( std::memory_order_relaxed );
+  ret.released = released_.load( std::memory_order_relaxed );
+  ret.corrupted = corrupted_.load( std::memory_order_relaxed );
+  ret.last_corrupted = last_corrupted_.load( std::memory_order_relaxed );
+  return ret;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    QUARANTINE_COUNTERS_IMPL_PROTECT_SIGNATURE_V6HN1SK8PD3ZFQ
+#endif  // QUARANTINE_COUNTERS_IMPL_PROTECT_SIGNATURE_V6HN1SK8PD3ZFQ
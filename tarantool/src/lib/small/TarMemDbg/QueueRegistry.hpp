@@ -0,0 +1,52 @@
+/**
+ ** @file QueueRegistry.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий реестр очередей эпох с поиском без блокировок
+ ** \~russian @details Заменяет std::map под глобальным мьютексом на горячем пути аллокаций
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    QUEUE_REGISTRY_PROTECT_SIGNATURE_W5K2D9QH1ZR7XE
+#define    QUEUE_REGISTRY_PROTECT_SIGNATURE_W5K2D9QH1ZR7XE
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Реестр всех созданных очередей эпох
+ ** @details Хэш-таблица фиксированного размера с открытой адресацией. Запись (Register) 
+ **          выполняется под глобальной блокировкой, чтение (Contains) - без блокировок, 
+ **          поэтому проверку хэндла можно делать на каждой аллокации и даже из обработчика сигнала.
+ **          Очереди из реестра не удаляются: slab_arena_destroy очередь не уничтожает
+ **/
+class QueueRegistry {
+ public:
+  static constexpr const Size kCapacity = 1024; ///< обязательно степень двойки
+
+  bool Register( MemoryEpochQueue * que ) noexcept;
+  bool Contains( const void * que ) const noexcept;
+  Size GetCount() const noexcept { return count_.load( std::memory_order_relaxed ); }
+  /**
+   ** @brief вызывает @a functor для каждой очереди, пока он не вернёт true. Без блокировок
+   ** @return true, если functor вернул true
+   **/
+  template <typename FunctorTn> bool FindIf( FunctorTn && functor ) const noexcept;
+
+ protected:
+  static Size Hash( const void * que ) noexcept;
+
+ private:
+  static_assert( ( kCapacity & ( kCapacity - 1 ) ) == 0, "kCapacity must be a power of two" );
+  std::array< std::atomic<MemoryEpochQueue *>, kCapacity > slots_ {};
+  std::atomic<Size> count_ { 0 };
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // QUEUE_REGISTRY_PROTECT_SIGNATURE_W5K2D9QH1ZR7XE
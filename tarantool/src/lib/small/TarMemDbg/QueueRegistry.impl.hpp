@@ -0,0 +1,66 @@
+/**
+ ** @file QueueRegistry.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "реестра очередей эпох" QueueRegistry.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    QUEUE_REGISTRY_IMPL_PROTECT_SIGNATURE_0JX6BN3TAP8LQC
+
+namespace      TARMEMDBG_NAMESPACE {
+
+Size QueueRegistry::Hash( const void * que ) noexcept {
+  // очереди выровнены по странице, младшие биты адреса всегда нулевые
+  Size key = (Size)( (uintptr_t)que / PageSize::kInitialPageSize );
+  key ^= key >> 17;
+  key *= 0x9E3779B97F4A7C15ull;
+  return ( key >> 32 ) & ( kCapacity - 1 );
+}
+
+bool QueueRegistry::Register( MemoryEpochQueue * que ) noexcept {
+  assert( (bool)que );
+  Size index = Hash( que );
+  for ( Size probe = 0; probe < kCapacity; ++probe, index = ( index + 1 ) & ( kCapacity - 1 ) ) {
+    MemoryEpochQueue * current = slots_[index].load( std::memory_order_relaxed );
+    if ( current == que ) return true;
+    if ( current == nullptr ) {
+      slots_[index].store( que, std::memory_order_release );
+      count_.fetch_add( 1, std::memory_order_relaxed );
+      return true;
+    }
+  }
+  return false; // таблица заполнена
+}
+
+bool QueueRegistry::Contains( const void * que ) const noexcept {
+  if ( !que ) return false;
+  Size index = Hash( que );
+  for ( Size probe = 0; probe < kCapacity; ++probe, index = ( index + 1 ) & ( kCapacity - 1 ) ) {
+    MemoryEpochQueue * current = slots_[index].load( std::memory_order_acquire );
+    if ( current == que ) return true;
+    if ( current == nullptr ) return false;
+  }
+  return false;
+}
+
+template <typename FunctorTn> 
+bool QueueRegistry::FindIf( FunctorTn && functor ) const noexcept {
+  for ( const auto & slot : slots_ ) {
+    MemoryEpochQueue * que = slot.load( std::memory_order_acquire );
+    if ( que && functor( que ) ) return true;
+  }
+  return false;
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    QUEUE_REGISTRY_IMPL_PROTECT_SIGNATURE_0JX6BN3TAP8LQC
+#endif  // QUEUE_REGISTRY_IMPL_PROTECT_SIGNATURE_0JX6BN3TAP8LQC
@@ -0,0 +1,109 @@
+/**
+ ** @file Redzone.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий redzone'ы с канарейками за аллокациями lsregion'ов эпох
+ ** \~russian @details Защита страниц не видит выход за конец аллокации внутри slab'а. Поэтому обёртки
+ **                    lsregion_alloc/lsregion_aligned_alloc могут добавлять к каждой аллокации redzone,
+ **                    заполненный канарейкой, а эпоха - запоминать его в таблице. Канарейки проверяются,
+ **                    когда эпоха перестаёт быть текущей (и перед lsregion_gc_orig текущей эпохи)
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    REDZONE_PROTECT_SIGNATURE_H6TQ2MV9XB4KZE
+#define    REDZONE_PROTECT_SIGNATURE_H6TQ2MV9XB4KZE
+
+namespace      TARMEMDBG_NAMESPACE {
+
+enum RedzoneScanIsa : int {
+  kScanScalar = 0,
+  kScanSse2 = 1,
+  kScanAvx2 = 2,
+};
+
+struct RedzoneStats {
+  Size redzone_size = 0;           ///< размер redzone'а новых аллокаций, 0 - выключено
+  RedzoneScanIsa isa = kScanScalar; ///< чем проверяются канарейки
+  Size table_bytes = 0;            ///< память таблиц эпох
+  Size checked = 0;                ///< проверено redzone'ов за всё время
+  Size corrupted = 0;              ///< из них испорчено
+  uint64_t scan_ns = 0;            ///< время проверок
+  const void * last_corrupted = nullptr; ///< первый испорченный байт последнего испорченного redzone'а
+};
+
+/**
+ ** @brief Таблица redzone'ов одной эпохи
+ ** @details Redzone'ы хранятся сериями: серия - база, id аллокаций и размер redzone'а,
+ **          а на каждый redzone остаётся только 32-битное смещение от базы. Новая серия начинается,
+ **          когда меняется id (lsregion_gc_orig освобождает память по id) или размер redzone'а,
+ **          или смещение не помещается в 32 бита. Таблицу меняет только поток, аллоцирующий из эпохи,
+ **          а проверяет - он же или EpochProtector, когда эпоха уже не текущая
+ **/
+class RedzoneTable {
+ public:
+  static constexpr const uint8_t kCanary = 0xCB;
+  static constexpr const Size kMaxRedzoneSize = 4096;
+
+  /// размер redzone'а новых аллокаций, при первом обращении читается из TARARAM_REDZONE
+  static Size GetRedzoneSize() noexcept { return redzone_size_.Get(); }
+  /// @return предыдущий размер. Приводится к [0, kMaxRedzoneSize]
+  static Size SetRedzoneSize( Size byte_size ) noexcept { return redzone_size_.Set( byte_size ); }
+  static RedzoneScanIsa GetScanIsa() noexcept;
+  static RedzoneStats GetStats() noexcept;
+  /// @return true, если [ @a from, @a from + @a byte_size ) целиком заполнен канарейкой
+  static bool IsIntact( const Byte * from, Size byte_size ) noexcept;
+  /// заливает [ @a from, @a from + @a byte_size ) канарейкой и запрещает целые страницы внутри. @return размер запрещённой части
+  static Size PoisonAndProtect( Byte * from, Size byte_size ) noexcept;
+  /**
+   ** @brief снимает защиту, поставленную PoisonAndProtect, и проверяет канарейку
+   ** @return первый испорченный байт или nullptr
+   **/
+  static const Byte * UnprotectAndVerify( Byte * from, Size byte_size, Size & protected_bytes ) noexcept;
+
+  ~RedzoneTable() { AccountTable( -(PtrDiff)GetTableBytes() ); }
+  /// заполняет [ @a redzone, @a redzone + @a byte_size ) канарейкой и запоминает его
+  void Add( Byte * redzone, Size byte_size, int64_t id ) noexcept;
+  /**
+   ** @brief проверяет все канарейки, потом забывает redzone'ы аллокаций с id <= @a forget_id
+   ** @param sites выбранные чанки эпохи: место аллокации испорченного redzone'а попадёт в сообщение
+   ** @return число испорченных redzone'ов
+   **/
+  Size Verify( int64_t forget_id, PerfCost & cost, const EpochSiteTable * sites = nullptr ) noexcept;
+  bool IsEmpty() const noexcept { return offsets_.empty(); }
+
+ protected:
+  struct Run {
+    Byte * base = nullptr;
+    int64_t id = 0;
+    uint32_t first = 0;        ///< первое смещение серии в offsets_
+    uint32_t redzone_size = 0;
+  };
+  /// @return индекс первого испорченного redzone'а серии, начиная с @a from, или @a count
+  typedef Size (*ScanFunction)( const Byte * base, const uint32_t * offsets, Size from, Size count, Size redzone_size );
+
+  static ScanFunction GetScanFunction() noexcept;
+  static void ReportCorruption( const Byte * redzone, Size redzone_size, int64_t id, const EpochSiteTable * sites ) noexcept;
+  void Forget( int64_t forget_id ) noexcept;
+  Size GetTableBytes() const noexcept { return runs_.capacity() * sizeof( Run ) + offsets_.capacity() * sizeof( uint32_t ); }
+  static void AccountTable( PtrDiff byte_size ) noexcept { table_bytes_.fetch_add( (Size)byte_size, std::memory_order_relaxed ); }
+
+ private:
+  std::vector< Run > runs_;
+  std::vector< uint32_t > offsets_;
+  static EnvSetting<Size> redzone_size_;
+  static std::atomic<Size> table_bytes_;
+  static std::atomic<Size> checked_;
+  static std::atomic<Size> corrupted_;
+  static std::atomic<uint64_t> scan_ns_;
+  static std::atomic<const void *> last_corrupted_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // REDZONE_PROTECT_SIGNATURE_H6TQ2MV9XB4KZE
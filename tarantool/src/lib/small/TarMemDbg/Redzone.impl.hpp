@@ -0,0 +1,225 @@
+/**
+ ** @file Redzone.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "redzone'ов" Redzone.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    REDZONE_IMPL_PROTECT_SIGNATURE_P0DJ7WC3NS5YUG
+
+namespace      TARMEMDBG_NAMESPACE {
+
+EnvSetting<Size> RedzoneTable::redzone_size_ { "TARARAM_REDZONE", TARMEMDBG_REDZONE_SIZE, ParseEnvSize, LimitSize<RedzoneTable::kMaxRedzoneSize> };
+std::atomic<Size> RedzoneTable::table_bytes_ { 0 };
+std::atomic<Size> RedzoneTable::checked_ { 0 };
+std::atomic<Size> RedzoneTable::corrupted_ { 0 };
+std::atomic<uint64_t> RedzoneTable::scan_ns_ { 0 };
+std::atomic<const void *> RedzoneTable::last_corrupted_ { nullptr };
+
+// Проверка канареек. redzone'ы обычно короткие, поэтому векторные версии читают только целые
+// векторы внутри redzone'а, а хвост дочитывают более узкими шагами
+
+static inline bool IsCanaryScalar( const Byte * from, Size byte_size ) noexcept {
+  constexpr uint64_t kCanaryWord = 0x0101010101010101ull * RedzoneTable::kCanary;
+  Size i = 0;
+  for ( ; i + sizeof( uint64_t ) <= byte_size; i += sizeof( uint64_t ) ) {
+    uint64_t word;
+    memcpy( &word, from + i, sizeof( word ) );
+    if ( word != kCanaryWord ) return false;
+  }
+  for ( ; i < byte_size; ++i ) {
+    if ( from[i] != RedzoneTable::kCanary ) return false;
+  }
+  return true;
+}
+
+static Size ScanRunScalar( const Byte * base, const uint32_t * offsets, Size from, Size count, Size redzone_size ) {
+  for ( Size i = from; i < count; ++i ) {
+    if ( !IsCanaryScalar( base + offsets[i], redzone_size ) ) return i;
+  }
+  return count;
+}
+
+# if       defined(__x86_64__)
+static inline bool IsCanarySse2( const Byte * from, Size byte_size ) noexcept {
+  const __m128i canary = _mm_set1_epi8( (char)RedzoneTable::kCanary );
+  Size i = 0;
+  for ( ; i + sizeof( __m128i ) <= byte_size; i += sizeof( __m128i ) ) {
+    __m128i value = _mm_loadu_si128( (const __m128i *)( from + i ) );
+    if ( _mm_movemask_epi8( _mm_cmpeq_epi8( value, canary ) ) != 0xFFFF ) return false;
+  }
+  return IsCanaryScalar( from + i, byte_size - i );
+}
+
+static Size ScanRunSse2( const Byte * base, const uint32_t * offsets, Size from, Size count, Size redzone_size ) {
+  for ( Size i = from; i < count; ++i ) {
+    if ( !IsCanarySse2( base + offsets[i], redzone_size ) ) return i;
+  }
+  return count;
+}
+
+#   if       defined(__GNUC__)
+#     define TARMEMDBG_HAS_AVX2_SCAN 1
+__attribute__(( target( "avx2" ) ))
+static inline bool IsCanaryAvx2( const Byte * from, Size byte_size ) noexcept {
+  const __m256i canary = _mm256_set1_epi8( (char)RedzoneTable::kCanary );
+  Size i = 0;
+  for ( ; i + sizeof( __m256i ) <= byte_size; i += sizeof( __m256i ) ) {
+    __m256i value = _mm256_loadu_si256( (const __m256i *)( from + i ) );
+    if ( (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( value, canary ) ) != 0xFFFFFFFFu ) return false;
+  }
+  return IsCanarySse2( from + i, byte_size - i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static Size ScanRunAvx2( const Byte * base, const uint32_t * offsets, Size from, Size count, Size redzone_size ) {
+  for ( Size i = from; i < count; ++i ) {
+    if ( !IsCanaryAvx2( base + offsets[i], redzone_size ) ) return i;
+  }
+  return count;
+}
+#   endif // defined(__GNUC__)
+# endif // defined(__x86_64__)
+
+RedzoneScanIsa RedzoneTable::GetScanIsa() noexcept {
+# if       defined(TARMEMDBG_HAS_AVX2_SCAN)
+  static const bool has_avx2 = __builtin_cpu_supports( "avx2" );
+  if ( has_avx2 ) return kScanAvx2;
+# endif // defined(TARMEMDBG_HAS_AVX2_SCAN)
+# if       defined(__x86_64__)
+  return kScanSse2;
+# else  // defined(__x86_64__)
+  return kScanScalar;
+# endif // defined(__x86_64__)
+}
+
+RedzoneTable::ScanFunction RedzoneTable::GetScanFunction() noexcept {
+  switch ( GetScanIsa() ) {
+# if       defined(TARMEMDBG_HAS_AVX2_SCAN)
+    case kScanAvx2: return &ScanRunAvx2;
+# endif // defined(TARMEMDBG_HAS_AVX2_SCAN)
+# if       defined(__x86_64__)
+    case kScanSse2: return &ScanRunSse2;
+# endif // defined(__x86_64__)
+    default: return &ScanRunScalar;
+  }
+}
+
+bool RedzoneTable::IsIntact( const Byte * from, Size byte_size ) noexcept {
+  switch ( GetScanIsa() ) {
+# if       defined(TARMEMDBG_HAS_AVX2_SCAN)
+    case kScanAvx2: return IsCanaryAvx2( from, byte_size );
+# endif // defined(TARMEMDBG_HAS_AVX2_SCAN)
+# if       defined(__x86_64__)
+    case kScanSse2: return IsCanarySse2( from, byte_size );
+# endif // defined(__x86_64__)
+    default: return IsCanaryScalar( from, byte_size );
+  }
+}
+
+Size RedzoneTable::PoisonAndProtect( Byte * from, Size byte_size ) noexcept {
+  memset( from, kCanary, byte_size );
+  return ProtectWholePagesInside( from, byte_size, kProtectNone );
+}
+
+const Byte * RedzoneTable::UnprotectAndVerify( Byte * from, Size byte_size, Size & protected_bytes ) noexcept {
+  protected_bytes = ProtectWholePagesInside( from, byte_size, kProtectReadWrite );
+  if ( IsIntact( from, byte_size ) ) return nullptr;
+  Size bad = 0;
+  while ( from[bad] == kCanary ) ++bad;
+  return from + bad;
+}
+
+RedzoneStats RedzoneTable::GetStats() noexcept {
+  RedzoneStats ret;
+  ret.redzone_size = GetRedzoneSize();
+  ret.isa = GetScanIsa();
+  ret.table_bytes = table_bytes_.load( std::memory_order_relaxed );
+  ret.checked = checked_.load( std::memory_order_relaxed );
+  ret.corrupted = corrupted_.load( std::memory_order_relaxed );
+  ret.scan_ns = scan_ns_.load( std::memory_order_relaxed );
+  ret.last_corrupted = last_corrupted_.load( std::memory_order_relaxed );
+  return ret;
+}
+
+void RedzoneTable::Add( Byte * redzone, Size byte_size, int64_t id ) noexcept {
+  memset( redzone, kCanary, byte_size );
+  Size table_bytes = GetTableBytes();
+  Run * run = runs_.empty() ? nullptr : &runs_.back();
+  if ( !run || run->id != id || run->redzone_size != byte_size ||
+       redzone < run->base || (Size)( redzone - run->base ) > UINT32_MAX ) {
+    Run started;
+    started.base = redzone;
+    started.id = id;
+    started.first = (uint32_t)offsets_.size();
+    started.redzone_size = (uint32_t)byte_size;
+    runs_.push_back( started );
+    run = &runs_.back();
+  }
+  offsets_.push_back( (uint32_t)( redzone - run->base ) );
+  // ёмкость векторов меняется редко, так что учёт памяти таблиц на горячем пути почти бесплатен
+  Size grown = GetTableBytes();
+  if ( grown != table_bytes ) AccountTable( (PtrDiff)( grown - table_bytes ) );
+}
+
+Size RedzoneTable::Verify( int64_t forget_id, PerfCost & cost, const EpochSiteTable * sites ) noexcept {
+  if ( offsets_.empty() ) return 0;
+  const auto started = Clock::now();
+  static const ScanFunction scan = GetScanFunction();
+  Size ret = 0;
+  for ( Size r = 0; r < runs_.size(); ++r ) {
+    const Run & run = runs_[r];
+    Size count = r + 1 < runs_.size() ? runs_[r + 1].first : offsets_.size();
+    for ( Size i = run.first; ( i = scan( run.base, offsets_.data(), i, count, run.redzone_size ) ) < count; ++i ) {
+      ReportCorruption( run.base + offsets_[i], run.redzone_size, run.id, sites );
+      ++ret;
+    }
+  }
+  cost.redzone_checks += offsets_.size();
+  checked_.fetch_add( offsets_.size(), std::memory_order_relaxed );
+  if ( ret ) corrupted_.fetch_add( ret, std::memory_order_relaxed );
+  Forget( forget_id );
+  uint64_t elapsed = ElapsedNs( started );
+  cost.redzone_ns += elapsed;
+  scan_ns_.fetch_add( elapsed, std::memory_order_relaxed );
+  return ret;
+}
+
+void RedzoneTable::Forget( int64_t forget_id ) noexcept {
+  // id в lsregion не убывают, поэтому забываемые серии - всегда начало таблицы
+  Size nruns = 0;
+  while ( nruns < runs_.size() && runs_[nruns].id <= forget_id ) ++nruns;
+  if ( nruns == runs_.size() ) {
+    runs_.clear();
+    offsets_.clear();
+    return;
+  }
+  Size noffsets = runs_[nruns].first;
+  runs_.erase( runs_.begin(), runs_.begin() + nruns );
+  offsets_.erase( offsets_.begin(), offsets_.begin() + noffsets );
+  for ( Run & run : runs_ ) run.first -= (uint32_t)noffsets;
+}
+
+void RedzoneTable::ReportCorruption( const Byte * redzone, Size redzone_size, int64_t id, const EpochSiteTable * sites ) noexcept {
+  Size bad = 0;
+  while ( bad < redzone_size && redzone[bad] == kCanary ) ++bad;
+  assert( bad < redzone_size );
+  last_corrupted_.store( redzone + bad, std::memory_order_relaxed );
+  fprintf( stderr, "TaraRam: lsregion allocation ending at %p (id %lld) overrun: redzone byte +%zu is 0x%02x instead of 0x%02x\n",
+           (const void *)redzone, (long long)id, (size_t)bad, (unsigned)redzone[bad], (unsigned)kCanary );
+  if ( sites ) AllocationSites::Print( sites->Find( redzone ) );
+  if ( TARMEMDBG_REDZONE_ABORT ) abort();
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    REDZONE_IMPL_PROTECT_SIGNATURE_P0DJ7WC3NS5YUG
+#endif  // REDZONE_IMPL_PROTECT_SIGNATURE_P0DJ7WC3NS5YUG
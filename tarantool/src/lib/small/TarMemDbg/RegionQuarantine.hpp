@@ -0,0 +1,89 @@
+/**
+ ** @file RegionQuarantine.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий поколения отрезанных slab'ов region'а
+ ** \~russian @details region_truncate и region_free сразу отдают slab'ы в slab_cache, и висячий указатель
+ **                    в память region'а (обычно - файбера) читает уже чужие данные. Тот же приём, что и
+ **                    у эпох: slab'ы, отрезанные одним вызовом, образуют поколение, region держит
+ **                    SlidingWindow последних поколений, а вытесненное поколение возвращается в slab_cache
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    REGION_QUARANTINE_PROTECT_SIGNATURE_K3MX8DW1QF6ZTB
+#define    REGION_QUARANTINE_PROTECT_SIGNATURE_K3MX8DW1QF6ZTB
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/// поколение - slab'ы одного region_truncate/region_free, связанные через next_in_list.next
+struct RegionGeneration {
+  struct slab * first = nullptr;
+};
+
+/// стратегия SlidingWindow: вытесненное поколение возвращается в slab_cache region'а
+class RegionGenerationRelease {
+ public:
+  typedef RegionGeneration Type;
+
+  explicit RegionGenerationRelease( struct slab_cache * cache = nullptr ) : cache_( cache ) {}
+  void OnDelete( Type & generation ) noexcept;
+
+ private:
+  struct slab_cache * cache_;
+};
+
+/**
+ ** @brief Поколения отрезанных slab'ов одного region'а
+ ** @details Put заливает данные slab'а канарейкой и запрещает его целые страницы после заголовка rslab
+ **          (страница заголовка остаётся доступной: её читает и пишет slab_cache при слиянии соседей
+ **          и в списке allocated, так что slab в одну страницу только отравляется). Slab'ы копятся в
+ **          открытом поколении, Seal кладёт его в окно. Канарейка проверяется при возврате в slab_cache.
+ **          Глубина окна берётся при создании, как и у эпох. Region используется одним потоком
+ **/
+class RegionQuarantine {
+ public:
+  static constexpr const Size kMaxGenerations = 16;
+
+  /// глубина окна новых region'ов, при первом обращении читается из TARARAM_REGION_GENERATIONS
+  static Size GetGenerations() noexcept { return generations_.Get(); }
+  /// @return предыдущую глубину. 0 возвращает поколения region'а в slab_cache при его следующем Put
+  static Size SetGenerations( Size generations ) noexcept { return generations_.Set( generations ); }
+  /// limit - глубина в поколениях, items - slab'ы, released - возвращённые в slab_cache
+  static QuarantineStats GetStats() noexcept { return counters_.GetStats( GetGenerations() ); }
+
+  /// @return false, если карантин выключен и slab надо вернуть в slab_cache как обычно
+  static bool Put( struct region * region, struct slab * slab ) noexcept;
+  /// закрывает открытое поколение region'а, если в нём есть slab'ы
+  static void Seal( struct region * region ) noexcept;
+  /// возвращает все поколения в slab_cache и удаляет карантин region'а
+  static void Drain( struct region * region ) noexcept;
+
+  RegionQuarantine( struct slab_cache * cache, Size generations );
+
+ protected:
+  friend class RegionGenerationRelease;
+  typedef SlidingWindow< RegionGeneration, kMaxGenerations, RegionGenerationRelease > Window;
+
+  DISALLOW_COPY_MOVE_AND_ASSIGN( RegionQuarantine )
+  static RegionQuarantine * Get( struct region * region ) noexcept { return (RegionQuarantine *)region->quarantine; }
+  static void Release( struct slab_cache * cache, RegionGeneration & generation ) noexcept;
+  static struct slab * GetNext( struct slab * slab ) noexcept {
+    return slab->next_in_list.next ? rlist_entry( slab->next_in_list.next, struct slab, next_in_list ) : nullptr;
+  }
+
+ private:
+  Window window_;
+  RegionGeneration open_;
+  static EnvSetting<Size> generations_;
+  static QuarantineCounters counters_;
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // REGION_QUARANTINE_PROTECT_SIGNATURE_K3MX8DW1QF6ZTB
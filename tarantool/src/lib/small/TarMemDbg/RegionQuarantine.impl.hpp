@@ -0,0 +1,87 @@
+/**
+ ** @file RegionQuarantine.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "поколений slab'ов region'а" RegionQuarantine.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    REGION_QUARANTINE_IMPL_PROTECT_SIGNATURE_U7BN2KE5YH0RPC
+
+namespace      TARMEMDBG_NAMESPACE {
+
+EnvSetting<Size> RegionQuarantine::generations_ { "TARARAM_REGION_GENERATIONS", TARMEMDBG_REGION_GENERATIONS, ParseEnvSize, LimitSize<RegionQuarantine::kMaxGenerations> };
+QuarantineCounters RegionQuarantine::counters_ { "region slab", "truncation" };
+
+void RegionGenerationRelease::OnDelete( Type & generation ) noexcept {
+  RegionQuarantine::Release( cache_, generation );
+}
+
+RegionQuarantine::RegionQuarantine( struct slab_cache * cache, Size generations )
+    :  window_( 1, RegionGeneration(), RegionGenerationRelease( cache ), generations ) {}
+
+bool RegionQuarantine::Put( struct region * region, struct slab * slab ) noexcept {
+  Size generations = GetGenerations();
+  RegionQuarantine * quarantine = Get( region );
+  if ( !generations ) {
+    if ( quarantine ) Drain( region );
+    return false;
+  }
+  if ( !quarantine ) {
+    quarantine = NewAligned<RegionQuarantine>( region->cache, generations );
+    if ( !quarantine ) return false;
+    region->quarantine = (struct region_quarantine *)quarantine;
+  }
+  Size protected_bytes = RedzoneTable::PoisonAndProtect( (Byte *)slab + rslab_sizeof(), slab->size - rslab_sizeof() );
+  // slab уже вынут из списка region'а, его next_in_list свободен
+  slab->next_in_list.next = quarantine->open_.first ? &quarantine->open_.first->next_in_list : nullptr;
+  quarantine->open_.first = slab;
+  counters_.Put( slab->size, protected_bytes );
+  return true;
+}
+
+void RegionQuarantine::Seal( struct region * region ) noexcept {
+  RegionQuarantine * quarantine = Get( region );
+  if ( !quarantine || !quarantine->open_.first ) return;
+  quarantine->window_.Push( quarantine->open_ );
+  quarantine->open_ = RegionGeneration();
+}
+
+void RegionQuarantine::Drain( struct region * region ) noexcept {
+  RegionQuarantine * quarantine = Get( region );
+  if ( !quarantine ) return;
+  Release( region->cache, quarantine->open_ );
+  Window & window = quarantine->window_;
+  for ( Size i = 0; i < window.GetNumberEpochs(); ++i ) Release( region->cache, window.GetPrevious( i ) );
+  region->quarantine = nullptr;
+  DeleteAligned( quarantine );
+}
+
+void RegionQuarantine::Release( struct slab_cache * cache, RegionGeneration & generation ) noexcept {
+  struct slab * slab = generation.first;
+  generation = RegionGeneration();
+  while ( slab ) {
+    struct slab * next = GetNext( slab );
+    Size protected_bytes = 0;
+    const Byte * bad = RedzoneTable::UnprotectAndVerify( (Byte *)slab + rslab_sizeof(), slab->size - rslab_sizeof(), protected_bytes );
+    if ( bad ) {
+      counters_.ReportCorruption( slab, slab->size, bad );
+      if ( TARMEMDBG_REGION_QUARANTINE_ABORT ) abort();
+    }
+    counters_.Release( slab->size, protected_bytes );
+    slab_put( cache, slab );
+    slab = next;
+  }
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    REGION_QUARANTINE_IMPL_PROTECT_SIGNATURE_U7BN2KE5YH0RPC
+#endif  // REGION_QUARANTINE_IMPL_PROTECT_SIGNATURE_U7BN2KE5YH0RPC
@@ -0,0 +1,86 @@
+/**
+ ** @file Sampling.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, описывающий выборочную (sampled) защиту эпох
+ ** \~russian @details Полную защиту получает только каждый N-й сдвиг эпох и только каждая N-я арена.
+ **                    Остальные сдвиги просто вызывают lsregion_gc_orig у текущей эпохи, 
+ **                    а остальные арены никогда не сдвигают эпохи. Так отладчик можно держать включённым всегда
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    SAMPLING_PROTECT_SIGNATURE_5HN0QZ8CWT2MVK
+#define    SAMPLING_PROTECT_SIGNATURE_5HN0QZ8CWT2MVK
+
+namespace      TARMEMDBG_NAMESPACE {
+
+/**
+ ** @brief Глобальные настройки выборки
+ ** @details Частота N означает "в среднем один из N", 1 - всегда, 0 - никогда.
+ **          При первом обращении читаются из переменных окружения TARARAM_SAMPLE_ROTATIONS и TARARAM_SAMPLE_ARENAS,
+ **          если их нет - TARMEMDBG_SAMPLE_ROTATIONS и TARMEMDBG_SAMPLE_ARENAS
+ **/
+class SamplingConfig {
+ public:
+  static Size GetRotationRate() noexcept { InitOnce(); return rotation_rate_.load( std::memory_order_relaxed ); }
+  static Size GetArenaRate() noexcept { InitOnce(); return arena_rate_.load( std::memory_order_relaxed ); }
+  static void SetRates( Size rotation_rate, Size arena_rate ) noexcept;
+  /**
+   ** @brief решает, будет ли новая арена защищаться. Вызывается при создании очереди эпох под глобальной блокировкой
+   **/
+  static bool SampleArena() noexcept;
+  static Size GetSampledArenas() noexcept { return sampled_arenas_.load( std::memory_order_relaxed ); }
+  static Size GetSkippedArenas() noexcept { return skipped_arenas_.load( std::memory_order_relaxed ); }
+
+ private:
+  static void InitOnce() noexcept;
+  static Size ReadRateFromEnvironment( const char * name, Size default_value ) noexcept;
+
+  static std::atomic<bool> initialized_;
+  static std::atomic<Size> rotation_rate_;
+  static std::atomic<Size> arena_rate_;
+  static std::atomic<Size> arenas_created_;
+  static std::atomic<Size> sampled_arenas_;
+  static std::atomic<Size> skipped_arenas_;
+};
+
+/**
+ ** @brief Выборка сдвигов эпох одной очереди
+ ** @details Как в GWP-ASan: до следующего защищаемого сдвига отсчитывается случайное число сдвигов 
+ **          из [1, 2N-1], в среднем N. Случайность нужна, чтобы выборка не совпадала по фазе с периодической нагрузкой
+ **/
+class RotationSampler {
+ public:
+  void Init( bool arena_sampled, uint64_t seed ) noexcept;
+  bool IsArenaSampled() const noexcept { return arena_sampled_; }
+  /// вызывается на каждом сдвиге эпох
+  bool ShouldSample() noexcept;
+
+  /// учитывает сдвиг эпох и время, потраченное на него
+  void Account( bool sampled, uint64_t nanoseconds ) noexcept;
+  Size GetSampledRotations() const noexcept { return sampled_rotations_.load( std::memory_order_relaxed ); }
+  Size GetSkippedRotations() const noexcept { return skipped_rotations_.load( std::memory_order_relaxed ); }
+  uint64_t GetSampledNs() const noexcept { return sampled_ns_.load( std::memory_order_relaxed ); }
+  uint64_t GetSkippedNs() const noexcept { return skipped_ns_.load( std::memory_order_relaxed ); }
+
+ private:
+  uint64_t NextRandom() noexcept;
+
+  bool arena_sampled_ = true;
+  uint64_t random_state_ = 0x9E3779B97F4A7C15ull;
+  Size countdown_ = 0;
+  std::atomic<Size> sampled_rotations_ { 0 };
+  std::atomic<Size> skipped_rotations_ { 0 };
+  std::atomic<uint64_t> sampled_ns_ { 0 };
+  std::atomic<uint64_t> skipped_ns_ { 0 };
+};
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#endif  // SAMPLING_PROTECT_SIGNATURE_5HN0QZ8CWT2MVK
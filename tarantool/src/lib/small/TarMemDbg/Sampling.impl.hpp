@@ -0,0 +1,105 @@
+/**
+ ** @file Sampling.impl.hpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief
+ ** \~english @details
+ ** \~russian @brief Файл, содержащий определения функций для @ref "выборочной защиты" Sampling.hpp
+ ** \~russian @details
+ **/
+
+#if !defined(TARMEMDBG_ALLOW_INCLUDE)
+#   error Do not include this file manually
+#endif
+
+#ifndef    SAMPLING_IMPL_PROTECT_SIGNATURE_L4DX7PJ1RB9UEW
+
+namespace      TARMEMDBG_NAMESPACE {
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// SamplingConfig                                                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+std::atomic<bool> SamplingConfig::initialized_ { false };
+std::atomic<Size> SamplingConfig::rotation_rate_ { TARMEMDBG_SAMPLE_ROTATIONS };
+std::atomic<Size> SamplingConfig::arena_rate_ { TARMEMDBG_SAMPLE_ARENAS };
+std::atomic<Size> SamplingConfig::arenas_created_ { 0 };
+std::atomic<Size> SamplingConfig::sampled_arenas_ { 0 };
+std::atomic<Size> SamplingConfig::skipped_arenas_ { 0 };
+
+Size SamplingConfig::ReadRateFromEnvironment( const char * name, Size default_value ) noexcept {
+  const char * from_env = getenv( name );
+  Size ret = default_value;
+  if ( from_env && *from_env ) ParseEnvSize( from_env, ret );
+  return ret;
+}
+
+void SamplingConfig::InitOnce() noexcept {
+  if ( initialized_.load( std::memory_order_acquire ) ) return;
+  // гонка безопасна: оба потока прочитают одно и то же окружение
+  rotation_rate_.store( ReadRateFromEnvironment( "TARARAM_SAMPLE_ROTATIONS", TARMEMDBG_SAMPLE_ROTATIONS ), std::memory_order_relaxed );
+  arena_rate_.store( ReadRateFromEnvironment( "TARARAM_SAMPLE_ARENAS", TARMEMDBG_SAMPLE_ARENAS ), std::memory_order_relaxed );
+  initialized_.store( true, std::memory_order_release );
+}
+
+void SamplingConfig::SetRates( Size rotation_rate, Size arena_rate ) noexcept {
+  // окружение больше не нужно, но InitOnce не должен затереть новые значения
+  initialized_.store( true, std::memory_order_release );
+  rotation_rate_.store( rotation_rate, std::memory_order_relaxed );
+  arena_rate_.store( arena_rate, std::memory_order_relaxed );
+}
+
+bool SamplingConfig::SampleArena() noexcept {
+  Size rate = GetArenaRate();
+  Size index = arenas_created_.fetch_add( 1, std::memory_order_relaxed );
+  bool sampled = rate && !( index % rate );
+  ( sampled ? sampled_arenas_ : skipped_arenas_ ).fetch_add( 1, std::memory_order_relaxed );
+  return sampled;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// RotationSampler                                                           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void RotationSampler::Init( bool arena_sampled, uint64_t seed ) noexcept {
+  arena_sampled_ = arena_sampled;
+  if ( seed ) random_state_ ^= seed;
+  countdown_ = 0;
+}
+
+uint64_t RotationSampler::NextRandom() noexcept {
+  // xorshift64*
+  random_state_ ^= random_state_ >> 12;
+  random_state_ ^= random_state_ << 25;
+  random_state_ ^= random_state_ >> 27;
+  return random_state_ * 0x2545F4914F6CDD1Dull;
+}
+
+bool RotationSampler::ShouldSample() noexcept {
+  if ( !arena_sampled_ ) return false;
+  Size rate = SamplingConfig::GetRotationRate();
+  if ( rate <= 1 ) return rate == 1;
+  // новый отсчёт, если прошлый закончился или частоту уменьшили
+  if ( !countdown_ || countdown_ >= 2 * rate ) countdown_ = 1 + NextRandom() % ( 2 * rate - 1 );
+  return !--countdown_;
+}
+
+void RotationSampler::Account( bool sampled, uint64_t nanoseconds ) noexcept {
+  if ( sampled ) {
+    sampled_rotations_.fetch_add( 1, std::memory_order_relaxed );
+    sampled_ns_.fetch_add( nanoseconds, std::memory_order_relaxed );
+  } else {
+    skipped_rotations_.fetch_add( 1, std::memory_order_relaxed );
+    skipped_ns_.fetch_add( nanoseconds, std::memory_order_relaxed );
+  }
+}
+
+} // namespace TARMEMDBG_NAMESPACE
+
+#define    SAMPLING_IMPL_PROTECT_SIGNATURE_L4DX7PJ1RB9UEW
+#endif  // SAMPLING_IMPL_PROTECT_SIGNATURE_L4DX7PJ1RB9UEW
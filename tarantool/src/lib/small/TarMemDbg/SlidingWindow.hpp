@@ -19,57 +19,57 @@
 
 namespace      TARMEMDBG_NAMESPACE {
 
+/**
+ ** @brief Стратегия по умолчанию: перед затиранием значения ничего не делается
+ ** @details Стратегия - параметр шаблона SlidingWindow и хранится в нём по значению, поэтому 
+ **          её OnDelete вызывается напрямую и встраивается
+ **/
 template <typename TypeTn>
-class SlidingWindowOnDeleteInterface {
- public:
-  typedef TypeTn Type;
-
-  virtual ~SlidingWindowOnDeleteInterface() {}
-  virtual void OnDelete( Type & before_delete_value ) = 0;
-};
-
-template <typename TypeTn>
-class SlidingWindowDefaultOnDelete : public SlidingWindowOnDeleteInterface<TypeTn> {
+class SlidingWindowDefaultOnDelete {
  public:
   typedef TypeTn Type;
-  SlidingWindowDefaultOnDelete() {}
 
-  virtual void OnDelete( Type & before_delete_value ) {};
+  void OnDelete( Type & ) noexcept {}
 };
 
 /**
  ** @tname SlidingWindow
  ** @tparam TypeTn Хранимый тип
- ** @tparam BufferSizeTn размер циркулярного буфера
- ** @brief SlidingWindow - это класс, который хранит @b BufferSizeTn последних значений типа TypeTn
- ** @details Внутри хранение осуществляется с помощью циркулярного буфера
+ ** @tparam MaxBufferSizeTn максимальный размер циркулярного буфера
+ ** @tparam OnDeleteTn стратегия, вызываемая перед затиранием значения в буфере (метод OnDelete( Type & ))
+ ** @brief SlidingWindow - это класс, который хранит @b GetBufferSize() последних значений типа TypeTn
+ ** @details Внутри хранение осуществляется с помощью циркулярного буфера. Память под буфер 
+ **          резервируется на MaxBufferSizeTn значений, а сколько из них используется, задаётся при создании
  **/ 
-template <typename TypeTn, Size BufferSizeTn> class SlidingWindow {
+template <typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn> class SlidingWindow {
  public:
-  static constexpr const Size buffer_size = BufferSizeTn;
+  static constexpr const Size max_buffer_size = MaxBufferSizeTn;
   typedef TypeTn Type;  
-  typedef SlidingWindowOnDeleteInterface<Type> OnDeleteFunction;
-  typedef std::shared_ptr< SlidingWindowOnDeleteInterface<Type> > OnDeleteFunPtr;
+  typedef OnDeleteTn OnDeleteFunction;
 
   SlidingWindow( 
       Size starting_index, 
       const Type & initial_value, 
-      OnDeleteFunPtr on_delete_value = std::make_shared< SlidingWindowDefaultOnDelete<Type> >() )
+      const OnDeleteFunction & on_delete_value = OnDeleteFunction(),
+      Size buffer_size = MaxBufferSizeTn )
       :  start_( starting_index ), 
          pos_( starting_index ),
+         buffer_size_( buffer_size ),
          on_delete_( on_delete_value ) {
-    assert ( (bool)on_delete_ );
-    buffer_[0] = initial_value;
+    assert( buffer_size_ >= 1 && buffer_size_ <= max_buffer_size );
+    buffer_[starting_index % buffer_size_] = initial_value;
   }
-  SlidingWindow( OnDeleteFunPtr on_delete_value = std::make_shared< SlidingWindowDefaultOnDelete<Type> >() ) {}
+  explicit SlidingWindow( const OnDeleteFunction & on_delete_value = OnDeleteFunction() ) 
+      :  on_delete_( on_delete_value ) {}
 
   bool IsEmpty() const noexcept { return !start_; }
-  bool IsFull() const noexcept { return GetNumberEpochs() == buffer_size;}
+  bool IsFull() const noexcept { return GetNumberEpochs() == buffer_size_;}
+  Size GetBufferSize() const noexcept { return buffer_size_; }
   Size GetNumberEpochs() const noexcept { return (bool)start_ ? pos_ - start_ + 1 : 0;}
   void Push( const Type & value ) noexcept;
   void SlideEpochs() noexcept;
-  Type const & GetCurrent() const noexcept { return buffer_.at( GetLocalIndexBackwards(0) );}
-  Type       & GetCurrent()       noexcept { return buffer_[GetLocalIndexBackwards(0)];}
+  Type const & GetCurrent() const noexcept { return GetSlot( GetLocalIndexBackwards(0) );}
+  Type       & GetCurrent()       noexcept { return GetSlot( GetLocalIndexBackwards(0) );}
   Type const & GetPrevious( Size backward_offset ) const noexcept;
   Type       & GetPrevious( Size backward_offset )       noexcept;
   Type const & GetById( Size index ) const  noexcept;
@@ -78,22 +78,27 @@ template <typename TypeTn, Size BufferSizeTn> class SlidingWindow {
   static bool Test() noexcept;
 
  protected:
-  typedef std::array<Type, buffer_size > Buffer;
+  typedef std::array<Type, max_buffer_size > Buffer;
   static constexpr const Size kNoPos = Size(-1);
 
   static bool TestIndexes() noexcept;
 
-  Size GetLocalIndex( Size global_index ) noexcept;
+  Size GetLocalIndex( Size global_index ) const noexcept;
   /**
    ** @brief ищет индекс в буфере считая от конца к началу
    **/
-  Size GetLocalIndexBackwards( Size backward_offset ) noexcept;
+  Size GetLocalIndexBackwards( Size backward_offset ) const noexcept;
+  /// ячейка буфера, для kNoPos - пустое значение (nullptr для указателей), а не чтение за буфером
+  Type const & GetSlot( Size local_index ) const noexcept;
+  Type       & GetSlot( Size local_index )       noexcept;
   
  private:
   Size start_ = 0; ///< индексация на базе 1. 0 = неинициализированное значение
   Size pos_ = 0;   ///< индексация на базе 1. 0 = неинициализированное значение
+  Size buffer_size_ = MaxBufferSizeTn; ///< сколько ячеек буфера используется
   Buffer buffer_;
-  OnDeleteFunPtr on_delete_; ///< Стратегия, вызываемая перед затиранием объекта в буфере. Может использоваться для дополнительной зачистки.
+  Type missing_ {}; ///< пустое значение, которое GetSlot отдаёт вместо ячейки за окном
+  OnDeleteFunction on_delete_; ///< Стратегия, вызываемая перед затиранием объекта в буфере. Может использоваться для дополнительной зачистки.
 };
 
 
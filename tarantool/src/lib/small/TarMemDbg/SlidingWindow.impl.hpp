@@ -19,76 +19,97 @@
 
 namespace      TARMEMDBG_NAMESPACE {
 
-template<typename TypeTn, Size BufferSizeTn>
-void SlidingWindow<TypeTn, BufferSizeTn>::Push( const Type & value ) noexcept {
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+void SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Push( const Type & value ) noexcept {
   if ( !start_ ) start_ = 1;
   ++pos_;
-  on_delete_->OnDelete( buffer_[GetLocalIndex(0)] );
-  buffer_[GetLocalIndex(0)] = value;
+  // удаляем только вытесняемое значение, пока окно не заполнено ячейка ещё пуста
+  if ( pos_ - start_ + 1 > buffer_size_ ) {
+    on_delete_.OnDelete( buffer_[GetLocalIndex(start_)] );
+    ++start_;
+  }
+  buffer_[pos_ % buffer_size_] = value;
 }
 
-template<typename TypeTn, Size BufferSizeTn>
-void SlidingWindow<TypeTn, BufferSizeTn>::SlideEpochs() noexcept {
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+void SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::SlideEpochs() noexcept {
   ++start_;
   ++pos_;
 }
 
-template<typename TypeTn, Size BufferSizeTn>
-Size SlidingWindow<TypeTn, BufferSizeTn>::GetLocalIndex( Size global_index ) noexcept {
-  if ( !start_ || global_index >= pos_ || global_index < start_ ) return kNoPos;
-  return global_index % buffer_size;
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+Size SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetLocalIndex( Size global_index ) const noexcept {
+  if ( !start_ || global_index > pos_ || global_index < start_ ) return kNoPos;
+  return global_index % buffer_size_;
 }
 
-template<typename TypeTn, Size BufferSizeTn>
-Size SlidingWindow<TypeTn, BufferSizeTn>::GetLocalIndexBackwards( Size backward_offset ) noexcept {
-  if ( !start_ || backward_offset >= pos_ ) return kNoPos;
-  return ( pos_ - backward_offset ) % buffer_size;
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+Size SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetLocalIndexBackwards( Size backward_offset ) const noexcept {
+  if ( !start_ || backward_offset > pos_ - start_ ) return kNoPos;
+  return ( pos_ - backward_offset ) % buffer_size_;
+}
+
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+typename SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Type const & 
+SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetSlot( Size local_index ) const noexcept {
+  if ( local_index >= MaxBufferSizeTn ) return missing_;
+  return buffer_[local_index];
+}
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+typename SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Type       & 
+SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetSlot( Size local_index )       noexcept {
+  if ( local_index >= MaxBufferSizeTn ) {
+    // вызывающий мог записать в пустое значение
+    missing_ = Type();
+    return missing_;
+  }
+  return buffer_[local_index];
 }
 
 #   define TAR_MDBG_CHECK_OFFSET( backward_offset ) \
   assert( !IsEmpty() ); \
   assert( backward_offset < pos_ ); \
-  assert( backward_offset < buffer_size );
+  assert( backward_offset < buffer_size_ );
 
-template<typename TypeTn, Size BufferSizeTn>
-typename SlidingWindow<TypeTn, BufferSizeTn>::Type const & 
-SlidingWindow<TypeTn, BufferSizeTn>::GetPrevious( Size backward_offset ) const noexcept {
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+typename SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Type const & 
+SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetPrevious( Size backward_offset ) const noexcept {
   TAR_MDBG_CHECK_OFFSET( backward_offset )
-  return buffer_.at( GetLocalIndexBackwards(backward_offset) );
+  return GetSlot( GetLocalIndexBackwards(backward_offset) );
 }
-template<typename TypeTn, Size BufferSizeTn>
-typename SlidingWindow<TypeTn, BufferSizeTn>::Type       & 
-SlidingWindow<TypeTn, BufferSizeTn>::GetPrevious( Size backward_offset )       noexcept {
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+typename SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Type       & 
+SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetPrevious( Size backward_offset )       noexcept {
   TAR_MDBG_CHECK_OFFSET( backward_offset ) 
-  return buffer_[GetLocalIndexBackwards(backward_offset)];
+  return GetSlot( GetLocalIndexBackwards(backward_offset) );
 }
 #   undef TAR_MDBG_CHECK_OFFSET
 
 
 #   define TAR_MDBG_CHECK_INDEX( index ) \
   assert( !IsEmpty() ); \
-  assert( index < pos_ ); \
+  assert( index <= pos_ ); \
   assert( index >= start_ );
 
-template<typename TypeTn, Size BufferSizeTn>
-typename SlidingWindow<TypeTn, BufferSizeTn>::Type const & 
-SlidingWindow<TypeTn, BufferSizeTn>::GetById( Size index ) const noexcept {
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+typename SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Type const & 
+SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetById( Size index ) const noexcept {
   TAR_MDBG_CHECK_INDEX( index )
-  return buffer_.at( GetLocalIndex(index) );
+  return GetSlot( GetLocalIndex(index) );
 }
 
-template<typename TypeTn, Size BufferSizeTn>
-typename SlidingWindow<TypeTn, BufferSizeTn>::Type       & 
-SlidingWindow<TypeTn, BufferSizeTn>::GetById( Size index )       noexcept { 
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+typename SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::Type       & 
+SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::GetById( Size index )       noexcept { 
   TAR_MDBG_CHECK_INDEX( index )
-  return buffer_[GetLocalIndex(index)];
+  return GetSlot( GetLocalIndex(index) );
 }
 #   undef TAR_MDBG_CHECK_INDEX
 
 ////////////////////////////// тесты //////////////////////////////
 
-template<typename TypeTn, Size BufferSizeTn>
-bool SlidingWindow<TypeTn, BufferSizeTn>::TestIndexes() noexcept {
+template<typename TypeTn, Size MaxBufferSizeTn, typename OnDeleteTn>
+bool SlidingWindow<TypeTn, MaxBufferSizeTn, OnDeleteTn>::TestIndexes() noexcept {
   return 0;
 }
     
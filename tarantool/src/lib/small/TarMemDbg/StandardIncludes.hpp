@@ -16,14 +16,26 @@
 
 // общие включения
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
 #include <array>
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <assert.h>
 #include <type_traits>
 #include <climits>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include <map>
+#include <cmath>
+#include <cerrno>
+#include <string>
+#include <tuple>
 
 // платформозависимые включения
 #ifdef     _WIN32
@@ -37,7 +49,16 @@ typedef ptrdiff_t ssize_t;
 #   include <unistd.h>
 #   include <malloc.h>
 #   include <sys/mman.h>
+#   include <sys/syscall.h>
+#   include <fcntl.h>
+#   include <sys/uio.h> // writev для записи вызовов
+#   include <sys/stat.h> // lstat файла записи вызовов
+#   include <pthread.h> // границы стека потока для раскрутки по указателям кадров
 #endif  // _WIN32
+#if        defined(__x86_64__)
+#   include <immintrin.h> // проверка канареек redzone'ов
+#   include <x86intrin.h> // __rdtsc для трейса событий
+#endif  // defined(__x86_64__)
 
 /// third-party включения - таратнул, small и прочее
 
@@ -48,4 +69,6 @@ extern "C" {
 #include "../small/slab_arena_internal.h"
 #include "../small/slab_cache_internal.h"
 #include "../small/lsregion_internal.h"
+#include "../small/mempool_internal.h"
+#include "../small/region_internal.h"
 }
\ No newline at end of file
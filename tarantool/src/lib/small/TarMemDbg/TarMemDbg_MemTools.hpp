@@ -48,6 +48,133 @@ void ProtectMemoryOrDie(
   assert( no_error );
 }
 
+/**
+ ** @function ProtectWholePagesInside
+ ** @brief меняет защиту целых страниц, лежащих внутри [ @a start, @a start + @a byte_size )
+ ** @details Неполные страницы на краях не трогаются: в них может быть чужая память (заголовок slab'а)
+ ** @return размер защищённой части
+ **/
+static inline Size ProtectWholePagesInside( void * start, Size byte_size, ProtectMemoryConstant protection ) noexcept {
+  uintptr_t page_mask = (uintptr_t)PageSize()() - 1;
+  uintptr_t from = ( (uintptr_t)start + page_mask ) & ~page_mask;
+  uintptr_t to = ( (uintptr_t)start + byte_size ) & ~page_mask;
+  if ( from >= to ) return 0;
+  ProtectMemoryOrDie( (void *)from, (Size)( to - from ), protection );
+  return (Size)( to - from );
+}
+
+/**
+ ** @function ReserveAlignedWindow
+ ** @brief резервирует непрерывное окно адресов, выровненное по @a alignment
+ ** @details Память отображается без резервирования в swap (MAP_NORESERVE): пока к страницам
+ **          не обращались, они не занимают ни физической памяти, ни commit'а
+ ** @param[in] byte_size размер окна, кратный @a alignment
+ ** @param[in] alignment выравнивание начала окна, степень двойки
+ ** @param[in] shared MAP_SHARED вместо MAP_PRIVATE
+ ** @return начало окна или nullptr
+ **/
+static inline void * ReserveAlignedWindow( Size byte_size, Size alignment, bool shared ) noexcept {
+  assert(   ( alignment & ( alignment - 1 ) ) == 0   );
+  assert(   ( byte_size % alignment ) == 0   );
+# if      _WIN32
+  (void)byte_size; (void)alignment; (void)shared;
+  return nullptr;
+# else // _WIN32
+  int flags = ( shared ? MAP_SHARED : MAP_PRIVATE ) | MAP_ANONYMOUS | MAP_NORESERVE;
+  Size map_size = byte_size + alignment;
+  Byte * map = (Byte *)mmap( nullptr, map_size, PROT_READ | PROT_WRITE, flags, -1, 0 );
+  if ( (void *)map == MAP_FAILED ) return nullptr;
+  // отрезаем невыровненные голову и хвост
+  Byte * start = (Byte *)(   ( (uintptr_t)map + alignment - 1 ) & ~(uintptr_t)( alignment - 1 )   );
+  Byte * end = start + byte_size;
+  if ( start != map ) munmap( map, start - map );
+  if ( end != map + map_size ) munmap( end, map + map_size - end );
+  return start;
+# endif
+}
+
+/**
+ ** @function MapGuardedBlock
+ ** @brief отображает блок памяти, за которым стоят запрещённые страницы
+ ** @details [ @a body_byte_size на чтение и запись | @a guard_byte_size PROT_NONE ]
+ ** @return начало блока или nullptr
+ **/
+static inline void * MapGuardedBlock( Size body_byte_size, Size guard_byte_size ) noexcept {
+  assert(   ( body_byte_size % PageSize()() ) == 0   );
+  assert(   ( guard_byte_size % PageSize()() ) == 0   );
+# if      _WIN32
+  (void)body_byte_size; (void)guard_byte_size;
+  return nullptr;
+# else // _WIN32
+  Size map_size = body_byte_size + guard_byte_size;
+  Byte * map = (Byte *)mmap( nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if ( (void *)map == MAP_FAILED ) return nullptr;
+  if ( guard_byte_size && mprotect( map + body_byte_size, guard_byte_size, PROT_NONE ) != 0 ) {
+    munmap( map, map_size );
+    return nullptr;
+  }
+  return map;
+# endif
+}
+
+static inline void UnmapMemory( void * aligned_start, Size aligned_byte_size ) noexcept {
+  if ( !aligned_start || !aligned_byte_size ) return;
+# if      _WIN32
+  (void)aligned_start;
+# else // _WIN32
+  [[maybe_unused]] int ret = munmap( aligned_start, aligned_byte_size );
+  assert( ret == 0 );
+# endif
+}
+
+/**
+ ** @function ReleasePhysicalMemory
+ ** @brief отдаёт ядру физические страницы диапазона, оставляя адреса и защиту на месте
+ ** @details Обращение к диапазону под PROT_NONE по-прежнему вызовет segfault, а после открытия 
+ **          на запись страницы приватного отображения заново заполнятся нулями
+ ** @return false, если ничего не сделано
+ **/
+static inline bool ReleasePhysicalMemory( void * aligned_start, Size aligned_byte_size, QuarantineRelease mode ) noexcept {
+  if ( !aligned_byte_size || mode == kReleaseNone ) return false;
+  assert(   ( (intptr_t)aligned_start % PageSize()() ) == 0 );
+  assert(   ( aligned_byte_size % PageSize()() ) == 0 );
+# if      _WIN32
+  (void)aligned_start; (void)mode;
+  return false;
+# else // _WIN32
+  int advice = MADV_DONTNEED;
+#   if       defined(MADV_FREE)
+  if ( mode == kReleaseFree ) advice = MADV_FREE;
+#   endif // defined(MADV_FREE)
+  return madvise( aligned_start, aligned_byte_size, advice ) == 0;
+# endif
+}
+
+/**
+ ** @function CountResidentBytes
+ ** @brief сколько байт диапазона сейчас в физической памяти (mincore работает и под PROT_NONE)
+ **/
+static inline Size CountResidentBytes( void * aligned_start, Size aligned_byte_size ) noexcept {
+# if      _WIN32
+  (void)aligned_start;
+  return aligned_byte_size;
+# else // _WIN32
+  Size page_size = PageSize()();
+  // вектор на стеке, длинные диапазоны проверяются частями
+  unsigned char pages[1024];
+  Size ret = 0;
+  Byte * position = (Byte *)aligned_start;
+  Byte * end = position + aligned_byte_size;
+  while ( position < end ) {
+    Size npages = std::min( (Size)( end - position ) / page_size, (Size)sizeof( pages ) );
+    if ( mincore( position, npages * page_size, pages ) != 0 ) return ret;
+    for ( Size i = 0; i < npages; ++i ) ret += ( pages[i] & 1 ) ? page_size : 0;
+    position += npages * page_size;
+  }
+  return ret;
+# endif
+}
+
 template <typename Tn, typename ... Args> void Construct( Tn & to_construct, Args &&... args ) {
   ::new (&to_construct) Tn( std::forward<Args>(args)... );
 }
@@ -60,7 +187,7 @@ static inline void * AllocateAligned( Size byte_size, Size alignment ) noexcept
 # if      _WIN32
   return (void *) _aligned_malloc( byte_size, alignment );
 # else // _WIN32
-  return (void *) memalign( byte_size, alignment );
+  return (void *) memalign( alignment, byte_size );
 # endif
 }
 
@@ -77,25 +204,24 @@ static inline void DeallocateAligned( void * to_free ) noexcept {
   }
 }
 
+// NewAligned и NewAlignedInPages берут целые страницы (см. MetadataPagePool), DeleteAligned их возвращает
+
 template <typename Tn, typename... Args> Tn * NewAligned( Args && ... args ) {
-  Size page_size = PageSize()();
-  Tn * ret = (Tn *)AllocateAligned( sizeof(Tn), page_size );
+  Tn * ret = (Tn *)AllocateMetadataPages(   CalculateSizeInPages<Tn>( PageSize()() )   );
   if ( ret ) Construct(  *ret, std::forward<Args>( args )...   );
   return ret;
 }
 
 template <typename Tn> Tn * NewAlignedInPages() {
-  Size page_size = PageSize()();
-  Size allocate_size = CalculateSizeInPages<Tn>( page_size );
-  Tn * ret = (Tn *)AllocateAligned( allocate_size, page_size );
+  Tn * ret = (Tn *)AllocateMetadataPages(   CalculateSizeInPages<Tn>( PageSize()() )   );
   if ( ret ) Construct( *ret );
   return ret;
 }
 
 template <typename Tn> void DeleteAligned( Tn * to_free ) {
   if ( to_free ) {
-    Destruct( to_free );
-    DeallocateAlignedUnsafe( to_free );
+    Destruct( *to_free );
+    DeallocateMetadataPages( to_free, CalculateSizeInPages<Tn>( PageSize()() ) );
   }
 }
 
@@ -108,6 +234,71 @@ template <typename Tn> void Delete( Tn * to_free ) {
   ::delete( to_free );
 }
 
+/// десятичное число во всю строку переменной окружения, при ошибке @a value не меняется
+static inline bool ParseEnvSize( const char * from_env, Size & value ) noexcept {
+  char * end = nullptr;
+  unsigned long long parsed = strtoull( from_env, &end, 10 );
+  if ( !end || *end ) return false;
+  value = (Size)parsed;
+  return true;
+}
+
+/// одна цифра от 0 до MaxTn
+template <int MaxTn> bool ParseEnvDigit( const char * from_env, int & value ) noexcept {
+  if ( from_env[0] < '0' || from_env[0] > '0' + MaxTn || from_env[1] ) return false;
+  value = from_env[0] - '0';
+  return true;
+}
+
+template <Size MaxTn> Size LimitSize( Size value ) noexcept { return std::min( value, MaxTn ); }
+
+/**
+ ** @brief Настройка, значение по умолчанию которой переопределяет переменная окружения
+ ** @details Окружение читается при первом Get. Parse не меняет значение, если переменная неверна, тогда
+ **          остаётся значение по умолчанию. Limit, если есть, приводит к допустимому и прочитанное
+ **          значение, и значение Set. Tn(-1) означает, что окружение ещё не прочитано
+ **/
+template <typename Tn>
+class EnvSetting {
+ public:
+  typedef bool ( *Parse )( const char * from_env, Tn & value ) noexcept;
+  typedef Tn ( *Limit )( Tn value ) noexcept;
+
+  constexpr EnvSetting( const char * name, Tn default_value, Parse parse, Limit limit = nullptr ) noexcept
+      :  name_( name ), default_( default_value ), parse_( parse ), limit_( limit ), value_( kNotRead ) {}
+
+  Tn Get() noexcept {
+    Tn ret = value_.load( std::memory_order_relaxed );
+    return ret != kNotRead ? ret : Read();
+  }
+  /// @return предыдущее значение
+  Tn Set( Tn value ) noexcept {
+    Tn previous = Get();
+    value_.store( limit_ ? limit_( value ) : value, std::memory_order_relaxed );
+    return previous;
+  }
+
+ private:
+  static constexpr const Tn kNotRead = Tn(-1);
+
+  Tn Read() noexcept {
+    Tn ret = default_;
+    const char * from_env = getenv( name_ );
+    if ( from_env && *from_env ) parse_( from_env, ret );
+    if ( limit_ ) ret = limit_( ret );
+    // если кто-то успел вызвать Set, его значение важнее
+    Tn expected = kNotRead;
+    if ( !value_.compare_exchange_strong( expected, ret, std::memory_order_relaxed ) ) return expected;
+    return ret;
+  }
+
+  const char * const name_;
+  const Tn default_;
+  const Parse parse_;
+  const Limit limit_;
+  std::atomic<Tn> value_;
+};
+
 } // namespace TARMEMDBG_NAMESPACE
 
 #define    TARMEMDBG_TOOLS_PROTECT_SIGNATURE_CIY7GVUUK3BJMJ
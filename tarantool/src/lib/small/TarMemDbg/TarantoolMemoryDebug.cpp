@@ -13,13 +13,38 @@
 
 typedef ::TARMEMDBG_NAMESPACE::Mutex TararamLock; // SpinLock подошёл бы лучше, но за неимением гербовой... К тому же, поначалу мьютекс почти спинлок
 typedef ::TARMEMDBG_NAMESPACE::MemoryEpochQueue     MemoryEpochQueue;
-typedef ::TARMEMDBG_NAMESPACE::MemoryEpochInterface MemoryEpoch     ;
+typedef ::TARMEMDBG_NAMESPACE::MemoryEpoch          MemoryEpoch     ;
 typedef ::TARMEMDBG_NAMESPACE::LockGuard            LockGuard       ;
 
+typedef ::TARMEMDBG_NAMESPACE::QueueRegistry        QueueRegistry   ;
+typedef ::TARMEMDBG_NAMESPACE::EpochProtector       EpochProtector  ;
+typedef ::TARMEMDBG_NAMESPACE::SamplingConfig       SamplingConfig  ;
+typedef ::TARMEMDBG_NAMESPACE::AddressIndexEntry    AddressIndexEntry;
+typedef ::TARMEMDBG_NAMESPACE::PerfCounters         PerfCounters    ;
+typedef ::TARMEMDBG_NAMESPACE::LargeBlockOwnerScope LargeBlockOwnerScope;
+typedef ::TARMEMDBG_NAMESPACE::LargeBlockPool       LargeBlockPool  ;
+typedef ::TARMEMDBG_NAMESPACE::MetadataPagePool     MetadataPagePool;
+typedef ::TARMEMDBG_NAMESPACE::EpochPool            EpochPool       ;
+typedef ::TARMEMDBG_NAMESPACE::RedzoneTable         RedzoneTable    ;
+typedef ::TARMEMDBG_NAMESPACE::MempoolQuarantine    MempoolQuarantine;
+typedef ::TARMEMDBG_NAMESPACE::RegionQuarantine     RegionQuarantine;
+typedef ::TARMEMDBG_NAMESPACE::BufferQuarantine     BufferQuarantine;
+typedef ::TARMEMDBG_NAMESPACE::AllocationSites      AllocationSites ;
+typedef ::TARMEMDBG_NAMESPACE::AllocationSiteUsage  AllocationSiteUsage;
+typedef ::TARMEMDBG_NAMESPACE::RegionSiteTable      RegionSiteTable ;
+typedef ::TARMEMDBG_NAMESPACE::HeapProfile          HeapProfile     ;
+typedef ::TARMEMDBG_NAMESPACE::EventTrace           EventTrace      ;
+typedef ::TARMEMDBG_NAMESPACE::CallTrace            CallTrace       ;
+typedef ::TARMEMDBG_NAMESPACE::EntryPoints          EntryPoints     ;
+typedef ::TARMEMDBG_NAMESPACE::DebugEntryPoints     DebugEntryPoints;
+typedef ::TARMEMDBG_NAMESPACE::Size                 Size            ;
+typedef ::TARMEMDBG_NAMESPACE::Byte                 Byte            ;
+
 typedef std::unique_ptr<MemoryEpochQueue> MemoryEpochQueueUnique;
 //std::unique_ptr<::TARMEMDBG_NAMESPACE::MemoryEpochQueue> g_epochs;
-std::map<MemoryEpochQueue *, MemoryEpochQueueUnique> g_epochs;
-TararamLock g_lock;
+std::vector<MemoryEpochQueueUnique> g_epochs; ///< владение очередями, изменяется только под g_lock
+QueueRegistry g_registry; ///< поиск очередей без блокировок
+TararamLock g_lock; ///< нужен только для создания очередей и обхода g_epochs. Сдвиг эпох берёт блокировку своей очереди
 
 struct memory_epoch_queue;
 
@@ -30,83 +55,152 @@ struct memory_epoch_queue;
  **                   Эта страница запрещена к чтению и записи, и служит гарантией от
  **                   прямого обращения
  **/
-static inline MemoryEpoch * GetEpochByHandleUnsafe( memory_epoch_queue * handle ) {
+static inline MemoryEpochQueue * GetQueueByHandle( memory_epoch_queue * handle ) {
   assert( (bool)handle );
   MemoryEpochQueue * que = MemoryEpochQueue::GetSelfByHandle( handle );
   // полученный указатель мы проверяем. Есть ли такой вообще?
-  assert( g_epochs.count( que ) );
-  return que->GetCurrentEpoch();
-}
-static inline MemoryEpoch * GetEpochByHandle( memory_epoch_queue * ptr ) {
-  LockGuard lock( g_lock ); {
-    return GetEpochByHandleUnsafe( ptr );
-  }
+  assert( g_registry.Contains( que ) );
+  return que;
 }
 
-static inline lsregion * GetLsRegionByHandleUnsafe( memory_epoch_queue * ptr ) {
-  return GetEpochByHandleUnsafe( ptr )->GetLsRegion();
-}
-
-static inline slab_arena * GetArenaByHandleUnsafe( memory_epoch_queue * ptr ) {
-  return GetEpochByHandleUnsafe( ptr )->GetArena();
+static inline MemoryEpoch * GetEpochByHandleUnsafe( memory_epoch_queue * handle ) {
+  return GetQueueByHandle( handle )->GetCurrentEpoch();
 }
 
 static inline lsregion * GetLsRegionByHandle( memory_epoch_queue * ptr ) {
-  LockGuard lock( g_lock ); {
-    return GetLsRegionByHandleUnsafe( ptr );
-  }
+  return GetQueueByHandle( ptr )->GetLsRegionFast();
 }
 
 static inline slab_arena * GetArenaByHandle( memory_epoch_queue * ptr ) {
-  LockGuard lock( g_lock ); {
-    return GetArenaByHandleUnsafe( ptr );
-  }
+  return GetQueueByHandle( ptr )->GetArenaFast();
 }
 
 MemoryEpochQueue * AllocateEpochs() {
-  MemoryEpochQueueUnique storage( MemoryEpochQueue::Create( 0 ) );
+  MemoryEpochQueueUnique storage( MemoryEpochQueue::Create( 1 ) );
   assert( (bool)storage );
   MemoryEpochQueue * ret = storage.get();
   assert( (bool)ret );
-  g_epochs[ret] = std::move( storage );
+  [[maybe_unused]] bool registered = g_registry.Register( ret );
+  assert( registered );
+  g_epochs.push_back( std::move( storage ) );
   return ret;
 }
 
 extern "C" {
 
+static void * DebugSlabMap( slab_arena * arena );
+static void   DebugSlabUnmap( slab_arena * arena, void * ptr );
+static void * DebugLsRegionAlignedReserveSlow( lsregion * lsregion_value, size_t size, size_t alignment, void ** unaligned );
+static void * DebugLsRegionAlignedReserve( lsregion * lsregion_value, size_t size, size_t alignment, void ** unaligned );
+static void * DebugLsRegionReserve( lsregion * lsregion_value, size_t size );
+static void * DebugLsRegionAlloc( lsregion * lsregion_value, size_t size, int64_t id, const void * frame );
+static void * DebugLsRegionAlignedAlloc( lsregion * lsregion_value, size_t size, size_t alignment, int64_t id, const void * frame );
+static void   DebugLsRegionGc( lsregion * lsregion_value, int64_t min_id );
+static void * ForwardSlabMap( slab_arena * arena );
+static void   ForwardSlabUnmap( slab_arena * arena, void * ptr );
+static void * ForwardLsRegionAlignedReserveSlow( lsregion * lsregion_value, size_t size, size_t alignment, void ** unaligned );
+static void * ForwardLsRegionAlignedReserve( lsregion * lsregion_value, size_t size, size_t alignment, void ** unaligned );
+static void * ForwardLsRegionReserve( lsregion * lsregion_value, size_t size );
+static void * RecordLsRegionAlloc( lsregion * lsregion_value, size_t size, int64_t id, const void * frame );
+static void * RecordLsRegionAlignedAlloc( lsregion * lsregion_value, size_t size, size_t alignment, int64_t id, const void * frame );
+static void   RecordLsRegionGc( lsregion * lsregion_value, int64_t min_id );
+
+/// отладочные реализации обёрток, пока отладка включена (см. EntryPoints)
+static const DebugEntryPoints kDebugEntryPoints = {
+  DebugSlabMap,
+  DebugSlabUnmap,
+  DebugLsRegionAlignedReserveSlow,
+  DebugLsRegionAlignedReserve,
+  DebugLsRegionReserve,
+  DebugLsRegionAlloc,
+  DebugLsRegionAlignedAlloc,
+  DebugLsRegionGc,
+};
+
+/// пока открыта запись вызовов (см. CallTrace): записывает аллокации и lsregion_gc и идёт дальше в отладку или в *_orig
+static const DebugEntryPoints kRecordEntryPoints = {
+  ForwardSlabMap,
+  ForwardSlabUnmap,
+  ForwardLsRegionAlignedReserveSlow,
+  ForwardLsRegionAlignedReserve,
+  ForwardLsRegionReserve,
+  RecordLsRegionAlloc,
+  RecordLsRegionAlignedAlloc,
+  RecordLsRegionGc,
+};
+
+// отладка включена по умолчанию, так что подсказки ветвлению компилятору тут нет
+static inline bool IsDebugEnabled( const DebugEntryPoints * debug ) {
+  return debug != nullptr;
+}
+
 int slab_arena_create(
     memory_epoch_queue **arena, 
     quota *quota, 
     size_t prealloc, 
     uint32_t slab_size, 
     int flags ) {
-  slab_arena * current = nullptr;
   assert( (bool)arena );
+  EntryPoints::Init( &kDebugEntryPoints, &kRecordEntryPoints );
+  int ret;
   LockGuard lock( g_lock ); {
     auto * allocated = AllocateEpochs();
     *arena = (memory_epoch_queue*)MemoryEpochQueue::GetHandle( allocated );
-    current = allocated->GetCurrentEpoch()->GetArena();
+    ret = allocated->InitCurrentArena(
+        quota,
+        prealloc,
+        slab_size,
+        flags );
   }
-  return slab_arena_create_orig(
-      current,
-      quota,
-      prealloc,
-      slab_size,
-      flags );  
+  CallTrace::Record( SMALL_CALL_SLAB_ARENA_CREATE, *arena, nullptr, slab_size, (int64_t)prealloc, (uint32_t)flags );
+  return ret;
 }
 
 void slab_arena_destroy( [[maybe_unused]] memory_epoch_queue * arena ) {    
   //*arena = nullptr;
 }
 
-void * slab_map( slab_arena *arena ) {
+static void * DebugSlabMap( slab_arena *arena ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)arena );
+  void * ret = slab_map_orig(   que->GetArenaFast()   );
+  // slab'ы внутри окна эпохи индекс адресов и так покрывает
+  if ( ret && !que->IsInsideCurrentWindow( ret ) ) {
+    LockGuard lock( que->GetLock() );
+    que->TrackSlabOutsideWindow( que->GetCurrentEpoch(), ret );
+  }
+  return ret;
+}
+
+static void DebugSlabUnmap( slab_arena *arena, void *ptr ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)arena );
+  if ( ptr && !que->IsInsideCurrentWindow( ptr ) ) {
+    LockGuard lock( que->GetLock() );
+    que->UntrackSlabOutsideWindow( ptr );
+  }
+  return slab_unmap_orig(   que->GetArenaFast(), ptr   );
+}
+
+// Пока отладка выключена, slab'ы берутся из арены текущей эпохи без учёта в индексе адресов
+static inline void * OrigSlabMap( slab_arena *arena ) {
   return slab_map_orig(   GetArenaByHandle( (memory_epoch_queue *)arena )   );
 }
 
-void slab_unmap( slab_arena *arena, void *ptr ) {
+static inline void OrigSlabUnmap( slab_arena *arena, void *ptr ) {
   return slab_unmap_orig(   GetArenaByHandle( (memory_epoch_queue *)arena ), ptr   );
 }
 
+void * slab_map( slab_arena *arena ) {
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->slab_map( arena );
+  return OrigSlabMap( arena );
+}
+
+void slab_unmap( slab_arena *arena, void *ptr ) {
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->slab_unmap( arena, ptr );
+  return OrigSlabUnmap( arena, ptr );
+}
+
 void slab_arena_mprotect( slab_arena *arena ) {
   return slab_arena_mprotect_orig(   GetArenaByHandle( (memory_epoch_queue *)arena )   );
 }
@@ -116,6 +210,179 @@ size_t get_slab_arena_used(struct memory_epoch_queue **arena) {
   return GetArenaByHandle( *arena )->used;
 }
 
+int get_slab_arena_stats( 
+    struct memory_epoch_queue **arena, 
+    struct slab_arena_stats * stats ) {
+  assert( (bool)arena );
+  assert( (bool)stats );
+  MemoryEpochQueue * que = GetQueueByHandle( *arena );
+  const auto & counters = que->GetCounters();
+  const auto & allocation_counters = que->GetAllocationCounters();
+  const auto & sampler = que->GetSampler();
+  *stats = slab_arena_stats();
+  stats->allocations = PerfCounters::Get( allocation_counters.allocations );
+  stats->allocated_bytes = PerfCounters::Get( allocation_counters.allocated_bytes );
+  stats->sampled_rotations = sampler.GetSampledRotations();
+  stats->skipped_rotations = sampler.GetSkippedRotations();
+  stats->next_epoch_ns = sampler.GetSampledNs() + sampler.GetSkippedNs();
+  LockGuard lock( que->GetLock() ); {
+    // защиту эпох может менять фоновый поток, дожидаемся его. Под блокировкой очередь новых работ не отправит
+    EpochProtector::FlushIfAlive();
+    stats->mprotect_calls = PerfCounters::Get( counters.protect_calls );
+    stats->protect_ns = PerfCounters::Get( counters.protect_ns );
+    stats->gc_calls = PerfCounters::Get( counters.gc_calls );
+    stats->gc_ns = PerfCounters::Get( counters.gc_ns );
+    stats->redzone_checks = PerfCounters::Get( counters.redzone_checks );
+    stats->redzone_ns = PerfCounters::Get( counters.redzone_ns );
+    stats->used = lsregion_used_orig( que->GetLsRegionFast() );
+    que->ForEachEpoch( [stats]( MemoryEpoch * epoch, Size, Size ) {
+      ++stats->epochs;
+      stats->mapped_slabs += epoch->GetMappedSlabs();
+      Size resident = 0;
+      Size quarantined = epoch->GetQuarantinedBytes( resident );
+      if ( !quarantined ) return;
+      ++stats->quarantined_epochs;
+      stats->quarantined_virtual += quarantined;
+      stats->quarantined_resident += resident;
+    } );
+  }
+  return 0;
+}
+
+size_t get_slab_arena_epoch_stats( 
+    struct memory_epoch_queue **arena, 
+    struct slab_arena_epoch_stats * stats, 
+    size_t max_epochs ) {
+  assert( (bool)arena );
+  assert( (bool)stats || !max_epochs );
+  MemoryEpochQueue * que = GetQueueByHandle( *arena );
+  size_t ret = 0;
+  LockGuard lock( que->GetLock() ); {
+    EpochProtector::FlushIfAlive();
+    que->ForEachEpoch( [&]( MemoryEpoch * epoch, Size age, Size position ) {
+      if ( ret == max_epochs ) return;
+      slab_arena_epoch_stats & out = stats[ret++];
+      const auto & counters = epoch->GetCounters();
+      out = slab_arena_epoch_stats();
+      out.position = position;
+      out.age = age;
+      out.protection = (int)epoch->GetProtection();
+      out.mapped_slabs = epoch->GetMappedSlabs();
+      out.mprotect_calls = PerfCounters::Get( counters.protect_calls );
+      out.protect_ns = PerfCounters::Get( counters.protect_ns );
+      out.gc_calls = PerfCounters::Get( counters.gc_calls );
+      out.gc_ns = PerfCounters::Get( counters.gc_ns );
+      out.quarantined_virtual = epoch->GetQuarantinedBytes( out.quarantined_resident );
+    } );
+  }
+  return ret;
+}
+
+size_t get_slab_arena_rotation_mprotect_calls( 
+    struct memory_epoch_queue **arena, 
+    size_t * total_calls ) {
+  assert( (bool)arena );
+  MemoryEpochQueue * que = GetQueueByHandle( *arena );
+  if ( total_calls ) *total_calls = que->GetTotalProtectCalls();
+  return que->GetLastRotationProtectCalls();
+}
+
+int slab_arena_set_async_protection( int enabled ) {
+  EpochProtector & protector = EpochProtector::GetInstance();
+  int ret = protector.IsEnabled() ? 1 : 0;
+  protector.SetEnabled( enabled != 0 );
+  return ret;
+}
+
+void slab_arena_flush_protection( void ) {
+  EpochProtector::GetInstance().Flush();
+}
+
+size_t slab_arena_set_epoch_queue_depth( size_t depth ) {
+  if ( !depth ) return MemoryEpochQueue::GetDefaultDepth();
+  return MemoryEpochQueue::SetDefaultDepth( depth );
+}
+
+size_t get_slab_arena_epoch_queue_depth( struct memory_epoch_queue **arena ) {
+  assert( (bool)arena );
+  return GetQueueByHandle( *arena )->GetDepth();
+}
+
+void slab_arena_set_sampling( size_t rotation_rate, size_t arena_rate ) {
+  SamplingConfig::SetRates( rotation_rate, arena_rate );
+}
+
+void slab_arena_get_sampling_stats( struct slab_arena_sampling_stats * stats ) {
+  assert( (bool)stats );
+  *stats = slab_arena_sampling_stats();
+  stats->rotation_rate = SamplingConfig::GetRotationRate();
+  stats->arena_rate = SamplingConfig::GetArenaRate();
+  stats->sampled_arenas = SamplingConfig::GetSampledArenas();
+  stats->skipped_arenas = SamplingConfig::GetSkippedArenas();
+  // счётчики выборки атомарные, блокировки очередей не нужны
+  LockGuard lock( g_lock ); {
+    for ( const auto & que : g_epochs ) {
+      const auto & sampler = que->GetSampler();
+      stats->sampled_rotations += sampler.GetSampledRotations();
+      stats->skipped_rotations += sampler.GetSkippedRotations();
+      stats->sampled_rotation_ns += sampler.GetSampledNs();
+      stats->skipped_rotation_ns += sampler.GetSkippedNs();
+    }
+  }
+}
+
+int slab_arena_set_quarantine_release( int mode ) {
+  assert( mode >= ::TARMEMDBG_NAMESPACE::kReleaseNone && mode <= ::TARMEMDBG_NAMESPACE::kReleaseFree );
+  return MemoryEpoch::SetQuarantineRelease( (::TARMEMDBG_NAMESPACE::QuarantineRelease)mode );
+}
+
+void slab_arena_get_quarantine_stats( struct slab_arena_quarantine_stats * stats ) {
+  assert( (bool)stats );
+  *stats = slab_arena_quarantine_stats();
+  stats->release_mode = MemoryEpoch::GetQuarantineRelease();
+  stats->released_total = MemoryEpoch::GetReleasedBytesTotal();
+  // очереди блокируются по одной: сдвиги эпох остальных очередей продолжаются
+  LockGuard lock( g_lock ); {
+    for ( const auto & que : g_epochs ) {
+      Size resident = 0, nepochs = 0;
+      LockGuard que_lock( que->GetLock() );
+      // защиту эпох может менять фоновый поток, дожидаемся его
+      EpochProtector::FlushIfAlive();
+      stats->quarantined_virtual += que->GetQuarantinedBytes( resident, nepochs );
+      stats->quarantined_resident += resident;
+      stats->quarantined_epochs += nepochs;
+    }
+  }
+}
+
+int slab_arena_find_address( const void * ptr, struct slab_arena_address_info * info ) {
+  assert( (bool)info );
+  // вызывается из обработчика сигнала: ни блокировок, ни выделения памяти
+  AddressIndexEntry found;
+  Size age = 0;
+  MemoryEpochQueue * owner = nullptr;
+  bool ret = g_registry.FindIf( [&]( MemoryEpochQueue * que ) {
+    if ( !que->FindAddress( ptr, found, age ) ) return false;
+    owner = que;
+    return true;
+  } );
+  if ( !ret ) return 0;
+  info->arena = (memory_epoch_queue *)MemoryEpochQueue::GetHandle( owner );
+  info->epoch_position = found.position;
+  info->epoch_age = age;
+  info->range_start = found.start;
+  info->range_size = found.byte_size;
+  info->slab = nullptr;
+  if ( found.slab_size ) {
+    // окно и slab'ы вне окна выровнены на размер slab'а
+    Size offset = (Size)( (const Byte *)ptr - found.start );
+    info->slab = found.start + offset / found.slab_size * found.slab_size;
+  }
+  info->min_id = found.min_id;
+  info->max_id = found.max_id;
+  return 1;
+}
+
 struct quota * get_slab_arena_quota(struct memory_epoch_queue **arena) {
   assert( (bool)arena );
   //return GetArenaByHandle( *arena )->quota;
@@ -128,59 +395,249 @@ void   lsregion_create(
   assert( (bool) lsregion_value );
   lsregion *   current_allocator = nullptr;
   slab_arena *current_arena = nullptr;
-  LockGuard lock( g_lock ); {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)arena );
+  LockGuard lock( que->GetLock() ); {
     //AllocateEpochsIfNeed();
-    auto * epoch = GetEpochByHandleUnsafe( (memory_epoch_queue *)arena );
+    auto * epoch = que->GetCurrentEpoch();
     assert( epoch->CheckIfThisIsReallyMemoryEpoch() );
     current_allocator = epoch->GetLsRegion();
-    *lsregion_value = (memory_epoch_queue *)current_allocator;
+    // lsregion и slab_arena разделяют один хэндл - хэндл очереди эпох
+    *lsregion_value = (memory_epoch_queue *)arena;
     current_arena = epoch->GetArena();
   }
   assert( (bool)current_allocator );
   assert( (bool)current_arena );
   lsregion_create_orig( current_allocator, current_arena );
+  CallTrace::Record( SMALL_CALL_LSREGION_CREATE, *lsregion_value, arena, 0, 0, 0 );
 }
 
-void * lsregion_aligned_reserve_slow(
+// Все обёртки, которые могут дойти до lsregion_aligned_reserve_slow_orig, открывают LargeBlockOwnerScope:
+// большой slab тогда выделит эпоха, а не malloc.
+// С redzone'ами резервируется на redzone больше, чтобы lsregion_alloc того же размера вернул тот же адрес
+
+static void * DebugLsRegionAlignedReserveSlow(
     lsregion *lsregion_value, 
     size_t size, 
     size_t alignment, 
     void **unaligned ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)lsregion_value );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
   return lsregion_aligned_reserve_slow_orig(
-      GetLsRegionByHandle( (memory_epoch_queue *)lsregion_value ),
-      size,
+      que->GetLsRegionFast(),
+      size + RedzoneTable::GetRedzoneSize(),
       alignment,
       unaligned   );
 }
 
-void * lsregion_aligned_reserve(
+static void * DebugLsRegionAlignedReserve(
     lsregion *lsregion_value, 
     size_t size, 
     size_t alignment, 
     void **unaligned ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)lsregion_value );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
   return lsregion_aligned_reserve_orig(
-      GetLsRegionByHandle( (memory_epoch_queue *)lsregion_value ),
-      size,
+      que->GetLsRegionFast(),
+      size + RedzoneTable::GetRedzoneSize(),
       alignment,
       unaligned   );
 }
 
-void * lsregion_reserve(
+static void * DebugLsRegionReserve(
     lsregion *lsregion_value, 
     size_t size ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)lsregion_value );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
   return lsregion_reserve_orig(
-      GetLsRegionByHandle( (memory_epoch_queue *)lsregion_value ),
-      size   );
+      que->GetLsRegionFast(),
+      size + RedzoneTable::GetRedzoneSize()   );
+}
+
+static void * DebugLsRegionAlloc(
+    lsregion *lsregion_value, 
+    size_t size, 
+    int64_t id,
+    const void * frame ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)lsregion_value );
+  que->AccountAllocation( size );
+  MemoryEpoch * epoch = que->GetCurrentEpochFast();
+  LargeBlockOwnerScope large_blocks( epoch );
+  Size redzone = RedzoneTable::GetRedzoneSize();
+  void * ret = lsregion_alloc_orig( 
+      que->GetLsRegionFast(),
+      size + redzone,
+      id   );
+  if ( !ret ) return ret;
+  if ( redzone ) epoch->AddRedzone( (Byte *)ret + size, redzone, id );
+  uint32_t site = AllocationSites::Sample( size, frame );
+  if ( site ) epoch->AddSite( (Byte *)ret, size, redzone, site, id );
+  return ret;
+}
+
+static void * DebugLsRegionAlignedAlloc(
+    lsregion *lsregion_value, 
+    size_t size, 
+    size_t alignment, 
+    int64_t id,
+    const void * frame ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)lsregion_value );
+  que->AccountAllocation( size );
+  MemoryEpoch * epoch = que->GetCurrentEpochFast();
+  LargeBlockOwnerScope large_blocks( epoch );
+  Size redzone = RedzoneTable::GetRedzoneSize();
+  void * ret = lsregion_aligned_alloc_orig( 
+      que->GetLsRegionFast(),
+      size + redzone,
+      alignment,
+      id   );
+  if ( !ret ) return ret;
+  if ( redzone ) epoch->AddRedzone( (Byte *)ret + size, redzone, id );
+  uint32_t site = AllocationSites::Sample( size, frame );
+  if ( site ) epoch->AddSite( (Byte *)ret, size, redzone, site, id );
+  return ret;
+}
+
+static void DebugLsRegionGc(
+    lsregion *lsregion_value, 
+    int64_t min_id ) {
+  auto * que = MemoryEpochQueue::GetSelfByHandle( (memory_epoch_queue *)lsregion_value );
+  LockGuard lock( que->GetLock() ); {
+    que->NextEpoch( min_id );
+  }
+}
+
+// Пока отладка выключена, lsregion текущей эпохи работает как обычный: без учёта, redzone'ов и мест аллокаций,
+// а lsregion_gc освобождает его на месте. Большие slab'ы всё равно выделяет эпоха, а резерв оставляет место
+// под redzone, чтобы отладку можно было переключить между lsregion_reserve и lsregion_alloc
+// и чтобы после включения эпохи освобождали и то, что выделено без отладки
+
+// Быстрый путь *_orig - место в последнем slab'е - не трогает ни эпоху, ни её большие блоки,
+// поэтому LargeBlockOwnerScope открывается, только если без lsregion_aligned_reserve_slow_orig не обойтись
+
+static inline MemoryEpochQueue * GetQueueByLsRegionHandle( lsregion * handle ) {
+  assert( g_registry.Contains( MemoryEpochQueue::GetSelfByHandleNoChecks( handle ) ) );
+  return MemoryEpochQueue::GetSelfByHandleNoChecks( handle );
+}
+
+static inline bool FitsInLastSlab( lsregion * region, size_t size, size_t alignment ) {
+  if ( rlist_empty( &region->slabs.slabs ) ) return false;
+  lslab * slab = rlist_last_entry( &region->slabs.slabs, struct lslab, next_in_list );
+  Byte * pos = (Byte *)small_align( (size_t)lslab_pos( slab ), alignment );
+  return pos + size <= (Byte *)lslab_end( slab );
+}
+
+static inline void * OrigLsRegionAlignedReserveSlow(
+    lsregion *lsregion_value, 
+    size_t size, 
+    size_t alignment, 
+    void **unaligned ) {
+  MemoryEpochQueue * que = GetQueueByLsRegionHandle( lsregion_value );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
+  return lsregion_aligned_reserve_slow_orig(
+      que->GetLsRegionFast(),
+      size + RedzoneTable::GetRedzoneSize(),
+      alignment,
+      unaligned   );
+}
+
+static inline void * OrigLsRegionAlignedReserve(
+    lsregion *lsregion_value, 
+    size_t size, 
+    size_t alignment, 
+    void **unaligned ) {
+  MemoryEpochQueue * que = GetQueueByLsRegionHandle( lsregion_value );
+  lsregion * region = que->GetLsRegionFast();
+  // с запасом под самый большой redzone его размер можно не читать
+  if ( FitsInLastSlab( region, size + RedzoneTable::kMaxRedzoneSize, alignment ) ) {
+    return lsregion_aligned_reserve_orig( region, size, alignment, unaligned );
+  }
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
+  return lsregion_aligned_reserve_orig(
+      region,
+      size + RedzoneTable::GetRedzoneSize(),
+      alignment,
+      unaligned   );
+}
+
+static inline void * OrigLsRegionReserve(
+    lsregion *lsregion_value, 
+    size_t size ) {
+  MemoryEpochQueue * que = GetQueueByLsRegionHandle( lsregion_value );
+  lsregion * region = que->GetLsRegionFast();
+  if ( FitsInLastSlab( region, size + RedzoneTable::kMaxRedzoneSize, 1 ) ) return lsregion_reserve_orig( region, size );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
+  return lsregion_reserve_orig(
+      region,
+      size + RedzoneTable::GetRedzoneSize()   );
+}
+
+static inline void * OrigLsRegionAlloc(
+    lsregion *lsregion_value, 
+    size_t size, 
+    int64_t id ) {
+  MemoryEpochQueue * que = GetQueueByLsRegionHandle( lsregion_value );
+  lsregion * region = que->GetLsRegionFast();
+  if ( FitsInLastSlab( region, size, 1 ) ) return lsregion_alloc_orig( region, size, id );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
+  return lsregion_alloc_orig( region, size, id );
+}
+
+static inline void * OrigLsRegionAlignedAlloc(
+    lsregion *lsregion_value, 
+    size_t size, 
+    size_t alignment, 
+    int64_t id ) {
+  MemoryEpochQueue * que = GetQueueByLsRegionHandle( lsregion_value );
+  lsregion * region = que->GetLsRegionFast();
+  if ( FitsInLastSlab( region, size, alignment ) ) return lsregion_aligned_alloc_orig( region, size, alignment, id );
+  LargeBlockOwnerScope large_blocks( que->GetCurrentEpochFast() );
+  return lsregion_aligned_alloc_orig( region, size, alignment, id );
+}
+
+static inline void OrigLsRegionGc(
+    lsregion *lsregion_value, 
+    int64_t min_id ) {
+  MemoryEpochQueue * que = GetQueueByHandle( (memory_epoch_queue *)lsregion_value );
+  LockGuard lock( que->GetLock() ); {
+    que->CollectCurrentEpoch( min_id );
+  }
+}
+
+void * lsregion_aligned_reserve_slow(
+    lsregion *lsregion_value, 
+    size_t size, 
+    size_t alignment, 
+    void **unaligned ) {
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->lsregion_aligned_reserve_slow( lsregion_value, size, alignment, unaligned );
+  return OrigLsRegionAlignedReserveSlow( lsregion_value, size, alignment, unaligned );
+}
+
+void * lsregion_aligned_reserve(
+    lsregion *lsregion_value, 
+    size_t size, 
+    size_t alignment, 
+    void **unaligned ) {
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->lsregion_aligned_reserve( lsregion_value, size, alignment, unaligned );
+  return OrigLsRegionAlignedReserve( lsregion_value, size, alignment, unaligned );
+}
+
+void * lsregion_reserve(
+    lsregion *lsregion_value, 
+    size_t size ) {
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->lsregion_reserve( lsregion_value, size );
+  return OrigLsRegionReserve( lsregion_value, size );
 }
 
 void * lsregion_alloc(
     lsregion *lsregion_value, 
     size_t size, 
     int64_t id ) {
-  return lsregion_alloc_orig( 
-      GetLsRegionByHandle( (memory_epoch_queue *)lsregion_value ),
-      size,
-      id   );
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->lsregion_alloc( lsregion_value, size, id, __builtin_frame_address( 0 ) );
+  return OrigLsRegionAlloc( lsregion_value, size, id );
 }
 
 void * lsregion_aligned_alloc(
@@ -188,23 +645,475 @@ void * lsregion_aligned_alloc(
     size_t size, 
     size_t alignment, 
     int64_t id ) {
-  return lsregion_aligned_alloc_orig( 
-      GetLsRegionByHandle( (memory_epoch_queue *)lsregion_value ),
-      size,
-      alignment,
-      id   );
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->lsregion_aligned_alloc( lsregion_value, size, alignment, id, __builtin_frame_address( 0 ) );
+  return OrigLsRegionAlignedAlloc( lsregion_value, size, alignment, id );
 }
 
 void   lsregion_gc(
     lsregion *lsregion_value, 
-    [[maybe_unused]] int64_t min_id ) {
+    int64_t min_id ) {
+  const DebugEntryPoints * debug = EntryPoints::Get();
+  if ( IsDebugEnabled( debug ) ) return debug->lsregion_gc( lsregion_value, min_id );
+  OrigLsRegionGc( lsregion_value, min_id );
+}
+
+// Записывающая таблица идёт в отладочную, если отладка включена, или в *_orig.
+// Аллокации записываются после выполнения, чтобы в записи был их адрес
+
+static void * ForwardSlabMap( slab_arena *arena ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  return debug ? debug->slab_map( arena ) : OrigSlabMap( arena );
+}
+
+static void ForwardSlabUnmap( slab_arena *arena, void *ptr ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  if ( debug ) return debug->slab_unmap( arena, ptr );
+  OrigSlabUnmap( arena, ptr );
+}
+
+static void * ForwardLsRegionAlignedReserveSlow( lsregion *lsregion_value, size_t size, size_t alignment, void **unaligned ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  return debug ? debug->lsregion_aligned_reserve_slow( lsregion_value, size, alignment, unaligned ) :
+                 OrigLsRegionAlignedReserveSlow( lsregion_value, size, alignment, unaligned );
+}
+
+static void * ForwardLsRegionAlignedReserve( lsregion *lsregion_value, size_t size, size_t alignment, void **unaligned ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  return debug ? debug->lsregion_aligned_reserve( lsregion_value, size, alignment, unaligned ) :
+                 OrigLsRegionAlignedReserve( lsregion_value, size, alignment, unaligned );
+}
+
+static void * ForwardLsRegionReserve( lsregion *lsregion_value, size_t size ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  return debug ? debug->lsregion_reserve( lsregion_value, size ) : OrigLsRegionReserve( lsregion_value, size );
+}
+
+static void * RecordLsRegionAlloc( lsregion *lsregion_value, size_t size, int64_t id, const void * frame ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  void * ret = debug ? debug->lsregion_alloc( lsregion_value, size, id, frame ) :
+                       OrigLsRegionAlloc( lsregion_value, size, id );
+  CallTrace::Record( SMALL_CALL_LSREGION_ALLOC, lsregion_value, ret, size, id, 0 );
+  return ret;
+}
+
+static void * RecordLsRegionAlignedAlloc( lsregion *lsregion_value, size_t size, size_t alignment, int64_t id, const void * frame ) {
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  void * ret = debug ? debug->lsregion_aligned_alloc( lsregion_value, size, alignment, id, frame ) :
+                       OrigLsRegionAlignedAlloc( lsregion_value, size, alignment, id );
+  CallTrace::Record( SMALL_CALL_LSREGION_ALLOC, lsregion_value, ret, size, id, (uint32_t)alignment );
+  return ret;
+}
+
+static void RecordLsRegionGc( lsregion *lsregion_value, int64_t min_id ) {
+  CallTrace::Record( SMALL_CALL_LSREGION_GC, lsregion_value, nullptr, 0, min_id, 0 );
+  const DebugEntryPoints * debug = EntryPoints::GetDebug();
+  if ( debug ) return debug->lsregion_gc( lsregion_value, min_id );
+  OrigLsRegionGc( lsregion_value, min_id );
+}
+
+void * lsregion_large_slab_alloc( struct lsregion *lsregion_value, size_t size ) {
+  MemoryEpoch * owner = LargeBlockOwnerScope::GetOwner( lsregion_value );
+  if ( !owner ) return malloc( size );
+  return owner->AllocateLargeMemoryBlock( size );
+}
+
+void   lsregion_large_slab_free( struct lsregion *lsregion_value, struct lslab *slab ) {
+  MemoryEpoch * owner = LargeBlockOwnerScope::GetOwner( lsregion_value );
+  if ( !owner ) {
+    free( slab );
+    return;
+  }
+  owner->DeallocateLargeMemoryBlock( slab );
+}
+
+void slab_arena_get_large_block_stats( struct slab_arena_large_block_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::LargeBlockPoolStats pool = LargeBlockPool::GetStats();
+  stats->live_blocks = pool.live_blocks;
+  stats->live_bytes = pool.live_bytes;
+  stats->cached_blocks = pool.cached_blocks;
+  stats->cached_bytes = pool.cached_bytes;
+  stats->mapped = pool.mapped;
+  stats->reused = pool.reused;
+  stats->unmapped = pool.unmapped;
+}
+
+size_t slab_arena_set_epoch_pool_size( size_t size ) {
+  return EpochPool::SetSize( size );
+}
+
+size_t slab_arena_refill_epoch_pool( void ) {
+  return EpochPool::Refill();
+}
+
+void slab_arena_get_epoch_pool_stats( struct slab_arena_epoch_pool_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::EpochPoolStats pool = EpochPool::GetStats();
+  stats->size = pool.size;
+  stats->ready = pool.ready;
+  stats->taken = pool.taken;
+  stats->missed = pool.missed;
+  stats->built = pool.built;
+}
+
+void slab_arena_get_metadata_stats( struct slab_arena_metadata_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::MetadataPoolStats pool = MetadataPagePool::GetStats();
+  stats->mapped_bytes = pool.mapped_bytes;
+  stats->used_bytes = pool.used_bytes;
+  stats->cached_bytes = pool.cached_bytes;
+  stats->chunks = pool.chunks;
+  stats->direct_maps = pool.direct_maps;
+  stats->allocations = pool.allocations;
+  stats->reused = pool.reused;
+}
+
+size_t slab_arena_set_redzone( size_t byte_size ) {
+  return RedzoneTable::SetRedzoneSize( byte_size );
+}
+
+void slab_arena_get_redzone_stats( struct slab_arena_redzone_stats * stats ) {
+  assert( (bool)stats );
+  // канарейки могут проверяться в фоновом потоке, дожидаемся его
+  EpochProtector::FlushIfAlive();
+  ::TARMEMDBG_NAMESPACE::RedzoneStats redzones = RedzoneTable::GetStats();
+  stats->redzone_size = redzones.redzone_size;
+  stats->isa = redzones.isa;
+  stats->table_bytes = redzones.table_bytes;
+  stats->checked = redzones.checked;
+  stats->corrupted = redzones.corrupted;
+  stats->scan_ns = redzones.scan_ns;
+  stats->last_corrupted = redzones.last_corrupted;
+}
+
+size_t slab_arena_set_mempool_quarantine( size_t byte_size ) {
+  return MempoolQuarantine::SetBudget( byte_size );
+}
+
+void slab_arena_get_mempool_quarantine_stats( struct slab_arena_mempool_quarantine_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::QuarantineStats quarantine = MempoolQuarantine::GetStats();
+  stats->budget = quarantine.limit;
+  stats->objects = quarantine.items;
+  stats->bytes = quarantine.bytes;
+  stats->protected_slabs = quarantine.protected_size;
+  stats->recycled = quarantine.released;
+  stats->corrupted = quarantine.corrupted;
+  stats->last_corrupted = quarantine.last_corrupted;
+}
+
+bool mempool_quarantine_put( struct mempool * pool, struct mslab * slab, void * ptr ) {
+  return MempoolQuarantine::Put( pool, slab, ptr );
+}
+
+void mempool_quarantine_drain( struct mempool * pool ) {
+  MempoolQuarantine::Drain( pool );
+}
+
+size_t slab_arena_set_region_generations( size_t generations ) {
+  return RegionQuarantine::SetGenerations( generations );
+}
+
+void slab_arena_get_region_quarantine_stats( struct slab_arena_region_quarantine_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::QuarantineStats quarantine = RegionQuarantine::GetStats();
+  stats->generations = quarantine.limit;
+  stats->slabs = quarantine.items;
+  stats->bytes = quarantine.bytes;
+  stats->protected_bytes = quarantine.protected_size;
+  stats->released = quarantine.released;
+  stats->corrupted = quarantine.corrupted;
+  stats->last_corrupted = quarantine.last_corrupted;
+}
+
+bool region_quarantine_put( struct region * region, struct slab * slab ) {
+  return RegionQuarantine::Put( region, slab );
+}
+
+void region_quarantine_seal( struct region * region ) {
+  RegionQuarantine::Seal( region );
+}
+
+void region_quarantine_drain( struct region * region ) {
+  RegionQuarantine::Drain( region );
+}
+
+size_t slab_arena_set_buffer_quarantine( size_t byte_size ) {
+  return BufferQuarantine::SetBudget( byte_size );
+}
+
+void slab_arena_get_buffer_quarantine_stats( struct slab_arena_buffer_quarantine_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::QuarantineStats quarantine = BufferQuarantine::GetStats();
+  stats->budget = quarantine.limit;
+  stats->slabs = quarantine.items;
+  stats->bytes = quarantine.bytes;
+  stats->protected_bytes = quarantine.protected_size;
+  stats->released = quarantine.released;
+  stats->corrupted = quarantine.corrupted;
+  stats->last_corrupted = quarantine.last_corrupted;
+}
+
+bool buffer_quarantine_put( struct slab_cache * cache, struct slab * slab ) {
+  return BufferQuarantine::Put( cache, slab );
+}
+
+bool buffer_quarantine_is_enabled() {
+  return BufferQuarantine::IsEnabled();
+}
+
+void buffer_quarantine_drain( struct slab_cache * cache ) {
+  BufferQuarantine::Drain( cache );
+}
+
+size_t slab_arena_set_allocation_sampling( size_t sample_bytes ) {
+  return AllocationSites::SetSampleBytes( sample_bytes );
+}
+
+void slab_arena_get_allocation_site_stats( struct slab_arena_allocation_site_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::AllocationSiteStats sites = AllocationSites::GetStats();
+  stats->sample_bytes = sites.sample_bytes;
+  stats->sites = sites.sites;
+  stats->capacity = sites.capacity;
+  stats->samples = sites.samples;
+  stats->sampled_bytes = sites.sampled_bytes;
+  stats->dropped = sites.dropped;
+  stats->table_bytes = sites.table_bytes;
+}
+
+int slab_arena_get_allocation_site( uint32_t id, struct slab_arena_allocation_site * site ) {
+  assert( (bool)site );
+  static_assert( SLAB_ARENA_ALLOCATION_SITE_DEPTH == AllocationSites::kMaxDepth, "allocation site depth mismatch" );
+  ::TARMEMDBG_NAMESPACE::AllocationSiteInfo info;
+  if ( !AllocationSites::GetSite( id, info ) ) return 0;
+  *site = slab_arena_allocation_site();
+  site->id = info.id;
+  site->depth = (uint32_t)info.depth;
+  std::copy( info.frames, info.frames + info.depth, site->frames );
+  site->samples = info.samples;
+  site->sampled_bytes = info.sampled_bytes;
+  site->estimated_bytes = info.estimated_bytes;
+  return 1;
+}
+
+uint32_t slab_arena_find_allocation_site( const void * ptr ) {
+  uint32_t ret = 0;
+  // выбранных чанков в эпохе немного, поэтому просто обходим все эпохи всех очередей
   LockGuard lock( g_lock ); {
-    auto * que = MemoryEpochQueue::GetSelfByHandle( (memory_epoch_queue *)lsregion_value );
-    assert( (uint64_t)min_id == (uint64_t)que->GetPositionOrMaxId() );  
-    que->NextEpoch();
+    for ( const auto & que : g_epochs ) {
+      LockGuard que_lock( que->GetLock() );
+      EpochProtector::FlushIfAlive();
+      que->ForEachEpoch( [&]( MemoryEpoch * epoch, Size, Size ) {
+        if ( !ret ) ret = epoch->GetSites().Find( ptr );
+      } );
+      if ( ret ) break;
+    }
+  }
+  return ret;
+}
+
+uint32_t slab_arena_find_mempool_allocation_site( struct mempool * pool, const void * ptr ) {
+  assert( (bool)pool );
+  return AllocationSites::FindInMempool( pool, ptr );
+}
+
+static size_t ExportAllocationSiteUsage( 
+    const std::vector< AllocationSiteUsage > & sites, 
+    size_t nsites, 
+    struct slab_arena_allocation_site_usage * usage ) {
+  for ( size_t i = 0; i < std::min( nsites, sites.size() ); ++i ) {
+    usage[i].site = sites[i].site;
+    usage[i].chunks = sites[i].chunks;
+    usage[i].bytes = sites[i].bytes;
+  }
+  return nsites;
+}
+
+size_t slab_arena_get_epoch_allocation_sites( 
+    struct memory_epoch_queue **arena, 
+    size_t epoch_age, 
+    struct slab_arena_allocation_site_usage * usage, 
+    size_t max_sites ) {
+  assert( (bool)arena );
+  assert( (bool)usage || !max_sites );
+  MemoryEpochQueue * que = GetQueueByHandle( *arena );
+  std::vector< AllocationSiteUsage > sites( max_sites );
+  size_t ret = 0;
+  LockGuard lock( que->GetLock() ); {
+    EpochProtector::FlushIfAlive();
+    que->ForEachEpoch( [&]( MemoryEpoch * epoch, Size age, Size ) {
+      if ( age == epoch_age ) ret = epoch->GetSites().GetUsage( sites.data(), max_sites );
+    } );
+  }
+  return ExportAllocationSiteUsage( sites, ret, usage );
+}
+
+size_t slab_arena_get_mempool_allocation_sites( 
+    struct mempool * pool, 
+    struct slab_arena_allocation_site_usage * usage, 
+    size_t max_sites ) {
+  assert( (bool)pool );
+  assert( (bool)usage || !max_sites );
+  std::vector< AllocationSiteUsage > sites( max_sites );
+  size_t ret = AllocationSites::GetMempoolUsage( pool, sites.data(), max_sites );
+  return ExportAllocationSiteUsage( sites, ret, usage );
+}
+
+void mempool_site_alloc( struct mempool * pool, struct mslab * slab, void * ptr ) {
+  AllocationSites::OnMempoolAlloc( pool, slab, ptr, __builtin_frame_address( 0 ) );
+  if ( mempool_is_traced( pool ) ) CallTrace::Record( SMALL_CALL_MEMPOOL_ALLOC, pool, ptr, pool->objsize, 0, 0 );
+}
+
+void mempool_site_free( struct mempool * pool, struct mslab * slab, void * ptr ) {
+  if ( mempool_is_traced( pool ) ) CallTrace::Record( SMALL_CALL_MEMPOOL_FREE, pool, ptr, pool->objsize, 0, 0 );
+  AllocationSites::OnMempoolFree( pool, slab, ptr );
+}
+
+void mempool_site_release( struct mempool * pool, struct mslab * slab ) {
+  AllocationSites::ReleaseMempoolSlab( pool, slab );
+}
+
+void region_site_alloc( struct region * region, size_t size, size_t alignment ) {
+  RegionSiteTable::OnAlloc( region, size, __builtin_frame_address( 0 ) );
+  CallTrace::Record( SMALL_CALL_REGION_ALLOC, region, nullptr, size, 0, (uint32_t)alignment );
+}
+
+void region_site_truncate( struct region * region ) {
+  RegionSiteTable::Truncate( region );
+  CallTrace::Record( SMALL_CALL_REGION_TRUNCATE, region, nullptr, region->slabs.stats.used, 0, 0 );
+}
+
+void region_site_release( struct region * region ) {
+  RegionSiteTable::Release( region );
+}
+
+struct slab_arena_heap_profile * slab_arena_heap_profile_new() {
+  return (struct slab_arena_heap_profile *)::TARMEMDBG_NAMESPACE::NewAligned<HeapProfile>();
+}
+
+void slab_arena_heap_profile_add_mempool( struct slab_arena_heap_profile * profile, struct mempool * pool ) {
+  assert( (bool)profile );
+  assert( (bool)pool );
+  ( (HeapProfile *)profile )->AddMempool( pool );
+}
+
+void slab_arena_heap_profile_add_region( struct slab_arena_heap_profile * profile, struct region * region ) {
+  assert( (bool)profile );
+  assert( (bool)region );
+  ( (HeapProfile *)profile )->AddRegion( region );
+}
+
+void slab_arena_heap_profile_add_arena( struct slab_arena_heap_profile * profile, struct memory_epoch_queue **arena ) {
+  assert( (bool)profile );
+  assert( (bool)arena );
+  MemoryEpochQueue * que = GetQueueByHandle( *arena );
+  LockGuard lock( que->GetLock() ); {
+    EpochProtector::FlushIfAlive();
+    ( (HeapProfile *)profile )->AddEpochs( que );
   }
 }
 
+int slab_arena_heap_profile_write( struct slab_arena_heap_profile * profile, int fd ) {
+  assert( (bool)profile );
+  return ( (HeapProfile *)profile )->Write( fd ) ? 0 : -1;
+}
+
+void slab_arena_heap_profile_delete( struct slab_arena_heap_profile * profile ) {
+  if ( profile ) ::TARMEMDBG_NAMESPACE::DeleteAligned( (HeapProfile *)profile );
+}
+
+void small_trace( enum small_trace_type type, const void * ptr, uint64_t arg, uint32_t aux ) {
+  EventTrace::Record( type, ptr, arg, aux );
+}
+
+int slab_arena_open_event_trace( const char * path, size_t ring_events, size_t rings ) {
+  return EventTrace::Open( path, ring_events, rings ) ? 0 : -1;
+}
+
+void slab_arena_close_event_trace() {
+  EventTrace::Close();
+}
+
+void small_call( enum small_call_type type, const void * object, const void * ptr, uint64_t size, int64_t arg, uint32_t aux ) {
+  CallTrace::Record( type, object, ptr, size, arg, aux );
+}
+
+int slab_arena_open_call_trace( const char * path ) {
+  bool opened = CallTrace::Open( path );
+  EntryPoints::UpdateRecording();
+  return opened ? 0 : -1;
+}
+
+void slab_arena_close_call_trace() {
+  CallTrace::Close();
+  EntryPoints::UpdateRecording();
+}
+
+void slab_arena_get_call_trace_stats( struct slab_arena_call_trace_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::CallTraceStats trace = CallTrace::GetStats();
+  stats->enabled = trace.enabled;
+  stats->threads = trace.threads;
+  stats->records = trace.records;
+  stats->bytes = trace.bytes;
+  stats->chunks = trace.chunks;
+  stats->write_errors = trace.write_errors;
+}
+
+void slab_arena_get_event_trace_stats( struct slab_arena_event_trace_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::EventTraceStats trace = EventTrace::GetStats();
+  stats->enabled = trace.enabled;
+  stats->ring_count = trace.ring_count;
+  stats->ring_capacity = trace.ring_capacity;
+  stats->rings_used = trace.rings_used;
+  stats->events = trace.events;
+  stats->dropped = trace.dropped;
+}
+
+void   lsregion_slab_mapped( struct lsregion *lsregion_value, struct lslab *slab ) {
+  MemoryEpoch * owner = LargeBlockOwnerScope::GetOwner( lsregion_value );
+  // без владельца - lsregion не эпохи, а slab'ы внутри окна индекс адресов и так покрывает
+  if ( !owner || !owner->GetQueue() || MemoryEpoch::IsSlabInsideWindow( lsregion_value->arena, slab ) ) return;
+  MemoryEpochQueue * que = owner->GetQueue();
+  LockGuard lock( que->GetLock() );
+  que->TrackSlabOutsideWindow( owner, slab );
+}
+
+size_t lsregion_slab_size( struct lsregion *lsregion_value ) {
+  MemoryEpoch * owner = LargeBlockOwnerScope::GetOwner( lsregion_value );
+  if ( !owner ) return lsregion_value->arena->slab_size;
+  return owner->GetUsableSlabSize();
+}
+
+int slab_arena_set_memory_debug( int enabled ) {
+  EntryPoints::Init( &kDebugEntryPoints, &kRecordEntryPoints );
+  return EntryPoints::Set( enabled != 0 );
+}
+
+void slab_arena_get_memory_debug_stats( struct slab_arena_memory_debug_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::EntryPointStats entry_points = EntryPoints::GetStats();
+  stats->enabled = entry_points.enabled;
+  stats->switches = entry_points.switches;
+}
+
+int slab_arena_set_slab_guards( int enabled ) {
+  return MemoryEpoch::SetSlabGuards( enabled != 0 );
+}
+
+void slab_arena_get_slab_guard_stats( struct slab_arena_slab_guard_stats * stats ) {
+  assert( (bool)stats );
+  ::TARMEMDBG_NAMESPACE::SlabGuardStats guards = MemoryEpoch::GetSlabGuardStats();
+  stats->enabled = guards.enabled;
+  stats->guard_pages = guards.guard_pages;
+  stats->guard_bytes = guards.guard_bytes;
+  stats->mprotect_calls = guards.mprotect_calls;
+  stats->split_huge_pages = guards.split_huge_pages;
+}
+
 void   lsregion_destroy( memory_epoch_queue **lsregion_value ) {
     *lsregion_value = nullptr;
 }
@@ -214,14 +1123,9 @@ size_t lsregion_used_internal( memory_epoch_queue *lsregion_value ) {
 }
 
 size_t lsregion_used_main(void * handle) {
-  bool arg_type = 0;
-  {
-    LockGuard lock( g_lock ); {    
-      MemoryEpochQueue * que = MemoryEpochQueue::GetSelfByHandleNoChecks( handle );
-      // аргумент - lsregion * ?
-      arg_type = (   g_epochs.count( que ) > 0   );
-    }
-  }
+  MemoryEpochQueue * que = MemoryEpochQueue::GetSelfByHandleNoChecks( handle );
+  // аргумент - lsregion * ?
+  bool arg_type = g_registry.Contains( que );
   return ( arg_type ) ? (   lsregion_used_internal(   (memory_epoch_queue *)handle  )    ) :
                         (   lsregion_used_internal( *((memory_epoch_queue**)handle) )   );
 }
@@ -240,7 +1144,8 @@ struct slab_arena * get_slab_arena( struct memory_epoch_queue ** arena ) {
 }
 
 void slab_cache_create(struct slab_cache *cache, struct memory_epoch_queue ** arena) {
-  slab_cache_create_orig(   cache, (slab_arena *)GetEpochByHandle( *arena )  );
+  slab_cache_create_orig(   cache, GetArenaByHandle( *arena )  );
+  CallTrace::Record( SMALL_CALL_SLAB_CACHE_CREATE, cache, *arena, 0, 0, 0 );
 }
 
 } // extern C
\ No newline at end of file
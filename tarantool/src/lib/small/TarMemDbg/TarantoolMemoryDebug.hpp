@@ -38,14 +38,51 @@
 #   include "Declarations.hpp"
 #   include "TarMemDbg_PageSize.hpp"
 #   include "TarMemDbg_MemTools.hpp"
+#   include "MetadataPagePool.hpp"
+#   include "MetadataPagePool.impl.hpp"
 
 // Основной код
+#   include "PerfCounters.hpp"
+#   include "EventTrace.hpp"
+#   include "EventTrace.impl.hpp"
+#   include "CallTrace.hpp"
+#   include "CallTrace.impl.hpp"
+#   include "EntryPoints.hpp"
+#   include "EntryPoints.impl.hpp"
 #   include "SlidingWindow.hpp"
 #   include "SlidingWindow.impl.hpp"
+#   include "ProtectionPlan.hpp"
+#   include "ProtectionPlan.impl.hpp"
+#   include "AllocationSites.hpp"
+#   include "AllocationSites.impl.hpp"
+#   include "Redzone.hpp"
+#   include "Redzone.impl.hpp"
+#   include "QuarantineCounters.hpp"
+#   include "QuarantineCounters.impl.hpp"
+#   include "MempoolQuarantine.hpp"
+#   include "MempoolQuarantine.impl.hpp"
+#   include "RegionQuarantine.hpp"
+#   include "RegionQuarantine.impl.hpp"
+#   include "BufferQuarantine.hpp"
+#   include "BufferQuarantine.impl.hpp"
 #   include "MemoryEpoch.hpp"
+#   include "LargeBlockPool.hpp"
 #   include "MemoryEpoch.impl.hpp"
+#   include "LargeBlockPool.impl.hpp"
+#   include "AddressIndex.hpp"
+#   include "AddressIndex.impl.hpp"
+#   include "Sampling.hpp"
+#   include "Sampling.impl.hpp"
+#   include "EpochProtector.hpp"
+#   include "EpochPool.hpp"
+#   include "EpochPool.impl.hpp"
 #   include "MemoryEpochQueue.hpp"
 #   include "MemoryEpochQueue.impl.hpp"
+#   include "EpochProtector.impl.hpp"
+#   include "QueueRegistry.hpp"
+#   include "QueueRegistry.impl.hpp"
+#   include "HeapProfile.hpp"
+#   include "HeapProfile.impl.hpp"
 
 
 #   undef  TARMEMDBG_ALLOW_INCLUDE
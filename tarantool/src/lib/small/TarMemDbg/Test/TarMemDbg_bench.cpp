@@ -0,0 +1,305 @@
+/**
+ ** @file TarMemDbg_bench.cpp
+ ** @author Astapov Konstantin
+ ** @copyright 2021, Picodata. picodata.io - professional database services
+ ** @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ ** \~english @brief wrapped-vs-orig benchmark of the lsregion API
+ ** \~english @details
+ **  Drives the same lsregion_alloc/lsregion_gc stream through the TaraRam
+ **  wrappers and through the *_orig functions, prints a JSON report to stdout.
+ ** \~russian @brief сравнительный бенчмарк обёрток TaraRam и *_orig функций
+ ** \~russian @details
+ **  Каждый поток создаёт собственную арену и lsregion, выполняет поток
+ **  аллокаций переменного размера и периодически вызывает lsregion_gc.
+ **  Результат (ops/sec, p50/p99/p999 латентности, стоимость ротаций)
+ **  печатается в stdout в формате JSON.
+ **
+ **  Параметры:
+ **      --threads N      число потоков (1)
+ **      --ops N          число аллокаций на поток (2000000)
+ **      --gc-every N     вызывать lsregion_gc каждые N аллокаций (65536)
+ **      --min-size N     минимальный размер аллокации (8)
+ **      --max-size N     максимальный размер аллокации (512)
+ **      --slab-size N    размер слаба арены (4 MiB)
+ **      --sample N       замерять латентность каждой N-й аллокации (16)
+ **      --api A          orig | wrapped | both (both)
+ **      --async          включить асинхронную защиту эпох
+ **/
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+extern "C" {
+#include <climits>
+#include <cassert>
+#include <cstdlib>
+#include <sys/mman.h>
+// публичные заголовки small не собираются C++ компилятором при TARARAM,
+// поэтому, как и StandardIncludes.hpp, берём внутренние
+#include "../../small/rlist.h"
+#include "../../small/lf_lifo_struct.h"
+#include "../../small/quota_internal.h"
+#include "../../small/slab_arena_internal.h"
+#include "../../small/slab_cache_internal.h"
+#include "../../small/lsregion_internal.h"
+
+void   slab_arena_destroy(memory_epoch_queue *arena);
+void * lsregion_alloc(struct lsregion *lsregion, size_t size, int64_t id);
+void   lsregion_gc(struct lsregion *lsregion, int64_t min_id);
+void   lsregion_destroy(memory_epoch_queue **lsregion_value);
+int    slab_arena_set_async_protection(int enabled);
+void   slab_arena_flush_protection(void);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig {
+  int      threads   = 1;
+  uint64_t ops       = 2000000;
+  uint64_t gc_every  = 65536;
+  size_t   min_size  = 8;
+  size_t   max_size  = 512;
+  uint32_t slab_size = 4u << 20;
+  uint64_t sample    = 16;
+  bool     orig      = true;
+  bool     wrapped   = true;
+  bool     async     = false;
+};
+
+/// результат одного потока
+struct ThreadResult {
+  double                seconds = 0;
+  std::vector<uint32_t> latency_ns;
+  std::vector<uint64_t> rotation_ns;
+};
+
+/// агрегированный результат прогона одного API
+struct RunResult {
+  const char *          api;
+  double                seconds = 0;
+  uint64_t              ops = 0;
+  std::vector<uint32_t> latency_ns;
+  std::vector<uint64_t> rotation_ns;
+};
+
+inline uint64_t ElapsedNs(Clock::time_point from, Clock::time_point to) {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+inline uint64_t NextRandom(uint64_t &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+/// общий цикл бенчмарка. ApiTn предоставляет Alloc и Gc
+template<class ApiTn>
+void RunStream(ApiTn &api, const BenchConfig &cfg, int thread_no, ThreadResult &out) {
+  uint64_t rnd = 0x9E3779B97F4A7C15ull ^ (uint64_t)(thread_no + 1);
+  size_t   span = cfg.max_size - cfg.min_size + 1;
+  int64_t  id = 1;
+
+  out.latency_ns.reserve(cfg.ops / cfg.sample + 1);
+  out.rotation_ns.reserve(cfg.ops / cfg.gc_every + 1);
+
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < cfg.ops; ++i) {
+    if (i != 0 && i % cfg.gc_every == 0) {
+      Clock::time_point g0 = Clock::now();
+      api.Gc(id);
+      out.rotation_ns.push_back(ElapsedNs(g0, Clock::now()));
+      ++id;
+    }
+    size_t size = cfg.min_size + (size_t)(NextRandom(rnd) % span);
+    char * p;
+    if (i % cfg.sample == 0) {
+      Clock::time_point a0 = Clock::now();
+      p = (char *)api.Alloc(size, id);
+      out.latency_ns.push_back((uint32_t)ElapsedNs(a0, Clock::now()));
+    } else {
+      p = (char *)api.Alloc(size, id);
+    }
+    if (p == nullptr) {
+      fprintf(stderr, "allocation of %zu bytes failed\n", size);
+      abort();
+    }
+    p[0] = (char)i;
+  }
+  out.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct OrigApi {
+  slab_arena arena;
+  lsregion   region;
+
+  OrigApi(quota *q, uint32_t slab_size) {
+    if (slab_arena_create_orig(&arena, q, 0, slab_size, MAP_PRIVATE) != 0) {
+      fprintf(stderr, "slab_arena_create_orig failed\n");
+      abort();
+    }
+    lsregion_create_orig(&region, &arena);
+  }
+  ~OrigApi() {
+    lsregion_destroy_orig(&region);
+    slab_arena_destroy_orig(&arena);
+  }
+  void * Alloc(size_t size, int64_t id) { return lsregion_alloc_orig(&region, size, id); }
+  void   Gc(int64_t id) { lsregion_gc_orig(&region, id); }
+};
+
+struct WrappedApi {
+  memory_epoch_queue *arena  = nullptr;
+  memory_epoch_queue *region = nullptr;
+
+  WrappedApi(quota *q, uint32_t slab_size) {
+    if (slab_arena_create(&arena, q, 0, slab_size, MAP_PRIVATE) != 0) {
+      fprintf(stderr, "slab_arena_create failed\n");
+      abort();
+    }
+    lsregion_create(&region, (slab_arena *)arena);
+  }
+  ~WrappedApi() {
+    lsregion_destroy(&region);
+    slab_arena_destroy(arena);
+  }
+  void * Alloc(size_t size, int64_t id) { return lsregion_alloc((lsregion *)region, size, id); }
+  void   Gc(int64_t id) { lsregion_gc((lsregion *)region, id); }
+};
+
+template<class ApiTn>
+RunResult Run(const char *name, const BenchConfig &cfg, quota *q) {
+  std::vector<ThreadResult> results(cfg.threads);
+  std::vector<std::thread>  threads;
+  for (int t = 0; t < cfg.threads; ++t) {
+    threads.emplace_back([&, t]() {
+      ApiTn api(q, cfg.slab_size);
+      RunStream(api, cfg, t, results[t]);
+    });
+  }
+  for (std::thread &th : threads)
+    th.join();
+  slab_arena_flush_protection();
+
+  RunResult r;
+  r.api = name;
+  for (ThreadResult &tr : results) {
+    r.seconds = std::max(r.seconds, tr.seconds);
+    r.ops += cfg.ops;
+    r.latency_ns.insert(r.latency_ns.end(), tr.latency_ns.begin(), tr.latency_ns.end());
+    r.rotation_ns.insert(r.rotation_ns.end(), tr.rotation_ns.begin(), tr.rotation_ns.end());
+  }
+  std::sort(r.latency_ns.begin(), r.latency_ns.end());
+  std::sort(r.rotation_ns.begin(), r.rotation_ns.end());
+  return r;
+}
+
+template<class TypeTn>
+TypeTn Percentile(const std::vector<TypeTn> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t idx = (size_t)(p * (double)(sorted.size() - 1) + 0.5);
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void PrintResult(const RunResult &r, bool last) {
+  uint64_t rotation_total = 0;
+  for (uint64_t ns : r.rotation_ns)
+    rotation_total += ns;
+  printf("    {\n");
+  printf("      \"api\": \"%s\",\n", r.api);
+  printf("      \"ops\": %llu,\n", (unsigned long long)r.ops);
+  printf("      \"seconds\": %.6f,\n", r.seconds);
+  printf("      \"ops_per_sec\": %.0f,\n", r.seconds > 0 ? (double)r.ops / r.seconds : 0.0);
+  printf("      \"latency_ns\": { \"samples\": %zu, \"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u },\n",
+         r.latency_ns.size(), Percentile(r.latency_ns, 0.50), Percentile(r.latency_ns, 0.99),
+         Percentile(r.latency_ns, 0.999), r.latency_ns.empty() ? 0u : r.latency_ns.back());
+  printf("      \"rotation_ns\": { \"count\": %zu, \"total\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu }\n",
+         r.rotation_ns.size(), (unsigned long long)rotation_total,
+         (unsigned long long)Percentile(r.rotation_ns, 0.50),
+         (unsigned long long)Percentile(r.rotation_ns, 0.99),
+         (unsigned long long)(r.rotation_ns.empty() ? 0 : r.rotation_ns.back()));
+  printf("    }%s\n", last ? "" : ",");
+}
+
+bool ParseArgs(int argc, char **argv, BenchConfig &cfg) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> unsigned long long {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "%s requires a value\n", arg.c_str());
+        exit(2);
+      }
+      return strtoull(argv[++i], nullptr, 0);
+    };
+    if (arg == "--threads")        cfg.threads = (int)value();
+    else if (arg == "--ops")       cfg.ops = value();
+    else if (arg == "--gc-every")  cfg.gc_every = value();
+    else if (arg == "--min-size")  cfg.min_size = (size_t)value();
+    else if (arg == "--max-size")  cfg.max_size = (size_t)value();
+    else if (arg == "--slab-size") cfg.slab_size = (uint32_t)value();
+    else if (arg == "--sample")    cfg.sample = value();
+    else if (arg == "--async")     cfg.async = true;
+    else if (arg == "--api") {
+      if (i + 1 >= argc)
+        return false;
+      std::string api = argv[++i];
+      cfg.orig = api == "orig" || api == "both";
+      cfg.wrapped = api == "wrapped" || api == "both";
+      if (!cfg.orig && !cfg.wrapped)
+        return false;
+    } else {
+      return false;
+    }
+  }
+  return cfg.threads > 0 && cfg.ops > 0 && cfg.gc_every > 0 && cfg.sample > 0 &&
+         cfg.min_size > 0 && cfg.min_size <= cfg.max_size;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchConfig cfg;
+  if (!ParseArgs(argc, argv, cfg)) {
+    fprintf(stderr, "usage: %s [--threads N] [--ops N] [--gc-every N] [--min-size N] "
+                    "[--max-size N] [--slab-size N] [--sample N] [--api orig|wrapped|both] [--async]\n",
+            argv[0]);
+    return 2;
+  }
+  slab_arena_set_async_protection(cfg.async);
+
+  static quota q;
+  quota_init(&q, QUOTA_MAX);
+
+  std::vector<RunResult> runs;
+  if (cfg.orig)
+    runs.push_back(Run<OrigApi>("orig", cfg, &q));
+  if (cfg.wrapped)
+    runs.push_back(Run<WrappedApi>("wrapped", cfg, &q));
+
+  printf("{\n");
+  printf("  \"config\": { \"threads\": %d, \"ops_per_thread\": %llu, \"gc_every\": %llu, "
+         "\"min_size\": %zu, \"max_size\": %zu, \"slab_size\": %u, \"sample\": %llu, \"async\": %s },\n",
+         cfg.threads, (unsigned long long)cfg.ops, (unsigned long long)cfg.gc_every,
+         cfg.min_size, cfg.max_size, cfg.slab_size, (unsigned long long)cfg.sample,
+         cfg.async ? "true" : "false");
+  printf("  \"results\": [\n");
+  for (size_t i = 0; i < runs.size(); ++i)
+    PrintResult(runs[i], i + 1 == runs.size());
+  printf("  ]");
+  if (runs.size() == 2 && runs[0].seconds > 0 && runs[1].seconds > 0) {
+    printf(",\n  \"slowdown\": %.3f\n", runs[1].seconds / runs[0].seconds);
+  } else {
+    printf("\n");
+  }
+  printf("}\n");
+  return 0;
+}
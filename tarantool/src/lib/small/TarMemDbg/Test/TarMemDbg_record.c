@@ -0,0 +1,173 @@
+/**
+ * @file TarMemDbg_record.c
+ * @author Astapov Konstantin
+ * @copyright 2021, Picodata. picodata.io - professional database services
+ * @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ * \~english @brief writes a call trace of mempool, small_alloc and region calls
+ * \~english @details
+ *  Deterministic workload for the TarMemDbg_Replay test: every call of
+ *  mempool, small_alloc (including delayed free and its nested pools) and
+ *  region (including truncate and reset) is recorded to FILE.
+ * \~russian @brief запись вызовов mempool'а, small_alloc'а и region'а
+ * \~russian @details
+ *  Бенчмарк пишет только lsregion, а этот прогон - остальные аллокаторы.
+ *  Вызовы идут в одном потоке и не зависят от адресов, поэтому число
+ *  воспроизводимых операций известно заранее (RECORD_OPS), его проверяет
+ *  тест воспроизведения.
+ *
+ *  Параметры:
+ *      FILE             файл записи вызовов
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "../../small/quota.h"
+#include "../../small/slab_arena.h"
+#include "../../small/slab_cache.h"
+#include "../../small/mempool.h"
+#include "../../small/small.h"
+#include "../../small/region.h"
+
+enum {
+    POOL_OBJECTS    = 1000,
+    SMALL_OBJECTS   = 600,
+    /* каждый SMALL_LARGE_EVERY-й объект small_alloc'а больше его mempool'ов */
+    SMALL_LARGE_EVERY = 50,
+    SMALL_GARBAGE   = 100,
+    REGION_STEPS    = 500,
+    REGION_ALIGNED_EVERY  = 10,
+    REGION_TRUNCATE_EVERY = 25,
+    REGION_RESET_EVERY    = 100,
+    /*
+     * Создания в операции воспроизведения не входят, вызовы mempool'ов small_alloc'а
+     * не записываются, region_destroy - это truncate и destroy
+     */
+    RECORD_OPS = 2 * POOL_OBJECTS +
+                 2 * SMALL_OBJECTS + 2 + 2 * SMALL_GARBAGE +
+                 REGION_STEPS + REGION_STEPS / REGION_ALIGNED_EVERY +
+                 REGION_STEPS / REGION_TRUNCATE_EVERY + REGION_STEPS / REGION_RESET_EVERY + 2 +
+                 2,
+};
+
+static void
+fail(const char *what)
+{
+    fprintf(stderr, "%s failed\n", what);
+    exit(1);
+}
+
+static void
+check(void *ptr, const char *what)
+{
+    if (ptr == NULL)
+        fail(what);
+    *(char *)ptr = 0;
+}
+
+static size_t
+small_size(unsigned i)
+{
+    return i % SMALL_LARGE_EVERY == SMALL_LARGE_EVERY - 1 ? 100000 : 8 + i * 37 % 600;
+}
+
+static void
+drive_mempool(struct slab_cache *cache)
+{
+    static void *objects[POOL_OBJECTS];
+    struct mempool pool;
+    mempool_create(&pool, cache, 48);
+    for (unsigned i = 0; i < POOL_OBJECTS; ++i) {
+        objects[i] = mempool_alloc(&pool);
+        check(objects[i], "mempool_alloc");
+    }
+    /* освобождения не в порядке аллокаций */
+    for (unsigned i = 0; i < POOL_OBJECTS; i += 2)
+        mempool_free(&pool, objects[i]);
+    for (unsigned i = 1; i < POOL_OBJECTS; i += 2)
+        mempool_free(&pool, objects[i]);
+    mempool_destroy(&pool);
+}
+
+static void
+drive_small(struct slab_cache *cache)
+{
+    static void *objects[SMALL_OBJECTS];
+    struct small_alloc alloc;
+    float actual_factor;
+    small_alloc_create(&alloc, cache, 16, 1.05f, &actual_factor);
+    for (unsigned i = 0; i < SMALL_OBJECTS; ++i) {
+        objects[i] = smalloc(&alloc, small_size(i));
+        check(objects[i], "smalloc");
+    }
+    for (unsigned i = 0; i < SMALL_OBJECTS / 2; ++i)
+        smfree(&alloc, objects[i], small_size(i));
+    small_alloc_setopt(&alloc, SMALL_DELAYED_FREE_MODE, true);
+    for (unsigned i = SMALL_OBJECTS / 2; i < SMALL_OBJECTS; ++i)
+        smfree_delayed(&alloc, objects[i], small_size(i));
+    /* отложенные освобождения выполняются внутри smalloc'ов после выключения режима */
+    small_alloc_setopt(&alloc, SMALL_DELAYED_FREE_MODE, false);
+    for (unsigned i = 0; i < SMALL_GARBAGE; ++i) {
+        objects[i] = smalloc(&alloc, small_size(i));
+        check(objects[i], "smalloc");
+    }
+    for (unsigned i = 0; i < SMALL_GARBAGE; ++i)
+        smfree(&alloc, objects[i], small_size(i));
+    small_alloc_destroy(&alloc);
+}
+
+static void
+drive_region(struct slab_cache *cache)
+{
+    struct region region;
+    region_create(&region, cache);
+    size_t mark = 0;
+    for (unsigned i = 0; i < REGION_STEPS; ++i) {
+        /* отметка посередине шага truncate'ов, чтобы они не опустошали регион */
+        if (i % REGION_TRUNCATE_EVERY == REGION_TRUNCATE_EVERY / 2)
+            mark = region_used(&region);
+        check(region_alloc(&region, 1 + i * 53 % 3000), "region_alloc");
+        if (i % REGION_ALIGNED_EVERY == 0)
+            check(region_aligned_alloc(&region, 24, 16), "region_aligned_alloc");
+        if (i % REGION_TRUNCATE_EVERY == REGION_TRUNCATE_EVERY - 1)
+            region_truncate(&region, mark);
+        /* между truncate'ом и следующей отметкой: регион не пуст, и region_reset записывается */
+        if (i % REGION_RESET_EVERY == REGION_RESET_EVERY / 2)
+            region_reset(&region);
+    }
+    region_destroy(&region);
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s FILE\n", argv[0]);
+        return 2;
+    }
+    /* до создания арены: запись начинается с неё */
+    if (slab_arena_open_call_trace(argv[1]) != 0) {
+        fprintf(stderr, "cannot open call trace %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    struct quota quota;
+    quota_init(&quota, QUOTA_MAX);
+    struct memory_epoch_queue *arena;
+    if (slab_arena_create(&arena, &quota, 0, 4u << 20, MAP_PRIVATE) != 0)
+        fail("slab_arena_create");
+    struct slab_cache cache;
+    slab_cache_create(&cache, &arena);
+
+    drive_mempool(&cache);
+    drive_small(&cache);
+    drive_region(&cache);
+
+    slab_arena_close_call_trace();
+    slab_cache_destroy(&cache);
+    printf("{ \"ops\": %d }\n", RECORD_OPS);
+    return 0;
+}
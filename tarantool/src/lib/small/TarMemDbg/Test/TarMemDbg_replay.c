@@ -0,0 +1,944 @@
+/**
+ * @file TarMemDbg_replay.c
+ * @author Astapov Konstantin
+ * @copyright 2021, Picodata. picodata.io - professional database services
+ * @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ * \~english @brief replays a recorded allocator call trace
+ * \~english @details
+ *  Reads a file written by slab_arena_open_call_trace() (or TARARAM_CALL_TRACE),
+ *  runs the same mempool, small_alloc, region and lsregion calls again and
+ *  prints a JSON report to stdout, so that an allocator change can be measured
+ *  on a real workload without the application.
+ * \~russian @brief воспроизведение записи вызовов аллокаторов
+ * \~russian @details
+ *  Записи всех потоков выполняются в одном потоке в порядке кусков файла,
+ *  поэтому прогон детерминирован. Объекты (арены, slab_cache, mempool'ы,
+ *  small_alloc'и, region'ы, lsregion'ы) создаются до замера, в том числе
+ *  созданные до начала записи: их параметры выводятся из вызовов. Замеряются
+ *  только аллокации, освобождения, truncate, lsregion_gc и удаления объектов.
+ *  Арены slab_cache'ей - всегда *_orig, lsregion'ы - *_orig или обёртки TaraRam.
+ *  Только lsregion идёт через обёртки: mempool, small_alloc и region выполняют
+ *  один и тот же код с обоими API. Поэтому операции каждого вида аллокаторов
+ *  прогоняются и замеряются отдельно (объекты разных видов друг друга не
+ *  трогают), и slowdown выводится по видам: у mempool, small и region он
+ *  показывает только шум замера.
+ *  Написан на C: публичные заголовки small при TARARAM C++ компилятором
+ *  не собираются (mempool.h тянет exception.h тарантула).
+ *
+ *  Параметры:
+ *      FILE             файл записи вызовов
+ *      --api A          orig | wrapped | both (both)
+ *      --repeat N       сколько раз прогнать запись для каждого API (1)
+ *      --slab-size N    размер слаба всех арен (из записи, иначе 4 MiB)
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "../../small/quota.h"
+#include "../../small/slab_arena.h"
+#include "../../small/slab_cache.h"
+#include "../../small/mempool.h"
+#include "../../small/small.h"
+#include "../../small/region.h"
+#include "../../small/lsregion.h"
+
+/* обёртка lsregion_create в lsregion.h не объявлена */
+void lsregion_create(struct memory_epoch_queue **lsregion_value, struct slab_arena *arena);
+
+enum object_kind {
+    KIND_ARENA,
+    KIND_CACHE,
+    KIND_MEMPOOL,
+    KIND_SMALL,
+    KIND_REGION,
+    KIND_LSREGION,
+    KIND_COUNT,
+    /** ключи адресов объектов mempool'ов и small_alloc'ов */
+    KIND_POINTER = KIND_COUNT,
+};
+
+/** @brief объект из записи, состояние прогона лежит отдельно, чтобы не двигаться при росте массива */
+struct replay_object {
+    uint8_t  kind;
+    bool     created;     /* есть запись о создании */
+    bool     destroyed;   /* при разборе: удалён, следующий вызов по адресу - новый объект */
+    bool     has_cache;   /* арена: на ней есть slab_cache */
+    bool     has_lsregion;/* арена: на ней есть lsregion */
+    uint32_t parent;      /* арена slab_cache'а и lsregion'а, slab_cache остальных */
+    uint64_t size;        /* размер слаба, объекта mempool'а, objsize_min small_alloc'а */
+    int64_t  arg;         /* prealloc арены */
+    uint32_t aux;         /* флаги арены, биты alloc_factor small_alloc'а */
+    int64_t  max_id;      /* lsregion: наибольший id аллокаций */
+};
+
+struct replay_state {
+    bool live;
+    union {
+        struct slab_arena  arena;
+        struct slab_cache  cache;
+        struct mempool     pool;
+        struct small_alloc small;
+        struct region      region;
+        struct lsregion    lsregion;
+    } u;
+    struct memory_epoch_queue *handle; /* обёрнутый lsregion */
+};
+
+struct replay_op {
+    uint8_t  type;
+    uint32_t aux;
+    uint32_t object;
+    uint32_t slot;
+    uint64_t size;
+    int64_t  arg;
+};
+
+struct map_entry {
+    uint64_t key;
+    uint32_t kind;  /* UINT32_MAX - пусто */
+    uint32_t value;
+};
+
+/** @brief открытая адресация без удаления: адрес -> объект или слот */
+struct replay_map {
+    struct map_entry *entries;
+    size_t            mask;
+    size_t            count;
+};
+
+static const char *const kind_names[KIND_COUNT] = {
+    "arena", "cache", "mempool", "small", "region", "lsregion",
+};
+
+/** @brief операции объектов одного вида в порядке записи */
+struct replay_ops {
+    struct replay_op *ops;
+    size_t            count;
+    size_t            capacity;
+};
+
+struct replay {
+    struct replay_object *objects;
+    uint32_t              object_count;
+    size_t                object_capacity;
+    struct replay_ops     ops[KIND_COUNT];
+    size_t                op_count;
+    bool                 *slot_live;  /* при разборе */
+    uint32_t              slot_count;
+    size_t                slot_capacity;
+    struct replay_map     map;
+    uint64_t              records;
+    uint32_t              threads;
+    uint64_t              unmatched;
+};
+
+struct replay_config {
+    const char *path;
+    bool        orig;
+    bool        wrapped;
+    unsigned    repeat;
+    uint32_t    slab_size;
+};
+
+static void *
+xrealloc(void *ptr, size_t size)
+{
+    void *ret = realloc(ptr, size);
+    if (ret == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return ret;
+}
+
+#define RESERVE(array, count, capacity) do {                                  \
+    if ((count) == (capacity)) {                                              \
+        (capacity) = (capacity) ? (capacity) * 2 : 1024;                      \
+        (array) = xrealloc((array), (capacity) * sizeof(*(array)));           \
+    }                                                                         \
+} while (0)
+
+static uint64_t
+hash_key(uint64_t key, uint32_t kind)
+{
+    key ^= (uint64_t)kind << 56;
+    key *= 0x9E3779B97F4A7C15ull;
+    return key ^ (key >> 29);
+}
+
+static void
+map_grow(struct replay_map *map)
+{
+    size_t capacity = map->entries ? (map->mask + 1) * 2 : 4096;
+    struct map_entry *entries = xrealloc(NULL, capacity * sizeof(*entries));
+    for (size_t i = 0; i < capacity; ++i)
+        entries[i].kind = UINT32_MAX;
+    for (size_t i = 0; map->entries && i <= map->mask; ++i) {
+        struct map_entry *e = &map->entries[i];
+        if (e->kind == UINT32_MAX)
+            continue;
+        size_t pos = hash_key(e->key, e->kind) & (capacity - 1);
+        while (entries[pos].kind != UINT32_MAX)
+            pos = (pos + 1) & (capacity - 1);
+        entries[pos] = *e;
+    }
+    free(map->entries);
+    map->entries = entries;
+    map->mask = capacity - 1;
+}
+
+/** @return запись для ключа, новая - с kind == UINT32_MAX до заполнения вызывающим */
+static struct map_entry *
+map_find(struct replay_map *map, uint64_t key, uint32_t kind, bool *found)
+{
+    if (map->entries == NULL || (map->count + 1) * 2 > map->mask + 1)
+        map_grow(map);
+    size_t pos = hash_key(key, kind) & map->mask;
+    for (;; pos = (pos + 1) & map->mask) {
+        struct map_entry *e = &map->entries[pos];
+        if (e->kind == UINT32_MAX) {
+            *found = false;
+            e->key = key;
+            return e;
+        }
+        if (e->key == key && e->kind == kind) {
+            *found = true;
+            return e;
+        }
+    }
+}
+
+static uint32_t
+new_object(struct replay *r, uint8_t kind, uint32_t parent)
+{
+    RESERVE(r->objects, r->object_count, r->object_capacity);
+    struct replay_object *obj = &r->objects[r->object_count];
+    memset(obj, 0, sizeof(*obj));
+    obj->kind = kind;
+    obj->parent = parent;
+    return r->object_count++;
+}
+
+static uint32_t resolve(struct replay *r, uint8_t kind, uint64_t ptr, bool create);
+
+/** родитель объекта, созданного до начала записи, - объект по адресу 0 */
+static uint32_t
+default_parent(struct replay *r, uint8_t kind)
+{
+    if (kind == KIND_ARENA)
+        return UINT32_MAX;
+    if (kind == KIND_CACHE || kind == KIND_LSREGION)
+        return resolve(r, KIND_ARENA, 0, false);
+    return resolve(r, KIND_CACHE, 0, false);
+}
+
+/**
+ * Создание всегда начинает новый объект, кроме объекта, уже встреченного
+ * без создания: записи потоков идут кусками, и вызовы объекта могут попасть
+ * в файл раньше куска с его созданием
+ */
+static uint32_t
+resolve(struct replay *r, uint8_t kind, uint64_t ptr, bool create)
+{
+    bool found;
+    struct map_entry *e = map_find(&r->map, ptr, kind, &found);
+    if (found) {
+        struct replay_object *obj = &r->objects[e->value];
+        if (!obj->destroyed && !(create && obj->created))
+            return e->value;
+    } else {
+        r->map.count++;
+    }
+    e->kind = kind;
+    e->value = UINT32_MAX;
+    /* родителя создания проставит decode_record */
+    uint32_t parent = create ? UINT32_MAX : default_parent(r, kind);
+    /* default_parent мог перестроить таблицу */
+    e = map_find(&r->map, ptr, kind, &found);
+    e->kind = kind;
+    e->value = new_object(r, kind, parent);
+    return e->value;
+}
+
+static uint32_t
+new_slot(struct replay *r)
+{
+    RESERVE(r->slot_live, r->slot_count, r->slot_capacity);
+    r->slot_live[r->slot_count] = false;
+    return r->slot_count++;
+}
+
+/** @return слот объекта по адресу, UINT32_MAX - освобождение неизвестного объекта */
+static uint32_t
+resolve_slot(struct replay *r, uint64_t ptr, bool alloc)
+{
+    bool found;
+    struct map_entry *e = map_find(&r->map, ptr, KIND_POINTER, &found);
+    if (!found) {
+        r->map.count++;
+        e->kind = KIND_POINTER;
+        e->value = UINT32_MAX;
+    }
+    if (alloc) {
+        /* освобождение живого объекта в запись не попало */
+        if (e->value == UINT32_MAX || r->slot_live[e->value]) {
+            uint32_t slot = new_slot(r);
+            e = map_find(&r->map, ptr, KIND_POINTER, &found);
+            e->value = slot;
+        }
+        r->slot_live[e->value] = true;
+        return e->value;
+    }
+    if (e->value == UINT32_MAX || !r->slot_live[e->value])
+        return UINT32_MAX;
+    r->slot_live[e->value] = false;
+    return e->value;
+}
+
+static uint8_t
+kind_of(uint8_t type)
+{
+    switch (type) {
+    case SMALL_CALL_SLAB_ARENA_CREATE:
+        return KIND_ARENA;
+    case SMALL_CALL_SLAB_CACHE_CREATE:
+        return KIND_CACHE;
+    case SMALL_CALL_MEMPOOL_CREATE:
+    case SMALL_CALL_MEMPOOL_DESTROY:
+    case SMALL_CALL_MEMPOOL_ALLOC:
+    case SMALL_CALL_MEMPOOL_FREE:
+        return KIND_MEMPOOL;
+    case SMALL_CALL_SMALL_CREATE:
+    case SMALL_CALL_SMALL_DESTROY:
+    case SMALL_CALL_SMALLOC:
+    case SMALL_CALL_SMFREE:
+    case SMALL_CALL_SMFREE_DELAYED:
+    case SMALL_CALL_SMALL_SETOPT:
+        return KIND_SMALL;
+    case SMALL_CALL_REGION_CREATE:
+    case SMALL_CALL_REGION_ALLOC:
+    case SMALL_CALL_REGION_TRUNCATE:
+    case SMALL_CALL_REGION_DESTROY:
+        return KIND_REGION;
+    case SMALL_CALL_LSREGION_CREATE:
+    case SMALL_CALL_LSREGION_ALLOC:
+    case SMALL_CALL_LSREGION_GC:
+        return KIND_LSREGION;
+    default:
+        return KIND_COUNT;
+    }
+}
+
+struct call_record {
+    uint8_t  type;
+    uint64_t object;
+    uint64_t ptr;
+    uint64_t size;
+    int64_t  arg;
+    uint32_t aux;
+};
+
+struct call_reader {
+    const uint8_t *pos;
+    const uint8_t *end;
+    uint64_t       object;
+    uint64_t       ptr;
+    int64_t        arg;
+};
+
+static bool
+read_varint(struct call_reader *rd, uint64_t *value)
+{
+    uint64_t ret = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (rd->pos == rd->end)
+            return false;
+        uint8_t byte = *rd->pos++;
+        ret |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = ret;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t
+unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/** @return 1 - запись прочитана, 0 - кусок кончился, -1 - кусок испорчен */
+static int
+read_record(struct call_reader *rd, struct call_record *rec)
+{
+    if (rd->pos == rd->end)
+        return 0;
+    if (rd->end - rd->pos < 2)
+        return -1;
+    rec->type = rd->pos[0];
+    uint8_t flags = rd->pos[1];
+    rd->pos += 2;
+    uint64_t value = 0;
+    if (flags & SMALL_CALL_FIELD_OBJECT) {
+        if (!read_varint(rd, &rd->object))
+            return -1;
+    }
+    rec->object = rd->object;
+    rec->ptr = 0;
+    if (flags & SMALL_CALL_FIELD_PTR) {
+        if (!read_varint(rd, &value))
+            return -1;
+        rd->ptr += (uint64_t)unzigzag(value);
+        rec->ptr = rd->ptr;
+    }
+    rec->size = 0;
+    if ((flags & SMALL_CALL_FIELD_SIZE) && !read_varint(rd, &rec->size))
+        return -1;
+    rec->arg = 0;
+    if (flags & SMALL_CALL_FIELD_ARG) {
+        if (!read_varint(rd, &value))
+            return -1;
+        rd->arg = (int64_t)((uint64_t)rd->arg + (uint64_t)unzigzag(value));
+        rec->arg = rd->arg;
+    }
+    value = 0;
+    if ((flags & SMALL_CALL_FIELD_AUX) && !read_varint(rd, &value))
+        return -1;
+    rec->aux = (uint32_t)value;
+    return 1;
+}
+
+typedef void (*record_handler)(struct replay *r, const struct call_record *rec);
+
+/** @return false - файл испорчен */
+static bool
+for_each_record(struct replay *r, const uint8_t *data, size_t size, record_handler handler)
+{
+    const struct small_call_header *header = (const struct small_call_header *)data;
+    size_t offset = header->header_size;
+    while (offset < size) {
+        struct small_call_chunk chunk;
+        if (size - offset < sizeof(chunk))
+            return false;
+        memcpy(&chunk, data + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+        if (size - offset < chunk.byte_size)
+            return false;
+        if (chunk.thread + 1 > r->threads)
+            r->threads = chunk.thread + 1;
+        struct call_reader rd = { data + offset, data + offset + chunk.byte_size, 0, 0, 0 };
+        struct call_record rec;
+        int rc;
+        while ((rc = read_record(&rd, &rec)) > 0)
+            handler(r, &rec);
+        if (rc < 0)
+            return false;
+        offset += chunk.byte_size;
+    }
+    return true;
+}
+
+static void
+add_op(struct replay *r, uint8_t type, uint32_t object, uint32_t slot, uint64_t size, int64_t arg, uint32_t aux)
+{
+    struct replay_ops *list = &r->ops[r->objects[object].kind];
+    RESERVE(list->ops, list->count, list->capacity);
+    struct replay_op *op = &list->ops[list->count++];
+    r->op_count++;
+    op->type = type;
+    op->object = object;
+    op->slot = slot;
+    op->size = size;
+    op->arg = arg;
+    op->aux = aux;
+}
+
+static void
+decode_record(struct replay *r, const struct call_record *rec)
+{
+    uint8_t kind = kind_of(rec->type);
+    r->records++;
+    if (kind == KIND_COUNT)
+        return;
+    bool create = rec->type == SMALL_CALL_SLAB_ARENA_CREATE || rec->type == SMALL_CALL_SLAB_CACHE_CREATE ||
+                  rec->type == SMALL_CALL_MEMPOOL_CREATE || rec->type == SMALL_CALL_SMALL_CREATE ||
+                  rec->type == SMALL_CALL_REGION_CREATE || rec->type == SMALL_CALL_LSREGION_CREATE;
+    uint32_t index = resolve(r, kind, rec->object, create);
+    if (create) {
+        uint32_t parent = UINT32_MAX;
+        if (kind == KIND_CACHE || kind == KIND_LSREGION)
+            parent = resolve(r, KIND_ARENA, rec->ptr, false);
+        else if (kind != KIND_ARENA)
+            parent = resolve(r, KIND_CACHE, rec->ptr, false);
+        struct replay_object *obj = &r->objects[index];
+        obj->created = true;
+        obj->parent = parent;
+        if (rec->size)
+            obj->size = rec->size;
+        obj->arg = rec->arg;
+        obj->aux = rec->aux;
+        return;
+    }
+    struct replay_object *obj = &r->objects[index];
+    uint32_t slot = UINT32_MAX;
+    switch (rec->type) {
+    case SMALL_CALL_MEMPOOL_ALLOC:
+        if (obj->size == 0)
+            obj->size = rec->size;
+        /* fall through */
+    case SMALL_CALL_SMALLOC:
+        slot = resolve_slot(r, rec->ptr, true);
+        break;
+    case SMALL_CALL_MEMPOOL_FREE:
+    case SMALL_CALL_SMFREE:
+    case SMALL_CALL_SMFREE_DELAYED:
+        slot = resolve_slot(r, rec->ptr, false);
+        if (slot == UINT32_MAX) {
+            r->unmatched++;
+            return;
+        }
+        break;
+    case SMALL_CALL_LSREGION_ALLOC:
+        /* куски потоков идут не по времени, а id аллокаций lsregion'а не должны убывать */
+        if (rec->arg > obj->max_id)
+            obj->max_id = rec->arg;
+        add_op(r, rec->type, index, slot, rec->size, obj->max_id, rec->aux);
+        return;
+    case SMALL_CALL_MEMPOOL_DESTROY:
+    case SMALL_CALL_SMALL_DESTROY:
+    case SMALL_CALL_REGION_DESTROY:
+        r->objects[index].destroyed = true;
+        break;
+    default:
+        break;
+    }
+    add_op(r, rec->type, index, slot, rec->size, rec->arg, rec->aux);
+}
+
+/** @brief проставляет арене, на чём она используется, и параметры по умолчанию объектам без создания */
+static void
+finish_objects(struct replay *r, const struct replay_config *cfg)
+{
+    for (uint32_t i = 0; i < r->object_count; ++i) {
+        struct replay_object *obj = &r->objects[i];
+        switch (obj->kind) {
+        case KIND_ARENA:
+            if (cfg->slab_size)
+                obj->size = cfg->slab_size;
+            else if (obj->size == 0)
+                obj->size = 4u << 20;
+            if (!obj->created)
+                obj->aux = MAP_PRIVATE;
+            break;
+        case KIND_CACHE:
+            r->objects[obj->parent].has_cache = true;
+            break;
+        case KIND_LSREGION:
+            r->objects[obj->parent].has_lsregion = true;
+            break;
+        case KIND_MEMPOOL:
+            if (obj->size == 0)
+                obj->size = 64;
+            break;
+        case KIND_SMALL:
+            if (!obj->created) {
+                float factor = 1.05f;
+                obj->size = 16;
+                memcpy(&obj->aux, &factor, sizeof(factor));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static bool
+load(struct replay *r, const struct replay_config *cfg)
+{
+    FILE *f = fopen(cfg->path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", cfg->path, strerror(errno));
+        return false;
+    }
+    uint8_t *data = NULL;
+    size_t size = 0, capacity = 0;
+    for (;;) {
+        if (capacity - size < 65536) {
+            capacity = capacity ? capacity * 2 : 1 << 20;
+            data = xrealloc(data, capacity);
+        }
+        size_t n = fread(data + size, 1, capacity - size, f);
+        size += n;
+        if (n == 0)
+            break;
+    }
+    bool failed = ferror(f);
+    fclose(f);
+    const struct small_call_header *header = (const struct small_call_header *)data;
+    if (failed || size < sizeof(*header) || memcmp(header->magic, "SMCALLS", 8) != 0 ||
+        header->version != SMALL_CALL_VERSION || header->header_size < sizeof(*header) ||
+        header->header_size > size) {
+        fprintf(stderr, "%s is not a call trace\n", cfg->path);
+        free(data);
+        return false;
+    }
+    bool ok = for_each_record(r, data, size, decode_record);
+    free(data);
+    if (!ok) {
+        fprintf(stderr, "%s is truncated or corrupted\n", cfg->path);
+        return false;
+    }
+    finish_objects(r, cfg);
+    return true;
+}
+
+static struct quota replay_quota;
+
+static void
+fail(const char *what)
+{
+    fprintf(stderr, "%s failed\n", what);
+    abort();
+}
+
+/** родители создаются раньше детей: арены, slab_cache'и, объекты вида @a kind */
+static void
+setup(struct replay *r, struct replay_state **states, uint8_t kind, bool wrapped)
+{
+    static const uint8_t order[] = { KIND_ARENA, KIND_CACHE, KIND_MEMPOOL, KIND_SMALL, KIND_REGION, KIND_LSREGION };
+    for (size_t k = 0; k < sizeof(order); ++k) {
+        for (uint32_t i = 0; i < r->object_count; ++i) {
+            struct replay_object *obj = &r->objects[i];
+            if (obj->kind != order[k])
+                continue;
+            struct replay_state *st = states[i];
+            struct replay_state *parent = obj->parent != UINT32_MAX ? states[obj->parent] : NULL;
+            float factor, actual_factor;
+            memset(st, 0, sizeof(*st));
+            if (obj->kind != kind && obj->kind != KIND_ARENA && obj->kind != KIND_CACHE)
+                continue;
+            st->live = true;
+            switch (obj->kind) {
+            case KIND_ARENA:
+                if ((obj->has_cache || (obj->has_lsregion && !wrapped)) &&
+                    slab_arena_create_orig(&st->u.arena, &replay_quota, (size_t)obj->arg,
+                                           (uint32_t)obj->size, (int)obj->aux) != 0)
+                    fail("slab_arena_create_orig");
+                break;
+            case KIND_CACHE:
+                slab_cache_create_orig(&st->u.cache, &parent->u.arena);
+                break;
+            case KIND_MEMPOOL:
+                mempool_create(&st->u.pool, &parent->u.cache, (uint32_t)obj->size);
+                break;
+            case KIND_SMALL:
+                memcpy(&factor, &obj->aux, sizeof(factor));
+                small_alloc_create(&st->u.small, &parent->u.cache, (uint32_t)obj->size, factor, &actual_factor);
+                break;
+            case KIND_REGION:
+                region_create(&st->u.region, &parent->u.cache);
+                break;
+            case KIND_LSREGION:
+                if (wrapped) {
+                    /*
+                     * Обёрнутый lsregion - это хэндл очереди эпох его арены, так что
+                     * lsregion'ам, созданным до записи на одной арене по умолчанию, нужны свои
+                     */
+                    const struct replay_object *arena = &r->objects[obj->parent];
+                    struct memory_epoch_queue *queue;
+                    if (slab_arena_create(&queue, &replay_quota, (size_t)arena->arg,
+                                          (uint32_t)arena->size, (int)arena->aux) != 0)
+                        fail("slab_arena_create");
+                    lsregion_create(&st->handle, (struct slab_arena *)queue);
+                } else {
+                    lsregion_create_orig(&st->u.lsregion, &parent->u.arena);
+                }
+                break;
+            }
+        }
+    }
+}
+
+/** обёрнутые арены и lsregion'ы не удаляются, как и в бенчмарке */
+static void
+teardown(struct replay *r, struct replay_state **states, bool wrapped)
+{
+    for (uint32_t i = r->object_count; i-- > 0;) {
+        struct replay_object *obj = &r->objects[i];
+        struct replay_state *st = states[i];
+        if (!st->live)
+            continue;
+        st->live = false;
+        switch (obj->kind) {
+        case KIND_MEMPOOL:
+            mempool_destroy(&st->u.pool);
+            break;
+        case KIND_SMALL:
+            small_alloc_destroy(&st->u.small);
+            break;
+        case KIND_REGION:
+            region_destroy(&st->u.region);
+            break;
+        case KIND_LSREGION:
+            if (!wrapped)
+                lsregion_destroy_orig(&st->u.lsregion);
+            break;
+        default:
+            break;
+        }
+    }
+    /* арены и slab_cache'и - после всех их пользователей */
+    for (uint32_t i = r->object_count; i-- > 0;) {
+        struct replay_object *obj = &r->objects[i];
+        struct replay_state *st = states[i];
+        if (obj->kind == KIND_CACHE)
+            slab_cache_destroy(&st->u.cache);
+    }
+    for (uint32_t i = r->object_count; i-- > 0;) {
+        struct replay_object *obj = &r->objects[i];
+        struct replay_state *st = states[i];
+        if (obj->kind == KIND_ARENA && (obj->has_cache || (obj->has_lsregion && !wrapped)))
+            slab_arena_destroy_orig(&st->u.arena);
+    }
+}
+
+static void
+touch(void *ptr, uint64_t size)
+{
+    if (ptr == NULL)
+        fail("allocation");
+    if (size)
+        *(char *)ptr = 0;
+}
+
+static void
+execute(const struct replay_ops *list, struct replay_state **states, void **slots, bool wrapped)
+{
+    for (size_t i = 0; i < list->count; ++i) {
+        const struct replay_op *op = &list->ops[i];
+        struct replay_state *st = states[op->object];
+        switch (op->type) {
+        case SMALL_CALL_MEMPOOL_ALLOC:
+            slots[op->slot] = mempool_alloc(&st->u.pool);
+            touch(slots[op->slot], 1);
+            break;
+        case SMALL_CALL_MEMPOOL_FREE:
+            mempool_free(&st->u.pool, slots[op->slot]);
+            break;
+        case SMALL_CALL_MEMPOOL_DESTROY:
+            mempool_destroy(&st->u.pool);
+            st->live = false;
+            break;
+        case SMALL_CALL_SMALLOC:
+            slots[op->slot] = smalloc(&st->u.small, op->size);
+            touch(slots[op->slot], op->size);
+            break;
+        case SMALL_CALL_SMFREE:
+            smfree(&st->u.small, slots[op->slot], op->size);
+            break;
+        case SMALL_CALL_SMFREE_DELAYED:
+            smfree_delayed(&st->u.small, slots[op->slot], op->size);
+            break;
+        case SMALL_CALL_SMALL_SETOPT:
+            small_alloc_setopt(&st->u.small, (enum small_opt)op->aux, op->arg != 0);
+            break;
+        case SMALL_CALL_SMALL_DESTROY:
+            small_alloc_destroy(&st->u.small);
+            st->live = false;
+            break;
+        case SMALL_CALL_REGION_ALLOC:
+            touch(op->aux ? region_aligned_alloc(&st->u.region, op->size, op->aux) :
+                            region_alloc(&st->u.region, op->size), op->size);
+            break;
+        case SMALL_CALL_REGION_TRUNCATE: {
+            /* выравнивание зависит от адресов, так что занятое может не совпасть с записанным */
+            size_t used = region_used(&st->u.region);
+            region_truncate(&st->u.region, op->size < used ? op->size : used);
+            break;
+        }
+        case SMALL_CALL_REGION_DESTROY:
+            region_destroy(&st->u.region);
+            st->live = false;
+            break;
+        case SMALL_CALL_LSREGION_ALLOC:
+            if (wrapped) {
+                struct lsregion *lsr = (struct lsregion *)st->handle;
+                touch(op->aux ? lsregion_aligned_alloc(lsr, op->size, op->aux, op->arg) :
+                                lsregion_alloc(lsr, op->size, op->arg), op->size);
+            } else {
+                touch(op->aux ? lsregion_aligned_alloc_orig(&st->u.lsregion, op->size, op->aux, op->arg) :
+                                lsregion_alloc_orig(&st->u.lsregion, op->size, op->arg), op->size);
+            }
+            break;
+        case SMALL_CALL_LSREGION_GC:
+            if (wrapped)
+                lsregion_gc((struct lsregion *)st->handle, op->arg);
+            else
+                lsregion_gc_orig(&st->u.lsregion, op->arg);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/** @param seconds время операций каждого вида */
+static void
+run(struct replay *r, const struct replay_config *cfg, bool wrapped, double *seconds)
+{
+    struct replay_state **states = xrealloc(NULL, (r->object_count + 1) * sizeof(*states));
+    for (uint32_t i = 0; i < r->object_count; ++i)
+        states[i] = xrealloc(NULL, sizeof(**states));
+    void **slots = xrealloc(NULL, (r->slot_count + 1) * sizeof(*slots));
+    for (uint8_t kind = 0; kind < KIND_COUNT; ++kind) {
+        seconds[kind] = 0;
+        for (unsigned i = 0; r->ops[kind].count && i < cfg->repeat; ++i) {
+            setup(r, states, kind, wrapped);
+            double start = now_seconds();
+            execute(&r->ops[kind], states, slots, wrapped);
+            seconds[kind] += now_seconds() - start;
+            teardown(r, states, wrapped);
+        }
+    }
+    slab_arena_flush_protection();
+    for (uint32_t i = 0; i < r->object_count; ++i)
+        free(states[i]);
+    free(states);
+    free(slots);
+}
+
+static void
+print_result(const char *api, const struct replay *r, const struct replay_config *cfg, const double *seconds, bool last)
+{
+    uint64_t ops = (uint64_t)r->op_count * cfg->repeat;
+    double total = 0;
+    for (uint8_t kind = 0; kind < KIND_COUNT; ++kind)
+        total += seconds[kind];
+    printf("    {\n");
+    printf("      \"api\": \"%s\",\n", api);
+    printf("      \"ops\": %llu,\n", (unsigned long long)ops);
+    printf("      \"seconds\": %.6f,\n", total);
+    printf("      \"ops_per_sec\": %.0f,\n", total > 0 ? (double)ops / total : 0.0);
+    printf("      \"ns_per_op\": %.1f,\n", ops ? total * 1e9 / (double)ops : 0.0);
+    printf("      \"kinds\": {");
+    const char *sep = "";
+    for (uint8_t kind = 0; kind < KIND_COUNT; ++kind) {
+        uint64_t kind_ops = (uint64_t)r->ops[kind].count * cfg->repeat;
+        if (kind_ops == 0)
+            continue;
+        printf("%s\n        \"%s\": { \"ops\": %llu, \"seconds\": %.6f, \"ns_per_op\": %.1f }", sep,
+               kind_names[kind], (unsigned long long)kind_ops, seconds[kind], seconds[kind] * 1e9 / (double)kind_ops);
+        sep = ",";
+    }
+    printf("%s}\n", *sep ? "\n      " : " ");
+    printf("    }%s\n", last ? "" : ",");
+}
+
+/** @brief замедление обёрток по видам аллокаторов, сравнимы только lsregion'ы */
+static void
+print_slowdown(const struct replay *r, const double *orig_seconds, const double *wrapped_seconds)
+{
+    printf("  \"slowdown\": {");
+    const char *sep = "";
+    for (uint8_t kind = 0; kind < KIND_COUNT; ++kind) {
+        if (r->ops[kind].count == 0 || orig_seconds[kind] <= 0 || wrapped_seconds[kind] <= 0)
+            continue;
+        printf("%s \"%s\": %.3f", sep, kind_names[kind], wrapped_seconds[kind] / orig_seconds[kind]);
+        sep = ",";
+    }
+    printf(" }\n");
+}
+
+static bool
+parse_args(int argc, char **argv, struct replay_config *cfg)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            if (cfg->path != NULL)
+                return false;
+            cfg->path = arg;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "%s requires a value\n", arg);
+            exit(2);
+        }
+        const char *value = argv[++i];
+        if (strcmp(arg, "--repeat") == 0) {
+            cfg->repeat = (unsigned)strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--slab-size") == 0) {
+            cfg->slab_size = (uint32_t)strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--api") == 0) {
+            cfg->orig = strcmp(value, "orig") == 0 || strcmp(value, "both") == 0;
+            cfg->wrapped = strcmp(value, "wrapped") == 0 || strcmp(value, "both") == 0;
+            if (!cfg->orig && !cfg->wrapped)
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return cfg->path != NULL && cfg->repeat > 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct replay_config cfg = { NULL, true, true, 1, 0 };
+    if (!parse_args(argc, argv, &cfg)) {
+        fprintf(stderr, "usage: %s FILE [--api orig|wrapped|both] [--repeat N] [--slab-size N]\n", argv[0]);
+        return 2;
+    }
+    /* воспроизведение не записывается, даже если TARARAM_CALL_TRACE задан */
+    slab_arena_close_call_trace();
+    quota_init(&replay_quota, QUOTA_MAX);
+
+    struct replay r;
+    memset(&r, 0, sizeof(r));
+    if (!load(&r, &cfg))
+        return 1;
+
+    double orig_seconds[KIND_COUNT], wrapped_seconds[KIND_COUNT];
+    if (cfg.orig)
+        run(&r, &cfg, false, orig_seconds);
+    if (cfg.wrapped)
+        run(&r, &cfg, true, wrapped_seconds);
+
+    printf("{\n");
+    printf("  \"trace\": { \"path\": \"%s\", \"records\": %llu, \"threads\": %u, \"objects\": %u, "
+           "\"ops\": %zu, \"unmatched_frees\": %llu },\n",
+           cfg.path, (unsigned long long)r.records, r.threads, r.object_count, r.op_count,
+           (unsigned long long)r.unmatched);
+    printf("  \"config\": { \"repeat\": %u, \"slab_size\": %u },\n", cfg.repeat, cfg.slab_size);
+    printf("  \"results\": [\n");
+    if (cfg.orig)
+        print_result("orig", &r, &cfg, orig_seconds, !cfg.wrapped);
+    if (cfg.wrapped)
+        print_result("wrapped", &r, &cfg, wrapped_seconds, true);
+    printf("  ]");
+    if (cfg.orig && cfg.wrapped) {
+        printf(",\n");
+        print_slowdown(&r, orig_seconds, wrapped_seconds);
+    } else {
+        printf("\n");
+    }
+    printf("}\n");
+    return 0;
+}
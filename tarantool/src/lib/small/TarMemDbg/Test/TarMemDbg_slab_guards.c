@@ -0,0 +1,77 @@
+/**
+ * @file TarMemDbg_slab_guards.c
+ * @author Astapov Konstantin
+ * @copyright 2021, Picodata. picodata.io - professional database services
+ * @remark "TaraRam" project - Memory allocation debugger for Tarantool DBMS
+ * \~english @brief lsregion allocations just above the usable slab size with slab guards
+ * \~english @details
+ *  With slab guards a slab of an epoch loses a page. An allocation that fits
+ *  the arena slab but not the usable part goes to a large block, and
+ *  lsregion_gc must return it as a large block, not as an arena slab.
+ * \~russian @brief аллокации lsregion'а чуть больше полезного размера slab'а
+ * \~russian @details
+ *  Размер аллокации между slab_size - page и slab_size: раньше lsregion_gc
+ *  сравнивал размер большого блока с размером slab'а арены и клал блок в кэш
+ *  slab'ов арены (assert в lf_lifo_push или утечка квоты и блока).
+ *  Проверяется, что большие блоки выделялись и что квота, занятая ими,
+ *  возвращается при gc.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "../../small/quota.h"
+#include "../../small/slab_arena.h"
+#include "../../small/lsregion.h"
+
+enum {
+    SLAB_SIZE  = 64 * 1024,
+    /* больше SLAB_SIZE - page, но меньше SLAB_SIZE */
+    ALLOC_SIZE = 63000,
+    STEPS      = 64,
+    /* без возврата квота растёт с каждым большим блоком */
+    QUOTA_LIMIT = 8 * SLAB_SIZE,
+};
+
+int
+main(void)
+{
+    slab_arena_set_slab_guards(1);
+    struct quota quota;
+    quota_init(&quota, QUOTA_MAX);
+    struct memory_epoch_queue *arena = NULL;
+    if (slab_arena_create(&arena, &quota, 0, SLAB_SIZE, MAP_PRIVATE) != 0) {
+        fprintf(stderr, "slab_arena_create failed\n");
+        return 1;
+    }
+    struct memory_epoch_queue *region = NULL;
+    lsregion_create(&region, (struct slab_arena *)arena);
+    for (int64_t id = 1; id <= STEPS; ++id) {
+        void *ptr = lsregion_alloc((struct lsregion *)region, ALLOC_SIZE, id);
+        if (ptr == NULL) {
+            fprintf(stderr, "lsregion_alloc failed\n");
+            return 1;
+        }
+        memset(ptr, 0, ALLOC_SIZE);
+        /* и обычный slab, чтобы в эпохе было что класть в кэш */
+        if (lsregion_alloc((struct lsregion *)region, 64, id) == NULL) {
+            fprintf(stderr, "lsregion_alloc failed\n");
+            return 1;
+        }
+        lsregion_gc((struct lsregion *)region, id);
+    }
+
+    struct slab_arena_large_block_stats stats;
+    slab_arena_get_large_block_stats(&stats);
+    printf("{ \"live_blocks\": %zu, \"mapped\": %zu, \"reused\": %zu, \"quota_used\": %zu }\n",
+           stats.live_blocks, stats.mapped, stats.reused, quota_used(&quota));
+    /* живы только slab'ы и блоки эпох, ещё не переиспользованных ротацией */
+    if (stats.mapped + stats.reused == 0 || quota_used(&quota) > QUOTA_LIMIT) {
+        fprintf(stderr, "large blocks leaked\n");
+        return 1;
+    }
+    return 0;
+}
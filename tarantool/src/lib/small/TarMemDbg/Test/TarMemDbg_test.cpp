@@ -1,3 +0,0 @@
-int main() {
-  return 0;
-}
\ No newline at end of file
@@ -47,7 +47,8 @@ ibuf_destroy(struct ibuf *ibuf)
 {
 	if (ibuf->buf) {
 		struct slab *slab = slab_from_data(ibuf->buf);
-		slab_put(ibuf->slabc, slab);
+		if (!buffer_quarantine_put(ibuf->slabc, slab))
+			slab_put(ibuf->slabc, slab);
 	 }
 }
 
@@ -76,13 +77,17 @@ ibuf_reserve_slow(struct ibuf *ibuf, size_t size)
 	 * Check if we have enough space in the
 	 * current buffer. In this case de-fragment it
 	 * by moving existing data to the beginning.
-	 * Otherwise, get a bigger buffer.
+	 * Otherwise, get a bigger buffer. Under the buffer
+	 * quarantine the data is moved to a new buffer of the
+	 * same size, so that stale pointers into the consumed
+	 * part fault instead of reading moved data.
 	 */
-	if (size + used <= capacity) {
+	bool fits = size + used <= capacity;
+	if (fits && !buffer_quarantine_is_enabled()) {
 		memmove(ibuf->buf, ibuf->rpos, used);
 	} else {
 		/* Use iobuf_readahead as allocation factor. */
-		size_t new_capacity = capacity * 2;
+		size_t new_capacity = fits ? capacity : capacity * 2;
 		if (new_capacity < ibuf->start_capacity)
 			new_capacity = ibuf->start_capacity;
 
@@ -94,8 +99,11 @@ ibuf_reserve_slow(struct ibuf *ibuf, size_t size)
 			return NULL;
 		char *ptr = (char *) slab_data(slab);
 		memcpy(ptr, ibuf->rpos, used);
-		if (ibuf->buf)
-			slab_put(ibuf->slabc, slab_from_data(ibuf->buf));
+		if (ibuf->buf) {
+			struct slab *old = slab_from_data(ibuf->buf);
+			if (!buffer_quarantine_put(ibuf->slabc, old))
+				slab_put(ibuf->slabc, old);
+		}
 		ibuf->buf = ptr;
 		ibuf->end = ibuf->buf + slab_capacity(slab);
 	}
@@ -38,7 +38,7 @@ lsregion_aligned_reserve_slow_orig(struct lsregion *lsregion, size_t size,
 	void *pos;
 	struct lslab *slab;
 	struct slab_arena *arena = lsregion->arena;
-	size_t slab_size = arena->slab_size;
+	size_t slab_size = lsregion_slab_size(lsregion);
 
 	/* If there is an existing slab then try to use it. */
 	if (! rlist_empty(&lsregion->slabs.slabs)) {
@@ -57,12 +57,12 @@ lsregion_aligned_reserve_slow_orig(struct lsregion *lsregion, size_t size,
 	 */
 	size_t aligned_size = size + alignment - 1;
 	if (aligned_size + lslab_sizeof() > slab_size) {
-		/* Large allocation, use malloc() */
+		/* Large allocation, use malloc() or the memory epoch */
 		slab_size = aligned_size + lslab_sizeof();
 		struct quota *quota = arena->quota;
 		if (quota_use(quota, slab_size) < 0)
 			return NULL;
-		slab = malloc(slab_size);
+		slab = lsregion_large_slab_alloc(lsregion, slab_size);
 		if (slab == NULL) {
 			quota_release(quota, slab_size);
 			return NULL;
@@ -82,6 +82,7 @@ lsregion_aligned_reserve_slow_orig(struct lsregion *lsregion, size_t size,
 		if (slab == NULL)
 			return NULL;
 		lslab_create(slab, slab_size);
+		lsregion_slab_mapped(lsregion, slab);
 		rlist_add_tail_entry(&lsregion->slabs.slabs, slab,
 				     next_in_list);
 		lsregion->slabs.stats.total += slab_size;
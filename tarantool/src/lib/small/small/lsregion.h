@@ -53,7 +53,7 @@ void   lsregion_gc(struct lsregion *lsregion, int64_t min_id);
 void   lsregion_destroy(struct lsregion *lsregion);
 size_t lsregion_used(const struct lsregion *lsregion);
 size_t lsregion_total(const struct lsregion *lsregion);
-struct lsregion * get_lsregion( memory_epoch_queue ** lsregion_value );
+struct lsregion * get_lsregion( struct memory_epoch_queue ** lsregion_value );
 
 #   else  // picodata memory debug
 
@@ -86,6 +86,6 @@ static inline void   lsregion_gc_orig(struct lsregion *lsregion, int64_t min_id)
 static inline void   lsregion_destroy_orig(struct lsregion *lsregion);
 static inline size_t lsregion_used_orig(const struct lsregion *lsregion);
 static inline size_t lsregion_total_orig(const struct lsregion *lsregion);
-static inline struct lsregion * get_lsregion( struct lsregion* lsregion_value ) { return lsregion_value; }
+static inline struct lsregion * get_lsregion_orig( struct lsregion* lsregion_value ) { return lsregion_value; }
 
 #endif
@@ -267,6 +267,54 @@ lsregion_aligned_alloc_orig(struct lsregion *lsregion, size_t size, size_t align
 }
 
 
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * Allocate and free slabs bigger than the arena slab. Lsregions of
+ * memory epochs get guard-paged blocks protected with the epoch,
+ * other lsregions use malloc() and free().
+ */
+void * lsregion_large_slab_alloc(struct lsregion *lsregion, size_t size);
+void   lsregion_large_slab_free(struct lsregion *lsregion, struct lslab *slab);
+/**
+ * Usable size of an arena slab. It is one page less than the
+ * arena slab size when the epoch puts a guard page at the end
+ * of each slab.
+ */
+size_t lsregion_slab_size(struct lsregion *lsregion);
+/**
+ * Called after the lsregion took a new slab from its arena.
+ * Memory epochs index slabs mapped outside their address window.
+ */
+void   lsregion_slab_mapped(struct lsregion *lsregion, struct lslab *slab);
+#   else  // picodata memory debug
+static inline void *
+lsregion_large_slab_alloc(struct lsregion *lsregion, size_t size)
+{
+	(void)lsregion;
+	return malloc(size);
+}
+
+static inline void
+lsregion_large_slab_free(struct lsregion *lsregion, struct lslab *slab)
+{
+	(void)lsregion;
+	free(slab);
+}
+
+static inline size_t
+lsregion_slab_size(struct lsregion *lsregion)
+{
+	return lsregion->arena->slab_size;
+}
+
+static inline void
+lsregion_slab_mapped(struct lsregion *lsregion, struct lslab *slab)
+{
+	(void)lsregion;
+	(void)slab;
+}
+#   endif // picodata memory debug
+
 /**
  * Try to free all memory blocks in which the biggest identifier
  * is less or equal then the specified identifier.
@@ -278,7 +326,9 @@ static inline void
 lsregion_gc_orig(struct lsregion *lsregion, int64_t min_id)
 {
 	struct lslab *slab, *next;
-	size_t arena_slab_size = lsregion->arena->slab_size;
+	/* Slabs up to the usable size came from the arena. */
+	size_t arena_slab_size = lsregion_slab_size(lsregion);
+	uint32_t freed = 0;
 	/*
 	 * First blocks are the oldest so free them until
 	 * max_id > min_id.
@@ -297,7 +347,7 @@ lsregion_gc_orig(struct lsregion *lsregion, int64_t min_id)
 			/* Never put large slabs into cache */
 			quota_release(lsregion->arena->quota, slab->slab_size);
 			lsregion->slabs.stats.total -= slab->slab_size;
-			free(slab);
+			lsregion_large_slab_free(lsregion, slab);
 		} else if (lsregion->cached != NULL) {
 			lsregion->slabs.stats.total -= slab->slab_size;
 			slab_unmap_orig(lsregion->arena, slab);
@@ -305,7 +355,9 @@ lsregion_gc_orig(struct lsregion *lsregion, int64_t min_id)
 			lslab_create(slab, slab->slab_size);
 			lsregion->cached = slab;
 		}
+		++freed;
 	}
+	small_trace(SMALL_TRACE_LSREGION_GC, lsregion, min_id, freed);
 }
 
 /**
@@ -336,7 +388,7 @@ lsregion_total_orig(const struct lsregion *lsregion)
 }
 
 #   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
-void   lsregion_create(memory_epoch_queue **lsregion_value, struct slab_arena *arena);
+void   lsregion_create(struct memory_epoch_queue **lsregion_value, struct slab_arena *arena);
 #   endif
 
 #   if defined(__cplusplus)
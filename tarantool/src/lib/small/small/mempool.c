@@ -57,6 +57,10 @@ mslab_create(struct mslab *slab, struct mempool *pool)
 	slab->free_offset = pool->offset;
 	slab->free_list = NULL;
 	slab->in_hot_slabs = false;
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	slab->nquarantined = 0;
+	slab->sites = NULL;
+#   endif // picodata memory debug
 	rlist_create(&slab->next_in_cold);
 }
 
@@ -129,11 +133,17 @@ mslab_free(struct mempool *pool, struct mslab *slab, void *ptr)
 		if (pool->spare > slab) {
 			slab_list_del(&pool->slabs, &pool->spare->slab,
 				      next_in_list);
+			mempool_site_release(pool, pool->spare);
+			small_trace(SMALL_TRACE_MEMPOOL_SLAB_PUT, pool->spare,
+				    pool->objsize, pool->slab_order);
 			slab_put_with_order(pool->cache, &pool->spare->slab);
 			pool->spare = slab;
 		 } else if (pool->spare) {
 			 slab_list_del(&pool->slabs, &slab->slab,
 				       next_in_list);
+			 mempool_site_release(pool, slab);
+			 small_trace(SMALL_TRACE_MEMPOOL_SLAB_PUT, slab,
+				     pool->objsize, pool->slab_order);
 			 slab_put_with_order(pool->cache, &slab->slab);
 		 } else {
 			 pool->spare = slab;
@@ -141,9 +151,9 @@ mslab_free(struct mempool *pool, struct mslab *slab, void *ptr)
 	}
 }
 
-void
-mempool_create_with_order(struct mempool *pool, struct slab_cache *cache,
-			  uint32_t objsize, uint8_t order)
+static void
+mempool_init(struct mempool *pool, struct slab_cache *cache,
+	     uint32_t objsize, uint8_t order)
 {
 	assert(order <= cache->order_max);
 	lifo_init(&pool->link);
@@ -154,6 +164,10 @@ mempool_create_with_order(struct mempool *pool, struct slab_cache *cache,
 	pool->first_hot_slab = NULL;
 	rlist_create(&pool->cold_slabs);
 	pool->spare = NULL;
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	pool->quarantine = NULL;
+	pool->nested = false;
+#   endif // picodata memory debug
 	pool->objsize = objsize;
 	pool->slab_order = order;
 	/* Total size of slab */
@@ -165,13 +179,38 @@ mempool_create_with_order(struct mempool *pool, struct slab_cache *cache,
 	pool->slab_ptr_mask = ~(slab_order_size(cache, order) - 1);
 }
 
+void
+mempool_create_with_order(struct mempool *pool, struct slab_cache *cache,
+			  uint32_t objsize, uint8_t order)
+{
+	mempool_init(pool, cache, objsize, order);
+	small_call(SMALL_CALL_MEMPOOL_CREATE, pool, cache, objsize, 0, order);
+}
+
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+void
+mempool_create_nested(struct mempool *pool, struct slab_cache *cache,
+		      uint32_t objsize)
+{
+	mempool_init(pool, cache, objsize, mempool_order(cache, objsize));
+	pool->nested = true;
+}
+#   endif // picodata memory debug
+
 void
 mempool_destroy(struct mempool *pool)
 {
 	struct slab *slab, *tmp;
+	if (mempool_is_traced(pool))
+		small_call(SMALL_CALL_MEMPOOL_DESTROY, pool, NULL, 0, 0, 0);
+	mempool_quarantine_drain(pool);
 	rlist_foreach_entry_safe(slab, &pool->slabs.slabs,
-				 next_in_list, tmp)
+				 next_in_list, tmp) {
+		mempool_site_release(pool, (struct mslab *)slab);
+		small_trace(SMALL_TRACE_MEMPOOL_SLAB_PUT, slab,
+			    pool->objsize, pool->slab_order);
 		slab_put_with_order(pool->cache, slab);
+	}
 }
 
 void *
@@ -188,6 +227,8 @@ mempool_alloc(struct mempool *pool)
 						pool->slab_order))) {
 			mslab_create(slab, pool);
 			slab_list_add(&pool->slabs, &slab->slab, next_in_list);
+			small_trace(SMALL_TRACE_MEMPOOL_SLAB_GET, slab,
+				    pool->objsize, pool->slab_order);
 		} else if (! rlist_empty(&pool->cold_slabs)) {
 			slab = rlist_shift_entry(&pool->cold_slabs, struct mslab,
 						 next_in_cold);
@@ -202,6 +243,7 @@ mempool_alloc(struct mempool *pool)
 	pool->slabs.stats.used += pool->objsize;
 	void *ptr = mslab_alloc(pool, slab);
 	assert(ptr != NULL);
+	mempool_site_alloc(pool, slab, ptr);
 	VALGRIND_MALLOCLIKE_BLOCK(ptr, pool->objsize, 0, 0);
 	return ptr;
 }
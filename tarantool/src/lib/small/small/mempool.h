@@ -36,9 +36,7 @@
 #include <sys/types.h> /* ssize_t */
 #include <string.h>
 #include "slab_cache.h"
-#include "lifo.h"
-#define RB_COMPACT 1
-#include "rb.h"
+#include "mempool_internal.h"
 
 #if defined(__cplusplus)
 extern "C" {
@@ -74,23 +72,6 @@ extern "C" {
  * error in case of failure.
  */
 
-/** mslab - a standard slab formatted to store objects of equal size. */
-struct mslab {
-	struct slab slab;
-	/* Head of the list of used but freed objects */
-	void *free_list;
-	/** Offset of an object that has never been allocated in mslab */
-	uint32_t free_offset;
-	/** Number of available slots in the slab. */
-	uint32_t nfree;
-	/** Used if this slab is a member of hot_slabs tree. */
-	rb_node(struct mslab) next_in_hot;
-	/** Next slab in stagged slabs list in mempool object */
-	struct rlist next_in_cold;
-	/** Set if this slab is a member of hot_slabs tree */
-	bool in_hot_slabs;
-};
-
 /**
  * Mempool will try to allocate blocks large enough to ensure
  * the overhead from internal fragmentation is less than the
@@ -98,12 +79,6 @@ struct mslab {
  */
 static const double OVERHEAD_RATIO = 0.01;
 
-static inline uint32_t
-mslab_sizeof()
-{
-	return small_align(sizeof(struct mslab), sizeof(intptr_t));
-}
-
 /**
  * Calculate the maximal size of an object for which it makes
  * sense to create a memory pool given the size of the slab.
@@ -116,67 +91,6 @@ mempool_objsize_max(uint32_t slab_size)
 		 ~(sizeof(intptr_t) - 1);
 }
 
-typedef rb_tree(struct mslab) mslab_tree_t;
-
-/** A memory pool. */
-struct mempool
-{
-	/**
-	 * A link in delayed free list of pools. Must be the first
-	 * member in the struct.
-	 * @sa smfree_delayed().
-	 */
-	struct lifo link;
-	/** List of pointers for delayed free. */
-	struct lifo delayed;
-	/** The source of empty slabs. */
-	struct slab_cache *cache;
-	/** All slabs. */
-	struct slab_list slabs;
-	/**
-	 * Slabs with some amount of free space available are put
-	 * into this red-black tree, which is sorted by slab
-	 * address. A (partially) free slab with the smallest
-	 * address is chosen for allocation. This reduces internal
-	 * memory fragmentation across many slabs.
-	 */
-	mslab_tree_t hot_slabs;
-	/** Cached leftmost node of hot_slabs tree. */
-	struct mslab *first_hot_slab;
-	/**
-	 * Slabs with a little of free items count, staged to
-	 * be added to hot_slabs tree. Are  used in case the
-	 * tree is empty or the allocator runs out of memory.
-	 */
-	struct rlist cold_slabs;
-	/**
-	 * A completely empty slab which is not freed only to
-	 * avoid the overhead of slab_cache oscillation around
-	 * a single element allocation.
-	 */
-	struct mslab *spare;
-	/**
-	 * The size of an individual object. All objects
-	 * allocated on the pool have the same size.
-	 */
-	uint32_t objsize;
-	/**
-	 * Mempool slabs are ordered (@sa slab_cache.h for
-	 * definition of "ordered"). The order is calculated
-	 * when the pool is initialized or is set explicitly.
-	 * The latter is necessary for 'small' allocator,
-	 * which needs to quickly find mempool containing
-	 * an allocated object when the object is freed.
-	 */
-	uint8_t slab_order;
-	/** How many objects can fit in a slab. */
-	uint32_t objcount;
-	/** Offset from beginning of slab to the first object */
-	uint32_t offset;
-	/** Address mask to translate ptr to slab */
-	intptr_t slab_ptr_mask;
-};
-
 /** Allocation statistics. */
 struct mempool_stats
 {
@@ -210,6 +124,25 @@ void
 mempool_create_with_order(struct mempool *pool, struct slab_cache *cache,
 			  uint32_t objsize, uint8_t order);
 
+/** Slab order of a pool of objects of the given size. */
+static inline uint8_t
+mempool_order(struct slab_cache *cache, uint32_t objsize)
+{
+	size_t overhead = (objsize > sizeof(struct mslab) ?
+			   objsize : sizeof(struct mslab));
+	size_t slab_size = (size_t) (overhead / OVERHEAD_RATIO);
+	if (slab_size > cache->arena->slab_size)
+		slab_size = cache->arena->slab_size;
+	/*
+	 * Calculate the amount of usable space in a slab.
+	 * @note: this asserts that slab_size_min is less than
+	 * SLAB_ORDER_MAX.
+	 */
+	uint8_t order = slab_order(cache, slab_size);
+	assert(order <= cache->order_max);
+	return order;
+}
+
 /**
  * Initialize a mempool. Tell the pool the size of objects
  * it will contain.
@@ -225,21 +158,28 @@ static inline void
 mempool_create(struct mempool *pool, struct slab_cache *cache,
 	       uint32_t objsize)
 {
-	size_t overhead = (objsize > sizeof(struct mslab) ?
-			   objsize : sizeof(struct mslab));
-	size_t slab_size = (size_t) (overhead / OVERHEAD_RATIO);
-	if (slab_size > cache->arena->slab_size)
-		slab_size = cache->arena->slab_size;
-	/*
-	 * Calculate the amount of usable space in a slab.
-	 * @note: this asserts that slab_size_min is less than
-	 * SLAB_ORDER_MAX.
-	 */
-	uint8_t order = slab_order(cache, slab_size);
-	assert(order <= cache->order_max);
-	return mempool_create_with_order(pool, cache, objsize, order);
+	mempool_create_with_order(pool, cache, objsize,
+				  mempool_order(cache, objsize));
 }
 
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * mempool_create() for a pool of a small allocator. The call
+ * trace records the calls of the allocator, not of its pools,
+ * see slab_arena_open_call_trace().
+ */
+void
+mempool_create_nested(struct mempool *pool, struct slab_cache *cache,
+		      uint32_t objsize);
+#   else  // picodata memory debug
+static inline void
+mempool_create_nested(struct mempool *pool, struct slab_cache *cache,
+		      uint32_t objsize)
+{
+	mempool_create(pool, cache, objsize);
+}
+#   endif // picodata memory debug
+
 static inline bool
 mempool_is_initialized(struct mempool *pool)
 {
@@ -257,9 +197,6 @@ mempool_destroy(struct mempool *pool);
 void *
 mempool_alloc(struct mempool *pool);
 
-void
-mslab_free(struct mempool *pool, struct mslab *slab, void *ptr);
-
 /**
  * Free a single object.
  * @pre the object is allocated in this pool.
@@ -275,6 +212,9 @@ mempool_free(struct mempool *pool, void *ptr)
 		slab_from_ptr(ptr, pool->slab_ptr_mask);
 	assert(slab->slab.order == pool->slab_order);
 	pool->slabs.stats.used -= pool->objsize;
+	mempool_site_free(pool, slab, ptr);
+	if (mempool_quarantine_put(pool, slab, ptr))
+		return;
 	mslab_free(pool, slab, ptr);
 }
 
@@ -0,0 +1,231 @@
+#ifndef INCLUDES_TARANTOOL_SMALL_MEMPOOL_INTERNAL_H
+#define INCLUDES_TARANTOOL_SMALL_MEMPOOL_INTERNAL_H
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "lifo.h"
+#define RB_COMPACT 1
+#include "rb.h"
+
+#   if defined(__cplusplus)
+extern "C" {
+#   endif /* defined(__cplusplus) */
+
+struct mempool_quarantine;
+
+/** mslab - a standard slab formatted to store objects of equal size. */
+struct mslab {
+	struct slab slab;
+	/* Head of the list of used but freed objects */
+	void *free_list;
+	/** Offset of an object that has never been allocated in mslab */
+	uint32_t free_offset;
+	/** Number of available slots in the slab. */
+	uint32_t nfree;
+	/** Used if this slab is a member of hot_slabs tree. */
+	rb_node(struct mslab) next_in_hot;
+	/** Next slab in stagged slabs list in mempool object */
+	struct rlist next_in_cold;
+	/** Set if this slab is a member of hot_slabs tree */
+	bool in_hot_slabs;
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	/** Freed objects of the slab held by the pool quarantine. */
+	uint32_t nquarantined;
+	/**
+	 * Allocation site ids of the objects, created on the first
+	 * sampled allocation from the slab.
+	 */
+	uint16_t *sites;
+#   endif // picodata memory debug
+};
+
+static inline uint32_t
+mslab_sizeof()
+{
+	return small_align(sizeof(struct mslab), sizeof(intptr_t));
+}
+
+typedef rb_tree(struct mslab) mslab_tree_t;
+
+/** A memory pool. */
+struct mempool
+{
+	/**
+	 * A link in delayed free list of pools. Must be the first
+	 * member in the struct.
+	 * @sa smfree_delayed().
+	 */
+	struct lifo link;
+	/** List of pointers for delayed free. */
+	struct lifo delayed;
+	/** The source of empty slabs. */
+	struct slab_cache *cache;
+	/** All slabs. */
+	struct slab_list slabs;
+	/**
+	 * Slabs with some amount of free space available are put
+	 * into this red-black tree, which is sorted by slab
+	 * address. A (partially) free slab with the smallest
+	 * address is chosen for allocation. This reduces internal
+	 * memory fragmentation across many slabs.
+	 */
+	mslab_tree_t hot_slabs;
+	/** Cached leftmost node of hot_slabs tree. */
+	struct mslab *first_hot_slab;
+	/**
+	 * Slabs with a little of free items count, staged to
+	 * be added to hot_slabs tree. Are  used in case the
+	 * tree is empty or the allocator runs out of memory.
+	 */
+	struct rlist cold_slabs;
+	/**
+	 * A completely empty slab which is not freed only to
+	 * avoid the overhead of slab_cache oscillation around
+	 * a single element allocation.
+	 */
+	struct mslab *spare;
+	/**
+	 * The size of an individual object. All objects
+	 * allocated on the pool have the same size.
+	 */
+	uint32_t objsize;
+	/**
+	 * Mempool slabs are ordered (@sa slab_cache.h for
+	 * definition of "ordered"). The order is calculated
+	 * when the pool is initialized or is set explicitly.
+	 * The latter is necessary for 'small' allocator,
+	 * which needs to quickly find mempool containing
+	 * an allocated object when the object is freed.
+	 */
+	uint8_t slab_order;
+	/** How many objects can fit in a slab. */
+	uint32_t objcount;
+	/** Offset from beginning of slab to the first object */
+	uint32_t offset;
+	/** Address mask to translate ptr to slab */
+	intptr_t slab_ptr_mask;
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	/** Use-after-free quarantine, created on the first free. */
+	struct mempool_quarantine *quarantine;
+	/**
+	 * A pool of a small allocator, created with
+	 * mempool_create_nested(). Its calls are a part of the
+	 * allocator calls and are not recorded in the call trace.
+	 */
+	bool nested;
+#   endif // picodata memory debug
+};
+
+/** Whether the call trace records the calls of the pool. */
+static inline bool
+mempool_is_traced(const struct mempool *pool)
+{
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	return !pool->nested;
+#   else  // picodata memory debug
+	(void)pool;
+	return false;
+#   endif // picodata memory debug
+}
+
+void
+mslab_free(struct mempool *pool, struct mslab *slab, void *ptr);
+
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * Use-after-free quarantine of a pool. Instead of the slab free
+ * list, a freed object is poisoned and put at the tail of a
+ * bounded FIFO of its pool. It returns to the slab with
+ * mslab_free() when it is pushed out of the FIFO. Returns false
+ * when the quarantine is off and the object must be freed as
+ * usual.
+ */
+bool   mempool_quarantine_put(struct mempool *pool, struct mslab *slab, void *ptr);
+/** Return all quarantined objects of the pool to their slabs. */
+void   mempool_quarantine_drain(struct mempool *pool);
+#   else  // picodata memory debug
+static inline bool
+mempool_quarantine_put(struct mempool *pool, struct mslab *slab, void *ptr)
+{
+	(void)pool;
+	(void)slab;
+	(void)ptr;
+	return false;
+}
+
+static inline void
+mempool_quarantine_drain(struct mempool *pool)
+{
+	(void)pool;
+}
+#   endif // picodata memory debug
+
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * Allocation site sampling. The site of a sampled object is
+ * stored in the site array of its slab, a non-sampled object
+ * clears its entry. A freed object keeps its site marked as
+ * freed, so that a use-after-free report can still name it. The
+ * array is released when the slab goes back to the slab cache.
+ * The alloc and free hooks also feed the call trace.
+ */
+void   mempool_site_alloc(struct mempool *pool, struct mslab *slab, void *ptr);
+void   mempool_site_free(struct mempool *pool, struct mslab *slab, void *ptr);
+void   mempool_site_release(struct mempool *pool, struct mslab *slab);
+#   else  // picodata memory debug
+static inline void
+mempool_site_alloc(struct mempool *pool, struct mslab *slab, void *ptr)
+{
+	(void)pool;
+	(void)slab;
+	(void)ptr;
+}
+
+static inline void
+mempool_site_free(struct mempool *pool, struct mslab *slab, void *ptr)
+{
+	(void)pool;
+	(void)slab;
+	(void)ptr;
+}
+
+static inline void
+mempool_site_release(struct mempool *pool, struct mslab *slab)
+{
+	(void)pool;
+	(void)slab;
+}
+#   endif // picodata memory debug
+
+#   if defined(__cplusplus)
+} /* extern "C" */
+#   endif /* defined(__cplusplus) */
+
+#endif /* INCLUDES_TARANTOOL_SMALL_MEMPOOL_INTERNAL_H */
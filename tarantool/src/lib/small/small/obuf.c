@@ -79,6 +79,12 @@ obuf_create(struct obuf *buf, struct slab_cache *slabc, size_t start_capacity)
 void
 obuf_reset(struct obuf *buf)
 {
+	if (buffer_quarantine_is_enabled()) {
+		/* Retire the iovecs instead of reusing them in place. */
+		obuf_destroy(buf);
+		obuf_create(buf, buf->slabc, buf->start_capacity);
+		return;
+	}
 	int iovcnt = obuf_iovcnt(buf);
 	int i;
 	for (i = 0; i < iovcnt; i++)
@@ -93,7 +99,8 @@ obuf_destroy(struct obuf *buf)
 	int i;
 	for (i = 0; i < buf->n_iov; i++) {
 		struct slab *slab = slab_from_data(buf->iov[i].iov_base);
-		slab_put(buf->slabc, slab);
+		if (!buffer_quarantine_put(buf->slabc, slab))
+			slab_put(buf->slabc, slab);
 	}
 #ifndef NDEBUG
 	obuf_create(buf, buf->slabc, buf->start_capacity);
@@ -190,7 +197,8 @@ obuf_reserve_slow(struct obuf *buf, size_t size)
 				return NULL;
 			struct slab *old =
 				slab_from_data(buf->iov[buf->pos].iov_base);
-			slab_put(buf->slabc, old);
+			if (!buffer_quarantine_put(buf->slabc, old))
+				slab_put(buf->slabc, old);
 			buf->iov[buf->pos].iov_base = slab_data(slab);
 			buf->capacity[buf->pos] = slab_capacity(slab);
 		} else if (obuf_alloc_pos(buf, size) == NULL) {
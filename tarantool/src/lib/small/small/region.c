@@ -59,10 +59,14 @@ region_free(struct region *region)
 {
 	struct slab *slab, *tmp;
 	rlist_foreach_entry_safe(slab, &region->slabs.slabs,
-				 next_in_list, tmp)
-		slab_put(region->cache, slab);
+				 next_in_list, tmp) {
+		if (!region_quarantine_put(region, slab))
+			slab_put(region->cache, slab);
+	}
+	region_quarantine_seal(region);
 
 	slab_list_create(&region->slabs);
+	region_site_truncate(region);
 }
 
 /**
@@ -88,10 +92,13 @@ region_truncate(struct region *region, size_t used)
 		cut_size -= slab->used;
 		/* Remove the entire slab. */
 		slab_list_del(&region->slabs, &slab->slab, next_in_list);
-		slab_put(region->cache, &slab->slab);
+		if (!region_quarantine_put(region, &slab->slab))
+			slab_put(region->cache, &slab->slab);
 	}
+	region_quarantine_seal(region);
 	assert(cut_size == 0);
 	region->slabs.stats.used = used;
+	region_site_truncate(region);
 }
 
 void *
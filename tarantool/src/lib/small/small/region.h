@@ -37,6 +37,7 @@
 #include <string.h>
 #include "rlist.h"
 #include "slab_cache.h"
+#include "region_internal.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,23 +68,6 @@ extern "C" {
  * allocate memory. alloc() calls return NULL in this case.
  */
 
-/** A memory region.
- *
- * A memory region is a list of memory blocks.
- *
- * It's possible to allocate a chunk of any size
- * from a region.
- * It's not possible, however, to free a single allocated
- * piece, all memory must be freed at once with region_reset() or
- * region_free().
- */
-
-struct region
-{
-	struct slab_cache *cache;
-	struct slab_list slabs;
-};
-
 /**
  * Initialize a memory region.
  * @sa region_free().
@@ -93,6 +77,11 @@ region_create(struct region *region, struct slab_cache *cache)
 {
 	region->cache = cache;
 	slab_list_create(&region->slabs);
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	region->quarantine = NULL;
+	region->sites = NULL;
+#   endif // picodata memory debug
+	small_call(SMALL_CALL_REGION_CREATE, region, cache, 0, 0, 0);
 }
 
 /**
@@ -105,24 +94,11 @@ region_free(struct region *region);
 static inline void
 region_destroy(struct region *region)
 {
-	return region_free(region);
-}
-
-/** Internal: a single block in a region.  */
-struct rslab
-{
-	/*
-	 * slab is a wrapper around struct slab - with a few
-	 * extra members.
-	 */
-	struct slab slab;
-	uint32_t used;
-};
-
-static inline uint32_t
-rslab_sizeof()
-{
-	return small_align(sizeof(struct rslab), sizeof(intptr_t));
+	region_free(region);
+	region_quarantine_drain(region);
+	region_site_release(region);
+	/* After region_free() recorded its truncation. */
+	small_call(SMALL_CALL_REGION_DESTROY, region, NULL, 0, 0, 0);
 }
 
 static inline void *
@@ -173,6 +149,7 @@ region_alloc(struct region *region, size_t size)
 
 		region->slabs.stats.used += size;
 		slab->used += size;
+		region_site_alloc(region, size, 0);
 	}
 	return ptr;
 }
@@ -206,6 +183,7 @@ region_aligned_alloc(struct region *region, size_t size, size_t alignment)
 
 		region->slabs.stats.used += effective_size;
 		slab->used += effective_size;
+		region_site_alloc(region, size, alignment);
 	}
 	return ptr;
 }
@@ -222,6 +200,7 @@ region_reset(struct region *region)
 						       slab.next_in_list);
 		region->slabs.stats.used -= slab->used;
 		slab->used = 0;
+		region_site_truncate(region);
 	}
 }
 
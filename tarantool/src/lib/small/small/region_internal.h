@@ -0,0 +1,151 @@
+#ifndef INCLUDES_TARANTOOL_SMALL_REGION_INTERNAL_H
+#define INCLUDES_TARANTOOL_SMALL_REGION_INTERNAL_H
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#   if defined(__cplusplus)
+extern "C" {
+#   endif /* defined(__cplusplus) */
+
+struct region_quarantine;
+struct region_sites;
+
+/** A memory region.
+ *
+ * A memory region is a list of memory blocks.
+ *
+ * It's possible to allocate a chunk of any size
+ * from a region.
+ * It's not possible, however, to free a single allocated
+ * piece, all memory must be freed at once with region_reset() or
+ * region_free().
+ */
+
+struct region
+{
+	struct slab_cache *cache;
+	struct slab_list slabs;
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+	/** Truncated slabs held back from the cache, see region_quarantine_put(). */
+	struct region_quarantine *quarantine;
+	/** Sampled allocation sites of live chunks, see region_site_alloc(). */
+	struct region_sites *sites;
+#   endif // picodata memory debug
+};
+
+/** Internal: a single block in a region.  */
+struct rslab
+{
+	/*
+	 * slab is a wrapper around struct slab - with a few
+	 * extra members.
+	 */
+	struct slab slab;
+	uint32_t used;
+};
+
+static inline uint32_t
+rslab_sizeof()
+{
+	return small_align(sizeof(struct rslab), sizeof(intptr_t));
+}
+
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * Delayed reuse of region slabs. A slab cut off by
+ * region_truncate() or region_free() is poisoned and joins the
+ * open generation of the region instead of going back to the
+ * slab cache. region_quarantine_seal() closes the generation,
+ * the region keeps the last few of them and returns the oldest
+ * one to the cache. region_quarantine_put() returns false when
+ * the quarantine is off and the slab must be put as usual.
+ */
+bool   region_quarantine_put(struct region *region, struct slab *slab);
+void   region_quarantine_seal(struct region *region);
+/** Return all held slabs to the cache. */
+void   region_quarantine_drain(struct region *region);
+/**
+ * Allocation site sampling and the call trace of region chunks.
+ * region_site_alloc() is called after size bytes were allocated
+ * from the region (alignment is 0 for region_alloc()),
+ * region_site_truncate() after region_used() went down,
+ * region_site_release() when the region is destroyed.
+ */
+void   region_site_alloc(struct region *region, size_t size, size_t alignment);
+void   region_site_truncate(struct region *region);
+void   region_site_release(struct region *region);
+#   else  // picodata memory debug
+static inline bool
+region_quarantine_put(struct region *region, struct slab *slab)
+{
+	(void)region;
+	(void)slab;
+	return false;
+}
+
+static inline void
+region_quarantine_seal(struct region *region)
+{
+	(void)region;
+}
+
+static inline void
+region_quarantine_drain(struct region *region)
+{
+	(void)region;
+}
+
+static inline void
+region_site_alloc(struct region *region, size_t size, size_t alignment)
+{
+	(void)region;
+	(void)size;
+	(void)alignment;
+}
+
+static inline void
+region_site_truncate(struct region *region)
+{
+	(void)region;
+}
+
+static inline void
+region_site_release(struct region *region)
+{
+	(void)region;
+}
+#   endif // picodata memory debug
+
+#   if defined(__cplusplus)
+} /* extern "C" */
+#   endif /* defined(__cplusplus) */
+
+#endif /* INCLUDES_TARANTOOL_SMALL_REGION_INTERNAL_H */
@@ -237,6 +237,7 @@ slab_map_orig(struct slab_arena *arena)
 	void *ptr;
 	if ((ptr = lf_lifo_pop(&arena->cache))) {
 		VALGRIND_MAKE_MEM_UNDEFINED(ptr, arena->slab_size);
+		small_trace(SMALL_TRACE_SLAB_MAP, ptr, arena->slab_size, 0);
 		return ptr;
 	}
 
@@ -249,6 +250,7 @@ slab_map_orig(struct slab_arena *arena)
 	if (used <= arena->prealloc) {
 		ptr = arena->arena + used - arena->slab_size;
 		VALGRIND_MAKE_MEM_UNDEFINED(ptr, arena->slab_size);
+		small_trace(SMALL_TRACE_SLAB_MAP, ptr, arena->slab_size, 1);
 		return ptr;
 	}
 
@@ -262,6 +264,8 @@ slab_map_orig(struct slab_arena *arena)
 	madvise_checked(ptr, arena->slab_size, arena->flags);
 
 	VALGRIND_MAKE_MEM_UNDEFINED(ptr, arena->slab_size);
+	if (ptr != NULL)
+		small_trace(SMALL_TRACE_SLAB_MAP, ptr, arena->slab_size, 2);
 	return ptr;
 }
 
@@ -271,6 +275,7 @@ slab_unmap_orig(struct slab_arena *arena, void *ptr)
 	if (ptr == NULL)
 		return;
 
+	small_trace(SMALL_TRACE_SLAB_UNMAP, ptr, arena->slab_size, 0);
 	lf_lifo_push(&arena->cache, ptr);
 	VALGRIND_MAKE_MEM_NOACCESS(ptr, arena->slab_size);
 	VALGRIND_MAKE_MEM_DEFINED(lf_lifo(ptr), sizeof(struct lf_lifo));
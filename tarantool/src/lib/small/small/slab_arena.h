@@ -33,9 +33,14 @@
 #include "lf_lifo.h"
 #include <sys/mman.h>
 #include <limits.h>
+#include <string.h>
 
 #include "slab_arena_internal.h"
 
+struct mempool;
+struct region;
+struct slab_arena_heap_profile;
+
 #   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
 
 //extern int slab_arena_create(struct slab_arena **arena, struct quota *quota, size_t prealloc, uint32_t slab_size, int flags);
@@ -44,9 +49,257 @@ extern void * slab_map(struct slab_arena *arena);
 extern void slab_unmap(struct slab_arena *arena, void *ptr);
 extern void slab_arena_mprotect(struct slab_arena *arena);
 struct slab_arena * get_slab_arena( struct memory_epoch_queue ** arena );
+struct slab_cache;
 extern void slab_cache_create(struct slab_cache *cache, struct memory_epoch_queue ** arena);
 size_t get_slab_arena_used( struct memory_epoch_queue **arena );
+/** Snapshot of the debugger cost counters of @a arena. Returns 0. */
+int get_slab_arena_stats(struct memory_epoch_queue **arena, struct slab_arena_stats *stats);
+/**
+ * Per-epoch counters of @a arena, the current epoch first.
+ * Returns the number of filled entries, at most @a max_epochs.
+ */
+size_t get_slab_arena_epoch_stats(struct memory_epoch_queue **arena, struct slab_arena_epoch_stats *stats, size_t max_epochs);
 struct quota * get_slab_arena_quota(struct memory_epoch_queue **arena);
+/** Number of mprotect() calls made by the last epoch rotation, and by all rotations via @a total_calls. */
+size_t get_slab_arena_rotation_mprotect_calls(struct memory_epoch_queue **arena, size_t *total_calls);
+/**
+ * Move epoch protection changes and retirement of old epochs to a
+ * background thread (1) or do them inline in lsregion_gc() (0).
+ * Returns the previous mode. Switching to 0 waits for queued work.
+ */
+int slab_arena_set_async_protection(int enabled);
+/** Wait until all epoch protection work queued so far is done. */
+void slab_arena_flush_protection(void);
+/**
+ * Set how many epochs (current, read-only and quarantined) arenas
+ * created after this call keep. The default comes from the
+ * TARARAM_EPOCH_QUEUE_DEPTH environment variable. Returns the
+ * previous value; 0 only queries it.
+ */
+size_t slab_arena_set_epoch_queue_depth(size_t depth);
+/** Number of epochs kept by @a arena. */
+size_t get_slab_arena_epoch_queue_depth(struct memory_epoch_queue **arena);
+/**
+ * Protect only 1-in-@a rotation_rate epoch rotations, and rotate
+ * epochs only in 1-in-@a arena_rate newly created arenas. The rest
+ * pass straight to lsregion_gc_orig(). 1 protects everything, 0
+ * nothing. Defaults come from TARARAM_SAMPLE_ROTATIONS and
+ * TARARAM_SAMPLE_ARENAS. The arena rate affects only arenas
+ * created later.
+ */
+void slab_arena_set_sampling(size_t rotation_rate, size_t arena_rate);
+/** Sampling rates and counters summed over all arenas. */
+void slab_arena_get_sampling_stats(struct slab_arena_sampling_stats *stats);
+/**
+ * Hand physical memory of quarantined epochs back to the kernel
+ * when they become inaccessible: 0 - keep it, 1 - MADV_DONTNEED,
+ * 2 - MADV_FREE. Address space and PROT_NONE stay, so stray
+ * accesses still fault. The first page of every slab is kept.
+ * The default comes from TARARAM_QUARANTINE_RELEASE. Returns the
+ * previous mode.
+ */
+int slab_arena_set_quarantine_release(int mode);
+/** Quarantined virtual and resident memory over all arenas. */
+void slab_arena_get_quarantine_stats(struct slab_arena_quarantine_stats *stats);
+/**
+ * Find the arena epoch owning @a ptr, e.g. a SIGSEGV fault address.
+ * Lock-free and allocation-free, safe to call from a signal
+ * handler. Returns 1 and fills @a info if found, 0 otherwise.
+ */
+int slab_arena_find_address(const void *ptr, struct slab_arena_address_info *info);
+/**
+ * Large lsregion slabs of epochs get their own mapping followed
+ * by PROT_NONE guard pages and are protected with the epoch.
+ * Freed mappings are cached for reuse instead of munmap().
+ */
+void slab_arena_get_large_block_stats(struct slab_arena_large_block_stats *stats);
+/**
+ * Turn the memory debugger on (1) or off (0) without restarting.
+ * While it is off, slab_map(), slab_unmap() and the lsregion
+ * functions check one flag and go to the original allocator of
+ * the current epoch: no rotations, protection, redzones or
+ * allocation sites, and lsregion_gc() frees the current epoch in
+ * place. Older epochs keep their memory until the debugger is
+ * turned back on and rotates them out. The default comes from
+ * TARARAM_MEMORY_DEBUG. Returns the previous setting.
+ */
+int slab_arena_set_memory_debug(int enabled);
+void slab_arena_get_memory_debug_stats(struct slab_arena_memory_debug_stats *stats);
+/**
+ * Put a PROT_NONE page at the end of every slab of new epochs,
+ * so a linear overrun of a slab faults instead of running into
+ * the next one. Slabs lose one page of usable size. The default
+ * comes from TARARAM_SLAB_GUARDS. Returns the previous setting.
+ */
+int slab_arena_set_slab_guards(int enabled);
+/** Guard page count and its memory and mprotect() cost. */
+void slab_arena_get_slab_guard_stats(struct slab_arena_slab_guard_stats *stats);
+/**
+ * Keep @a size epochs ready, so that epoch rotation does not create
+ * one inside lsregion_gc(). The pool is refilled by the background
+ * protection thread when it has nothing else to do, also in the
+ * synchronous mode. The default comes from TARARAM_EPOCH_POOL_SIZE,
+ * 0 disables the pool. Returns the previous size.
+ */
+size_t slab_arena_set_epoch_pool_size(size_t size);
+/**
+ * Fill the epoch pool right now, e.g. from an idle hook.
+ * Returns the number of ready epochs.
+ */
+size_t slab_arena_refill_epoch_pool(void);
+void slab_arena_get_epoch_pool_stats(struct slab_arena_epoch_pool_stats *stats);
+/**
+ * Epoch queues, epochs and their arenas and lsregions take whole
+ * pages from a pool of the debugger's own mappings instead of the
+ * application heap.
+ */
+void slab_arena_get_metadata_stats(struct slab_arena_metadata_stats *stats);
+/**
+ * Follow every lsregion_alloc() and lsregion_aligned_alloc()
+ * chunk with @a size bytes of canary. The canaries of an epoch
+ * are checked when it stops being current and before
+ * lsregion_gc() of the current epoch, a corrupted one is
+ * reported to stderr. The default comes from TARARAM_REDZONE.
+ * Returns the previous size.
+ */
+size_t slab_arena_set_redzone(size_t size);
+void slab_arena_get_redzone_stats(struct slab_arena_redzone_stats *stats);
+/**
+ * Hold back freed mempool and small_alloc objects instead of
+ * putting them on the slab free list: up to @a size bytes per
+ * pool, i.e. per size class, the oldest object is returned to its
+ * slab first. Quarantined objects are filled with the redzone
+ * canary, which is verified when they leave the quarantine, and a
+ * slab whose objects are all quarantined is made PROT_NONE except
+ * for its header page. The default comes from
+ * TARARAM_MEMPOOL_QUARANTINE, 0 disables the quarantine. Returns
+ * the previous size.
+ */
+size_t slab_arena_set_mempool_quarantine(size_t size);
+void slab_arena_get_mempool_quarantine_stats(struct slab_arena_mempool_quarantine_stats *stats);
+/**
+ * Do not return slabs cut off by region_truncate() and
+ * region_free() to the slab cache right away: each region keeps
+ * the slabs of its last @a generations truncations, filled with
+ * the redzone canary and PROT_NONE past their header page, and
+ * returns the oldest generation when a new one comes. The canary
+ * is verified on return. The default comes from
+ * TARARAM_REGION_GENERATIONS, 0 disables the quarantine. Regions
+ * keep the depth they got with their first truncation. Returns
+ * the previous setting.
+ */
+size_t slab_arena_set_region_generations(size_t generations);
+void slab_arena_get_region_quarantine_stats(struct slab_arena_region_quarantine_stats *stats);
+/**
+ * Do not reuse ibuf and obuf memory right away. Slabs dropped by
+ * ibuf_reserve_slow(), obuf_reserve_slow() and the destructors,
+ * and the iovecs of obuf_reset(), are filled with the redzone
+ * canary, made PROT_NONE past their header page and held in a
+ * FIFO of the calling thread. ibuf_reserve_slow() moves data to a
+ * new slab instead of memmove(). The oldest slabs go back to their
+ * caches when a thread holds more than @a size bytes, the canary
+ * is verified then. The default comes from
+ * TARARAM_BUFFER_QUARANTINE, 0 disables the quarantine. Returns
+ * the previous size.
+ */
+size_t slab_arena_set_buffer_quarantine(size_t size);
+void slab_arena_get_buffer_quarantine_stats(struct slab_arena_buffer_quarantine_stats *stats);
+/**
+ * Record the allocating stack of sampled lsregion_alloc(),
+ * lsregion_aligned_alloc(), mempool_alloc() (thus smalloc()) and
+ * region_alloc() chunks. Sampling is by bytes: on average one
+ * chunk per @a sample_bytes allocated bytes is sampled, so big
+ * chunks are sampled more often than small ones. The stack is
+ * taken by walking frame pointers, distinct stacks get ids in a
+ * table of a fixed size. small itself is built with
+ * -fno-omit-frame-pointer; a caller built without it drops out of
+ * the stack or ends it, so build the application with frame
+ * pointers too. Epochs keep the site ids of their
+ * sampled chunks until the chunks are freed by lsregion_gc() or
+ * the epoch is reused, mempools keep a 16-bit id per object of a
+ * sampled slab, also after the object is freed, regions keep them
+ * until the chunk is truncated. The default comes from
+ * TARARAM_ALLOCATION_SAMPLE_BYTES, 0 disables sampling. Returns
+ * the previous setting.
+ */
+size_t slab_arena_set_allocation_sampling(size_t sample_bytes);
+void slab_arena_get_allocation_site_stats(struct slab_arena_allocation_site_stats *stats);
+/** Stack of site @a id. Returns 1 if the site exists, 0 otherwise. */
+int slab_arena_get_allocation_site(uint32_t id, struct slab_arena_allocation_site *site);
+/**
+ * Site of a sampled lsregion chunk containing @a ptr or its
+ * redzone, e.g. a SIGSEGV fault address, 0 if the chunk was not
+ * sampled. Takes locks, call it from the thread that allocates
+ * from the arena.
+ */
+uint32_t slab_arena_find_allocation_site(const void *ptr);
+/** Site of a sampled object of @a pool containing @a ptr, freed or not, 0 if unknown. */
+uint32_t slab_arena_find_mempool_allocation_site(struct mempool *pool, const void *ptr);
+/**
+ * Sampled chunks of the epoch @a epoch_age of @a arena (0 - the
+ * current one) grouped by site, the biggest first. Returns the
+ * number of sites, fills at most @a max_sites entries.
+ */
+size_t slab_arena_get_epoch_allocation_sites(struct memory_epoch_queue **arena, size_t epoch_age, struct slab_arena_allocation_site_usage *usage, size_t max_sites);
+/** The same for the live sampled objects of @a pool. */
+size_t slab_arena_get_mempool_allocation_sites(struct mempool *pool, struct slab_arena_allocation_site_usage *usage, size_t max_sites);
+/**
+ * Heap profile of the live memory of small allocators by
+ * allocation site, written in the gzip'ed protobuf format of
+ * pprof. Sampled chunks are scaled up by their sampling
+ * probability, the rest of the used memory found by walking the
+ * allocator goes to an "[unsampled <allocator>]" frame, so the
+ * profile adds up to the used bytes. The add functions only take
+ * counts and must be called from the thread that owns the
+ * allocator; symbols, encoding and the write happen in
+ * slab_arena_heap_profile_write(), which may run on any thread.
+ * Returns NULL on out of memory.
+ */
+struct slab_arena_heap_profile *slab_arena_heap_profile_new(void);
+void slab_arena_heap_profile_add_mempool(struct slab_arena_heap_profile *profile, struct mempool *pool);
+void slab_arena_heap_profile_add_region(struct slab_arena_heap_profile *profile, struct region *region);
+/** Live chunks of all epochs of @a arena, takes the queue lock. */
+void slab_arena_heap_profile_add_arena(struct slab_arena_heap_profile *profile, struct memory_epoch_queue **arena);
+/** Returns 0 on success, -1 and errno on error. */
+int slab_arena_heap_profile_write(struct slab_arena_heap_profile *profile, int fd);
+void slab_arena_heap_profile_delete(struct slab_arena_heap_profile *profile);
+/**
+ * Start a binary trace of slab maps and unmaps, slab splits and
+ * merges, mempool slabs, lsregion_gc and epoch rotations into
+ * the file at @a path. Every thread writes to its own ring of
+ * @a ring_events events (rounded up to a power of two), threads
+ * beyond @a rings are counted as dropped. The file is mapped
+ * shared and can be read while the process runs, its layout is
+ * struct small_trace_header in slab_arena_internal.h. A trace
+ * opened earlier is closed, a regular file at @a path is
+ * replaced rather than truncated. The default comes from
+ * TARARAM_EVENT_TRACE. Returns 0 on success, -1 and errno on
+ * error.
+ */
+int slab_arena_open_event_trace(const char *path, size_t ring_events, size_t rings);
+/** Stop tracing, the file stays mapped until exit. */
+void slab_arena_close_event_trace(void);
+void slab_arena_get_event_trace_stats(struct slab_arena_event_trace_stats *stats);
+/**
+ * Record allocator calls into the file at @a path for replaying
+ * them later with TarMemDbg_Replay: creation of arenas, slab
+ * caches, mempools, small allocators, regions and lsregions,
+ * their allocations and frees, region truncations and lsregion_gc.
+ * Every thread buffers its records and appends them in chunks,
+ * the layout is struct small_call_header in slab_arena_internal.h.
+ * A trace opened earlier is closed. A regular file at @a path is
+ * replaced, not truncated, so threads of an earlier trace of the
+ * same path keep writing to the old file; anything else (a device,
+ * a fifo, a symlink) is opened as is. The default comes from
+ * TARARAM_CALL_TRACE. Returns 0 on success, -1 and errno on error.
+ */
+int slab_arena_open_call_trace(const char *path);
+/**
+ * Stop recording. Records of the calling thread are written now,
+ * those of other threads when they exit.
+ */
+void slab_arena_close_call_trace(void);
+void slab_arena_get_call_trace_stats(struct slab_arena_call_trace_stats *stats);
 
 #   else  // picodata memory debug
 
@@ -65,6 +318,66 @@ struct quota * get_slab_arena_quota(struct memory_epoch_queue **arena);
 #      define get_slab_arena_quota get_slab_arena_quota_orig
 static inline struct slab_arena * get_slab_arena( struct slab_arena * arena ) {return arena; }
 static inline size_t get_slab_arena_used(struct slab_arena *arena) {return arena->used;}
+static inline int get_slab_arena_stats(struct slab_arena *arena, struct slab_arena_stats *stats) {
+	(void)arena;
+	memset(stats, 0, sizeof(*stats));
+	return 0;
+}
+static inline size_t get_slab_arena_epoch_stats(struct slab_arena *arena, struct slab_arena_epoch_stats *stats, size_t max_epochs) {
+	(void)arena; (void)stats; (void)max_epochs;
+	return 0;
+}
+static inline size_t get_slab_arena_rotation_mprotect_calls(struct slab_arena *arena, size_t *total_calls) {
+	(void)arena;
+	if (total_calls)
+		*total_calls = 0;
+	return 0;
+}
+static inline int slab_arena_set_async_protection(int enabled) {(void)enabled; return 0;}
+static inline void slab_arena_flush_protection(void) {}
+static inline size_t slab_arena_set_epoch_queue_depth(size_t depth) {(void)depth; return 0;}
+static inline size_t get_slab_arena_epoch_queue_depth(struct slab_arena *arena) {(void)arena; return 0;}
+static inline void slab_arena_set_sampling(size_t rotation_rate, size_t arena_rate) {(void)rotation_rate; (void)arena_rate;}
+static inline void slab_arena_get_sampling_stats(struct slab_arena_sampling_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline int slab_arena_set_quarantine_release(int mode) {(void)mode; return 0;}
+static inline void slab_arena_get_quarantine_stats(struct slab_arena_quarantine_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline int slab_arena_find_address(const void *ptr, struct slab_arena_address_info *info) {(void)ptr; (void)info; return 0;}
+static inline void slab_arena_get_large_block_stats(struct slab_arena_large_block_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline int slab_arena_set_slab_guards(int enabled) {(void)enabled; return 0;}
+static inline void slab_arena_get_slab_guard_stats(struct slab_arena_slab_guard_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline int slab_arena_set_memory_debug(int enabled) {(void)enabled; return 0;}
+static inline void slab_arena_get_memory_debug_stats(struct slab_arena_memory_debug_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline size_t slab_arena_set_epoch_pool_size(size_t size) {(void)size; return 0;}
+static inline size_t slab_arena_refill_epoch_pool(void) {return 0;}
+static inline void slab_arena_get_epoch_pool_stats(struct slab_arena_epoch_pool_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline void slab_arena_get_metadata_stats(struct slab_arena_metadata_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline size_t slab_arena_set_redzone(size_t size) {(void)size; return 0;}
+static inline void slab_arena_get_redzone_stats(struct slab_arena_redzone_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline size_t slab_arena_set_mempool_quarantine(size_t size) {(void)size; return 0;}
+static inline void slab_arena_get_mempool_quarantine_stats(struct slab_arena_mempool_quarantine_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline size_t slab_arena_set_region_generations(size_t generations) {(void)generations; return 0;}
+static inline void slab_arena_get_region_quarantine_stats(struct slab_arena_region_quarantine_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline size_t slab_arena_set_buffer_quarantine(size_t size) {(void)size; return 0;}
+static inline void slab_arena_get_buffer_quarantine_stats(struct slab_arena_buffer_quarantine_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline size_t slab_arena_set_allocation_sampling(size_t sample_bytes) {(void)sample_bytes; return 0;}
+static inline void slab_arena_get_allocation_site_stats(struct slab_arena_allocation_site_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline int slab_arena_get_allocation_site(uint32_t id, struct slab_arena_allocation_site *site) {(void)id; (void)site; return 0;}
+static inline uint32_t slab_arena_find_allocation_site(const void *ptr) {(void)ptr; return 0;}
+static inline uint32_t slab_arena_find_mempool_allocation_site(struct mempool *pool, const void *ptr) {(void)pool; (void)ptr; return 0;}
+static inline size_t slab_arena_get_epoch_allocation_sites(struct slab_arena *arena, size_t epoch_age, struct slab_arena_allocation_site_usage *usage, size_t max_sites) {(void)arena; (void)epoch_age; (void)usage; (void)max_sites; return 0;}
+static inline size_t slab_arena_get_mempool_allocation_sites(struct mempool *pool, struct slab_arena_allocation_site_usage *usage, size_t max_sites) {(void)pool; (void)usage; (void)max_sites; return 0;}
+static inline struct slab_arena_heap_profile *slab_arena_heap_profile_new(void) {return NULL;}
+static inline void slab_arena_heap_profile_add_mempool(struct slab_arena_heap_profile *profile, struct mempool *pool) {(void)profile; (void)pool;}
+static inline void slab_arena_heap_profile_add_region(struct slab_arena_heap_profile *profile, struct region *region) {(void)profile; (void)region;}
+static inline void slab_arena_heap_profile_add_arena(struct slab_arena_heap_profile *profile, struct slab_arena *arena) {(void)profile; (void)arena;}
+static inline int slab_arena_heap_profile_write(struct slab_arena_heap_profile *profile, int fd) {(void)profile; (void)fd; return -1;}
+static inline void slab_arena_heap_profile_delete(struct slab_arena_heap_profile *profile) {(void)profile;}
+static inline int slab_arena_open_event_trace(const char *path, size_t ring_events, size_t rings) {(void)path; (void)ring_events; (void)rings; return -1;}
+static inline void slab_arena_close_event_trace(void) {}
+static inline void slab_arena_get_event_trace_stats(struct slab_arena_event_trace_stats *stats) {memset(stats, 0, sizeof(*stats));}
+static inline int slab_arena_open_call_trace(const char *path) {(void)path; return -1;}
+static inline void slab_arena_close_call_trace(void) {}
+static inline void slab_arena_get_call_trace_stats(struct slab_arena_call_trace_stats *stats) {memset(stats, 0, sizeof(*stats));}
 #   endif // picodata memory debug
 
 #endif /* INCLUDES_TARANTOOL_SMALL_SLAB_ARENA_H */
\ No newline at end of file
@@ -182,9 +182,495 @@ static inline struct quota * get_slab_arena_quota_orig( struct slab_arena * aren
 	return arena->quota; 
 }
 
+/**
+ * Memory debugger sampling counters, see slab_arena_set_sampling().
+ * All zero when the debugger is compiled out.
+ */
+struct slab_arena_sampling_stats {
+	/** 1-in-N epoch rotations get full protection, 0 - none. */
+	size_t rotation_rate;
+	/** 1-in-N arenas rotate epochs at all, 0 - none. */
+	size_t arena_rate;
+	size_t sampled_arenas;
+	size_t skipped_arenas;
+	size_t sampled_rotations;
+	size_t skipped_rotations;
+	/** Time spent in lsregion_gc() by sampled rotations. */
+	uint64_t sampled_rotation_ns;
+	/** Time spent in lsregion_gc() by pass-through rotations. */
+	uint64_t skipped_rotation_ns;
+};
+
+/**
+ * Memory held by quarantined (PROT_NONE) epochs, see
+ * slab_arena_set_quarantine_release().
+ */
+struct slab_arena_quarantine_stats {
+	/** 0 - keep pages, 1 - MADV_DONTNEED, 2 - MADV_FREE. */
+	int release_mode;
+	size_t quarantined_epochs;
+	/** Address space of quarantined epochs, all of it faults. */
+	size_t quarantined_virtual;
+	/** Part of quarantined_virtual still backed by physical pages. */
+	size_t quarantined_resident;
+	/** Bytes ever handed back to the kernel. */
+	size_t released_total;
+};
+
+/** Cost counters of one arena (epoch queue), see get_slab_arena_stats(). */
+struct slab_arena_stats {
+	/** lsregion_alloc() calls and bytes requested by them. */
+	size_t allocations;
+	size_t allocated_bytes;
+	/** lsregion_used() of the current epoch. */
+	size_t used;
+	/** Slabs handed out by the arenas of all epochs in the queue. */
+	size_t mapped_slabs;
+	/** Epochs currently in the queue. */
+	size_t epochs;
+	size_t sampled_rotations;
+	size_t skipped_rotations;
+	/** Totals over all epochs, including already deleted ones. */
+	size_t mprotect_calls;
+	size_t gc_calls;
+	/** Time spent in lsregion_gc() (epoch rotation), in epoch
+	 *  protection changes and in lsregion_gc_orig(). */
+	uint64_t next_epoch_ns;
+	uint64_t protect_ns;
+	uint64_t gc_ns;
+	/** Redzone canaries checked and time spent on it. */
+	size_t redzone_checks;
+	uint64_t redzone_ns;
+	size_t quarantined_epochs;
+	size_t quarantined_virtual;
+	size_t quarantined_resident;
+};
+
+/** Cost counters of one epoch, see get_slab_arena_epoch_stats(). */
+struct slab_arena_epoch_stats {
+	size_t position;
+	/** 0 - current, 1 - read-only, more - quarantined. */
+	size_t age;
+	/** PROT_* the epoch is protected with. */
+	int protection;
+	size_t mapped_slabs;
+	size_t mprotect_calls;
+	uint64_t protect_ns;
+	size_t gc_calls;
+	uint64_t gc_ns;
+	size_t quarantined_virtual;
+	size_t quarantined_resident;
+};
+
+/** Where an address lives, see slab_arena_find_address(). */
+struct slab_arena_address_info {
+	/** Arena (epoch queue) handle owning the address. */
+	struct memory_epoch_queue *arena;
+	/** Epoch position in the queue, grows with every rotation. */
+	size_t epoch_position;
+	/** 0 - current epoch, 1 - read-only, more - quarantined. */
+	size_t epoch_age;
+	/** Indexed address range containing the address. */
+	void *range_start;
+	size_t range_size;
+	/** Start of the slab containing the address, NULL if unknown. */
+	void *slab;
+	/** Allocations of the epoch have ids in (min_id, max_id]. */
+	int64_t min_id;
+	int64_t max_id;
+};
+
+/**
+ * Large lsregion slabs of epochs (bigger than the arena slab),
+ * see slab_arena_get_large_block_stats().
+ */
+struct slab_arena_large_block_stats {
+	/** Blocks held by epochs and their size without guard pages. */
+	size_t live_blocks;
+	size_t live_bytes;
+	/** Freed blocks kept mapped for reuse. */
+	size_t cached_blocks;
+	size_t cached_bytes;
+	/** Blocks that needed a new mapping, were taken from the
+	 *  cache, and were unmapped because the cache was full. */
+	size_t mapped;
+	size_t reused;
+	size_t unmapped;
+};
+
+/**
+ * Per-slab guard pages of epoch arenas, see
+ * slab_arena_set_slab_guards(). Each guard takes one page of
+ * the slab and one mprotect() call, and splits the transparent
+ * huge page it lands in.
+ */
+struct slab_arena_slab_guard_stats {
+	/** Whether new epochs place guard pages. */
+	int enabled;
+	/** Guard pages currently placed and their size. */
+	size_t guard_pages;
+	size_t guard_bytes;
+	/** mprotect() calls spent on placing and restoring guards. */
+	size_t mprotect_calls;
+	/** 2 MiB regions holding at least one guard page. */
+	size_t split_huge_pages;
+};
+
+/** Run-time debugger switch, see slab_arena_set_memory_debug(). */
+struct slab_arena_memory_debug_stats {
+	/** Whether the wrappers go to the debugger. */
+	int enabled;
+	/** Times the debugger was turned on or off. */
+	size_t switches;
+};
+
+/** Ready-made epochs, see slab_arena_set_epoch_pool_size(). */
+struct slab_arena_epoch_pool_stats {
+	/** Epochs the pool tries to keep and keeps right now. */
+	size_t size;
+	size_t ready;
+	/** Rotations served from the pool and ones that had to
+	 *  create an epoch in place. */
+	size_t taken;
+	size_t missed;
+	/** Epochs created ahead of time. */
+	size_t built;
+};
+
+/**
+ * Pages holding the debugger's own objects (epoch queues, epochs,
+ * their arenas and lsregions), see slab_arena_get_metadata_stats().
+ */
+struct slab_arena_metadata_stats {
+	/** Mapped by the pool, handed out, and freed for reuse. */
+	size_t mapped_bytes;
+	size_t used_bytes;
+	size_t cached_bytes;
+	/** Chunk mappings and separately mapped long page runs. */
+	size_t chunks;
+	size_t direct_maps;
+	size_t allocations;
+	size_t reused;
+};
+
+/** Allocation redzones, see slab_arena_set_redzone(). */
+struct slab_arena_redzone_stats {
+	/** Redzone bytes added to new allocations, 0 - disabled. */
+	size_t redzone_size;
+	/** Canary scanner: 0 - scalar, 1 - SSE2, 2 - AVX2. */
+	int isa;
+	/** Memory of the redzone tables of all epochs. */
+	size_t table_bytes;
+	/** Redzones checked and found corrupted so far. */
+	size_t checked;
+	size_t corrupted;
+	uint64_t scan_ns;
+	/** First bad byte of the last corrupted redzone. */
+	const void *last_corrupted;
+};
+
+/** Use-after-free quarantine of mempools, see slab_arena_set_mempool_quarantine(). */
+struct slab_arena_mempool_quarantine_stats {
+	/** Bytes of freed objects each pool may hold, 0 - disabled. */
+	size_t budget;
+	/** Objects held by all pools right now and their size. */
+	size_t objects;
+	size_t bytes;
+	/** Slabs whose objects are all quarantined, they are PROT_NONE. */
+	size_t protected_slabs;
+	/** Objects returned to their slabs so far. */
+	size_t recycled;
+	/** Recycled objects whose poison was overwritten. */
+	size_t corrupted;
+	/** First bad byte of the last corrupted object. */
+	const void *last_corrupted;
+};
+
+/** Delayed reuse of region slabs, see slab_arena_set_region_generations(). */
+struct slab_arena_region_quarantine_stats {
+	/** Truncations whose slabs each region holds, 0 - disabled. */
+	size_t generations;
+	/** Slabs held by all regions right now and their size. */
+	size_t slabs;
+	size_t bytes;
+	/** Part of the held bytes that is PROT_NONE. */
+	size_t protected_bytes;
+	/** Slabs returned to their caches so far. */
+	size_t released;
+	/** Released slabs whose poison was overwritten. */
+	size_t corrupted;
+	/** First bad byte of the last corrupted slab. */
+	const void *last_corrupted;
+};
+
+/** Quarantine of ibuf and obuf slabs, see slab_arena_set_buffer_quarantine(). */
+struct slab_arena_buffer_quarantine_stats {
+	/** Bytes of slabs each thread may hold, 0 - disabled. */
+	size_t budget;
+	/** Slabs held by all threads right now and their size. */
+	size_t slabs;
+	size_t bytes;
+	/** Part of the held bytes that is PROT_NONE. */
+	size_t protected_bytes;
+	/** Slabs returned to their caches so far. */
+	size_t released;
+	/** Released slabs whose poison was overwritten. */
+	size_t corrupted;
+	/** First bad byte of the last corrupted slab. */
+	const void *last_corrupted;
+};
+
+/** Allocation site sampling, see slab_arena_set_allocation_sampling(). */
+struct slab_arena_allocation_site_stats {
+	/** Mean number of allocated bytes between samples, 0 - disabled. */
+	size_t sample_bytes;
+	/** Distinct stacks in the site table and its capacity. */
+	size_t sites;
+	size_t capacity;
+	/** Allocations sampled so far and their size. */
+	size_t samples;
+	size_t sampled_bytes;
+	/** Samples lost because the site table was full. */
+	size_t dropped;
+	/** Memory of the site table and of the per-chunk site ids. */
+	size_t table_bytes;
+};
+
+enum { SLAB_ARENA_ALLOCATION_SITE_DEPTH = 16 };
+
+/** A distinct allocation stack, see slab_arena_get_allocation_site(). */
+struct slab_arena_allocation_site {
+	uint32_t id;
+	/** Return addresses, the caller of the allocator first. */
+	uint32_t depth;
+	uintptr_t frames[SLAB_ARENA_ALLOCATION_SITE_DEPTH];
+	/** Samples taken at the site so far and their size. */
+	size_t samples;
+	size_t sampled_bytes;
+	/** Estimate of all bytes allocated at the site. */
+	size_t estimated_bytes;
+};
+
+/** Sampled chunks of one site held by an epoch or a mempool. */
+struct slab_arena_allocation_site_usage {
+	uint32_t site;
+	size_t chunks;
+	size_t bytes;
+};
+
+/**
+ * Allocator event trace, see slab_arena_open_event_trace().
+ * The trace file is a struct small_trace_header followed by
+ * ring_count rings of ring_size bytes each. A ring is a
+ * struct small_trace_ring padded to SMALL_TRACE_ALIGN followed
+ * by ring_capacity events. Every ring has a single writer
+ * thread: it stores event number N into slot N % ring_capacity
+ * and then publishes head = N + 1 with a release store. A
+ * reader loads head, copies the slots it needs and loads head
+ * again: event N is valid only if N + ring_capacity is greater
+ * than the second head value, older slots may have been reused
+ * while they were copied.
+ */
+enum small_trace_type {
+	/** ptr - slab, arg - slab size, aux - source: 0 arena cache, 1 preallocated, 2 mmap. */
+	SMALL_TRACE_SLAB_MAP = 1,
+	/** ptr - slab, arg - slab size. */
+	SMALL_TRACE_SLAB_UNMAP = 2,
+	/** ptr - slab, arg - requested order, aux - order of the split slab. */
+	SMALL_TRACE_SLAB_SPLIT = 3,
+	/** ptr - merged slab, arg - its order, aux - order of the put slab. */
+	SMALL_TRACE_SLAB_MERGE = 4,
+	/** ptr - mslab, arg - object size, aux - slab order. */
+	SMALL_TRACE_MEMPOOL_SLAB_GET = 5,
+	SMALL_TRACE_MEMPOOL_SLAB_PUT = 6,
+	/** ptr - lsregion, arg - min_id, aux - freed slabs. */
+	SMALL_TRACE_LSREGION_GC = 7,
+	/** ptr - epoch queue, arg - min_id, aux - microseconds spent. */
+	SMALL_TRACE_EPOCH_ROTATION = 8,
+};
+
+enum {
+	SMALL_TRACE_VERSION = 1,
+	SMALL_TRACE_ALIGN = 64,
+};
+
+struct small_trace_event {
+	/** rdtsc, or CLOCK_MONOTONIC nanoseconds where there is none. */
+	uint64_t tsc;
+	uint64_t ptr;
+	uint64_t arg;
+	uint32_t aux;
+	uint16_t type;
+	uint16_t reserved;
+};
+
+struct small_trace_ring {
+	/** Events ever written to the ring. */
+	uint64_t head;
+	/** Kernel thread id of the writer, 0 - the ring is free. */
+	uint32_t tid;
+	uint32_t reserved;
+};
+
+struct small_trace_header {
+	/** "SMTRACE" and a zero byte. */
+	char magic[8];
+	uint32_t version;
+	uint32_t event_size;
+	uint32_t ring_count;
+	/** Events per ring, a power of two. */
+	uint32_t ring_capacity;
+	uint64_t ring_size;
+	/** Ticks per second and a tick paired with CLOCK_REALTIME. */
+	uint64_t tsc_hz;
+	uint64_t start_tsc;
+	uint64_t start_realtime_ns;
+	uint32_t pid;
+	/** Rings taken by threads so far. */
+	uint32_t rings_used;
+};
+
+/** Allocator event trace, see slab_arena_open_event_trace(). */
+struct slab_arena_event_trace_stats {
+	/** 1 if a trace file is open. */
+	int enabled;
+	size_t ring_count;
+	size_t ring_capacity;
+	size_t rings_used;
+	/** Events written to all rings so far. */
+	size_t events;
+	/** Events lost because all rings were taken. */
+	size_t dropped;
+};
+
+/**
+ * Allocator call trace, see slab_arena_open_call_trace(). Unlike
+ * the event trace it loses nothing and is meant for replaying the
+ * calls against the library. The file is a struct small_call_header
+ * followed by chunks: a struct small_call_chunk and byte_size bytes
+ * of records of one thread. A record is the type byte, a byte of
+ * SMALL_CALL_FIELD_* flags and the flagged fields as LEB128 varints
+ * in the flag order. A field that is not flagged equals 0, except
+ * for the object, which is then the object of the previous record.
+ * ptr and arg are flagged when not zero and stored as zigzag deltas
+ * from the previous flagged ptr and arg. Delta state starts from zero
+ * in every chunk.
+ */
+enum small_call_type {
+	/** object - arena, size - slab size, arg - prealloc, aux - flags. */
+	SMALL_CALL_SLAB_ARENA_CREATE = 1,
+	/** object - slab cache, ptr - arena. */
+	SMALL_CALL_SLAB_CACHE_CREATE = 2,
+	/**
+	 * object - pool, ptr - slab cache, size - object size,
+	 * aux - slab order. Pools of a small allocator are not
+	 * recorded, their calls are the SMALL_CALL_SMALL* ones.
+	 */
+	SMALL_CALL_MEMPOOL_CREATE = 3,
+	SMALL_CALL_MEMPOOL_DESTROY = 4,
+	/** object - pool, ptr - object, size - object size. */
+	SMALL_CALL_MEMPOOL_ALLOC = 5,
+	SMALL_CALL_MEMPOOL_FREE = 6,
+	/**
+	 * object - allocator, ptr - slab cache, size - minimal object
+	 * size, aux - alloc_factor bits.
+	 */
+	SMALL_CALL_SMALL_CREATE = 7,
+	SMALL_CALL_SMALL_DESTROY = 8,
+	/** object - allocator, ptr - object, size - requested size. */
+	SMALL_CALL_SMALLOC = 9,
+	SMALL_CALL_SMFREE = 10,
+	/** Only when the object goes to the delayed list. */
+	SMALL_CALL_SMFREE_DELAYED = 11,
+	/** object - allocator, arg - value, aux - option. */
+	SMALL_CALL_SMALL_SETOPT = 12,
+	/** object - region, ptr - slab cache. */
+	SMALL_CALL_REGION_CREATE = 13,
+	/** object - region, size - requested size, aux - alignment, 0 - none. */
+	SMALL_CALL_REGION_ALLOC = 14,
+	/** object - region, size - region_used() after truncation. */
+	SMALL_CALL_REGION_TRUNCATE = 15,
+	SMALL_CALL_REGION_DESTROY = 16,
+	/** object - lsregion, ptr - arena. */
+	SMALL_CALL_LSREGION_CREATE = 17,
+	/**
+	 * object - lsregion, ptr - chunk, size - requested size,
+	 * arg - id, aux - alignment, 0 - none.
+	 */
+	SMALL_CALL_LSREGION_ALLOC = 18,
+	/** object - lsregion, arg - min_id. */
+	SMALL_CALL_LSREGION_GC = 19,
+};
+
+enum {
+	SMALL_CALL_VERSION = 1,
+	SMALL_CALL_FIELD_OBJECT = 1,
+	SMALL_CALL_FIELD_PTR = 2,
+	SMALL_CALL_FIELD_SIZE = 4,
+	SMALL_CALL_FIELD_ARG = 8,
+	SMALL_CALL_FIELD_AUX = 16,
+	/** Type and flags bytes and five varints of up to 10 bytes. */
+	SMALL_CALL_RECORD_MAX = 52,
+};
+
+struct small_call_header {
+	/** "SMCALLS" and a zero byte. */
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t start_realtime_ns;
+	uint32_t pid;
+	uint32_t reserved;
+};
+
+struct small_call_chunk {
+	/** Writer thread, numbered from 0 in order of the first call. */
+	uint32_t thread;
+	uint32_t byte_size;
+	uint32_t records;
+	uint32_t reserved;
+};
+
+/** Allocator call trace, see slab_arena_open_call_trace(). */
+struct slab_arena_call_trace_stats {
+	int enabled;
+	/** Threads that recorded calls. */
+	size_t threads;
+	/** Records and bytes written to the file, without buffered ones. */
+	size_t records;
+	size_t bytes;
+	size_t chunks;
+	/** Chunks lost to write errors. */
+	size_t write_errors;
+};
+
 #   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
 struct memory_epoch_queue;
 extern int slab_arena_create(struct memory_epoch_queue **arena, struct quota *quota, size_t prealloc, uint32_t slab_size, int flags);
+/** Add an event to the ring of the calling thread if tracing is on. */
+void   small_trace(enum small_trace_type type, const void *ptr, uint64_t arg, uint32_t aux);
+/** Record a call of the calling thread if the call trace is on. */
+void   small_call(enum small_call_type type, const void *object, const void *ptr, uint64_t size, int64_t arg, uint32_t aux);
+#   else  // picodata memory debug
+static inline void
+small_trace(enum small_trace_type type, const void *ptr, uint64_t arg, uint32_t aux)
+{
+	(void)type;
+	(void)ptr;
+	(void)arg;
+	(void)aux;
+}
+
+static inline void
+small_call(enum small_call_type type, const void *object, const void *ptr, uint64_t size, int64_t arg, uint32_t aux)
+{
+	(void)type;
+	(void)object;
+	(void)ptr;
+	(void)size;
+	(void)arg;
+	(void)aux;
+}
 #   endif // picodata memory debug
 
 #   if defined(__cplusplus)
@@ -188,6 +188,7 @@ slab_cache_create_orig(struct slab_cache *cache, struct slab_arena *arena)
 void
 slab_cache_destroy(struct slab_cache *cache)
 {
+	buffer_quarantine_drain(cache);
 	struct rlist *slabs = &cache->allocated.slabs;
 	/*
 	 * cache->allocated contains huge allocations and
@@ -244,6 +245,7 @@ slab_get_with_order(struct slab_cache *cache, uint8_t order)
 		 * same memory.
 		 */
 		list->stats.total -= slab->size;
+		small_trace(SMALL_TRACE_SLAB_SPLIT, slab, order, slab->order);
 		/* Get a slab of the right order. */
 		do {
 			slab = slab_split(cache, slab);
@@ -337,6 +339,7 @@ slab_put_with_order(struct slab_cache *cache, struct slab *slab)
 	 * match the totals in cache->allocated.stats.
 	 */
 	if (buddy && buddy->order == slab->order && slab_is_free(buddy)) {
+		uint8_t put_order = slab->order;
 		cache->orders[slab->order].stats.total -= slab->size;
 		do {
 			slab = slab_merge(cache, slab, buddy);
@@ -344,6 +347,7 @@ slab_put_with_order(struct slab_cache *cache, struct slab *slab)
 		} while (buddy && buddy->order == slab->order &&
 			 slab_is_free(buddy));
 		cache->orders[slab->order].stats.total += slab->size;
+		small_trace(SMALL_TRACE_SLAB_MERGE, slab, slab->order, put_order);
 	}
 	slab_poison(slab);
 	if (slab->order == cache->order_max &&
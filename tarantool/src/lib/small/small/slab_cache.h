@@ -165,13 +165,6 @@ slab_from_ptr(void *ptr, intptr_t slab_mask)
 	return slab;
 }
 
-/* Aligned size of slab meta. */
-static inline uint32_t
-slab_sizeof()
-{
-	return small_align(sizeof(struct slab), sizeof(intptr_t));
-}
-
 /** Useful size of a slab. */
 static inline uint32_t
 slab_capacity(struct slab *slab)
@@ -236,7 +229,7 @@ slab_cache_set_thread(struct slab_cache *cache)
 }
 
 #   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
-extern void slab_cache_create(struct slab_cache *cache, struct memory_epoch_queue ** arena)
+extern void slab_cache_create(struct slab_cache *cache, struct memory_epoch_queue ** arena);
 #   else  // picodata memory debug
 #      ifdef TARMEMDBG_ALLOW_INCLUDE 
            // если включён этот флаг, значит компилируется TaraRam. А внутри 
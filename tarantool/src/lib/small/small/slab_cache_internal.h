@@ -94,6 +94,13 @@ struct slab_list {
 	struct small_stats stats;
 };
 
+/* Aligned size of slab meta. */
+static inline uint32_t
+slab_sizeof()
+{
+	return small_align(sizeof(struct slab), sizeof(intptr_t));
+}
+
 #define slab_list_add(list, slab, member)		\
 do {							\
 	rlist_add_entry(&(list)->slabs, (slab), member);\
@@ -114,6 +121,45 @@ slab_list_create(struct slab_list *list)
 }
 void
 slab_cache_create_orig(struct slab_cache *cache, struct slab_arena *arena);
+/** @sa slab_cache.h, declared here for the memory debugger. */
+void
+slab_put(struct slab_cache *cache, struct slab *slab);
+
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * Quarantine of retired ibuf and obuf slabs. Instead of
+ * slab_put() a slab is poisoned, made PROT_NONE past its header
+ * page and put at the tail of a FIFO of the calling thread. The
+ * oldest slabs go back to their caches when the FIFO runs over
+ * its byte budget. Returns false when the quarantine is off or
+ * the slab alone exceeds the budget.
+ */
+bool   buffer_quarantine_put(struct slab_cache *cache, struct slab *slab);
+/** Whether buffers should retire slabs they would reuse in place. */
+bool   buffer_quarantine_is_enabled(void);
+/** Return the slabs of @a cache held by the calling thread. */
+void   buffer_quarantine_drain(struct slab_cache *cache);
+#   else  // picodata memory debug
+static inline bool
+buffer_quarantine_put(struct slab_cache *cache, struct slab *slab)
+{
+	(void)cache;
+	(void)slab;
+	return false;
+}
+
+static inline bool
+buffer_quarantine_is_enabled(void)
+{
+	return false;
+}
+
+static inline void
+buffer_quarantine_drain(struct slab_cache *cache)
+{
+	(void)cache;
+}
+#   endif // picodata memory debug
 
 
 #if defined(__cplusplus)
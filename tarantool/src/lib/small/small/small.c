@@ -57,7 +57,7 @@ factor_pool_create(struct small_alloc *alloc)
 			objsize = alloc->objsize_max;
 		struct factor_pool *pool =
 			&alloc->factor_pool_cache[alloc->factor_pool_cache_size];
-		mempool_create(&pool->pool, alloc->cache, objsize);
+		mempool_create_nested(&pool->pool, alloc->cache, objsize);
 		pool->objsize_min = prevsize + 1;
 	}
 	alloc->objsize_max = objsize;
@@ -69,6 +69,10 @@ small_alloc_create(struct small_alloc *alloc, struct slab_cache *cache,
 		   uint32_t objsize_min, float alloc_factor,
 		   float *actual_alloc_factor)
 {
+	uint32_t factor_bits;
+	memcpy(&factor_bits, &alloc_factor, sizeof(factor_bits));
+	small_call(SMALL_CALL_SMALL_CREATE, alloc, cache, objsize_min, 0,
+		   factor_bits);
 	alloc->cache = cache;
 	/* Align sizes. */
 	objsize_min = small_align(objsize_min, sizeof(intptr_t));
@@ -95,6 +99,7 @@ small_alloc_create(struct small_alloc *alloc, struct slab_cache *cache,
 void
 small_alloc_setopt(struct small_alloc *alloc, enum small_opt opt, bool val)
 {
+	small_call(SMALL_CALL_SMALL_SETOPT, alloc, NULL, 0, val, opt);
 	switch (opt) {
 	case SMALL_DELAYED_FREE_MODE:
 		alloc->free_mode = val ? SMALL_DELAYED_FREE :
@@ -162,17 +167,19 @@ smalloc(struct small_alloc *alloc, size_t size)
 {
 	small_collect_garbage(alloc);
 
+	void *ptr;
 	struct factor_pool *upper_bound = factor_pool_search(alloc, size);
 	if (upper_bound == NULL) {
 		/* Object is too large, fallback to slab_cache */
 		struct slab *slab = slab_get_large(alloc->cache, size);
-		if (slab == NULL)
-			return NULL;
-		return slab_data(slab);
+		ptr = slab != NULL ? slab_data(slab) : NULL;
+	} else {
+		struct mempool *pool = &upper_bound->pool;
+		assert(size <= pool->objsize);
+		ptr = mempool_alloc(pool);
 	}
-	struct mempool *pool = &upper_bound->pool;
-	assert(size <= pool->objsize);
-	return mempool_alloc(pool);
+	small_call(SMALL_CALL_SMALLOC, alloc, ptr, size, 0, 0);
+	return ptr;
 }
 
 static inline struct mempool *
@@ -201,6 +208,7 @@ mempool_find(struct small_alloc *alloc, size_t size)
 void
 smfree(struct small_alloc *alloc, void *ptr, size_t size)
 {
+	small_call(SMALL_CALL_SMFREE, alloc, ptr, size, 0, 0);
 	struct mempool *pool = mempool_find(alloc, size);
 	if (pool == NULL) {
 		/* Large allocation by slab_cache */
@@ -222,6 +230,7 @@ void
 smfree_delayed(struct small_alloc *alloc, void *ptr, size_t size)
 {
 	if (alloc->free_mode == SMALL_DELAYED_FREE && ptr) {
+		small_call(SMALL_CALL_SMFREE_DELAYED, alloc, ptr, size, 0, 0);
 		struct mempool *pool = mempool_find(alloc, size);
 		if (pool == NULL) {
 			/* Large-object allocation by slab_cache. */
@@ -269,6 +278,7 @@ mempool_iterator_next(struct mempool_iterator *it)
 void
 small_alloc_destroy(struct small_alloc *alloc)
 {
+	small_call(SMALL_CALL_SMALL_DESTROY, alloc, NULL, 0, 0, 0);
 	struct mempool_iterator it;
 	mempool_iterator_create(&it, alloc);
 	struct mempool *pool;
@@ -306,3 +316,17 @@ small_stats(struct small_alloc *alloc,
 			break;
 	}
 }
+
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+void
+small_heap_profile_add(struct small_alloc *alloc,
+		       struct slab_arena_heap_profile *profile)
+{
+	struct mempool_iterator it;
+	mempool_iterator_create(&it, alloc);
+	struct mempool *pool;
+
+	while ((pool = mempool_iterator_next(&it)))
+		slab_arena_heap_profile_add_mempool(profile, pool);
+}
+#   endif // picodata memory debug
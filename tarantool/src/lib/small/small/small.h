@@ -247,6 +247,25 @@ small_stats(struct small_alloc *alloc,
 	    struct small_stats *totals,
 	    mempool_stats_cb cb, void *cb_ctx);
 
+#   if defined(TARMEMDBG) || defined(TARANTOOL_PICO_MEMORY_DEBUG_ON) || defined(TARARAM) // picodata memory debug
+/**
+ * Add the live objects of all pools of the allocator to a heap
+ * profile, see slab_arena_heap_profile_new(). Large allocations
+ * bypass the pools and are not included.
+ */
+void
+small_heap_profile_add(struct small_alloc *alloc,
+		       struct slab_arena_heap_profile *profile);
+#   else  // picodata memory debug
+static inline void
+small_heap_profile_add(struct small_alloc *alloc,
+		       struct slab_arena_heap_profile *profile)
+{
+	(void)alloc;
+	(void)profile;
+}
+#   endif // picodata memory debug
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #include "exception.h"